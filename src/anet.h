@@ -90,6 +90,7 @@ int anetDisableTcpNoDelay(char *err, int fd);
 int anetTcpKeepAlive(char *err, int fd);
 
 int anetSendTimeout(char *err, int fd, long long ms);
+int anetRecvTimeout(char *err, int fd, long long ms);
 
 int anetPeerToString(int fd, char *ip, size_t ip_len, int *port);
 /* 设置TCP连接一直存活，用来检测已经死去的结点，interval选项只适用于Linux下的系统 */
@@ -674,6 +674,8 @@ struct client *createFakeClient(void) {
     c->querybuf_peak = 0;
     c->argc = 0;
     c->argv = NULL;
+    c->argv_len = 0;
+    c->argv_pool_len = 0;
     c->bufpos = 0;
     c->flags = 0;
     c->btype = BLOCKED_NONE;
@@ -700,6 +702,10 @@ void freeFakeClientArgv(struct client *c) {
 }
 
 void freeFakeClient(struct client *c) {
+    /* Commands replacing their argv, see replaceClientCommandVector(), may
+     * leave the old arguments in the pool. */
+    while (c->argv_pool_len)
+        decrRefCount(c->argv_pool[--c->argv_pool_len]);
     sdsfree(c->querybuf);
     listRelease(c->reply);
     listRelease(c->watched_keys);
@@ -790,6 +796,7 @@ int loadAppendOnlyFile(char *filename) {
         argv = zmalloc(sizeof(robj*)*argc);
         fakeClient->argc = argc;
         fakeClient->argv = argv;
+        fakeClient->argv_len = argc;
 
         for (j = 0; j < argc; j++) {
             if (fgets(buf,sizeof(buf),fp) == NULL) {
@@ -823,7 +830,9 @@ int loadAppendOnlyFile(char *filename) {
 
         /* Run the command in the context of a fake client */
         fakeClient->cmd = cmd;
+        zarenaMark arena_mark = zarenaGetMark(&server.cmd_arena);
         cmd->proc(fakeClient);
+        zarenaRelease(&server.cmd_arena, arena_mark);
 
         /* The fake client should not have a reply */
         serverAssert(fakeClient->bufpos == 0 && listLength(fakeClient->reply) == 0);
@@ -1114,6 +1123,32 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* Emit an HPEXPIREAT for every field of the hash at 'key' having an expire.
+ * The function returns 0 on error, 1 on success. */
+int rewriteHashFieldExpires(rio *r, redisDb *db, robj *key) {
+    hashFieldExpiresIterator it;
+    dictEntry *de;
+    long long when;
+    sds field;
+    int retval = 1;
+
+    if (dictSize(db->hexpires) == 0 ||
+        (de = dictFind(db->hexpires,key->ptr)) == NULL) return 1;
+
+    hashFieldExpiresInitIterator(&it,dictGetVal(de));
+    while (retval && hashFieldExpiresNext(&it,&field,&when) == C_OK) {
+        char cmd[]="*6\r\n$10\r\nHPEXPIREAT\r\n";
+        if (rioWrite(r,cmd,sizeof(cmd)-1) == 0 ||
+            rioWriteBulkObject(r,key) == 0 ||
+            rioWriteBulkLongLong(r,when) == 0 ||
+            rioWriteBulkString(r,"FIELDS",6) == 0 ||
+            rioWriteBulkLongLong(r,1) == 0 ||
+            rioWriteBulkString(r,field,sdslen(field)) == 0) retval = 0;
+        sdsfree(field);
+    }
+    return retval;
+}
+
 /* Helper for rewriteStreamObject() that generates a bulk string into the
  * AOF representing the ID 'id'. */
 int rioWriteBulkStreamID(rio *r,streamID *id) {
@@ -1302,6 +1337,7 @@ int rewriteAppendOnlyFileRio(rio *aof) {
                 if (rewriteSortedSetObject(aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_HASH) {
                 if (rewriteHashObject(aof,&key,o) == 0) goto werr;
+                if (rewriteHashFieldExpires(aof,db,&key) == 0) goto werr;
             } else if (o->type == OBJ_STREAM) {
                 if (rewriteStreamObject(aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_MODULE) {
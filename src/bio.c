@@ -86,12 +86,18 @@ struct bio_job {
     /* Job specific arguments pointers. If we need to pass more than three
      * arguments we can just pass a pointer to a structure or alike. */
     void *arg1, *arg2, *arg3;
+    /* BIO_LAZY_FREE jobs created by bioCreateLazyFreeJob() only: the
+     * function releasing arg1. */
+    lazyFreeFn *free_fn;
 };
 
 void *bioProcessBackgroundJobs(void *arg);
 void lazyfreeFreeObjectFromBioThread(robj *o);
 void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
-void lazyfreeFreeSlotsMapFromBioThread(zskiplist *sl);
+void lazyfreeFreeSlotsMapFromBioThread(dict **slots);
+void lazyfreeFreeExpireIndexFromBioThread(rax *index);
+void sortProcessJobFromBioThread(void *job);
+void defragComputePlanFromBioThread(void *plan);
 
 /* Make sure we have enough stack to perform all the things we do in the
  * main thread. */
@@ -155,6 +161,7 @@ void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3) {
     job->arg1 = arg1;
     job->arg2 = arg2;
     job->arg3 = arg3;
+    job->free_fn = NULL;
     pthread_mutex_lock(&bio_mutex[type]);
     listAddNodeTail(bio_jobs[type],job);
     bio_pending[type]++;
@@ -162,6 +169,22 @@ void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3) {
     pthread_mutex_unlock(&bio_mutex[type]);
 }
 
+/* Create a BIO_LAZY_FREE job calling free_fn(arg) in the background, for
+ * the things that are neither objects nor dictionaries of a DB. */
+void bioCreateLazyFreeJob(lazyFreeFn *free_fn, void *arg) {
+    struct bio_job *job = zmalloc(sizeof(*job));
+
+    job->time = time(NULL);
+    job->arg1 = arg;
+    job->arg2 = job->arg3 = NULL;
+    job->free_fn = free_fn;
+    pthread_mutex_lock(&bio_mutex[BIO_LAZY_FREE]);
+    listAddNodeTail(bio_jobs[BIO_LAZY_FREE],job);
+    bio_pending[BIO_LAZY_FREE]++;
+    pthread_cond_signal(&bio_newjob_cond[BIO_LAZY_FREE]);
+    pthread_mutex_unlock(&bio_mutex[BIO_LAZY_FREE]);
+}
+
 void *bioProcessBackgroundJobs(void *arg) {
     struct bio_job *job;
     unsigned long type = (unsigned long) arg;
@@ -212,15 +235,25 @@ void *bioProcessBackgroundJobs(void *arg) {
             redis_fsync((long)job->arg1);
         } else if (type == BIO_LAZY_FREE) {
             /* What we free changes depending on what arguments are set:
+             * free_fn -> call it with arg1, see bioCreateLazyFreeJob().
              * arg1 -> free the object at pointer.
              * arg2 & arg3 -> free two dictionaries (a Redis DB).
-             * only arg3 -> free the skiplist. */
-            if (job->arg1)
+             * only arg3 -> free the skiplist.
+             * only arg2 -> free a DB expire index. */
+            if (job->free_fn)
+                job->free_fn(job->arg1);
+            else if (job->arg1)
                 lazyfreeFreeObjectFromBioThread(job->arg1);
             else if (job->arg2 && job->arg3)
                 lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3);
             else if (job->arg3)
                 lazyfreeFreeSlotsMapFromBioThread(job->arg3);
+            else if (job->arg2)
+                lazyfreeFreeExpireIndexFromBioThread(job->arg2);
+        } else if (type == BIO_SORT) {
+            sortProcessJobFromBioThread(job->arg1);
+        } else if (type == BIO_DEFRAG_PLAN) {
+            defragComputePlanFromBioThread(job->arg1);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
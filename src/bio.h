@@ -38,6 +38,9 @@ void bioInit(void);
  * @param arg3
  */
 void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3);
+/* A lazy free job releasing 'arg' with 'free_fn' in the lazy free thread. */
+typedef void lazyFreeFn(void *arg);
+void bioCreateLazyFreeJob(lazyFreeFn *free_fn, void *arg);
 unsigned long long bioPendingJobsOfType(int type);
 unsigned long long bioWaitStepOfType(int type);
 time_t bioOlderJobOfType(int type);
@@ -47,6 +50,8 @@ void bioKillThreads(void);
 #define BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. 文件的关闭 */
 #define BIO_AOF_FSYNC     1 /* Deferred AOF fsync. AOF文件的同步 */
 #define BIO_LAZY_FREE     2 /* Deferred objects freeing. */
+#define BIO_SORT          3 /* Background SORT of a snapshot vector. */
+#define BIO_DEFRAG_PLAN   4 /* Allocator stats for the active defrag plan. */
 
-/* BIO后台操作类型总数为 3 个 */
-#define BIO_NUM_OPS       3
+/* BIO后台操作类型总数为 5 个 */
+#define BIO_NUM_OPS       5
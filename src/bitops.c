@@ -668,9 +668,9 @@ void bitopCommand(client *c) {
 
     /* Lookup keys, and store pointers to the string objects into an array. */
     numkeys = c->argc - 3;
-    src = zmalloc(sizeof(unsigned char*) * numkeys);
-    len = zmalloc(sizeof(long) * numkeys);
-    objects = zmalloc(sizeof(robj*) * numkeys);
+    src = cmdArenaAlloc(sizeof(unsigned char*) * numkeys);
+    len = cmdArenaAlloc(sizeof(long) * numkeys);
+    objects = cmdArenaAlloc(sizeof(robj*) * numkeys);
     for (j = 0; j < numkeys; j++) {
         o = lookupKeyRead(c->db,c->argv[j+3]);
         /* Handle non-existing keys as empty strings. */
@@ -688,9 +688,6 @@ void bitopCommand(client *c) {
                 if (objects[i])
                     decrRefCount(objects[i]);
             }
-            zfree(src);
-            zfree(len);
-            zfree(objects);
             return;
         }
         objects[j] = getDecodedObject(o);
@@ -794,9 +791,6 @@ void bitopCommand(client *c) {
         if (objects[j])
             decrRefCount(objects[j]);
     }
-    zfree(src);
-    zfree(len);
-    zfree(objects);
 
     /* Store the computed value into the target key */
     if (maxlen) {
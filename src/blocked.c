@@ -143,6 +143,8 @@ void unblockClient(client *c) {
         unblockClientWaitingReplicas(c);
     } else if (c->btype == BLOCKED_MODULE) {
         unblockClientFromModule(c);
+    } else if (c->btype == BLOCKED_SORT) {
+        unblockClientFromSort(c);
     } else {
         serverPanic("Unknown btype in unblockClient().");
     }
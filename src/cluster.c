@@ -89,6 +89,7 @@ void clusterReadHandler(aeEventLoop *el, int fd, void *privdata, int mask);
  * @param type ping 命令类型
  */
 void clusterSendPing(clusterLink *link, int type);
+void clusterSendPingTo(clusterLink *link, clusterNode *peer, int type);
 
 /**
  * 集群环境发送 fail 消息
@@ -163,6 +164,10 @@ void clusterDelNode(clusterNode *delnode);
 
 sds representClusterNodeFlags(sds ci, uint16_t flags);
 
+void clusterMigrateSlotCommand(client *c);
+
+void clusterSlotMigrationCron(void);
+
 /**
  * 获取集群环境最大的投票纪元
  *
@@ -557,6 +562,7 @@ void clusterInit(void) {
     server.cluster->state = CLUSTER_FAIL;
     server.cluster->size = 1;
     server.cluster->todo_before_sleep = 0;
+    server.cluster->slot_migrations = listCreate();
     server.cluster->nodes = dictCreate(&clusterNodesDictType, NULL);
     server.cluster->nodes_black_list =
             dictCreate(&clusterNodesBlackListDictType, NULL);
@@ -569,7 +575,16 @@ void clusterInit(void) {
     for (int i = 0; i < CLUSTERMSG_TYPE_COUNT; i++) {
         server.cluster->stats_bus_messages_sent[i] = 0;
         server.cluster->stats_bus_messages_received[i] = 0;
-    }
+        server.cluster->stats_bus_bytes_sent[i] = 0;
+        server.cluster->stats_bus_bytes_received[i] = 0;
+        server.cluster->stats_bus_bytes_sent_prev[i] = 0;
+        server.cluster->stats_bus_bytes_received_prev[i] = 0;
+        server.cluster->stats_bus_bytes_sent_rate[i] = 0;
+        server.cluster->stats_bus_bytes_received_rate[i] = 0;
+    }
+    server.cluster->stats_bus_rate_time = mstime();
+    server.cluster->stats_bus_compact_sent = 0;
+    server.cluster->stats_bus_compact_received = 0;
     server.cluster->stats_pfail_nodes = 0;
     memset(server.cluster->slots, 0, sizeof(server.cluster->slots));
     clusterCloseAllSlots();
@@ -621,10 +636,9 @@ void clusterInit(void) {
         }
     }
 
-    /* The slots -> keys map is a radix tree. Initialize it here. */
-    server.cluster->slots_to_keys = raxNew();
-    memset(server.cluster->slots_keys_count, 0,
-           sizeof(server.cluster->slots_keys_count));
+    /* The slots -> keys map is a dict per slot, created on demand. */
+    server.cluster->slots_to_keys =
+            zcalloc(sizeof(dict *) * CLUSTER_SLOTS);
 
     /* Set myself->port / cport to my listening ports, we'll just need to
      * discover the IP address via MEET messages. */
@@ -727,8 +741,11 @@ void freeClusterLink(clusterLink *link) {
     }
     sdsfree(link->sndbuf);
     sdsfree(link->rcvbuf);
-    if (link->node)
+    if (link->node) {
         link->node->link = NULL;
+        /* The node may have restarted: start again with a full PING. */
+        link->node->bus_full_countdown = 0;
+    }
     close(link->fd);
     zfree(link);
 }
@@ -851,6 +868,11 @@ clusterNode *createClusterNode(char *nodename, int flags) {
     node->orphaned_time = 0;
     node->repl_offset_time = 0;
     node->repl_offset = 0;
+    node->bus_compact = 0;
+    node->bus_send_full = 0;
+    node->bus_want_full = 0;
+    node->bus_full_countdown = 0;
+    node->bus_slots_digest = 0;
     listSetFreeMethod(node->fail_reports, zfree);
     return node;
 }
@@ -1776,6 +1798,94 @@ void clusterUpdateSlotsConfigWith(clusterNode *sender, uint64_t senderConfigEpoc
     }
 }
 
+/* Digest of a slots bitmap, used by compact PING / PONG to tell the
+ * receiver if its view of the sender slots is still valid. */
+static uint64_t clusterSlotsDigest(unsigned char *slots) {
+    return crc64(0, slots, CLUSTER_SLOTS / 8);
+}
+
+/* Replace the compact PING / PONG in link->rcvbuf with the full clusterMsg
+ * it stands for, so that clusterProcessPacket() can handle it as usual.
+ * The slots bitmap is taken from our own view of the sender (or of its
+ * master), the address of the gossiped nodes from our nodes table.
+ *
+ * Returns 0 if the message can't be expanded and must be discarded. */
+int clusterExpandCompactPacket(clusterLink *link) {
+    clusterMsgCompact *c = (clusterMsgCompact *) link->rcvbuf;
+    uint32_t totlen = ntohl(c->totlen);
+    uint16_t type = ntohs(c->type);
+    uint16_t count = ntohs(c->count);
+    clusterNode *sender, *owner;
+    clusterMsg *hdr;
+    sds full;
+    int j, known = 0;
+
+    if (type != CLUSTERMSG_TYPE_PING && type != CLUSTERMSG_TYPE_PONG) return 0;
+    if (totlen != CLUSTERMSG_COMPACT_MIN_LEN +
+                  sizeof(clusterMsgDataGossipCompact) * count) return 0;
+
+    /* The slots can only be rebuilt if we already know the sender. */
+    sender = clusterLookupNode(c->sender);
+    if (!sender || nodeInHandshake(sender)) return 0;
+    owner = sender;
+    if (memcmp(c->slaveof, CLUSTER_NODE_NULL_NAME, CLUSTER_NAMELEN) != 0) {
+        owner = clusterLookupNode(c->slaveof);
+        if (!owner) {
+            sender->bus_want_full = 1;
+            return 0;
+        }
+    }
+
+    full = sdsnewlen(NULL, sizeof(clusterMsg) - sizeof(union clusterMsgData) +
+                           sizeof(clusterMsgDataGossip) * count);
+    hdr = (clusterMsg *) full;
+    memcpy(hdr->sig, c->sig, sizeof(hdr->sig));
+    hdr->ver = htons(CLUSTER_PROTO_VER);
+    hdr->port = c->port;
+    hdr->type = c->type;
+    hdr->currentEpoch = c->currentEpoch;
+    hdr->configEpoch = c->configEpoch;
+    hdr->offset = c->offset;
+    memcpy(hdr->sender, c->sender, CLUSTER_NAMELEN);
+    memcpy(hdr->myslots, owner->slots, sizeof(hdr->myslots));
+    memcpy(hdr->slaveof, c->slaveof, CLUSTER_NAMELEN);
+    memcpy(hdr->myip, c->myip, NET_IP_STR_LEN);
+    hdr->cport = c->cport;
+    hdr->flags = c->flags;
+    hdr->state = c->state;
+    memcpy(hdr->mflags, c->mflags, sizeof(hdr->mflags));
+    if (clusterSlotsDigest(hdr->myslots) != ntohu64(c->slots_digest))
+        sender->bus_want_full = 1;
+
+    /* Gossip about nodes we don't know is dropped: we'll learn about them
+     * from the next full message. */
+    for (j = 0; j < count; j++) {
+        clusterMsgDataGossipCompact *cg = &c->gossip[j];
+        clusterMsgDataGossip *g = &hdr->data.ping.gossip[known];
+        clusterNode *node = clusterLookupNode(cg->nodename);
+
+        if (!node) continue;
+        memcpy(g->nodename, cg->nodename, CLUSTER_NAMELEN);
+        g->ping_sent = 0;
+        g->pong_received = cg->pong_received;
+        memcpy(g->ip, node->ip, sizeof(g->ip));
+        g->port = htons(node->port);
+        g->cport = htons(node->cport);
+        g->flags = cg->flags;
+        g->notused1 = 0;
+        known++;
+    }
+    totlen = sizeof(clusterMsg) - sizeof(union clusterMsgData) +
+             sizeof(clusterMsgDataGossip) * known;
+    hdr->count = htons(known);
+    hdr->totlen = htonl(totlen);
+    sdssetlen(full, totlen);
+
+    sdsfree(link->rcvbuf);
+    link->rcvbuf = full;
+    return 1;
+}
+
 /* When this function is called, there is a packet to process starting
  * at node->rcvbuf. Releasing the buffer is up to the caller, so this
  * function should just handle the higher level stuff of processing the
@@ -1789,9 +1899,12 @@ int clusterProcessPacket(clusterLink *link) {
     clusterMsg *hdr = (clusterMsg *) link->rcvbuf;
     uint32_t totlen = ntohl(hdr->totlen);
     uint16_t type = ntohs(hdr->type);
+    int compact = 0;
 
-    if (type < CLUSTERMSG_TYPE_COUNT)
+    if (type < CLUSTERMSG_TYPE_COUNT) {
         server.cluster->stats_bus_messages_received[type]++;
+        server.cluster->stats_bus_bytes_received[type] += totlen;
+    }
     serverLog(LL_DEBUG, "--- Processing packet of type %d, %lu bytes",
               type, (unsigned long) totlen);
 
@@ -1799,10 +1912,18 @@ int clusterProcessPacket(clusterLink *link) {
     if (totlen < 16) return 1; /* At least signature, version, totlen, count. */
     if (totlen > sdslen(link->rcvbuf)) return 1;
 
-    if (ntohs(hdr->ver) != CLUSTER_PROTO_VER) {
+    if (ntohs(hdr->ver) == CLUSTER_PROTO_VER_COMPACT) {
+        /* Turn it into the full PING / PONG it stands for. */
+        if (!clusterExpandCompactPacket(link)) return 1;
+        hdr = (clusterMsg *) link->rcvbuf;
+        totlen = ntohl(hdr->totlen);
+        compact = 1;
+        server.cluster->stats_bus_compact_received++;
+    } else if (ntohs(hdr->ver) != CLUSTER_PROTO_VER) {
         /* Can't handle messages of different versions. */
         return 1;
     }
+    if (totlen < CLUSTERMSG_MIN_LEN) return 1;
 
     uint16_t flags = ntohs(hdr->flags);
     uint64_t senderCurrentEpoch = 0, senderConfigEpoch = 0;
@@ -1865,6 +1986,13 @@ int clusterProcessPacket(clusterLink *link) {
         /* Update the replication offset info for this node. */
         sender->repl_offset = ntohu64(hdr->offset);
         sender->repl_offset_time = mstime();
+        /* Compact PING / PONG negotiation, see clusterSendPingTo(). */
+        sender->bus_compact = (hdr->mflags[0] & CLUSTERMSG_FLAG0_COMPACT) != 0;
+        if (hdr->mflags[0] & CLUSTERMSG_FLAG0_WANTFULL)
+            sender->bus_send_full = 1;
+        if (!compact && (type == CLUSTERMSG_TYPE_PING ||
+                         type == CLUSTERMSG_TYPE_PONG))
+            sender->bus_want_full = 0;
         /* If we are a slave performing a manual failover and our master
          * sent its offset while already paused, populate the MF state. */
         if (server.cluster->mf_end &&
@@ -1930,7 +2058,7 @@ int clusterProcessPacket(clusterLink *link) {
             clusterProcessGossipSection(hdr, link);
 
         /* Anyway reply with a PONG */
-        clusterSendPing(link, CLUSTERMSG_TYPE_PONG);
+        clusterSendPingTo(link, sender, CLUSTERMSG_TYPE_PONG);
     }
 
     /* PING, PONG, MEET: process config information. */
@@ -2300,7 +2428,7 @@ void clusterReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                 /* Perform some sanity check on the message signature
                  * and length. */
                 if (memcmp(hdr->sig, "RCmb", 4) != 0 ||
-                    ntohl(hdr->totlen) < CLUSTERMSG_MIN_LEN) {
+                    ntohl(hdr->totlen) < CLUSTERMSG_COMPACT_MIN_LEN) {
                     serverLog(LL_WARNING,
                               "Bad message length or signature received "
                               "from Cluster bus.");
@@ -2355,8 +2483,10 @@ void clusterSendMessage(clusterLink *link, unsigned char *msg, size_t msglen) {
     /* Populate sent messages stats. */
     clusterMsg *hdr = (clusterMsg *) msg;
     uint16_t type = ntohs(hdr->type);
-    if (type < CLUSTERMSG_TYPE_COUNT)
+    if (type < CLUSTERMSG_TYPE_COUNT) {
         server.cluster->stats_bus_messages_sent[type]++;
+        server.cluster->stats_bus_bytes_sent[type] += msglen;
+    }
 }
 
 /* Send a message to all the nodes that are part of the cluster having
@@ -2443,6 +2573,8 @@ void clusterBuildMessageHdr(clusterMsg *hdr, int type) {
     /* Set the message flags. */
     if (nodeIsMaster(myself) && server.cluster->mf_end)
         hdr->mflags[0] |= CLUSTERMSG_FLAG0_PAUSED;
+    if (server.cluster_compact_bus)
+        hdr->mflags[0] |= CLUSTERMSG_FLAG0_COMPACT;
 
     /* Compute the message length for certain messages. For other messages
      * this is up to the caller. */
@@ -2485,6 +2617,42 @@ void clusterSetGossipEntry(clusterMsg *hdr, int i, clusterNode *n) {
     gossip->notused1 = 0;
 }
 
+/* Send to 'link' the compact version of the PING / PONG 'hdr' having
+ * 'gossipcount' gossip entries. Helper for clusterSendPingTo(). */
+void clusterSendCompactPing(clusterLink *link, clusterMsg *hdr, int gossipcount) {
+    uint32_t totlen = CLUSTERMSG_COMPACT_MIN_LEN +
+                      sizeof(clusterMsgDataGossipCompact) * gossipcount;
+    clusterMsgCompact *c = zcalloc(totlen);
+    int j;
+
+    memcpy(c->sig, hdr->sig, sizeof(c->sig));
+    c->totlen = htonl(totlen);
+    c->ver = htons(CLUSTER_PROTO_VER_COMPACT);
+    c->port = hdr->port;
+    c->type = hdr->type;
+    c->count = htons(gossipcount);
+    c->currentEpoch = hdr->currentEpoch;
+    c->configEpoch = hdr->configEpoch;
+    c->offset = hdr->offset;
+    memcpy(c->sender, hdr->sender, CLUSTER_NAMELEN);
+    c->slots_digest = htonu64(clusterSlotsDigest(hdr->myslots));
+    memcpy(c->slaveof, hdr->slaveof, CLUSTER_NAMELEN);
+    memcpy(c->myip, hdr->myip, NET_IP_STR_LEN);
+    c->cport = hdr->cport;
+    c->flags = hdr->flags;
+    c->state = hdr->state;
+    memcpy(c->mflags, hdr->mflags, sizeof(c->mflags));
+    for (j = 0; j < gossipcount; j++) {
+        memcpy(c->gossip[j].nodename, hdr->data.ping.gossip[j].nodename,
+               CLUSTER_NAMELEN);
+        c->gossip[j].pong_received = hdr->data.ping.gossip[j].pong_received;
+        c->gossip[j].flags = hdr->data.ping.gossip[j].flags;
+    }
+    server.cluster->stats_bus_compact_sent++;
+    clusterSendMessage(link, (unsigned char *) c, totlen);
+    zfree(c);
+}
+
 /*
  * Send a PING or PONG packet to the specified node, making sure to add enough
  * gossip informations.
@@ -2492,6 +2660,18 @@ void clusterSetGossipEntry(clusterMsg *hdr, int i, clusterNode *n) {
  * 将 PING 或 PONG 数据包发送到指定节点，确保添加足够的数据包 gossip 信息
  */
 void clusterSendPing(clusterLink *link, int type) {
+    clusterSendPingTo(link, link->node, type);
+}
+
+/* Like clusterSendPing() but 'peer' is the node at the other side of the
+ * link, that may be known even when link->node is NULL (a PONG sent over an
+ * incoming link).
+ *
+ * When both sides set CLUSTERMSG_FLAG0_COMPACT, the message is sent in the
+ * compact form (no slots bitmap, short gossip entries), unless our slots
+ * changed since the last full message sent to 'peer', the peer asked for a
+ * full one, or CLUSTER_COMPACT_FULL_EVERY messages were already compact. */
+void clusterSendPingTo(clusterLink *link, clusterNode *peer, int type) {
     unsigned char *buf;
     clusterMsg *hdr;
     int gossipcount = 0; /* Number of gossip sections added so far. */
@@ -2552,6 +2732,8 @@ void clusterSendPing(clusterLink *link, int type) {
     if (link->node && type == CLUSTERMSG_TYPE_PING)
         link->node->ping_sent = mstime();
     clusterBuildMessageHdr(hdr, type);
+    if (peer && peer->bus_want_full)
+        hdr->mflags[0] |= CLUSTERMSG_FLAG0_WANTFULL;
 
     /* Populate the gossip fields */
     int maxiterations = wanted * 3;
@@ -2609,6 +2791,26 @@ void clusterSendPing(clusterLink *link, int type) {
         dictReleaseIterator(di);
     }
 
+    /* Use the compact form if the peer has an up to date full message. */
+    if (server.cluster_compact_bus && peer && !nodeInHandshake(peer) &&
+        peer->bus_compact && (type == CLUSTERMSG_TYPE_PING ||
+                              type == CLUSTERMSG_TYPE_PONG))
+    {
+        uint64_t digest = clusterSlotsDigest(hdr->myslots);
+
+        if (!peer->bus_send_full && peer->bus_full_countdown > 0 &&
+            peer->bus_slots_digest == digest)
+        {
+            peer->bus_full_countdown--;
+            clusterSendCompactPing(link, hdr, gossipcount);
+            zfree(buf);
+            return;
+        }
+        peer->bus_slots_digest = digest;
+        peer->bus_full_countdown = CLUSTER_COMPACT_FULL_EVERY - 1;
+        peer->bus_send_full = 0;
+    }
+
     /* Ready to send... fix the totlen fiend and queue the message in the
      * output buffer. */
     totlen = sizeof(clusterMsg) - sizeof(union clusterMsgData);
@@ -3737,6 +3939,29 @@ void clusterCron(void) {
             clusterHandleSlaveMigration(max_slaves);
     }
 
+    /* Check the progress of the CLUSTER MIGRATESLOT in progress. */
+    clusterSlotMigrationCron();
+
+    /* Refresh the bus bytes per second rates shown by CLUSTER INFO. */
+    if (now - server.cluster->stats_bus_rate_time >= 1000) {
+        mstime_t elapsed = now - server.cluster->stats_bus_rate_time;
+
+        for (int j = 0; j < CLUSTERMSG_TYPE_COUNT; j++) {
+            long long *sent = server.cluster->stats_bus_bytes_sent;
+            long long *received = server.cluster->stats_bus_bytes_received;
+
+            server.cluster->stats_bus_bytes_sent_rate[j] =
+                (sent[j] - server.cluster->stats_bus_bytes_sent_prev[j]) *
+                1000 / elapsed;
+            server.cluster->stats_bus_bytes_received_rate[j] =
+                (received[j] - server.cluster->stats_bus_bytes_received_prev[j]) *
+                1000 / elapsed;
+            server.cluster->stats_bus_bytes_sent_prev[j] = sent[j];
+            server.cluster->stats_bus_bytes_received_prev[j] = received[j];
+        }
+        server.cluster->stats_bus_rate_time = now;
+    }
+
     if (update_state || server.cluster->state == CLUSTER_FAIL)
         clusterUpdateState();
 }
@@ -4376,6 +4601,9 @@ void clusterCommand(client *c) {
                 "info - Return onformation about the cluster.",
                 "keyslot <key> -- Return the hash slot for <key>.",
                 "meet <ip> <port> [bus-port] -- Connect nodes into a working cluster.",
+                "migrateslot <slot> [timeout <ms>] -- Move the keys of a migrating slot to its target in background.",
+                "migrateslot status -- Return the state of the slot migrations.",
+                "migrateslot cancel <slot> -- Abort a slot migration.",
                 "myid -- Return the node id.",
                 "nodes -- Return cluster configuration seen by node. Output format:",
                 "    <id> <ip:port> <flags> <master> <pings> <pongs> <epoch> <link> <slot> ... <slot>",
@@ -4664,6 +4892,46 @@ void clusterCommand(client *c) {
         info = sdscatprintf(info,
                             "cluster_stats_messages_received:%lld\r\n", tot_msg_received);
 
+        /* Bytes sent and received over the bus, and their rate. */
+        long long tot_bytes_sent = 0, tot_bytes_received = 0;
+        long long tot_rate_sent = 0, tot_rate_received = 0;
+
+        for (int i = 0; i < CLUSTERMSG_TYPE_COUNT; i++) {
+            tot_bytes_sent += server.cluster->stats_bus_bytes_sent[i];
+            tot_rate_sent += server.cluster->stats_bus_bytes_sent_rate[i];
+            if (server.cluster->stats_bus_bytes_sent[i] == 0) continue;
+            info = sdscatprintf(info,
+                                "cluster_stats_bytes_%s_sent:%lld\r\n"
+                                "cluster_stats_bytes_%s_sent_per_sec:%lld\r\n",
+                                clusterGetMessageTypeString(i),
+                                server.cluster->stats_bus_bytes_sent[i],
+                                clusterGetMessageTypeString(i),
+                                server.cluster->stats_bus_bytes_sent_rate[i]);
+        }
+        for (int i = 0; i < CLUSTERMSG_TYPE_COUNT; i++) {
+            tot_bytes_received += server.cluster->stats_bus_bytes_received[i];
+            tot_rate_received += server.cluster->stats_bus_bytes_received_rate[i];
+            if (server.cluster->stats_bus_bytes_received[i] == 0) continue;
+            info = sdscatprintf(info,
+                                "cluster_stats_bytes_%s_received:%lld\r\n"
+                                "cluster_stats_bytes_%s_received_per_sec:%lld\r\n",
+                                clusterGetMessageTypeString(i),
+                                server.cluster->stats_bus_bytes_received[i],
+                                clusterGetMessageTypeString(i),
+                                server.cluster->stats_bus_bytes_received_rate[i]);
+        }
+        info = sdscatprintf(info,
+                            "cluster_stats_bytes_sent:%lld\r\n"
+                            "cluster_stats_bytes_sent_per_sec:%lld\r\n"
+                            "cluster_stats_bytes_received:%lld\r\n"
+                            "cluster_stats_bytes_received_per_sec:%lld\r\n"
+                            "cluster_stats_compact_sent:%lld\r\n"
+                            "cluster_stats_compact_received:%lld\r\n",
+                            tot_bytes_sent, tot_rate_sent,
+                            tot_bytes_received, tot_rate_received,
+                            server.cluster->stats_bus_compact_sent,
+                            server.cluster->stats_bus_compact_received);
+
         /* Produce the reply protocol. */
         addReplySds(c, sdscatprintf(sdsempty(), "$%lu\r\n",
                                     (unsigned long) sdslen(info)));
@@ -4722,6 +4990,9 @@ void clusterCommand(client *c) {
             decrRefCount(keys[j]);
         }
         zfree(keys);
+    } else if (!strcasecmp(c->argv[1]->ptr, "migrateslot") && c->argc >= 3) {
+        /* CLUSTER MIGRATESLOT <slot> [TIMEOUT <ms>] | STATUS | CANCEL <slot> */
+        clusterMigrateSlotCommand(c);
     } else if (!strcasecmp(c->argv[1]->ptr, "forget") && c->argc == 3) {
         /* CLUSTER FORGET <NODE ID> */
         clusterNode *n = clusterLookupNode(c->argv[2]->ptr);
@@ -4938,16 +5209,21 @@ void clusterCommand(client *c) {
  * -------------------------------------------------------------------------- */
 
 /*
- * Generates a DUMP-format representation of the object 'o', adding it to the
- * io stream pointed by 'rio'. This function can't fail.
+ * Generates a DUMP-format representation of the object 'o' stored at 'key'
+ * in 'db', adding it to the io stream pointed by 'rio'. This function can't
+ * fail.
  */
-void createDumpPayload(rio *payload, robj *o) {
+void createDumpPayload(rio *payload, redisDb *db, robj *key, robj *o) {
     unsigned char buf[2];
     uint64_t crc;
 
     /* Serialize the object in a RDB-like format. It consist of an object type
-     * byte followed by the serialized object. This is understood by RESTORE. */
+     * byte followed by the serialized object. This is understood by RESTORE.
+     * The expire times of the fields of a hash, if any, precede the type
+     * like in the RDB file. */
     rioInitWithBuffer(payload, sdsempty());
+    if (o->type == OBJ_HASH)
+        serverAssert(rdbSaveFieldExpires(payload, db, key) != -1);
     serverAssert(rdbSaveObjectType(payload, o));
     serverAssert(rdbSaveObject(payload, o));
 
@@ -5007,7 +5283,7 @@ void dumpCommand(client *c) {
     }
 
     /* Create the DUMP encoded representation. */
-    createDumpPayload(&payload, o);
+    createDumpPayload(&payload, c->db, c->argv[1], o);
 
     /* Transfer to the client */
     dumpobj = createObject(OBJ_STRING, payload.io.buffer.ptr);
@@ -5018,9 +5294,10 @@ void dumpCommand(client *c) {
 
 /* RESTORE key ttl serialized-value [REPLACE] */
 void restoreCommand(client *c) {
-    long long ttl, lfu_freq = -1, lru_idle = -1, lru_clock;
+    long long ttl, lfu_freq = -1, lru_idle = -1, lru_clock = 0;
     rio payload;
     int j, type, replace = 0, absttl = 0;
+    unsigned char *field_expires = NULL;
     robj *obj;
 
     /* Parse additional options */
@@ -5078,8 +5355,16 @@ void restoreCommand(client *c) {
     }
 
     rioInitWithBuffer(&payload, c->argv[3]->ptr);
-    if (((type = rdbLoadObjectType(&payload)) == -1) ||
+    if ((type = rdbLoadType(&payload)) == RDB_OPCODE_FIELD_EXPIRES) {
+        if ((field_expires = rdbLoadFieldExpires(&payload)) == NULL) {
+            addReplyError(c, "Bad data format");
+            return;
+        }
+        type = rdbLoadType(&payload);
+    }
+    if (type == -1 || !rdbIsObjectType(type) ||
         ((obj = rdbLoadObject(type, &payload)) == NULL)) {
+        if (field_expires) zfree(field_expires);
         addReplyError(c, "Bad data format");
         return;
     }
@@ -5093,6 +5378,7 @@ void restoreCommand(client *c) {
         if (!absttl) ttl += mstime();
         setExpire(c, c->db, c->argv[1], ttl);
     }
+    if (field_expires) hashFieldExpiresRestore(c->db, c->argv[1], field_expires);
     objectSetLRUOrLFU(obj, lfu_freq, lru_idle, lru_clock);
     signalModifiedKey(c->db, c->argv[1]);
     addReply(c, shared.ok);
@@ -5353,7 +5639,7 @@ void migrateCommand(client *c) {
 
         /* Emit the payload argument, that is the serialized object using
          * the DUMP format. */
-        createDumpPayload(&payload, ov[j]);
+        createDumpPayload(&payload, c->db, kv[j], ov[j]);
         serverAssertWithInfo(c, NULL,
                              rioWriteBulkString(&cmd, payload.io.buffer.ptr,
                                                 sdslen(payload.io.buffer.ptr)));
@@ -5526,6 +5812,606 @@ void migrateCommand(client *c) {
     return;
 }
 
+/* -----------------------------------------------------------------------------
+ * CLUSTER MIGRATESLOT: server side slot migration
+ *
+ * Resharding with GETKEYSINSLOT + MIGRATE blocks the source node for a full
+ * round trip with the target for every batch of keys. Here the node streams
+ * the whole slot to the node set with SETSLOT MIGRATING in the background:
+ * keys are sent as pipelined batches of RESTORE-ASKING commands carrying the
+ * DUMP payload, and the event loop keeps serving clients while the target
+ * applies them. A key is deleted locally only once acknowledged, and keys
+ * written while their batch is in flight are sent again. Once no key is
+ * left, the slot is assigned to the target with SETSLOT NODE on both sides.
+ * -------------------------------------------------------------------------- */
+
+static void clusterSlotMigrationReadHandler(aeEventLoop *el, int fd,
+                                            void *privdata, int mask);
+static void clusterSlotMigrationWriteHandler(aeEventLoop *el, int fd,
+                                             void *privdata, int mask);
+
+static char *clusterSlotMigrationStateName(int state) {
+    switch (state) {
+        case CLUSTER_MIGRATESLOT_STREAMING: return "streaming";
+        case CLUSTER_MIGRATESLOT_CUTOVER: return "cutover";
+        case CLUSTER_MIGRATESLOT_DONE: return "done";
+        case CLUSTER_MIGRATESLOT_FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+static clusterSlotMigration *clusterSlotMigrationCreate(int slot,
+                                                        clusterNode *target,
+                                                        int fd,
+                                                        long long timeout) {
+    clusterSlotMigration *m = zmalloc(sizeof(*m));
+
+    m->slot = slot;
+    memcpy(m->target, target->name, CLUSTER_NAMELEN);
+    m->state = CLUSTER_MIGRATESLOT_STREAMING;
+    m->fd = fd;
+    m->timeout = timeout;
+    m->start_time = m->last_io_time = mstime();
+    m->end_time = 0;
+    m->outbuf = sdsempty();
+    m->outpos = 0;
+    m->inbuf = sdsempty();
+    m->batch = NULL;
+    m->batch_len = m->batch_pos = 0;
+    m->inflight = dictCreate(&setDictType, NULL);
+    m->resend = dictCreate(&setDictType, NULL);
+    m->keys_migrated = 0;
+    m->bytes_sent = 0;
+    m->batches = 0;
+    m->error = NULL;
+    return m;
+}
+
+/* Close the connection with the target and forget the batch in flight.
+ * Keys not yet acknowledged are still in the local keyspace. */
+static void clusterSlotMigrationReset(clusterSlotMigration *m) {
+    if (m->fd != -1) {
+        aeDeleteFileEvent(server.el, m->fd, AE_READABLE | AE_WRITABLE);
+        close(m->fd);
+        m->fd = -1;
+    }
+    sdsclear(m->outbuf);
+    m->outpos = 0;
+    sdsclear(m->inbuf);
+    zfree(m->batch);
+    m->batch = NULL;
+    m->batch_len = m->batch_pos = 0;
+    dictEmpty(m->inflight, NULL);
+    dictEmpty(m->resend, NULL);
+}
+
+static void clusterSlotMigrationFree(clusterSlotMigration *m) {
+    clusterSlotMigrationReset(m);
+    sdsfree(m->outbuf);
+    sdsfree(m->inbuf);
+    dictRelease(m->inflight);
+    dictRelease(m->resend);
+    sdsfree(m->error);
+    zfree(m);
+}
+
+static void clusterSlotMigrationFail(clusterSlotMigration *m,
+                                     const char *reason) {
+    sds error = sdsnew(reason); /* 'reason' may point inside m->inbuf. */
+
+    serverLog(LL_WARNING, "Migration of slot %d to %.40s failed: %s",
+              m->slot, m->target, error);
+    clusterSlotMigrationReset(m);
+    sdsfree(m->error);
+    m->error = error;
+    m->state = CLUSTER_MIGRATESLOT_FAILED;
+    m->end_time = mstime();
+}
+
+/* Return the migration of 'slot', or NULL if there is none. */
+static clusterSlotMigration *clusterSlotMigrationLookup(int slot) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.cluster->slot_migrations, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *m = listNodeValue(ln);
+        if (m->slot == slot) return m;
+    }
+    return NULL;
+}
+
+static void clusterSlotMigrationRemove(clusterSlotMigration *m) {
+    listNode *ln = listSearchKey(server.cluster->slot_migrations, m);
+
+    listDelNode(server.cluster->slot_migrations, ln);
+    clusterSlotMigrationFree(m);
+}
+
+/* Return the target node if the slot can still be migrated, that is we
+ * are a master still serving it and it is still migrating to the target. */
+static clusterNode *clusterSlotMigrationTarget(clusterSlotMigration *m) {
+    clusterNode *n = clusterLookupNode(m->target);
+
+    if (n == NULL || nodeIsSlave(myself) ||
+        server.cluster->slots[m->slot] != myself ||
+        server.cluster->migrating_slots_to[m->slot] != n)
+        return NULL;
+    return n;
+}
+
+/* Write as much of the pending batch as the socket accepts, installing the
+ * writable handler for the rest. */
+static int clusterSlotMigrationWrite(clusterSlotMigration *m) {
+    while (m->outpos < sdslen(m->outbuf)) {
+        ssize_t nwritten = write(m->fd, m->outbuf + m->outpos,
+                                 sdslen(m->outbuf) - m->outpos);
+        if (nwritten == -1) {
+            if (errno == EAGAIN) break;
+            clusterSlotMigrationFail(m, strerror(errno));
+            return C_ERR;
+        }
+        m->outpos += nwritten;
+        m->bytes_sent += nwritten;
+        m->last_io_time = mstime();
+    }
+    if (m->outpos == sdslen(m->outbuf)) {
+        sdsclear(m->outbuf);
+        m->outpos = 0;
+        aeDeleteFileEvent(server.el, m->fd, AE_WRITABLE);
+    } else if (!(aeGetFileEvents(server.el, m->fd) & AE_WRITABLE)) {
+        if (aeCreateFileEvent(server.el, m->fd, AE_WRITABLE,
+                              clusterSlotMigrationWriteHandler, m) == AE_ERR) {
+            clusterSlotMigrationFail(m, "can't create writable event");
+            return C_ERR;
+        }
+    }
+    return C_OK;
+}
+
+static void clusterSlotMigrationWriteHandler(aeEventLoop *el, int fd,
+                                             void *privdata, int mask) {
+    UNUSED(el);
+    UNUSED(fd);
+    UNUSED(mask);
+    clusterSlotMigrationWrite(privdata);
+}
+
+static void clusterSlotMigrationAddCmd(clusterSlotMigration *m, int type,
+                                       int replies, sds key) {
+    clusterSlotMigrationCmd *cmd;
+
+    m->batch = zrealloc(m->batch, sizeof(*cmd) * (m->batch_len + 1));
+    cmd = &m->batch[m->batch_len++];
+    cmd->type = type;
+    cmd->replies = replies;
+    cmd->key = key;
+}
+
+/* Append to the batch the command moving 'name' to the target: a RESTORE
+ * of the current value, or a DEL if the key is gone and 'del_missing' is
+ * true, since the target may hold a copy sent by a previous batch.
+ * Returns the number of bytes appended. */
+static size_t clusterSlotMigrationAppendKey(clusterSlotMigration *m, rio *cmd,
+                                            sds name, int del_missing) {
+    size_t oldlen = sdslen(cmd->io.buffer.ptr);
+    robj *keyobj, *o;
+    dictEntry *de;
+
+    /* The key is read from the dictionary directly, so that the migration
+     * does not touch the keyspace stats nor the LRU/LFU of the keys, and
+     * does not expire them: keys already expired are sent with the
+     * smallest TTL and expire on the target. */
+    de = dictFind(server.db->dict, name);
+    o = de ? dictGetVal(de) : NULL;
+    if (o == NULL && !del_missing) return 0;
+
+    de = dictAddRaw(m->inflight, sdsdup(name), NULL);
+    serverAssert(de != NULL);
+    name = dictGetKey(de);
+
+    if (o == NULL) {
+        serverAssert(rioWriteBulkCount(cmd, '*', 1));
+        serverAssert(rioWriteBulkString(cmd, "ASKING", 6));
+        serverAssert(rioWriteBulkCount(cmd, '*', 2));
+        serverAssert(rioWriteBulkString(cmd, "DEL", 3));
+        serverAssert(rioWriteBulkString(cmd, name, sdslen(name)));
+        clusterSlotMigrationAddCmd(m, CLUSTER_MIGRATESLOT_CMD_DEL, 2, name);
+    } else {
+        long long ttl = 0, expireat;
+        rio payload;
+
+        keyobj = createStringObject(name, sdslen(name));
+        expireat = getExpire(server.db, keyobj);
+        if (expireat != -1) {
+            ttl = expireat - mstime();
+            if (ttl < 1) ttl = 1;
+        }
+        serverAssert(rioWriteBulkCount(cmd, '*', 5));
+        serverAssert(rioWriteBulkString(cmd, "RESTORE-ASKING", 14));
+        serverAssert(rioWriteBulkString(cmd, name, sdslen(name)));
+        serverAssert(rioWriteBulkLongLong(cmd, ttl));
+        createDumpPayload(&payload, server.db, keyobj, o);
+        decrRefCount(keyobj);
+        serverAssert(rioWriteBulkString(cmd, payload.io.buffer.ptr,
+                                        sdslen(payload.io.buffer.ptr)));
+        sdsfree(payload.io.buffer.ptr);
+        serverAssert(rioWriteBulkString(cmd, "REPLACE", 7));
+        clusterSlotMigrationAddCmd(m, CLUSTER_MIGRATESLOT_CMD_RESTORE, 1, name);
+    }
+    return sdslen(cmd->io.buffer.ptr) - oldlen;
+}
+
+/* Send the next batch to the target: first the keys written while their
+ * previous batch was in flight, then keys not sent yet. When the slot is
+ * empty ask the target to take the slot ownership. */
+static void clusterSlotMigrationSendBatch(clusterSlotMigration *m) {
+    size_t bytes = 0;
+    int keys = 0;
+    rio cmd;
+
+    serverAssert(m->batch_len == 0 && m->fd != -1);
+    rioInitWithBuffer(&cmd, m->outbuf);
+
+    if (dictSize(m->resend)) {
+        dictIterator *di = dictGetSafeIterator(m->resend);
+        dictEntry *de;
+
+        while (keys < CLUSTER_MIGRATESLOT_BATCH_KEYS &&
+               bytes < CLUSTER_MIGRATESLOT_BATCH_BYTES &&
+               (de = dictNext(di)) != NULL) {
+            sds name = dictGetKey(de);
+            bytes += clusterSlotMigrationAppendKey(m, &cmd, name, 1);
+            keys++;
+            dictDelete(m->resend, name);
+        }
+        dictReleaseIterator(di);
+    }
+
+    if (keys < CLUSTER_MIGRATESLOT_BATCH_KEYS &&
+        bytes < CLUSTER_MIGRATESLOT_BATCH_BYTES) {
+        /* Keys waiting to be sent again are still in the slot, fetch
+         * enough of them to fill the batch anyway. */
+        unsigned int count = CLUSTER_MIGRATESLOT_BATCH_KEYS - keys +
+                             dictSize(m->inflight) + dictSize(m->resend);
+        robj **kv = zmalloc(sizeof(robj *) * count);
+        unsigned int numkeys = getKeysInSlot(m->slot, kv, count), j;
+
+        for (j = 0; j < numkeys; j++) {
+            sds name = kv[j]->ptr;
+
+            if (keys < CLUSTER_MIGRATESLOT_BATCH_KEYS &&
+                bytes < CLUSTER_MIGRATESLOT_BATCH_BYTES &&
+                dictFind(m->inflight, name) == NULL &&
+                dictFind(m->resend, name) == NULL) {
+                size_t len = clusterSlotMigrationAppendKey(m, &cmd, name, 0);
+                if (len) {
+                    bytes += len;
+                    keys++;
+                }
+            }
+            decrRefCount(kv[j]);
+        }
+        zfree(kv);
+    }
+
+    if (m->batch_len == 0) {
+        /* Only keys that just expired were found: retry from the cron. */
+        if (countKeysInSlot(m->slot) != 0) {
+            m->outbuf = cmd.io.buffer.ptr;
+            return;
+        }
+
+        char slotbuf[8];
+        int slotlen = ll2string(slotbuf, sizeof(slotbuf), m->slot);
+
+        serverAssert(rioWriteBulkCount(&cmd, '*', 5));
+        serverAssert(rioWriteBulkString(&cmd, "CLUSTER", 7));
+        serverAssert(rioWriteBulkString(&cmd, "SETSLOT", 7));
+        serverAssert(rioWriteBulkString(&cmd, slotbuf, slotlen));
+        serverAssert(rioWriteBulkString(&cmd, "NODE", 4));
+        serverAssert(rioWriteBulkString(&cmd, m->target, CLUSTER_NAMELEN));
+        clusterSlotMigrationAddCmd(m, CLUSTER_MIGRATESLOT_CMD_SETSLOT, 1, NULL);
+        m->state = CLUSTER_MIGRATESLOT_CUTOVER;
+    }
+    m->outbuf = cmd.io.buffer.ptr;
+    m->batches++;
+    m->last_io_time = mstime();
+    clusterSlotMigrationWrite(m);
+}
+
+/* The target now owns the slot: do the same locally. The target bumped its
+ * config epoch, so the rest of the cluster will follow. */
+static void clusterSlotMigrationCutover(clusterSlotMigration *m,
+                                        clusterNode *n) {
+    clusterDelSlot(m->slot);
+    clusterAddSlot(n, m->slot);
+    server.cluster->migrating_slots_to[m->slot] = NULL;
+    clusterDoBeforeSleep(CLUSTER_TODO_SAVE_CONFIG | CLUSTER_TODO_UPDATE_STATE);
+
+    clusterSlotMigrationReset(m);
+    m->state = CLUSTER_MIGRATESLOT_DONE;
+    m->end_time = mstime();
+    serverLog(LL_NOTICE,
+              "Slot %d migrated to %.40s: %lld keys, %lld bytes in %lld ms",
+              m->slot, m->target, m->keys_migrated, m->bytes_sent,
+              (long long) (m->end_time - m->start_time));
+}
+
+/* All the replies of the batch were received: delete the keys that the
+ * target acknowledged and nobody touched since, and queue the others to be
+ * sent again. */
+static void clusterSlotMigrationBatchDone(clusterSlotMigration *m) {
+    clusterNode *n = clusterSlotMigrationTarget(m);
+    int j;
+
+    if (n == NULL) {
+        clusterSlotMigrationFail(m, "slot is no longer migrating to the target node");
+        return;
+    }
+
+    for (j = 0; j < m->batch_len; j++) {
+        clusterSlotMigrationCmd *cmd = &m->batch[j];
+
+        if (cmd->type == CLUSTER_MIGRATESLOT_CMD_SETSLOT) {
+            clusterSlotMigrationCutover(m, n);
+            return;
+        }
+
+        dictEntry *de = dictFind(m->inflight, cmd->key);
+        robj *keyobj;
+
+        if (dictGetVal(de) != NULL) {
+            dictAdd(m->resend, sdsdup(cmd->key), NULL);
+            continue;
+        }
+        if (cmd->type != CLUSTER_MIGRATESLOT_CMD_RESTORE) continue;
+
+        /* The target has the only up to date copy now. */
+        keyobj = createStringObject(cmd->key, sdslen(cmd->key));
+        if (dbDelete(server.db, keyobj)) {
+            robj *argv[2];
+
+            argv[0] = shared.del;
+            argv[1] = keyobj;
+            propagate(server.delCommand, 0, argv, 2,
+                      PROPAGATE_AOF | PROPAGATE_REPL);
+            signalModifiedKey(server.db, keyobj);
+            server.dirty++;
+            m->keys_migrated++;
+        }
+        decrRefCount(keyobj);
+    }
+
+    zfree(m->batch);
+    m->batch = NULL;
+    m->batch_len = m->batch_pos = 0;
+    dictEmpty(m->inflight, NULL);
+    clusterSlotMigrationSendBatch(m);
+}
+
+static void clusterSlotMigrationReadHandler(aeEventLoop *el, int fd,
+                                            void *privdata, int mask) {
+    clusterSlotMigration *m = privdata;
+    char buf[PROTO_IOBUF_LEN];
+    ssize_t nread;
+    char *p, *nl;
+    UNUSED(el);
+    UNUSED(mask);
+
+    nread = read(fd, buf, sizeof(buf));
+    if (nread == -1 && errno == EAGAIN) return;
+    if (nread <= 0) {
+        clusterSlotMigrationFail(m, nread == 0 ?
+                                    "connection closed by the target node" :
+                                    strerror(errno));
+        return;
+    }
+    m->inbuf = sdscatlen(m->inbuf, buf, nread);
+    m->last_io_time = mstime();
+
+    /* All the commands we send have single line replies. */
+    p = m->inbuf;
+    while (m->batch_pos < m->batch_len &&
+           (nl = memchr(p, '\n', sdslen(m->inbuf) - (p - m->inbuf))) != NULL) {
+        clusterSlotMigrationCmd *cmd = &m->batch[m->batch_pos];
+
+        if (*p == '-') {
+            sds err = sdscatlen(sdsnew("target node replied: "), p + 1,
+                                nl - p - 1);
+            sdstrim(err, "\r");
+            clusterSlotMigrationFail(m, err);
+            sdsfree(err);
+            return;
+        }
+        if (--cmd->replies == 0) m->batch_pos++;
+        p = nl + 1;
+    }
+    sdsrange(m->inbuf, p - m->inbuf, -1);
+    if (m->batch_len && m->batch_pos == m->batch_len)
+        clusterSlotMigrationBatchDone(m);
+}
+
+/* Called when a key is written or deleted: if it is part of a batch in
+ * flight, the copy the target is receiving is stale. */
+void clusterSlotMigrationKeyTouched(sds key) {
+    listIter li;
+    listNode *ln;
+    int slot;
+
+    if (listLength(server.cluster->slot_migrations) == 0) return;
+    slot = keyHashSlot(key, sdslen(key));
+    listRewind(server.cluster->slot_migrations, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *m = listNodeValue(ln);
+        dictEntry *de;
+
+        if (m->slot != slot || dictSize(m->inflight) == 0) continue;
+        if ((de = dictFind(m->inflight, key)) != NULL)
+            dictSetVal(m->inflight, de, (void *) 1);
+    }
+}
+
+/* Called when the whole keyspace is flushed. */
+void clusterSlotMigrationFlushed(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.cluster->slot_migrations, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *m = listNodeValue(ln);
+        dictIterator *di = dictGetIterator(m->inflight);
+        dictEntry *de;
+
+        while ((de = dictNext(di)) != NULL)
+            dictSetVal(m->inflight, de, (void *) 1);
+        dictReleaseIterator(di);
+    }
+}
+
+/* Called by clusterCron(): abort migrations whose slot changed state or
+ * whose target stopped replying, and restart the ones that found no key
+ * to send. */
+void clusterSlotMigrationCron(void) {
+    mstime_t now = mstime();
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.cluster->slot_migrations, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        clusterSlotMigration *m = listNodeValue(ln);
+
+        if (m->state == CLUSTER_MIGRATESLOT_DONE ||
+            m->state == CLUSTER_MIGRATESLOT_FAILED)
+            continue;
+        if (clusterSlotMigrationTarget(m) == NULL) {
+            clusterSlotMigrationFail(m, "slot is no longer migrating to the target node");
+        } else if (m->batch_len && now - m->last_io_time > m->timeout) {
+            clusterSlotMigrationFail(m, "timeout waiting for the target node");
+        } else if (m->batch_len == 0) {
+            clusterSlotMigrationSendBatch(m);
+        }
+    }
+}
+
+/* CLUSTER MIGRATESLOT <slot> [TIMEOUT <milliseconds>]
+ * CLUSTER MIGRATESLOT STATUS
+ * CLUSTER MIGRATESLOT CANCEL <slot>
+ *
+ * Start moving all the keys of <slot> to the node it is migrating to, see
+ * CLUSTER SETSLOT. The command returns immediately, the progress can be
+ * checked with STATUS. */
+void clusterMigrateSlotCommand(client *c) {
+    clusterSlotMigration *m;
+    clusterNode *n;
+    long long timeout = CLUSTER_MIGRATESLOT_DEFAULT_TIMEOUT;
+    int slot, fd;
+
+    if (c->argc == 3 && !strcasecmp(c->argv[2]->ptr, "status")) {
+        mstime_t now = mstime();
+        listIter li;
+        listNode *ln;
+
+        addReplyMultiBulkLen(c, listLength(server.cluster->slot_migrations));
+        listRewind(server.cluster->slot_migrations, &li);
+        while ((ln = listNext(&li)) != NULL) {
+            m = listNodeValue(ln);
+            addReplyMultiBulkLen(c, 18);
+            addReplyBulkCString(c, "slot");
+            addReplyLongLong(c, m->slot);
+            addReplyBulkCString(c, "target");
+            addReplyBulkCBuffer(c, m->target, CLUSTER_NAMELEN);
+            addReplyBulkCString(c, "state");
+            addReplyBulkCString(c, clusterSlotMigrationStateName(m->state));
+            addReplyBulkCString(c, "keys-migrated");
+            addReplyLongLong(c, m->keys_migrated);
+            addReplyBulkCString(c, "keys-in-flight");
+            addReplyLongLong(c, dictSize(m->inflight));
+            addReplyBulkCString(c, "bytes-sent");
+            addReplyLongLong(c, m->bytes_sent);
+            addReplyBulkCString(c, "batches");
+            addReplyLongLong(c, m->batches);
+            addReplyBulkCString(c, "elapsed-ms");
+            addReplyLongLong(c, (m->end_time ? m->end_time : now) -
+                                m->start_time);
+            addReplyBulkCString(c, "error");
+            if (m->error)
+                addReplyBulkCBuffer(c, m->error, sdslen(m->error));
+            else
+                addReply(c, shared.nullbulk);
+        }
+        return;
+    } else if (c->argc == 4 && !strcasecmp(c->argv[2]->ptr, "cancel")) {
+        if ((slot = getSlotOrReply(c, c->argv[3])) == -1) return;
+        if ((m = clusterSlotMigrationLookup(slot)) == NULL) {
+            addReplyErrorFormat(c, "No migration for hash slot %d", slot);
+            return;
+        }
+        clusterSlotMigrationRemove(m);
+        addReply(c, shared.ok);
+        return;
+    } else if (c->argc == 5 && !strcasecmp(c->argv[3]->ptr, "timeout")) {
+        if (getLongLongFromObjectOrReply(c, c->argv[4], &timeout, NULL)
+            != C_OK)
+            return;
+        if (timeout <= 0) timeout = CLUSTER_MIGRATESLOT_DEFAULT_TIMEOUT;
+    } else if (c->argc != 3) {
+        addReply(c, shared.syntaxerr);
+        return;
+    }
+
+    if ((slot = getSlotOrReply(c, c->argv[2])) == -1) return;
+    if (nodeIsSlave(myself)) {
+        addReplyError(c, "Please use MIGRATESLOT only with masters.");
+        return;
+    }
+    if (server.cluster->slots[slot] != myself) {
+        addReplyErrorFormat(c, "I'm not the owner of hash slot %d", slot);
+        return;
+    }
+    if ((n = server.cluster->migrating_slots_to[slot]) == NULL) {
+        addReplyErrorFormat(c, "Hash slot %d is not in migrating state, "
+                               "use CLUSTER SETSLOT first", slot);
+        return;
+    }
+    if ((m = clusterSlotMigrationLookup(slot)) != NULL) {
+        if (m->state == CLUSTER_MIGRATESLOT_STREAMING ||
+            m->state == CLUSTER_MIGRATESLOT_CUTOVER) {
+            addReplyErrorFormat(c, "Hash slot %d is already being migrated",
+                                slot);
+            return;
+        }
+        clusterSlotMigrationRemove(m);
+    }
+
+    fd = anetTcpNonBlockConnect(server.neterr, n->ip, n->port);
+    if (fd == -1) {
+        addReplyErrorFormat(c, "Can't connect to target node: %s",
+                            server.neterr);
+        return;
+    }
+    anetEnableTcpNoDelay(server.neterr, fd);
+    if ((aeWait(fd, AE_WRITABLE, timeout) & AE_WRITABLE) == 0) {
+        close(fd);
+        addReplySds(c, sdsnew("-IOERR error or timeout connecting to the target node\r\n"));
+        return;
+    }
+
+    m = clusterSlotMigrationCreate(slot, n, fd, timeout);
+    listAddNodeTail(server.cluster->slot_migrations, m);
+    if (aeCreateFileEvent(server.el, fd, AE_READABLE,
+                          clusterSlotMigrationReadHandler, m) == AE_ERR) {
+        clusterSlotMigrationFail(m, "can't create readable event");
+    } else {
+        serverLog(LL_NOTICE, "Migrating slot %d to %.40s", slot, m->target);
+        clusterSlotMigrationSendBatch(m);
+    }
+    if (m->state == CLUSTER_MIGRATESLOT_FAILED)
+        addReplyErrorFormat(c, "Migration failed: %s", m->error);
+    else
+        addReply(c, shared.ok);
+}
+
 /* -----------------------------------------------------------------------------
  * Cluster functions related to serving / redirecting clients
  * -------------------------------------------------------------------------- */
@@ -17,6 +17,8 @@
 #define CLUSTER_DEFAULT_SLAVE_VALIDITY 10 /* Slave max data age factor. */
 #define CLUSTER_DEFAULT_REQUIRE_FULL_COVERAGE 1
 #define CLUSTER_DEFAULT_SLAVE_NO_FAILOVER 0 /* Failover by default. */
+#define CLUSTER_DEFAULT_COMPACT_BUS 1 /* Compact PING/PONG when supported. */
+#define CLUSTER_COMPACT_FULL_EVERY 10 /* Full PING/PONG every N to a node. */
 #define CLUSTER_FAIL_REPORT_VALIDITY_MULT 2 /* Fail report validity. */
 #define CLUSTER_FAIL_UNDO_TIME_MULT 2 /* Undo fail if master is back. */
 #define CLUSTER_FAIL_UNDO_TIME_ADD 10 /* Some additional time. */
@@ -90,6 +92,15 @@ typedef struct clusterLink {
 #define CLUSTER_TODO_SAVE_CONFIG (1<<2)
 #define CLUSTER_TODO_FSYNC_CONFIG (1<<3)
 
+/* CLUSTER MIGRATESLOT states and batch limits. */
+#define CLUSTER_MIGRATESLOT_STREAMING 0  /* Moving keys to the target. */
+#define CLUSTER_MIGRATESLOT_CUTOVER 1    /* Slot empty, SETSLOT NODE sent. */
+#define CLUSTER_MIGRATESLOT_DONE 2       /* Slot now owned by the target. */
+#define CLUSTER_MIGRATESLOT_FAILED 3     /* Aborted, keys left in place. */
+#define CLUSTER_MIGRATESLOT_BATCH_KEYS 100
+#define CLUSTER_MIGRATESLOT_BATCH_BYTES (256*1024)
+#define CLUSTER_MIGRATESLOT_DEFAULT_TIMEOUT 10000 /* milliseconds. */
+
 /* Message types.
  *
  * Note that the PING, PONG and MEET messages are actually the same exact
@@ -194,8 +205,52 @@ typedef struct clusterNode {
      */
     clusterLink *link;          /* TCP/IP link with this node */
     list *fail_reports;         /* List of nodes signaling this as failing */
+    /* Compact PING/PONG state, see clusterSendPingTo(). */
+    int bus_compact;            /* Node accepts compact PING/PONG. */
+    int bus_send_full;          /* Node asked for our full header. */
+    int bus_want_full;          /* We need the full header of the node. */
+    int bus_full_countdown;     /* Compact messages before the next full. */
+    uint64_t bus_slots_digest;  /* Digest of the slots of our last full. */
 } clusterNode;
 
+/* Commands of the batch a slot migration is waiting replies for. */
+#define CLUSTER_MIGRATESLOT_CMD_RESTORE 0 /* RESTORE-ASKING key ... REPLACE */
+#define CLUSTER_MIGRATESLOT_CMD_DEL 1     /* ASKING + DEL key */
+#define CLUSTER_MIGRATESLOT_CMD_SETSLOT 2 /* CLUSTER SETSLOT slot NODE id */
+
+typedef struct clusterSlotMigrationCmd {
+    int type;           /* CLUSTER_MIGRATESLOT_CMD_* */
+    int replies;        /* Reply lines still expected. */
+    sds key;            /* Key name, owned by the 'inflight' dict. */
+} clusterSlotMigrationCmd;
+
+/* State of a background CLUSTER MIGRATESLOT. Keys are moved in pipelined
+ * batches of RESTORE-ASKING commands over a dedicated connection, and only
+ * deleted locally once the target acknowledged them. Writes hitting a key
+ * while its batch is in flight mark it as dirty so that it is sent again. */
+typedef struct clusterSlotMigration {
+    int slot;
+    char target[CLUSTER_NAMELEN]; /* Name of the node importing the slot. */
+    int state;                  /* CLUSTER_MIGRATESLOT_* */
+    int fd;                     /* Connection with the target, or -1. */
+    long long timeout;          /* I/O timeout in milliseconds. */
+    mstime_t start_time;
+    mstime_t end_time;          /* When the migration completed or failed. */
+    mstime_t last_io_time;      /* Last time the target made progress. */
+    sds outbuf;                 /* Batch protocol not yet written. */
+    size_t outpos;
+    sds inbuf;                  /* Replies not yet parsed. */
+    clusterSlotMigrationCmd *batch; /* Commands waiting for replies. */
+    int batch_len;
+    int batch_pos;              /* First command still waiting replies. */
+    dict *inflight;             /* Keys of the batch, value is dirty flag. */
+    dict *resend;               /* Keys written while in flight. */
+    long long keys_migrated;
+    long long bytes_sent;
+    long long batches;
+    sds error;                  /* Reason of the failure, if any. */
+} clusterSlotMigration;
+
 typedef struct clusterState {
     /**
      * 指向当前节点的指针
@@ -234,8 +289,9 @@ typedef struct clusterState {
      * 如果 slots[i] 指针指向了 null，那么标识该槽未指派给任何节点。
      */
     clusterNode *slots[CLUSTER_SLOTS];
-    uint64_t slots_keys_count[CLUSTER_SLOTS];
-    rax *slots_to_keys;
+    /* Keys of every slot, NULL for empty slots. The dicts reference the
+     * key names of the main dictionary of DB 0, they don't own them. */
+    dict **slots_to_keys;
     /* The following fields are used to take the slave state on elections. */
     mstime_t failover_auth_time; /* Time of previous or next election. */
     int failover_auth_count;    /* Number of votes received so far. */
@@ -257,11 +313,22 @@ typedef struct clusterState {
     /* The followign fields are used by masters to take state on elections. */
     uint64_t lastVoteEpoch;     /* Epoch of the last vote granted. */
     int todo_before_sleep; /* Things to do in clusterBeforeSleep(). */
+    list *slot_migrations;  /* clusterSlotMigration of CLUSTER MIGRATESLOT. */
     /* Messages received and sent by type. */
     long long stats_bus_messages_sent[CLUSTERMSG_TYPE_COUNT];
     long long stats_bus_messages_received[CLUSTERMSG_TYPE_COUNT];
     long long stats_pfail_nodes;    /* Number of nodes in PFAIL status,
                                        excluding nodes without address. */
+    /* Bytes sent and received by type, and their rate per second. */
+    long long stats_bus_bytes_sent[CLUSTERMSG_TYPE_COUNT];
+    long long stats_bus_bytes_received[CLUSTERMSG_TYPE_COUNT];
+    long long stats_bus_bytes_sent_prev[CLUSTERMSG_TYPE_COUNT];
+    long long stats_bus_bytes_received_prev[CLUSTERMSG_TYPE_COUNT];
+    long long stats_bus_bytes_sent_rate[CLUSTERMSG_TYPE_COUNT];
+    long long stats_bus_bytes_received_rate[CLUSTERMSG_TYPE_COUNT];
+    mstime_t stats_bus_rate_time;   /* Time of the last rates update. */
+    long long stats_bus_compact_sent;     /* Compact PING/PONG sent. */
+    long long stats_bus_compact_received; /* Compact PING/PONG received. */
 } clusterState;
 
 /* Redis cluster messages header */
@@ -361,6 +428,7 @@ union clusterMsgData {
 };
 
 #define CLUSTER_PROTO_VER 1 /* Cluster bus protocol version. */
+#define CLUSTER_PROTO_VER_COMPACT 2 /* Compact PING/PONG, see clusterMsgCompact. */
 
 /**
  * 消息头信息
@@ -417,10 +485,51 @@ typedef struct {
 #define CLUSTERMSG_FLAG0_PAUSED (1<<0) /* Master paused for manual failover. */
 #define CLUSTERMSG_FLAG0_FORCEACK (1<<1) /* Give ACK to AUTH_REQUEST even if
                                             master is up. */
+#define CLUSTERMSG_FLAG0_COMPACT (1<<2) /* Sender accepts compact PING/PONG. */
+#define CLUSTERMSG_FLAG0_WANTFULL (1<<3) /* Sender wants our full header. */
+
+/* Compact PING / PONG, sent with the CLUSTER_PROTO_VER_COMPACT version only
+ * to nodes that advertised CLUSTERMSG_FLAG0_COMPACT. It is a clusterMsg
+ * without the 2k slots bitmap, replaced by a digest of it: the receiver
+ * uses its own view of the sender slots, and asks for a full message with
+ * CLUSTERMSG_FLAG0_WANTFULL if the digest does not match. Gossip entries
+ * only carry the node health, nodes unknown to the receiver are learned
+ * from the full messages sent every CLUSTER_COMPACT_FULL_EVERY. */
+typedef struct {
+    char nodename[CLUSTER_NAMELEN];
+    uint32_t pong_received;
+    uint16_t flags;
+    uint16_t notused1;
+} clusterMsgDataGossipCompact;
+
+typedef struct {
+    char sig[4];        /* Signature "RCmb" (Redis Cluster message bus). */
+    uint32_t totlen;    /* Total length of this message */
+    uint16_t ver;       /* CLUSTER_PROTO_VER_COMPACT */
+    uint16_t port;      /* TCP base port number. */
+    uint16_t type;      /* CLUSTERMSG_TYPE_PING or CLUSTERMSG_TYPE_PONG. */
+    uint16_t count;     /* Number of gossip entries. */
+    uint64_t currentEpoch;
+    uint64_t configEpoch;
+    uint64_t offset;
+    char sender[CLUSTER_NAMELEN];
+    uint64_t slots_digest; /* crc64 of the slots bitmap of the full header. */
+    char slaveof[CLUSTER_NAMELEN];
+    char myip[NET_IP_STR_LEN];
+    uint16_t cport;
+    uint16_t flags;
+    unsigned char state;
+    unsigned char mflags[3];
+    clusterMsgDataGossipCompact gossip[1];
+} clusterMsgCompact;
+
+#define CLUSTERMSG_COMPACT_MIN_LEN (offsetof(clusterMsgCompact,gossip))
 
 /* ---------------------- API exported outside cluster.c -------------------- */
 clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, int argc, int *hashslot, int *ask);
 int clusterRedirectBlockedClientIfNeeded(client *c);
 void clusterRedirectClient(client *c, clusterNode *n, int hashslot, int error_code);
+void clusterSlotMigrationKeyTouched(sds key);
+void clusterSlotMigrationFlushed(void);
 
 #endif /* __CLUSTER_H */
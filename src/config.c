@@ -20,9 +20,11 @@ configEnum maxmemory_policy_enum[] = {
     {"volatile-lfu", MAXMEMORY_VOLATILE_LFU},
     {"volatile-random",MAXMEMORY_VOLATILE_RANDOM},
     {"volatile-ttl",MAXMEMORY_VOLATILE_TTL},
+    {"volatile-tinylfu",MAXMEMORY_VOLATILE_TINYLFU},
     {"allkeys-lru",MAXMEMORY_ALLKEYS_LRU},
     {"allkeys-lfu",MAXMEMORY_ALLKEYS_LFU},
     {"allkeys-random",MAXMEMORY_ALLKEYS_RANDOM},
+    {"allkeys-tinylfu",MAXMEMORY_ALLKEYS_TINYLFU},
     {"noeviction",MAXMEMORY_NO_EVICTION},
     {NULL, 0}
 };
@@ -63,6 +65,13 @@ configEnum aof_fsync_enum[] = {
     {NULL, 0}
 };
 
+configEnum repl_diskless_load_enum[] = {
+    {"disabled", REPL_DISKLESS_LOAD_DISABLED},
+    {"on-empty-db", REPL_DISKLESS_LOAD_WHEN_DB_EMPTY},
+    {"swapdb", REPL_DISKLESS_LOAD_SWAPDB},
+    {NULL, 0}
+};
+
 /* Output buffer limits presets. */
 clientBufferLimitsConfig clientBufferLimitsDefaults[CLIENT_TYPE_OBUF_COUNT] = {
     {0, 0, 0}, /* normal */
@@ -338,6 +347,29 @@ void loadServerConfigFromString(char *config) {
                 err = "lfu-log-factor must be 0 or greater";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"maxmemory-eviction-watermark") && argc == 2) {
+            server.maxmemory_eviction_watermark = atoi(argv[1]);
+            if (server.maxmemory_eviction_watermark < 0 ||
+                server.maxmemory_eviction_watermark > 100)
+            {
+                err = "maxmemory-eviction-watermark must be between 0 and 100";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"intern-values-max-entries") && argc == 2) {
+            long long entries = memtoll(argv[1],NULL);
+            if (entries < 0) {
+                err = "intern-values-max-entries can't be negative";
+                goto loaderr;
+            }
+            server.intern_values_max_entries = entries;
+        } else if (!strcasecmp(argv[0],"intern-values-max-len") && argc == 2) {
+            server.intern_values_max_len = atoi(argv[1]);
+            if (server.intern_values_max_len < 1 ||
+                server.intern_values_max_len > 44)
+            {
+                err = "intern-values-max-len must be between 1 and 44";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lfu-decay-time") && argc == 2) {
             server.lfu_decay_time = atoi(argv[1]);
             if (server.lfu_decay_time < 0) {
@@ -375,6 +407,12 @@ void loadServerConfigFromString(char *config) {
                 err = "repl-diskless-sync-delay can't be negative";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"repl-diskless-sync-max-stall") && argc==2) {
+            server.repl_diskless_sync_max_stall = atoi(argv[1]);
+            if (server.repl_diskless_sync_max_stall < 0) {
+                err = "repl-diskless-sync-max-stall can't be negative";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"repl-backlog-size") && argc == 2) {
             long long size = memtoll(argv[1],NULL);
             if (size <= 0) {
@@ -423,10 +461,45 @@ void loadServerConfigFromString(char *config) {
             if ((server.lazyfree_lazy_server_del = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"repl-diskless-load") && argc==2) {
+            server.repl_diskless_load =
+                configEnumGetValue(repl_diskless_load_enum,argv[1]);
+            if (server.repl_diskless_load == INT_MIN) {
+                err = "argument must be 'disabled', 'on-empty-db' or 'swapdb'";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slave-lazy-flush") && argc == 2) {
             if ((server.repl_slave_lazy_flush = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"slave-io-thread") && argc == 2) {
+            if ((server.repl_slave_io_thread = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"active-expire-index") && argc == 2) {
+            if ((server.active_expire_index = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"memory-tracking") && argc == 2) {
+            if ((server.memory_tracking = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"memory-tracking-delimiters") && argc == 2) {
+            if (argv[1][0] == '\0') {
+                err = "memory-tracking-delimiters can't be empty"; goto loaderr;
+            }
+            zfree(server.memory_tracking_delimiters);
+            server.memory_tracking_delimiters = zstrdup(argv[1]);
+        } else if (!strcasecmp(argv[0],"numa-node") && argc == 2) {
+            server.numa_node = atoi(argv[1]);
+            if (server.numa_node < -1 || server.numa_node > 1023) {
+                err = "numa-node must be -1 or between 0 and 1023"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"hugepages-tables") && argc == 2) {
+            if ((server.hugepages_tables = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+            zmalloc_set_huge_pages(server.hugepages_tables);
         } else if (!strcasecmp(argv[0],"activedefrag") && argc == 2) {
             if ((server.active_defrag_enabled = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -663,8 +736,22 @@ void loadServerConfigFromString(char *config) {
                 err = "argument must be 'yes' or 'no'";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"cluster-compact-bus") && argc == 2) {
+            server.cluster_compact_bus = yesnotoi(argv[1]);
+            if (server.cluster_compact_bus == -1) {
+                err = "argument must be 'yes' or 'no'";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lua-time-limit") && argc == 2) {
             server.lua_time_limit = strtoll(argv[1],NULL,10);
+        } else if (!strcasecmp(argv[0],"sort-async-min-elements") &&
+                   argc == 2)
+        {
+            server.sort_async_min_elements = strtoll(argv[1],NULL,10);
+            if (server.sort_async_min_elements < 0) {
+                err = "sort-async-min-elements can't be negative";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slowlog-log-slower-than") &&
                    argc == 2)
         {
@@ -928,6 +1015,34 @@ void configSetCommand(client *c) {
                 return;
             }
         }
+    } config_set_special_field("active-expire-index") {
+        int enable = yesnotoi(o->ptr);
+
+        if (enable == -1) goto badfmt;
+        if (enable) expireIndexEnable();
+        else expireIndexDisable();
+    } config_set_special_field("memory-tracking") {
+        int enable = yesnotoi(o->ptr);
+
+        if (enable == -1) goto badfmt;
+        server.memory_tracking = enable;
+        if (enable) memTrackEnable();
+        else memTrackDisable();
+    } config_set_special_field("memory-tracking-delimiters") {
+        if (sdslen(o->ptr) == 0) goto badfmt;
+        zfree(server.memory_tracking_delimiters);
+        server.memory_tracking_delimiters = zstrdup(o->ptr);
+        /* The prefixes change: account again all the keys. */
+        if (server.memory_tracking) {
+            memTrackDisable();
+            memTrackEnable();
+        }
+    } config_set_special_field("hugepages-tables") {
+        int enable = yesnotoi(o->ptr);
+
+        if (enable == -1) goto badfmt;
+        server.hugepages_tables = enable;
+        zmalloc_set_huge_pages(enable);
     } config_set_special_field("save") {
         int vlen, j;
         sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
@@ -1034,6 +1149,8 @@ void configSetCommand(client *c) {
       "cluster-require-full-coverage",server.cluster_require_full_coverage) {
     } config_set_bool_field(
       "cluster-slave-no-failover",server.cluster_slave_no_failover) {
+    } config_set_bool_field(
+      "cluster-compact-bus",server.cluster_compact_bus) {
     } config_set_bool_field(
       "aof-rewrite-incremental-fsync",server.aof_rewrite_incremental_fsync) {
     } config_set_bool_field(
@@ -1073,6 +1190,8 @@ void configSetCommand(client *c) {
       "lazyfree-lazy-server-del",server.lazyfree_lazy_server_del) {
     } config_set_bool_field(
       "slave-lazy-flush",server.repl_slave_lazy_flush) {
+    } config_set_bool_field(
+      "slave-io-thread",server.repl_slave_io_thread) {
     } config_set_bool_field(
       "no-appendfsync-on-rewrite",server.aof_no_fsync_on_rewrite) {
 
@@ -1084,6 +1203,12 @@ void configSetCommand(client *c) {
       "maxmemory-samples",server.maxmemory_samples,1,INT_MAX) {
     } config_set_numerical_field(
       "lfu-log-factor",server.lfu_log_factor,0,INT_MAX) {
+    } config_set_numerical_field(
+      "maxmemory-eviction-watermark",server.maxmemory_eviction_watermark,0,100) {
+    } config_set_numerical_field(
+      "intern-values-max-entries",server.intern_values_max_entries,0,LONG_MAX) {
+    } config_set_numerical_field(
+      "intern-values-max-len",server.intern_values_max_len,1,44) {
     } config_set_numerical_field(
       "lfu-decay-time",server.lfu_decay_time,0,INT_MAX) {
     } config_set_numerical_field(
@@ -1124,6 +1249,8 @@ void configSetCommand(client *c) {
       "hll-sparse-max-bytes",server.hll_sparse_max_bytes,0,LONG_MAX) {
     } config_set_numerical_field(
       "lua-time-limit",server.lua_time_limit,0,LONG_MAX) {
+    } config_set_numerical_field(
+      "sort-async-min-elements",server.sort_async_min_elements,0,LLONG_MAX) {
     } config_set_numerical_field(
       "slowlog-log-slower-than",server.slowlog_log_slower_than,0,LLONG_MAX) {
     } config_set_numerical_field(
@@ -1140,6 +1267,8 @@ void configSetCommand(client *c) {
       "repl-backlog-ttl",server.repl_backlog_time_limit,0,LONG_MAX) {
     } config_set_numerical_field(
       "repl-diskless-sync-delay",server.repl_diskless_sync_delay,0,INT_MAX) {
+    } config_set_numerical_field(
+      "repl-diskless-sync-max-stall",server.repl_diskless_sync_max_stall,0,INT_MAX) {
     } config_set_numerical_field(
       "slave-priority",server.slave_priority,0,INT_MAX) {
     } config_set_numerical_field(
@@ -1197,8 +1326,11 @@ void configSetCommand(client *c) {
       "loglevel",server.verbosity,loglevel_enum) {
     } config_set_enum_field(
       "maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum) {
+        evictionPoolEmpty();
     } config_set_enum_field(
       "appendfsync",server.aof_fsync,aof_fsync_enum) {
+    } config_set_enum_field(
+      "repl-diskless-load",server.repl_diskless_load,repl_diskless_load_enum) {
 
     /* Everyhing else is an error... */
     } config_set_else {
@@ -1271,6 +1403,7 @@ void configGetCommand(client *c) {
     config_get_string_field("logfile",server.logfile);
     config_get_string_field("pidfile",server.pidfile);
     config_get_string_field("slave-announce-ip",server.slave_announce_ip);
+    config_get_string_field("memory-tracking-delimiters",server.memory_tracking_delimiters);
 
     /* Numerical values */
     config_get_numerical_field("maxmemory",server.maxmemory);
@@ -1279,6 +1412,10 @@ void configGetCommand(client *c) {
     config_get_numerical_field("maxmemory-samples",server.maxmemory_samples);
     config_get_numerical_field("lfu-log-factor",server.lfu_log_factor);
     config_get_numerical_field("lfu-decay-time",server.lfu_decay_time);
+    config_get_numerical_field("maxmemory-eviction-watermark",server.maxmemory_eviction_watermark);
+    config_get_numerical_field("intern-values-max-entries",server.intern_values_max_entries);
+    config_get_numerical_field("intern-values-max-len",server.intern_values_max_len);
+    config_get_numerical_field("numa-node",server.numa_node);
     config_get_numerical_field("timeout",server.maxidletime);
     config_get_numerical_field("active-defrag-threshold-lower",server.active_defrag_threshold_lower);
     config_get_numerical_field("active-defrag-threshold-upper",server.active_defrag_threshold_upper);
@@ -1311,6 +1448,7 @@ void configGetCommand(client *c) {
     config_get_numerical_field("hll-sparse-max-bytes",
             server.hll_sparse_max_bytes);
     config_get_numerical_field("lua-time-limit",server.lua_time_limit);
+    config_get_numerical_field("sort-async-min-elements",server.sort_async_min_elements);
     config_get_numerical_field("slowlog-log-slower-than",
             server.slowlog_log_slower_than);
     config_get_numerical_field("latency-monitor-threshold",
@@ -1337,6 +1475,7 @@ void configGetCommand(client *c) {
     config_get_numerical_field("cluster-migration-barrier",server.cluster_migration_barrier);
     config_get_numerical_field("cluster-slave-validity-factor",server.cluster_slave_validity_factor);
     config_get_numerical_field("repl-diskless-sync-delay",server.repl_diskless_sync_delay);
+    config_get_numerical_field("repl-diskless-sync-max-stall",server.repl_diskless_sync_max_stall);
     config_get_numerical_field("tcp-keepalive",server.tcpkeepalive);
 
     /* Bool (yes/no) values */
@@ -1344,6 +1483,8 @@ void configGetCommand(client *c) {
             server.cluster_require_full_coverage);
     config_get_bool_field("cluster-slave-no-failover",
             server.cluster_slave_no_failover);
+    config_get_bool_field("cluster-compact-bus",
+            server.cluster_compact_bus);
     config_get_bool_field("no-appendfsync-on-rewrite",
             server.aof_no_fsync_on_rewrite);
     config_get_bool_field("slave-serve-stale-data",
@@ -1357,6 +1498,9 @@ void configGetCommand(client *c) {
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
     config_get_bool_field("activedefrag", server.active_defrag_enabled);
+    config_get_bool_field("active-expire-index", server.active_expire_index);
+    config_get_bool_field("memory-tracking", server.memory_tracking);
+    config_get_bool_field("hugepages-tables", server.hugepages_tables);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
@@ -1378,6 +1522,8 @@ void configGetCommand(client *c) {
             server.lazyfree_lazy_server_del);
     config_get_bool_field("slave-lazy-flush",
             server.repl_slave_lazy_flush);
+    config_get_bool_field("slave-io-thread",
+            server.repl_slave_io_thread);
 
     /* Enum values */
     config_get_enum_field("maxmemory-policy",
@@ -1388,6 +1534,8 @@ void configGetCommand(client *c) {
             server.supervised_mode,supervised_mode_enum);
     config_get_enum_field("appendfsync",
             server.aof_fsync,aof_fsync_enum);
+    config_get_enum_field("repl-diskless-load",
+            server.repl_diskless_load,repl_diskless_load_enum);
     config_get_enum_field("syslog-facility",
             server.syslog_facility,syslog_facility_enum);
 
@@ -2051,6 +2199,8 @@ int rewriteConfig(char *path) {
     rewriteConfigYesNoOption(state,"repl-disable-tcp-nodelay",server.repl_disable_tcp_nodelay,CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY);
     rewriteConfigYesNoOption(state,"repl-diskless-sync",server.repl_diskless_sync,CONFIG_DEFAULT_REPL_DISKLESS_SYNC);
     rewriteConfigNumericalOption(state,"repl-diskless-sync-delay",server.repl_diskless_sync_delay,CONFIG_DEFAULT_REPL_DISKLESS_SYNC_DELAY);
+    rewriteConfigNumericalOption(state,"repl-diskless-sync-max-stall",server.repl_diskless_sync_max_stall,CONFIG_DEFAULT_REPL_DISKLESS_SYNC_MAX_STALL);
+    rewriteConfigEnumOption(state,"repl-diskless-load",server.repl_diskless_load,repl_diskless_load_enum,CONFIG_DEFAULT_REPL_DISKLESS_LOAD);
     rewriteConfigNumericalOption(state,"slave-priority",server.slave_priority,CONFIG_DEFAULT_SLAVE_PRIORITY);
     rewriteConfigNumericalOption(state,"min-slaves-to-write",server.repl_min_slaves_to_write,CONFIG_DEFAULT_MIN_SLAVES_TO_WRITE);
     rewriteConfigNumericalOption(state,"min-slaves-max-lag",server.repl_min_slaves_max_lag,CONFIG_DEFAULT_MIN_SLAVES_MAX_LAG);
@@ -2063,6 +2213,9 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,CONFIG_DEFAULT_MAXMEMORY_SAMPLES);
     rewriteConfigNumericalOption(state,"lfu-log-factor",server.lfu_log_factor,CONFIG_DEFAULT_LFU_LOG_FACTOR);
     rewriteConfigNumericalOption(state,"lfu-decay-time",server.lfu_decay_time,CONFIG_DEFAULT_LFU_DECAY_TIME);
+    rewriteConfigNumericalOption(state,"maxmemory-eviction-watermark",server.maxmemory_eviction_watermark,CONFIG_DEFAULT_MAXMEMORY_EVICTION_WATERMARK);
+    rewriteConfigNumericalOption(state,"intern-values-max-entries",server.intern_values_max_entries,CONFIG_DEFAULT_INTERN_VALUES_MAX_ENTRIES);
+    rewriteConfigNumericalOption(state,"intern-values-max-len",server.intern_values_max_len,CONFIG_DEFAULT_INTERN_VALUES_MAX_LEN);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-lower",server.active_defrag_threshold_lower,CONFIG_DEFAULT_DEFRAG_THRESHOLD_LOWER);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-upper",server.active_defrag_threshold_upper,CONFIG_DEFAULT_DEFRAG_THRESHOLD_UPPER);
     rewriteConfigBytesOption(state,"active-defrag-ignore-bytes",server.active_defrag_ignore_bytes,CONFIG_DEFAULT_DEFRAG_IGNORE_BYTES);
@@ -2076,10 +2229,12 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"auto-aof-rewrite-percentage",server.aof_rewrite_perc,AOF_REWRITE_PERC);
     rewriteConfigBytesOption(state,"auto-aof-rewrite-min-size",server.aof_rewrite_min_size,AOF_REWRITE_MIN_SIZE);
     rewriteConfigNumericalOption(state,"lua-time-limit",server.lua_time_limit,LUA_SCRIPT_TIME_LIMIT);
+    rewriteConfigNumericalOption(state,"sort-async-min-elements",server.sort_async_min_elements,CONFIG_DEFAULT_SORT_ASYNC_MIN_ELEMENTS);
     rewriteConfigYesNoOption(state,"cluster-enabled",server.cluster_enabled,0);
     rewriteConfigStringOption(state,"cluster-config-file",server.cluster_configfile,CONFIG_DEFAULT_CLUSTER_CONFIG_FILE);
     rewriteConfigYesNoOption(state,"cluster-require-full-coverage",server.cluster_require_full_coverage,CLUSTER_DEFAULT_REQUIRE_FULL_COVERAGE);
     rewriteConfigYesNoOption(state,"cluster-slave-no-failover",server.cluster_slave_no_failover,CLUSTER_DEFAULT_SLAVE_NO_FAILOVER);
+    rewriteConfigYesNoOption(state,"cluster-compact-bus",server.cluster_compact_bus,CLUSTER_DEFAULT_COMPACT_BUS);
     rewriteConfigNumericalOption(state,"cluster-node-timeout",server.cluster_node_timeout,CLUSTER_DEFAULT_NODE_TIMEOUT);
     rewriteConfigNumericalOption(state,"cluster-migration-barrier",server.cluster_migration_barrier,CLUSTER_DEFAULT_MIGRATION_BARRIER);
     rewriteConfigNumericalOption(state,"cluster-slave-validity-factor",server.cluster_slave_validity_factor,CLUSTER_DEFAULT_SLAVE_VALIDITY);
@@ -2099,6 +2254,11 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
     rewriteConfigYesNoOption(state,"activedefrag",server.active_defrag_enabled,CONFIG_DEFAULT_ACTIVE_DEFRAG);
+    rewriteConfigYesNoOption(state,"active-expire-index",server.active_expire_index,CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX);
+    rewriteConfigYesNoOption(state,"memory-tracking",server.memory_tracking,CONFIG_DEFAULT_MEMORY_TRACKING);
+    rewriteConfigStringOption(state,"memory-tracking-delimiters",server.memory_tracking_delimiters,CONFIG_DEFAULT_MEMORY_TRACKING_DELIMITERS);
+    rewriteConfigNumericalOption(state,"numa-node",server.numa_node,CONFIG_DEFAULT_NUMA_NODE);
+    rewriteConfigYesNoOption(state,"hugepages-tables",server.hugepages_tables,CONFIG_DEFAULT_HUGEPAGES_TABLES);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,CONFIG_DEFAULT_HZ);
@@ -2111,6 +2271,7 @@ int rewriteConfig(char *path) {
     rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
     rewriteConfigYesNoOption(state,"slave-lazy-flush",server.repl_slave_lazy_flush,CONFIG_DEFAULT_SLAVE_LAZY_FLUSH);
+    rewriteConfigYesNoOption(state,"slave-io-thread",server.repl_slave_io_thread,CONFIG_DEFAULT_SLAVE_IO_THREAD);
 
     /* Rewrite Sentinel config if in Sentinel mode. */
     if (server.sentinel_mode) rewriteConfigSentinelOption(state);
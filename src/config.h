@@ -53,6 +53,7 @@
 #define HAVE_PROC_STAT 1
 #define HAVE_PROC_MAPS 1
 #define HAVE_PROC_SMAPS 1
+#define HAVE_PROC_NUMA_MAPS 1
 #define HAVE_PROC_SOMAXCONN 1
 #endif
 
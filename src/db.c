@@ -66,6 +66,10 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
     if (de) {
         robj *val = dictGetVal(de);
 
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU &&
+            !(flags & LOOKUP_NOTOUCH))
+            evictionSketchRecord(key->ptr);
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
@@ -134,11 +138,18 @@ robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags) {
             return NULL;
         }
     }
+    if (dictSize(db->hexpires)) hashExpireFieldsIfNeeded(db, key);
     val = lookupKey(db, key, flags);
-    if (val == NULL)
+    if (val == NULL) {
+        /* TinyLFU also counts the misses, so that a popular key that was
+         * evicted is recognized as such when it is added again. */
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU &&
+            !(flags & LOOKUP_NOTOUCH))
+            evictionSketchRecord(key->ptr);
         server.stat_keyspace_misses++;
-    else
+    } else {
         server.stat_keyspace_hits++;
+    }
     return val;
 }
 
@@ -155,6 +166,7 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  * does not exist in the specified DB. */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
     expireIfNeeded(db, key);
+    if (dictSize(db->hexpires)) hashExpireFieldsIfNeeded(db, key);
     return lookupKey(db, key, LOOKUP_NONE);
 }
 
@@ -191,7 +203,13 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
         val->type == OBJ_ZSET)
         signalKeyAsReady(db, key);
     // 如果开启了集群，则往 slot 里面也要添加 key
-    if (server.cluster_enabled) slotToKeyAdd(key);
+    if (server.cluster_enabled) slotToKeyAdd(copy);
+    /* With volatile-tinylfu the key can't be evicted until it gets a TTL:
+     * it is offered by setExpire() instead. */
+    if ((server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU) &&
+        (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS))
+        evictionPoolOfferKey(db->id, copy, val);
+    memTrackKey(db, copy, val);
 }
 
 /*
@@ -207,6 +225,8 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict, key->ptr);
 
     serverAssertWithInfo(NULL, key, de != NULL);
+    /* The fields of the old value are gone with their expire times. */
+    hashFieldExpiresDelKey(db, key->ptr);
     if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
         robj *old = dictGetVal(de);
         int saved_lru = old->lru;
@@ -215,6 +235,7 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     } else {
         dictReplace(db->dict, key->ptr, val);
     }
+    memTrackKey(db, dictGetKey(de), val);
 }
 
 /*
@@ -295,9 +316,17 @@ robj *dbRandomKey(redisDb *db) {
 int dbSyncDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires, key->ptr);
-    if (dictDelete(db->dict, key->ptr) == DICT_OK) {
-        if (server.cluster_enabled) slotToKeyDel(key);
+    if (dictSize(db->expires) > 0) {
+        expireIndexDel(db, key->ptr);
+        dictDelete(db->expires, key->ptr);
+    }
+    hashFieldExpiresDelKey(db, key->ptr);
+    dictEntry *de = dictUnlink(db->dict, key->ptr);
+    if (de) {
+        /* The slot dict references the key name: unlink it first. */
+        if (server.cluster_enabled) slotToKeyDel(dictGetKey(de));
+        memTrackDel(db, dictGetKey(de));
+        dictFreeUnlinkedEntry(db->dict, de);
         return 1;
     } else {
         return 0;
@@ -380,6 +409,9 @@ long long emptyDb(int dbnum, int flags, void(callback)(void *)) {
         } else {
             dictEmpty(server.db[j].dict, callback);
             dictEmpty(server.db[j].expires, callback);
+            dictEmpty(server.db[j].hexpires, callback);
+            expireIndexFlush(&server.db[j]);
+            memTrackFlush(&server.db[j]);
         }
     }
     if (server.cluster_enabled) {
@@ -393,6 +425,79 @@ long long emptyDb(int dbnum, int flags, void(callback)(void *)) {
     return removed;
 }
 
+/* Create an array of server.dbnum empty databases, used by the replicas in
+ * order to load the dataset received by the master while the old one is
+ * still served from server.db. */
+redisDb *createTempDbs(void) {
+    redisDb *dbs = zmalloc(sizeof(redisDb) * server.dbnum);
+    for (int j = 0; j < server.dbnum; j++) {
+        dbs[j].dict = dictCreate(&dbDictType, NULL);
+        dbs[j].expires = dictCreate(&keyptrDictType, NULL);
+        dbs[j].expires_index = NULL;
+        dbs[j].hexpires = dictCreate(&hashFieldExpiresDictType, NULL);
+        dbs[j].memstats = server.memory_tracking ? memTrackCreate() : NULL;
+        dbs[j].blocking_keys = dictCreate(&keylistDictType, NULL);
+        dbs[j].ready_keys = dictCreate(&objectKeyPointerValueDictType, NULL);
+        dbs[j].watched_keys = dictCreate(&keylistDictType, NULL);
+        dbs[j].id = j;
+        dbs[j].avg_ttl = 0;
+        dbs[j].defrag_later = listCreate();
+    }
+    return dbs;
+}
+
+/* Exchange the keys of server.db with the ones of the temp databases 'dbs'.
+ * Clients blocked or watching keys stay attached to server.db, and are
+ * signaled like after a FLUSHALL. After the call 'dbs' holds the old
+ * dataset, that the caller usually releases with discardTempDbs(). */
+void swapTempDbs(redisDb *dbs) {
+    signalFlushedDb(-1);
+    for (int j = 0; j < server.dbnum; j++) {
+        dict *d = server.db[j].dict, *e = server.db[j].expires;
+        dict *he = server.db[j].hexpires;
+        rax *ei = server.db[j].expires_index;
+        dbMemStats *ms = server.db[j].memstats;
+        long long avg_ttl = server.db[j].avg_ttl;
+
+        server.db[j].dict = dbs[j].dict;
+        server.db[j].expires = dbs[j].expires;
+        server.db[j].expires_index = dbs[j].expires_index;
+        server.db[j].hexpires = dbs[j].hexpires;
+        server.db[j].memstats = dbs[j].memstats;
+        server.db[j].avg_ttl = dbs[j].avg_ttl;
+        dbs[j].dict = d;
+        dbs[j].expires = e;
+        dbs[j].expires_index = ei;
+        dbs[j].hexpires = he;
+        dbs[j].memstats = ms;
+        dbs[j].avg_ttl = avg_ttl;
+    }
+    /* memory-tracking may have been toggled while loading. */
+    if (server.memory_tracking)
+        memTrackEnable();
+    else
+        memTrackDisable();
+    flushSlaveKeysWithExpireList();
+}
+
+/* Release the temp databases created by createTempDbs() with their keys.
+ * If 'flags' is EMPTYDB_ASYNC the keys are freed by a background thread. */
+void discardTempDbs(redisDb *dbs, int flags) {
+    for (int j = 0; j < server.dbnum; j++) {
+        if (flags & EMPTYDB_ASYNC) emptyDbAsync(&dbs[j]);
+        dictRelease(dbs[j].dict);
+        dictRelease(dbs[j].expires);
+        dictRelease(dbs[j].hexpires);
+        expireIndexFlush(&dbs[j]);
+        memTrackRelease(dbs[j].memstats);
+        dictRelease(dbs[j].blocking_keys);
+        dictRelease(dbs[j].ready_keys);
+        dictRelease(dbs[j].watched_keys);
+        listRelease(dbs[j].defrag_later);
+    }
+    zfree(dbs);
+}
+
 int selectDb(client *c, int id) {
     if (id < 0 || id >= server.dbnum)
         return C_ERR;
@@ -411,6 +516,10 @@ int selectDb(client *c, int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db, key);
+    if (server.cluster_enabled && sdsEncodedObject(key))
+        clusterSlotMigrationKeyTouched(key->ptr);
+    if (db->memstats && sdsEncodedObject(key))
+        memTrackKeyByName(db, key->ptr);
 }
 
 void signalFlushedDb(int dbid) {
@@ -654,6 +763,8 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     sds pat = NULL;
     int patlen = 0, use_pattern = 0;
     dict *ht;
+    hashFieldExpires *hfe = NULL;
+    long long now = 0;
 
     /* Object must be NULL (to iterate keys names), or the type of the object
      * must be Set, Sorted Set, or Hash. */
@@ -760,6 +871,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     }
 
     /* Step 3: Filter elements. */
+    if (o && o->type == OBJ_HASH) hfe = hashFieldExpiresDue(c->db, c->argv[1], &now);
     node = listFirst(keys);
     while (node) {
         robj *kobj = listNodeValue(node);
@@ -784,6 +896,14 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
         /* Filter element if it is an expired key. */
         if (!filter && o == NULL && expireIfNeeded(c->db, kobj)) filter = 1;
 
+        /* Filter element if it is a hash field that expired, but that the
+         * master did not delete yet. */
+        if (!filter && hfe) {
+            robj *field = getDecodedObject(kobj);
+            if (hashFieldIsDue(hfe, field->ptr, now)) filter = 1;
+            decrRefCount(field);
+        }
+
         /* Remove the element and its associted value if needed. */
         if (filter) {
             decrRefCount(kobj);
@@ -908,6 +1028,7 @@ void shutdownCommand(client *c) {
 void renameGenericCommand(client *c, int nx) {
     robj *o;
     long long expire;
+    hashFieldExpires *hfe;
     int samekey = 0;
 
     /* When source and dest key is the same, no operation is performed,
@@ -934,8 +1055,11 @@ void renameGenericCommand(client *c, int nx) {
          * with the same name. */
         dbDelete(c->db, c->argv[2]);
     }
+    /* The hash fields expire times move with the key. */
+    hfe = hashFieldExpiresUnlink(c->db, c->argv[1]);
     dbAdd(c->db, c->argv[2], o);
     if (expire != -1) setExpire(c, c->db, c->argv[2], expire);
+    hashFieldExpiresLink(c->db, c->argv[2], hfe);
     dbDelete(c->db, c->argv[1]);
     signalModifiedKey(c->db, c->argv[1]);
     signalModifiedKey(c->db, c->argv[2]);
@@ -960,6 +1084,7 @@ void moveCommand(client *c) {
     redisDb *src, *dst;
     int srcid;
     long long dbid, expire;
+    hashFieldExpires *hfe;
 
     if (server.cluster_enabled) {
         addReplyError(c, "MOVE is not allowed in cluster mode");
@@ -999,8 +1124,10 @@ void moveCommand(client *c) {
         addReply(c, shared.czero);
         return;
     }
+    hfe = hashFieldExpiresUnlink(src, c->argv[1]);
     dbAdd(dst, c->argv[1], o);
     if (expire != -1) setExpire(c, dst, c->argv[1], expire);
+    hashFieldExpiresLink(dst, c->argv[1], hfe);
     incrRefCount(o);
 
     /* OK! key moved, free the entry in the source DB */
@@ -1048,10 +1175,16 @@ int dbSwapDatabases(int id1, int id2) {
      * remain in the same DB they were. */
     db1->dict = db2->dict;
     db1->expires = db2->expires;
+    db1->expires_index = db2->expires_index;
+    db1->hexpires = db2->hexpires;
+    db1->memstats = db2->memstats;
     db1->avg_ttl = db2->avg_ttl;
 
     db2->dict = aux.dict;
     db2->expires = aux.expires;
+    db2->expires_index = aux.expires_index;
+    db2->hexpires = aux.hexpires;
+    db2->memstats = aux.memstats;
     db2->avg_ttl = aux.avg_ttl;
 
     /* Now we need to handle clients blocked on lists: as an effect
@@ -1105,6 +1238,7 @@ int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
     serverAssertWithInfo(NULL, key, dictFind(db->dict, key->ptr) != NULL);
+    expireIndexDel(db, key->ptr);
     return dictDelete(db->expires, key->ptr) == DICT_OK;
 }
 
@@ -1124,9 +1258,18 @@ void setExpire(client *c, redisDb *db, robj *key, long long when) {
     kde = dictFind(db->dict, key->ptr);
     serverAssertWithInfo(NULL, key, kde != NULL);
     // 将该 key 添加到过期 dict 字典当中去
+    expireIndexDel(db, key->ptr);
+    unsigned long volatile_keys = dictSize(db->expires);
     de = dictAddOrFind(db->expires, dictGetKey(kde));
     // 设置 value 和 过期时间
     dictSetSignedIntegerVal(de, when);
+    expireIndexAdd(db, dictGetKey(kde), when);
+
+    /* A key that just became volatile is a new eviction candidate for
+     * volatile-tinylfu, see dbAdd(). */
+    if (server.maxmemory_policy == MAXMEMORY_VOLATILE_TINYLFU &&
+        dictSize(db->expires) != volatile_keys)
+        evictionPoolOfferKey(db->id, dictGetKey(kde), dictGetVal(kde));
 
     int writable_slave = server.masterhost && server.repl_slave_ro == 0;
     if (c && writable_slave && !(c->flags & CLIENT_MASTER))
@@ -1497,84 +1640,96 @@ int *xreadGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys)
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
  * while rehashing the cluster and in other conditions when we need to
- * understand if we have keys for a given hash slot. */
-void slotToKeyUpdateKey(robj *key, int add) {
-    unsigned int hashslot = keyHashSlot(key->ptr, sdslen(key->ptr));
-    unsigned char buf[64];
-    unsigned char *indexed = buf;
-    size_t keylen = sdslen(key->ptr);
-
-    server.cluster->slots_keys_count[hashslot] += add ? 1 : -1;
-    if (keylen + 2 > 64) indexed = zmalloc(keylen + 2);
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    memcpy(indexed + 2, key->ptr, keylen);
-    if (add) {
-        raxInsert(server.cluster->slots_to_keys, indexed, keylen + 2, NULL, NULL);
-    } else {
-        raxRemove(server.cluster->slots_to_keys, indexed, keylen + 2, NULL);
+ * understand if we have keys for a given hash slot.
+ *
+ * Every slot has its own dict, created with the first key of the slot and
+ * released with the last one. The dicts reference the sds key names owned
+ * by the main dictionary, so a key must be removed from here before its
+ * name is released. */
+void slotToKeyAdd(sds key) {
+    unsigned int hashslot = keyHashSlot(key, sdslen(key));
+    dict **d = &server.cluster->slots_to_keys[hashslot];
+
+    if (*d == NULL) *d = dictCreate(&keyptrDictType, NULL);
+    serverAssert(dictAdd(*d, key, NULL) == DICT_OK);
+    clusterSlotMigrationKeyTouched(key);
+}
+
+void slotToKeyDel(sds key) {
+    unsigned int hashslot = keyHashSlot(key, sdslen(key));
+    dict **d = &server.cluster->slots_to_keys[hashslot];
+
+    clusterSlotMigrationKeyTouched(key);
+    if (*d == NULL || dictDelete(*d, key) != DICT_OK) return;
+    if (dictSize(*d) == 0) {
+        dictRelease(*d);
+        *d = NULL;
+    } else if (htNeedsResize(*d)) {
+        dictResize(*d);
     }
-    if (indexed != buf) zfree(indexed);
 }
 
-void slotToKeyAdd(robj *key) {
-    slotToKeyUpdateKey(key, 1);
+void slotToKeyFlush(void) {
+    clusterSlotMigrationFlushed();
+    for (int j = 0; j < CLUSTER_SLOTS; j++) {
+        if (server.cluster->slots_to_keys[j] == NULL) continue;
+        dictRelease(server.cluster->slots_to_keys[j]);
+        server.cluster->slots_to_keys[j] = NULL;
+    }
 }
 
-void slotToKeyDel(robj *key) {
-    slotToKeyUpdateKey(key, 0);
-}
+/* Update the key name referenced by the slot dict after the main dict key
+ * was reallocated by the active defragmentation. 'oldkey' may be a dead
+ * pointer and is not accessed, 'hash' is its hash. */
+void slotToKeyReplaceKeyPtr(sds oldkey, sds newkey, uint64_t hash) {
+    unsigned int hashslot = keyHashSlot(newkey, sdslen(newkey));
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictEntry **deref;
 
-void slotToKeyFlush(void) {
-    raxFree(server.cluster->slots_to_keys);
-    server.cluster->slots_to_keys = raxNew();
-    memset(server.cluster->slots_keys_count, 0,
-           sizeof(server.cluster->slots_keys_count));
+    if (d && (deref = dictFindEntryRefByPtrAndHash(d, oldkey, hash)) != NULL)
+        (*deref)->key = newkey;
 }
 
 /* Pupulate the specified array of objects with keys in the specified slot.
  * New objects are returned to represent keys, it's up to the caller to
  * decrement the reference count to release the keys names. */
 unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count) {
-    raxIterator iter;
-    int j = 0;
-    unsigned char indexed[2];
-
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    raxStart(&iter, server.cluster->slots_to_keys);
-    raxSeek(&iter, ">=", indexed, 2);
-    while (count-- && raxNext(&iter)) {
-        if (iter.key[0] != indexed[0] || iter.key[1] != indexed[1]) break;
-        keys[j++] = createStringObject((char *) iter.key + 2, iter.key_len - 2);
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
+    unsigned int j = 0;
+
+    if (d == NULL) return 0;
+    di = dictGetIterator(d);
+    while (j < count && (de = dictNext(di)) != NULL) {
+        sds key = dictGetKey(de);
+        keys[j++] = createStringObject(key, sdslen(key));
     }
-    raxStop(&iter);
+    dictReleaseIterator(di);
     return j;
 }
 
 /* Remove all the keys in the specified hash slot.
  * The number of removed items is returned. */
 unsigned int delKeysInSlot(unsigned int hashslot) {
-    raxIterator iter;
     int j = 0;
-    unsigned char indexed[2];
 
-    indexed[0] = (hashslot >> 8) & 0xff;
-    indexed[1] = hashslot & 0xff;
-    raxStart(&iter, server.cluster->slots_to_keys);
-    while (server.cluster->slots_keys_count[hashslot]) {
-        raxSeek(&iter, ">=", indexed, 2);
-        raxNext(&iter);
+    while (server.cluster->slots_to_keys[hashslot]) {
+        dict *d = server.cluster->slots_to_keys[hashslot];
+        dictIterator *di = dictGetIterator(d);
+        dictEntry *de = dictNext(di);
+        sds name = dictGetKey(de);
+        robj *key = createStringObject(name, sdslen(name));
 
-        robj *key = createStringObject((char *) iter.key + 2, iter.key_len - 2);
+        dictReleaseIterator(di);
         dbDelete(&server.db[0], key);
         decrRefCount(key);
         j++;
     }
-    raxStop(&iter);
     return j;
 }
 
 unsigned int countKeysInSlot(unsigned int hashslot) {
-    return server.cluster->slots_keys_count[hashslot];
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    return d ? dictSize(d) : 0;
 }
@@ -35,6 +35,7 @@
  */
 
 #include "server.h"
+#include "bio.h"
 #include <time.h>
 #include <assert.h>
 #include <stddef.h>
@@ -49,6 +50,109 @@ int je_get_defrag_hint(void* ptr, int *bin_util, int *run_util);
 void defragDictBucketCallback(void *privdata, dictEntry **bucketref);
 dictEntry* replaceSateliteDictKeyPtrAndOrDefragDictEntry(dict *d, sds oldkey, sds newkey, unsigned int hash, long *defragged);
 
+/* The defrag plan: which jemalloc bins (small size classes) are fragmented
+ * enough to be worth defragging. It is computed from the allocator statistics
+ * by the BIO_DEFRAG_PLAN thread about once per second while active defrag is
+ * enabled, so that the main thread doesn't pay for querying them, and it is
+ * used by the main thread to:
+ *
+ * 1) Not start a scan if no bin is fragmented: the fragmentation reported
+ *    by the allocator may be in large allocations, that can't be defragged.
+ * 2) Skip the allocations of bins that are not fragmented without asking
+ *    jemalloc for a defrag hint and without moving them.
+ *
+ * The allocations are still moved, and the pointers referencing them updated,
+ * by the main thread, the only one that can access the keyspace. */
+#define DEFRAG_PLAN_MAX_BINS 64
+#define DEFRAG_PLAN_MAX_AGE 3000 /* Don't use plans older than this (ms). */
+typedef struct defragPlan {
+    mstime_t ctime;         /* Time the plan was requested. */
+    int threshold;          /* Min fragmentation % of the bins to defrag. */
+    int nbins;              /* Number of bins, 0 if stats not available. */
+    int frag_bins;          /* Number of bins worth defragging. */
+    size_t frag_bytes;      /* Free bytes in the slabs of those bins. */
+    size_t size[DEFRAG_PLAN_MAX_BINS];  /* Region size of every bin. */
+    unsigned char skip[DEFRAG_PLAN_MAX_BINS]; /* True if not fragmented. */
+} defragPlan;
+
+static pthread_mutex_t defrag_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static defragPlan *defrag_plan_ready = NULL; /* Set by the BIO thread. */
+static defragPlan *defrag_plan = NULL;       /* Used by the main thread. */
+
+/* Executed by the BIO_DEFRAG_PLAN thread: fill the plan and hand it to the
+ * main thread. */
+void defragComputePlanFromBioThread(void *ptr) {
+    defragPlan *plan = ptr;
+    size_t curregs[DEFRAG_PLAN_MAX_BINS], totregs[DEFRAG_PLAN_MAX_BINS];
+    int j;
+
+    plan->nbins = zmalloc_get_allocator_bins(plan->size,curregs,totregs,
+                                             DEFRAG_PLAN_MAX_BINS);
+    plan->frag_bins = 0;
+    plan->frag_bytes = 0;
+    for (j = 0; j < plan->nbins; j++) {
+        size_t freeregs = totregs[j] > curregs[j] ? totregs[j]-curregs[j] : 0;
+
+        /* Like the allocator fragmentation (active/allocated), the bin
+         * fragmentation is the ratio of the free regions to the used ones
+         * in the slabs of the bin. */
+        plan->skip[j] = !curregs[j] ||
+                        freeregs*100 < curregs[j]*plan->threshold;
+        if (!plan->skip[j]) {
+            plan->frag_bins++;
+            plan->frag_bytes += freeregs*plan->size[j];
+        }
+    }
+
+    pthread_mutex_lock(&defrag_plan_mutex);
+    zfree(defrag_plan_ready);
+    defrag_plan_ready = plan;
+    pthread_mutex_unlock(&defrag_plan_mutex);
+}
+
+/* Called once per second by the main thread: take the last plan computed by
+ * the BIO thread, if any, and request a new one. */
+void defragPlanUpdate(void) {
+    defragPlan *plan;
+
+    pthread_mutex_lock(&defrag_plan_mutex);
+    if (defrag_plan_ready) {
+        zfree(defrag_plan);
+        defrag_plan = defrag_plan_ready;
+        defrag_plan_ready = NULL;
+    }
+    pthread_mutex_unlock(&defrag_plan_mutex);
+
+    if (bioPendingJobsOfType(BIO_DEFRAG_PLAN) == 0) {
+        plan = zmalloc(sizeof(*plan));
+        plan->ctime = server.mstime;
+        plan->threshold = server.active_defrag_threshold_lower;
+        bioCreateBackgroundJob(BIO_DEFRAG_PLAN,plan,NULL,NULL);
+    }
+}
+
+/* Return the current plan, or NULL if there is no recent plan. Without a
+ * plan every allocation is considered for defrag. */
+static defragPlan *defragGetPlan(void) {
+    if (defrag_plan == NULL || defrag_plan->nbins == 0 ||
+        server.mstime - defrag_plan->ctime > DEFRAG_PLAN_MAX_AGE)
+        return NULL;
+    return defrag_plan;
+}
+
+/* Return true if the plan says that the bin of allocations of 'size' bytes
+ * is not fragmented. The bin sizes are sorted, so we use a binary search. */
+static int defragPlanSkip(defragPlan *plan, size_t size) {
+    int lo = 0, hi = plan->nbins-1;
+
+    while (lo <= hi) {
+        int mid = (lo+hi)/2;
+        if (plan->size[mid] == size) return plan->skip[mid];
+        if (plan->size[mid] < size) lo = mid+1; else hi = mid-1;
+    }
+    return 0; /* Not a bin size: a large allocation, let jemalloc say. */
+}
+
 /* Defrag helper for generic allocations.
  *
  * returns NULL in case the allocatoin wasn't moved.
@@ -57,7 +161,14 @@ dictEntry* replaceSateliteDictKeyPtrAndOrDefragDictEntry(dict *d, sds oldkey, sd
 void* activeDefragAlloc(void *ptr) {
     int bin_util, run_util;
     size_t size;
+    defragPlan *plan = defragGetPlan();
     void *newptr;
+    /* The allocation size is only needed to look up the plan, and to copy
+     * the allocations that are moved. */
+    if (plan && defragPlanSkip(plan, zmalloc_size(ptr))) {
+        server.stat_active_defrag_misses++;
+        return NULL;
+    }
     if(!je_get_defrag_hint(ptr, &bin_util, &run_util)) {
         server.stat_active_defrag_misses++;
         return NULL;
@@ -129,6 +240,9 @@ robj *activeDefragStringOb(robj* ob, long *defragged) {
                 ret->ptr = (void*)((intptr_t)ret + ofs);
                 (*defragged)++;
             }
+        } else if (ob->encoding==OBJ_ENCODING_INTERNED) {
+            /* The sds of an interned value is not ours, just the robj was
+             * moved above. */
         } else if (ob->encoding!=OBJ_ENCODING_INT) {
             serverPanic("Unknown string encoding");
         }
@@ -169,16 +283,22 @@ long dictIterDefragEntry(dictIterator *iter) {
 
 /* Defrag helper for dict main allocations (dict struct, and hash tables).
  * receives a pointer to the dict* and implicitly updates it when the dict
- * struct itself was moved. Returns a stat of how many pointers were moved. */
+ * struct itself was moved. Returns a stat of how many pointers were moved.
+ * Tables of ZMALLOC_HUGE_MIN bytes or more are never moved, since they may
+ * be huge page mappings made by zcalloc_huge() and not by the allocator. */
 long dictDefragTables(dict* d) {
     dictEntry **newtable;
     long defragged = 0;
     /* handle the first hash table */
-    newtable = activeDefragAlloc(d->ht[0].table);
-    if (newtable)
-        defragged++, d->ht[0].table = newtable;
+    if (d->ht[0].size*sizeof(dictEntry*) < ZMALLOC_HUGE_MIN) {
+        newtable = activeDefragAlloc(d->ht[0].table);
+        if (newtable)
+            defragged++, d->ht[0].table = newtable;
+    }
     /* handle the second hash table */
-    if (d->ht[1].table) {
+    if (d->ht[1].table &&
+        d->ht[1].size*sizeof(dictEntry*) < ZMALLOC_HUGE_MIN)
+    {
         newtable = activeDefragAlloc(d->ht[1].table);
         if (newtable)
             defragged++, d->ht[1].table = newtable;
@@ -408,25 +528,36 @@ dictEntry* replaceSateliteDictKeyPtrAndOrDefragDictEntry(dict *d, sds oldkey, sd
     return NULL;
 }
 
-long activeDefragQuickListNodes(quicklist *ql) {
-    quicklistNode *node = ql->head, *newnode;
+/* Defrag a quicklist node and its ziplist, updating *node_ref if the node
+ * was moved. Returns a stat of how many pointers were moved. */
+long activeDefragQuickListNode(quicklist *ql, quicklistNode **node_ref) {
+    quicklistNode *newnode, *node = *node_ref;
     long defragged = 0;
     unsigned char *newzl;
+    if ((newnode = activeDefragAlloc(node))) {
+        if (newnode->prev)
+            newnode->prev->next = newnode;
+        else
+            ql->head = newnode;
+        if (newnode->next)
+            newnode->next->prev = newnode;
+        else
+            ql->tail = newnode;
+        if (ql->bookmark_count)
+            quicklistBookmarkReplaceNode(ql, node, newnode);
+        *node_ref = node = newnode;
+        defragged++;
+    }
+    if ((newzl = activeDefragAlloc(node->zl)))
+        defragged++, node->zl = newzl;
+    return defragged;
+}
+
+long activeDefragQuickListNodes(quicklist *ql) {
+    quicklistNode *node = ql->head;
+    long defragged = 0;
     while (node) {
-        if ((newnode = activeDefragAlloc(node))) {
-            if (newnode->prev)
-                newnode->prev->next = newnode;
-            else
-                ql->head = newnode;
-            if (newnode->next)
-                newnode->next->prev = newnode;
-            else
-                ql->tail = newnode;
-            node = newnode;
-            defragged++;
-        }
-        if ((newzl = activeDefragAlloc(node->zl)))
-            defragged++, node->zl = newzl;
+        defragged += activeDefragQuickListNode(ql, &node);
         node = node->next;
     }
     return defragged;
@@ -440,12 +571,48 @@ void defragLater(redisDb *db, dictEntry *kde) {
     listAddNodeTail(db->defrag_later, key);
 }
 
-long scanLaterList(robj *ob) {
+/* Lists have no scan API: the position of the next node to defrag is kept
+ * in a quicklist bookmark, that stays valid if the list is modified in the
+ * meantime, and the cursor is just non zero while the bookmark is set. Every
+ * call defrags up to DEFRAG_LIST_NODES_PER_STEP nodes, so a big list doesn't
+ * need to be handled in a single step, nor walked from the head again. */
+#define DEFRAG_LIST_NODES_PER_STEP 128
+#define DEFRAG_LIST_BOOKMARK "_AD"
+long scanLaterList(robj *ob, unsigned long *cursor) {
     quicklist *ql = ob->ptr;
-    if (ob->type != OBJ_LIST || ob->encoding != OBJ_ENCODING_QUICKLIST)
+    quicklistNode *node;
+    unsigned long j;
+    long defragged = 0;
+    if (ob->type != OBJ_LIST || ob->encoding != OBJ_ENCODING_QUICKLIST) {
+        *cursor = 0;
         return 0;
-    server.stat_active_defrag_scanned+=ql->len;
-    return activeDefragQuickListNodes(ql);
+    }
+    if (*cursor == 0) {
+        node = ql->head;
+    } else {
+        /* The bookmark is gone if the nodes after it were deleted. */
+        node = quicklistBookmarkFind(ql, DEFRAG_LIST_BOOKMARK);
+        if (!node) {
+            *cursor = 0;
+            return 0;
+        }
+    }
+    for (j = 0; node && j < DEFRAG_LIST_NODES_PER_STEP; j++) {
+        defragged += activeDefragQuickListNode(ql, &node);
+        server.stat_active_defrag_scanned++;
+        node = node->next;
+    }
+    if (node && quicklistBookmarkCreate(&ql, DEFRAG_LIST_BOOKMARK, node)) {
+        /* Creating the bookmark may reallocate the quicklist. */
+        ob->ptr = ql;
+        *cursor = 1;
+    } else {
+        /* Done, or no bookmark available: the rest of the list is left to
+         * the next defrag cycle. */
+        quicklistBookmarkDelete(ql, DEFRAG_LIST_BOOKMARK);
+        *cursor = 0;
+    }
+    return defragged;
 }
 
 typedef struct {
@@ -613,6 +780,19 @@ long defragKey(redisDb *db, dictEntry *de) {
         uint64_t hash = dictGetHash(db->dict, de->key);
         replaceSateliteDictKeyPtrAndOrDefragDictEntry(db->expires, keysds, newsds, hash, &defragged);
     }
+    if (dictSize(db->hexpires)) {
+        uint64_t hash = dictGetHash(db->dict, de->key);
+        replaceSateliteDictKeyPtrAndOrDefragDictEntry(db->hexpires, keysds, newsds, hash, &defragged);
+    }
+    if (newsds && server.cluster_enabled)
+        slotToKeyReplaceKeyPtr(keysds, newsds, dictGetHash(db->dict, newsds));
+    if (newsds && db->expires_index)
+        expireIndexReplaceKeyPtr(db, keysds, newsds, dictGetHash(db->dict, newsds));
+    if (db->memstats) {
+        uint64_t hash = dictGetHash(db->dict, de->key);
+        replaceSateliteDictKeyPtrAndOrDefragDictEntry(db->memstats->keys, keysds, newsds, hash, &defragged);
+        replaceSateliteDictKeyPtrAndOrDefragDictEntry(db->memstats->stale, keysds, newsds, hash, &defragged);
+    }
 
     /* Try to defrag robj and / or string value. */
     ob = dictGetVal(de);
@@ -733,8 +913,7 @@ unsigned long defragLaterItem(dictEntry *de, unsigned long cursor) {
     if (de) {
         robj *ob = dictGetVal(de);
         if (ob->type == OBJ_LIST) {
-            defragged += scanLaterList(ob);
-            cursor = 0; /* list has no scan, we must finish it in one go */
+            defragged += scanLaterList(ob, &cursor);
         } else if (ob->type == OBJ_SET) {
             defragged += scanLaterSet(ob, &cursor);
         } else if (ob->type == OBJ_ZSET) {
@@ -793,8 +972,8 @@ int defragLaterStep(redisDb *db, long long endtime) {
             /* Once in 16 scan iterations, 512 pointer reallocations, or 64 fields
              * (if we have a lot of pointers in one hash bucket, or rehashing),
              * check if we reached the time limit.
-             * But regardless, don't start a new BIG key in this loop, this is because the
-             * next key can be a list, and scanLaterList must be done in once cycle */
+             * But regardless, don't start a new BIG key in this loop, so that the
+             * time check happens at least once per key. */
             if (!cursor || (++iterations > 16 ||
                             server.stat_active_defrag_hits - prev_defragged > 512 ||
                             server.stat_active_defrag_scanned - prev_scanned > 64)) {
@@ -824,10 +1003,20 @@ int defragLaterStep(redisDb *db, long long endtime) {
 void computeDefragCycles() {
     size_t frag_bytes;
     float frag_pct = getAllocatorFragmentation(&frag_bytes);
+    defragPlan *plan = defragGetPlan();
     /* If we're not already running, and below the threshold, exit. */
     if (!server.active_defrag_running) {
         if(frag_pct < server.active_defrag_threshold_lower || frag_bytes < server.active_defrag_ignore_bytes)
             return;
+        /* Don't start a scan if the plan says no bin is worth defragging:
+         * the fragmentation is elsewhere and moving allocations won't fix
+         * it. */
+        if (plan && plan->frag_bins == 0) {
+            serverLog(LL_DEBUG,
+                "Active defrag not started, no fragmented bins (frag_bytes=%zu)",
+                frag_bytes);
+            return;
+        }
     }
 
     /* Calculate the adaptive aggressiveness of the defrag */
@@ -844,10 +1033,14 @@ void computeDefragCycles() {
     if (!server.active_defrag_running ||
         cpu_pct > server.active_defrag_running)
     {
+        char planinfo[64] = "";
+        if (plan)
+            snprintf(planinfo,sizeof(planinfo),", fragmented bins=%d/%d",
+                plan->frag_bins, plan->nbins);
         server.active_defrag_running = cpu_pct;
         serverLog(LL_VERBOSE,
-            "Starting active defrag, frag=%.0f%%, frag_bytes=%zu, cpu=%d%%",
-            frag_pct, frag_bytes, cpu_pct);
+            "Starting active defrag, frag=%.0f%%, frag_bytes=%zu, cpu=%d%%%s",
+            frag_pct, frag_bytes, cpu_pct, planinfo);
     }
 }
 
@@ -872,6 +1065,7 @@ void activeDefragCycle(void) {
     /* Once a second, check if we the fragmentation justfies starting a scan
      * or making it more aggressive. */
     run_with_period(1000) {
+        defragPlanUpdate();
         computeDefragCycles();
     }
     if (!server.active_defrag_running)
@@ -964,4 +1158,8 @@ void activeDefragCycle(void) {
     /* Not implemented yet. */
 }
 
+void defragComputePlanFromBioThread(void *plan) {
+    UNUSED(plan);
+}
+
 #endif
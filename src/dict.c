@@ -54,6 +54,14 @@
 #include <assert.h>
 #endif
 
+/* Cache prefetch hint used by the batched lookup helpers. It is a no-op
+ * with compilers not supporting it. */
+#if defined(__GNUC__)
+#define dictPrefetch(addr) __builtin_prefetch(addr)
+#else
+#define dictPrefetch(addr) ((void)(addr))
+#endif
+
 /* Using dictEnableResize() / dictDisableResize() we make possible to
  * enable/disable resizing of the hash table as needed. This is very important
  * for Redis, as we use copy-on-write and don't want to move too much memory
@@ -177,7 +185,7 @@ int dictExpand(dict *d, unsigned long size) {
     /* 给新 hashtable 初始化 */
     n.size = realsize;
     n.sizemask = realsize - 1;
-    n.table = zcalloc(realsize * sizeof(dictEntry *));
+    n.table = zcalloc_huge(realsize * sizeof(dictEntry *));
     n.used = 0;
 
     //如果这是第一次初始化，那么直接就设置成指定大小
@@ -257,7 +265,7 @@ int dictRehash(dict *d, int n) {
     /* 检查是否已经 rehash 完毕了 */
     if (d->ht[0].used == 0) {
         // 释放 ht[0]
-        zfree(d->ht[0].table);
+        zfree_huge(d->ht[0].table, d->ht[0].size * sizeof(dictEntry *));
         // 将 ht[1] 赋值给 ht[0]
         d->ht[0] = d->ht[1];
         // 重置 ht[1]，等待下一次扩容
@@ -525,7 +533,7 @@ int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
         }
     }
     /* Free the table and the allocated cache structure */
-    zfree(ht->table);
+    zfree_huge(ht->table, ht->size * sizeof(dictEntry *));
     /* Re-initialize the table */
     _dictReset(ht);
     return DICT_OK; /* never fails */
@@ -559,6 +567,43 @@ dictEntry *dictFind(dict *d, const void *key) {
     return NULL;
 }
 
+/* The following two functions allow callers that need to perform many
+ * lookups at once to overlap the cache misses of the different lookups,
+ * instead of paying them one after the other inside dictFind().
+ *
+ * The caller first calls dictPrefetchBucket() for every key of the batch,
+ * that starts loading the bucket slot of the key and returns its hash. Then
+ * dictPrefetchEntry() is called with the returned hashes, in order to start
+ * loading the first entry of every bucket, that at this point is likely to
+ * be already in the cache. Finally dictFind() is called normally.
+ *
+ * Both functions are just hints: they don't modify the dictionary nor
+ * perform any rehashing step, so it is safe for the dictionary to change
+ * between the calls. */
+uint64_t dictPrefetchBucket(dict *d, const void *key) {
+    uint64_t h, table;
+
+    if (d->ht[0].used + d->ht[1].used == 0) return 0;
+    h = dictHashKey(d, key);
+    for (table = 0; table <= 1; table++) {
+        dictPrefetch(&d->ht[table].table[h & d->ht[table].sizemask]);
+        if (!dictIsRehashing(d)) break;
+    }
+    return h;
+}
+
+void dictPrefetchEntry(dict *d, uint64_t hash) {
+    uint64_t table;
+    dictEntry *he;
+
+    if (d->ht[0].used + d->ht[1].used == 0) return;
+    for (table = 0; table <= 1; table++) {
+        he = d->ht[table].table[hash & d->ht[table].sizemask];
+        if (he) dictPrefetch(he);
+        if (!dictIsRehashing(d)) break;
+    }
+}
+
 void *dictFetchValue(dict *d, const void *key) {
     dictEntry *he;
 
@@ -191,6 +191,8 @@ void dictRelease(dict *d);
 // 查找
 dictEntry * dictFind(dict *d, const void *key);
 void *dictFetchValue(dict *d, const void *key);
+uint64_t dictPrefetchBucket(dict *d, const void *key);
+void dictPrefetchEntry(dict *d, uint64_t hash);
 int dictResize(dict *d);
 dictIterator *dictGetIterator(dict *d);
 dictIterator *dictGetSafeIterator(dict *d);
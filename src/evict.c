@@ -48,8 +48,12 @@
  * instead of the idle time, so that we still evict by larger value (larger
  * inverse frequency means to evict keys with the least frequent accesses).
  *
+ * The TinyLFU policies use a larger pool, see evictionPoolSize().
+ *
  * Empty entries have the key pointer set to NULL. */
 #define EVPOOL_SIZE 16
+#define EVPOOL_SIZE_TINYLFU 64
+#define EVPOOL_SIZE_MAX EVPOOL_SIZE_TINYLFU
 #define EVPOOL_CACHED_SDS_SIZE 255
 struct evictionPoolEntry {
     unsigned long long idle;    /* Object idle time (inverse frequency for LFU) */
@@ -60,6 +64,27 @@ struct evictionPoolEntry {
 
 static struct evictionPoolEntry *EvictionPoolLRU;
 
+/* Count-min sketch estimating the access frequency of keys, including keys
+ * that are not in the dataset (misses, or keys already evicted), for the
+ * TinyLFU policies. Every row has 'width' 8 bit logarithmic counters, and
+ * every key maps to a counter per row: its frequency is the min of them.
+ * The doorkeeper is a bloom filter of 'width' bytes remembering the keys
+ * accessed once, so that they don't take sketch counters. */
+#define EVSKETCH_DEPTH 4
+#define EVSKETCH_MIN_WIDTH 4096
+#define EVSKETCH_MAX_WIDTH (1<<24)
+#define EVSKETCH_AGING_FACTOR 10 /* Halve counters every width*10 accesses. */
+struct evictionSketch {
+    uint8_t *counters;          /* EVSKETCH_DEPTH rows of 'width' counters. */
+    unsigned char *doorkeeper;  /* Bloom filter of width*8 bits. */
+    unsigned long width;        /* Counters per row, power of two. */
+    unsigned long long accesses; /* Accesses recorded since the last aging. */
+};
+
+static struct evictionSketch *EvictionSketch;
+
+static unsigned long long evictionTinyLFUScore(sds key, robj *o);
+
 /* ----------------------------------------------------------------------------
  * Implementation of eviction, aging and LRU
  * --------------------------------------------------------------------------*/
@@ -142,8 +167,8 @@ void evictionPoolAlloc(void) {
     struct evictionPoolEntry *ep;
     int j;
 
-    ep = zmalloc(sizeof(*ep)*EVPOOL_SIZE);
-    for (j = 0; j < EVPOOL_SIZE; j++) {
+    ep = zmalloc(sizeof(*ep)*EVPOOL_SIZE_MAX);
+    for (j = 0; j < EVPOOL_SIZE_MAX; j++) {
         ep[j].idle = 0;
         ep[j].key = NULL;
         ep[j].cached = sdsnewlen(NULL,EVPOOL_CACHED_SDS_SIZE);
@@ -152,17 +177,96 @@ void evictionPoolAlloc(void) {
     EvictionPoolLRU = ep;
 }
 
-/* This is an helper function for freeMemoryIfNeeded(), it is used in order
- * to populate the evictionPool with a few entries every time we want to
- * expire a key. Keys with idle time smaller than one of the current
- * keys are added. Keys are always added if there are free entries.
+/* Number of entries of the eviction pool used by the current policy. */
+static int evictionPoolSize(void) {
+    return (server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU) ?
+           EVPOOL_SIZE_TINYLFU : EVPOOL_SIZE;
+}
+
+/* Empty the eviction pool, so that scores computed by a different policy
+ * don't survive a CONFIG SET maxmemory-policy. */
+void evictionPoolEmpty(void) {
+    struct evictionPoolEntry *pool = EvictionPoolLRU;
+
+    for (int k = 0; k < EVPOOL_SIZE_MAX; k++) {
+        if (pool[k].key && pool[k].key != pool[k].cached)
+            sdsfree(pool[k].key);
+        pool[k].key = NULL;
+        pool[k].idle = 0;
+    }
+}
+
+/* Insert 'key' of the DB 'dbid' with the score 'idle' in the eviction pool,
+ * if there is a free entry or it is better than one of the current keys.
  *
  * We insert keys on place in ascending order, so keys with the smaller
  * idle time are on the left, and keys with the higher idle time on the
  * right. */
+static void evictionPoolInsert(struct evictionPoolEntry *pool, int size,
+                               int dbid, sds key, unsigned long long idle)
+{
+    int k;
+
+    /* Insert the element inside the pool.
+     * First, find the first empty bucket or the first populated
+     * bucket that has an idle time smaller than our idle time. */
+    k = 0;
+    while (k < size &&
+           pool[k].key &&
+           pool[k].idle < idle) k++;
+    if (k == 0 && pool[size-1].key != NULL) {
+        /* Can't insert if the element is < the worst element we have
+         * and there are no empty buckets. */
+        return;
+    } else if (k < size && pool[k].key == NULL) {
+        /* Inserting into empty position. No setup needed before insert. */
+    } else {
+        /* Inserting in the middle. Now k points to the first element
+         * greater than the element to insert.  */
+        if (pool[size-1].key == NULL) {
+            /* Free space on the right? Insert at k shifting
+             * all the elements from k to end to the right. */
+
+            /* Save SDS before overwriting. */
+            sds cached = pool[size-1].cached;
+            memmove(pool+k+1,pool+k,
+                sizeof(pool[0])*(size-k-1));
+            pool[k].cached = cached;
+        } else {
+            /* No free space on right? Insert at k-1 */
+            k--;
+            /* Shift all elements on the left of k (included) to the
+             * left, so we discard the element with smaller idle time. */
+            sds cached = pool[0].cached; /* Save SDS before overwriting. */
+            if (pool[0].key != pool[0].cached) sdsfree(pool[0].key);
+            memmove(pool,pool+1,sizeof(pool[0])*k);
+            pool[k].cached = cached;
+        }
+    }
+
+    /* Try to reuse the cached SDS string allocated in the pool entry,
+     * because allocating and deallocating this object is costly
+     * (according to the profiler, not my fantasy. Remember:
+     * premature optimizbla bla bla bla. */
+    int klen = sdslen(key);
+    if (klen > EVPOOL_CACHED_SDS_SIZE) {
+        pool[k].key = sdsdup(key);
+    } else {
+        memcpy(pool[k].cached,key,klen+1);
+        sdssetlen(pool[k].cached,klen);
+        pool[k].key = pool[k].cached;
+    }
+    pool[k].idle = idle;
+    pool[k].dbid = dbid;
+}
+
+/* This is an helper function for freeMemoryIfNeeded(), it is used in order
+ * to populate the evictionPool with a few entries every time we want to
+ * expire a key. Keys with idle time smaller than one of the current
+ * keys are added. Keys are always added if there are free entries. */
 
 void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict, struct evictionPoolEntry *pool) {
-    int j, k, count;
+    int j, count, size = evictionPoolSize();
     dictEntry *samples[server.maxmemory_samples];
 
     count = dictGetSomeKeys(sampledict,samples,server.maxmemory_samples);
@@ -186,7 +290,9 @@ void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict, struct evic
         /* Calculate the idle time according to the policy. This is called
          * idle just because the code initially handled LRU, but is in fact
          * just a score where an higher score means better candidate. */
-        if (server.maxmemory_policy & MAXMEMORY_FLAG_LRU) {
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU) {
+            idle = evictionTinyLFUScore(key,o);
+        } else if (server.maxmemory_policy & MAXMEMORY_FLAG_LRU) {
             idle = estimateObjectIdleTime(o);
         } else if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
             /* When we use an LRU policy, we sort the keys by idle time
@@ -204,60 +310,22 @@ void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict, struct evic
             serverPanic("Unknown eviction policy in evictionPoolPopulate()");
         }
 
-        /* Insert the element inside the pool.
-         * First, find the first empty bucket or the first populated
-         * bucket that has an idle time smaller than our idle time. */
-        k = 0;
-        while (k < EVPOOL_SIZE &&
-               pool[k].key &&
-               pool[k].idle < idle) k++;
-        if (k == 0 && pool[EVPOOL_SIZE-1].key != NULL) {
-            /* Can't insert if the element is < the worst element we have
-             * and there are no empty buckets. */
-            continue;
-        } else if (k < EVPOOL_SIZE && pool[k].key == NULL) {
-            /* Inserting into empty position. No setup needed before insert. */
-        } else {
-            /* Inserting in the middle. Now k points to the first element
-             * greater than the element to insert.  */
-            if (pool[EVPOOL_SIZE-1].key == NULL) {
-                /* Free space on the right? Insert at k shifting
-                 * all the elements from k to end to the right. */
-
-                /* Save SDS before overwriting. */
-                sds cached = pool[EVPOOL_SIZE-1].cached;
-                memmove(pool+k+1,pool+k,
-                    sizeof(pool[0])*(EVPOOL_SIZE-k-1));
-                pool[k].cached = cached;
-            } else {
-                /* No free space on right? Insert at k-1 */
-                k--;
-                /* Shift all elements on the left of k (included) to the
-                 * left, so we discard the element with smaller idle time. */
-                sds cached = pool[0].cached; /* Save SDS before overwriting. */
-                if (pool[0].key != pool[0].cached) sdsfree(pool[0].key);
-                memmove(pool,pool+1,sizeof(pool[0])*k);
-                pool[k].cached = cached;
-            }
-        }
-
-        /* Try to reuse the cached SDS string allocated in the pool entry,
-         * because allocating and deallocating this object is costly
-         * (according to the profiler, not my fantasy. Remember:
-         * premature optimizbla bla bla bla. */
-        int klen = sdslen(key);
-        if (klen > EVPOOL_CACHED_SDS_SIZE) {
-            pool[k].key = sdsdup(key);
-        } else {
-            memcpy(pool[k].cached,key,klen+1);
-            sdssetlen(pool[k].cached,klen);
-            pool[k].key = pool[k].cached;
-        }
-        pool[k].idle = idle;
-        pool[k].dbid = dbid;
+        evictionPoolInsert(pool,size,dbid,key,idle);
     }
 }
 
+/* Called by dbAdd() with the TinyLFU policies: new keys are offered to the
+ * eviction pool without waiting for them to be sampled, so that a key
+ * created by a one time access (a scan filling the cache on misses) competes
+ * right away with the sampled candidates. This is the admission side of
+ * TinyLFU: unless the sketch remembers enough past accesses to the key, it
+ * is evicted before keys that are accessed more frequently. */
+void evictionPoolOfferKey(int dbid, sds key, robj *o) {
+    if (!server.maxmemory) return;
+    evictionPoolInsert(EvictionPoolLRU,evictionPoolSize(),dbid,key,
+                       evictionTinyLFUScore(key,o));
+}
+
 /* ----------------------------------------------------------------------------
  * LFU (Least Frequently Used) implementation.
 
@@ -353,6 +421,212 @@ unsigned long LFUDecrAndReturn(robj *o) {
     return counter;
 }
 
+/* ----------------------------------------------------------------------------
+ * TinyLFU implementation.
+ *
+ * The LRU and LFU policies only know about the keys in the dataset, so under
+ * scan heavy traffic keys accessed a single time push out the keys accessed
+ * all the time: new keys are the most recently used ones, and with LFU they
+ * start with the LFU_INIT_VAL counter anyway, while a popular key evicted
+ * and then created again starts from scratch.
+ *
+ * The TinyLFU policies (allkeys-tinylfu, volatile-tinylfu) estimate the
+ * access frequency of every key read, existing or not, and of every existing
+ * key written, with a count-min sketch made of the same logarithmic counters
+ * used by LFU (see LFULogIncr), and evict the keys with the lowest estimated
+ * frequency, the least recently used first among keys with the same
+ * frequency: with these policies the object lru field keeps the LRU clock.
+ *
+ * Like in the TinyLFU paper the first access to a key only sets its bits in
+ * the doorkeeper bloom filter, and every width*EVSKETCH_AGING_FACTOR accesses
+ * the counters are halved and the doorkeeper cleared, so that the estimations
+ * follow the changes of the access pattern. The sketch is sized after the
+ * number of keys, and resized by evictionSketchCron() if the dataset grows
+ * or shrinks too much.
+ * --------------------------------------------------------------------------*/
+
+#define EVSKETCH_IDLE_BITS 40 /* Bits of the score used for the idle time. */
+
+/* Return the number of keys the sketch should be sized for: the keys in the
+ * dataset, or while the dataset is still growing the number of keys that
+ * will fit in maxmemory at the current average memory per key. */
+static unsigned long long evictionSketchKeys(void) {
+    unsigned long long keys = 0;
+    size_t used = zmalloc_used_memory();
+
+    for (int j = 0; j < server.dbnum; j++)
+        keys += dictSize(server.db[j].dict);
+    if (server.maxmemory && keys && used && used < server.maxmemory)
+        keys = (unsigned long long)((double)keys/used*server.maxmemory);
+    return keys;
+}
+
+/* Return the sketch row width fitting 'keys' keys. */
+static unsigned long evictionSketchWidth(unsigned long long keys) {
+    unsigned long width = EVSKETCH_MIN_WIDTH;
+
+    while (width < keys && width < EVSKETCH_MAX_WIDTH) width <<= 1;
+    return width;
+}
+
+static void evictionSketchFree(void) {
+    if (EvictionSketch == NULL) return;
+    zfree(EvictionSketch->counters);
+    zfree(EvictionSketch->doorkeeper);
+    zfree(EvictionSketch);
+    EvictionSketch = NULL;
+}
+
+/* Create the sketch with a row width fitting 'keys' keys. */
+static void evictionSketchCreate(unsigned long long keys) {
+    unsigned long width = evictionSketchWidth(keys);
+
+    EvictionSketch = zmalloc(sizeof(*EvictionSketch));
+    EvictionSketch->counters = zcalloc(width*EVSKETCH_DEPTH);
+    EvictionSketch->doorkeeper = zcalloc(width);
+    EvictionSketch->width = width;
+    EvictionSketch->accesses = 0;
+}
+
+/* Change the row width of the sketch without losing the history. Since the
+ * counter of a key in a row is selected by the low bits of its hash, the
+ * counter of a key in a row of width W is the counter at the same index
+ * modulo W in a row of width W/2. So growing the counters are copied to all
+ * the positions they map to, and shrinking the max of the counters folded
+ * together is taken: estimations can only grow, like with collisions. The
+ * doorkeeper is just cleared. */
+static void evictionSketchResize(unsigned long width) {
+    unsigned long oldwidth = EvictionSketch->width, i;
+    uint8_t *old = EvictionSketch->counters;
+    uint8_t *new = zcalloc(width*EVSKETCH_DEPTH);
+
+    for (int j = 0; j < EVSKETCH_DEPTH; j++) {
+        uint8_t *src = old+j*oldwidth, *dst = new+j*width;
+
+        if (width > oldwidth) {
+            for (i = 0; i < width; i++) dst[i] = src[i & (oldwidth-1)];
+        } else {
+            for (i = 0; i < oldwidth; i++) {
+                unsigned long k = i & (width-1);
+                if (src[i] > dst[k]) dst[k] = src[i];
+            }
+        }
+    }
+    zfree(old);
+    zfree(EvictionSketch->doorkeeper);
+    EvictionSketch->counters = new;
+    EvictionSketch->doorkeeper = zcalloc(width);
+    EvictionSketch->width = width;
+}
+
+/* Compute the index of the counter of 'key' in every row of the sketch, and
+ * of its two doorkeeper bits, deriving them from a single 64 bit hash. */
+static void evictionSketchIndexes(sds key, unsigned long *idx, unsigned long *bits) {
+    uint64_t hash = dictGenHashFunction(key,sdslen(key));
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    unsigned long mask = EvictionSketch->width-1;
+    unsigned long bitmask = EvictionSketch->width*8-1;
+
+    for (int j = 0; j < EVSKETCH_DEPTH; j++)
+        idx[j] = j*EvictionSketch->width + ((h1 + (uint32_t)j*h2) & mask);
+    bits[0] = (h1 + (uint32_t)EVSKETCH_DEPTH*h2) & bitmask;
+    bits[1] = (h1 + (uint32_t)(EVSKETCH_DEPTH+1)*h2) & bitmask;
+}
+
+static int evictionDoorkeeperTest(unsigned long *bits) {
+    unsigned char *dk = EvictionSketch->doorkeeper;
+
+    return (dk[bits[0]>>3] & (1<<(bits[0]&7))) &&
+           (dk[bits[1]>>3] & (1<<(bits[1]&7)));
+}
+
+/* Return the estimated access frequency of 'key', as a logarithmic
+ * counter from 0 to 255. */
+static uint8_t evictionSketchEstimate(sds key) {
+    unsigned long idx[EVSKETCH_DEPTH], bits[2];
+    uint8_t min = 255;
+
+    if (EvictionSketch == NULL) return 0;
+    evictionSketchIndexes(key,idx,bits);
+    for (int j = 0; j < EVSKETCH_DEPTH; j++)
+        if (EvictionSketch->counters[idx[j]] < min)
+            min = EvictionSketch->counters[idx[j]];
+    if (min < 255 && evictionDoorkeeperTest(bits)) min++;
+    return min;
+}
+
+/* OBJECT FREQ with the TinyLFU policies. */
+unsigned long evictionSketchFrequency(sds key) {
+    return evictionSketchEstimate(key);
+}
+
+/* Record an access to 'key', called by lookupKey() for the keys found and by
+ * lookupKeyReadWithFlags() for the misses with the TinyLFU policies. Only
+ * the counters at the minimum are incremented (conservative update), which
+ * reduces the overestimation caused by collisions. */
+void evictionSketchRecord(sds key) {
+    unsigned long idx[EVSKETCH_DEPTH], bits[2];
+    uint8_t min = 255, incr;
+    int j;
+
+    if (EvictionSketch == NULL) evictionSketchCreate(evictionSketchKeys());
+    evictionSketchIndexes(key,idx,bits);
+    if (!evictionDoorkeeperTest(bits)) {
+        /* First access in this aging period: only pass the doorkeeper. */
+        EvictionSketch->doorkeeper[bits[0]>>3] |= 1<<(bits[0]&7);
+        EvictionSketch->doorkeeper[bits[1]>>3] |= 1<<(bits[1]&7);
+    } else {
+        for (j = 0; j < EVSKETCH_DEPTH; j++)
+            if (EvictionSketch->counters[idx[j]] < min)
+                min = EvictionSketch->counters[idx[j]];
+        incr = LFULogIncr(min);
+        if (incr != min) {
+            for (j = 0; j < EVSKETCH_DEPTH; j++)
+                if (EvictionSketch->counters[idx[j]] < incr)
+                    EvictionSketch->counters[idx[j]] = incr;
+        }
+    }
+
+    /* Aging: halve all the counters once enough accesses were recorded. */
+    if (++EvictionSketch->accesses >=
+        (unsigned long long)EvictionSketch->width*EVSKETCH_AGING_FACTOR)
+    {
+        unsigned long len = EvictionSketch->width*EVSKETCH_DEPTH;
+
+        for (unsigned long i = 0; i < len; i++)
+            EvictionSketch->counters[i] >>= 1;
+        memset(EvictionSketch->doorkeeper,0,EvictionSketch->width);
+        EvictionSketch->accesses = 0;
+    }
+}
+
+/* Called by serverCron(): release the sketch if the policy is no longer a
+ * TinyLFU one, and resize it if the number of keys changed a lot. */
+void evictionSketchCron(void) {
+    unsigned long width;
+
+    if (!(server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU)) {
+        evictionSketchFree();
+        return;
+    }
+    if (EvictionSketch == NULL) return;
+    width = evictionSketchWidth(evictionSketchKeys());
+    if (width > EvictionSketch->width || width <= EvictionSketch->width/8)
+        evictionSketchResize(width);
+}
+
+/* The eviction pool score of a key with the TinyLFU policies: the inverse
+ * estimated frequency in the high bits, and the idle time in the low bits
+ * to break ties. */
+static unsigned long long evictionTinyLFUScore(sds key, robj *o) {
+    unsigned long long idle = estimateObjectIdleTime(o);
+    unsigned long long maxidle = (1ULL<<EVSKETCH_IDLE_BITS)-1;
+
+    if (idle > maxidle) idle = maxidle;
+    return ((unsigned long long)(255-evictionSketchEstimate(key)) <<
+            EVSKETCH_IDLE_BITS) | idle;
+}
+
 /* ----------------------------------------------------------------------------
  * The external API for eviction: freeMemroyIfNeeded() is called by the
  * server when there is data to add in order to make space if needed.
@@ -372,15 +646,24 @@ size_t freeMemoryGetNotCountedMemory(void) {
         listRewind(server.slaves,&li);
         while((ln = listNext(&li))) {
             client *slave = listNodeValue(ln);
-            overhead += getClientOutputBufferMemoryUsage(slave);
+            overhead += getClientOutputBufferMemoryUsage(slave) -
+                        slaveReplBufferPendingBytes(slave);
         }
     }
+    /* The shared replication buffer is counted like the backlog it used
+     * to be, except for the part retained only because of slow slaves. */
+    if ((long long) server.repl_buffer_mem > server.repl_backlog_size)
+        overhead += server.repl_buffer_mem - server.repl_backlog_size;
     if (server.aof_state != AOF_OFF) {
         overhead += sdslen(server.aof_buf)+aofRewriteBufferSize();
     }
     return overhead;
 }
 
+static int getMemoryStateForLimit(unsigned long long limit, size_t *total,
+                                  size_t *logical, size_t *tofree,
+                                  float *level);
+
 /* Get the memory status from the point of view of the maxmemory directive:
  * if the memory used is under the maxmemory setting then C_OK is returned.
  * Otherwise, if we are over the memory limit, the function returns
@@ -406,6 +689,16 @@ size_t freeMemoryGetNotCountedMemory(void) {
  *              (Populated both for C_ERR and C_OK)
  */
 int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *level) {
+    return getMemoryStateForLimit(server.maxmemory,total,logical,tofree,level);
+}
+
+/* Like getMaxmemoryState() but checking the memory usage against 'limit'
+ * instead of the maxmemory setting, used by the proactive eviction to check
+ * the soft watermark. The level is always relative to maxmemory. */
+static int getMemoryStateForLimit(unsigned long long limit, size_t *total,
+                                  size_t *logical, size_t *tofree,
+                                  float *level)
+{
     size_t mem_reported, mem_used, mem_tofree;
 
     /* Check if we are over the memory usage limit. If we are not, no need
@@ -414,7 +707,7 @@ int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *lev
     if (total) *total = mem_reported;
 
     /* We may return ASAP if there is no need to compute the level. */
-    int return_ok_asap = !server.maxmemory || mem_reported <= server.maxmemory;
+    int return_ok_asap = !limit || mem_reported <= limit;
     if (return_ok_asap && !level) return C_OK;
 
     /* Remove the size of slaves output buffers and AOF buffer from the
@@ -435,10 +728,10 @@ int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *lev
     if (return_ok_asap) return C_OK;
 
     /* Check if we are still over the memory limit. */
-    if (mem_used <= server.maxmemory) return C_OK;
+    if (mem_used <= limit) return C_OK;
 
     /* Compute how much memory we need to free. */
-    mem_tofree = mem_used - server.maxmemory;
+    mem_tofree = mem_used - limit;
 
     if (logical) *logical = mem_used;
     if (tofree) *tofree = mem_tofree;
@@ -446,6 +739,9 @@ int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *lev
     return C_ERR;
 }
 
+static int evictKeys(unsigned long long limit, size_t mem_tofree,
+                     long long timelimit, size_t *freed, long long *evicted);
+
 /* This function is periodically called to see if there is memory to free
  * according to the current "maxmemory" settings. In case we are over the
  * memory limit, the function will try to free some memory to return back
@@ -456,10 +752,9 @@ int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *lev
  * Otehrwise if we are over the memory limit, but not enough memory
  * was freed to return back under the limit, the function returns C_ERR. */
 int freeMemoryIfNeeded(void) {
-    size_t mem_reported, mem_tofree, mem_freed;
-    mstime_t latency, eviction_latency;
-    long long delta;
-    int slaves = listLength(server.slaves);
+    size_t mem_reported, mem_tofree, mem_freed = 0;
+    long long start;
+    int retval;
 
     /* When clients are paused the dataset should be static not just from the
      * POV of clients not being able to write, but also from the POV of
@@ -468,11 +763,43 @@ int freeMemoryIfNeeded(void) {
     if (getMaxmemoryState(&mem_reported,NULL,&mem_tofree,NULL) == C_OK)
         return C_OK;
 
-    mem_freed = 0;
-
     if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION)
         goto cant_free; /* We need to free memory, but policy forbids. */
 
+    start = ustime();
+    retval = evictKeys(server.maxmemory,mem_tofree,0,&mem_freed,NULL);
+    server.stat_eviction_fg_usec += ustime()-start;
+    if (retval == C_OK) return C_OK;
+
+cant_free:
+    /* We are here if we are not able to reclaim memory. There is only one
+     * last thing we can try: check if the lazyfree thread has jobs in queue
+     * and wait... */
+    while(bioPendingJobsOfType(BIO_LAZY_FREE)) {
+        if (((mem_reported - zmalloc_used_memory()) + mem_freed) >= mem_tofree)
+            break;
+        usleep(1000);
+    }
+    return C_ERR;
+}
+
+/* Evict keys according to the maxmemory policy until 'mem_tofree' bytes are
+ * released, or the memory used gets under 'limit' while the lazyfree thread
+ * releases the evicted values. If 'timelimit' is not zero the function also
+ * returns after about 'timelimit' microseconds.
+ *
+ * The memory released is stored in '*freed', and the number of keys evicted
+ * in '*evicted' if not NULL. The function returns C_ERR if it was not able to
+ * find keys to evict, otherwise C_OK. */
+static int evictKeys(unsigned long long limit, size_t mem_tofree,
+                     long long timelimit, size_t *freed, long long *evicted)
+{
+    size_t mem_freed = 0;
+    mstime_t latency, eviction_latency;
+    long long delta, start = timelimit ? ustime() : 0;
+    long long total_freed = 0;
+    int slaves = listLength(server.slaves);
+
     latencyStartMonitor(latency);
     while (mem_freed < mem_tofree) {
         int j, k, i, keys_freed = 0;
@@ -487,6 +814,7 @@ int freeMemoryIfNeeded(void) {
             server.maxmemory_policy == MAXMEMORY_VOLATILE_TTL)
         {
             struct evictionPoolEntry *pool = EvictionPoolLRU;
+            int size = evictionPoolSize();
 
             while(bestkey == NULL) {
                 unsigned long total_keys = 0, keys;
@@ -506,7 +834,7 @@ int freeMemoryIfNeeded(void) {
                 if (!total_keys) break; /* No keys to evict. */
 
                 /* Go backward from best to worst element to evict. */
-                for (k = EVPOOL_SIZE-1; k >= 0; k--) {
+                for (k = size-1; k >= 0; k--) {
                     if (pool[k].key == NULL) continue;
                     bestdbid = pool[k].dbid;
 
@@ -518,6 +846,29 @@ int freeMemoryIfNeeded(void) {
                             pool[k].key);
                     }
 
+                    /* With TinyLFU the key may have been accessed a few
+                     * times since it entered the pool: if its score is no
+                     * longer the best one, move it to the right place and
+                     * try the next candidate. Scores only grow with the idle
+                     * time once updated, so every key moves at most once. */
+                    if (de && k > 0 &&
+                        server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU)
+                    {
+                        sds key = dictGetKey(de);
+                        robj *o = dictFetchValue(server.db[bestdbid].dict,key);
+                        unsigned long long score = evictionTinyLFUScore(key,o);
+
+                        if (score < pool[k-1].idle) {
+                            if (pool[k].key != pool[k].cached)
+                                sdsfree(pool[k].key);
+                            pool[k].key = NULL;
+                            pool[k].idle = 0;
+                            evictionPoolInsert(pool,size,bestdbid,key,score);
+                            k++; /* Examine again the entry now at 'k'. */
+                            continue;
+                        }
+                    }
+
                     /* Remove the entry from the pool. */
                     if (pool[k].key != pool[k].cached)
                         sdsfree(pool[k].key);
@@ -601,7 +952,7 @@ int freeMemoryIfNeeded(void) {
              * across the dbAsyncDelete() call, while the thread can
              * release the memory all the time. */
             if (server.lazyfree_lazy_eviction && !(keys_freed % 16)) {
-                if (getMaxmemoryState(NULL,NULL,NULL,NULL) == C_OK) {
+                if (getMemoryStateForLimit(limit,NULL,NULL,NULL,NULL) == C_OK) {
                     /* Let's satisfy our stop condition. */
                     mem_freed = mem_tofree;
                 }
@@ -611,22 +962,78 @@ int freeMemoryIfNeeded(void) {
         if (!keys_freed) {
             latencyEndMonitor(latency);
             latencyAddSampleIfNeeded("eviction-cycle",latency);
-            goto cant_free; /* nothing to free... */
+            *freed = mem_freed;
+            if (evicted) *evicted = total_freed;
+            return C_ERR; /* nothing to free... */
         }
+        total_freed += keys_freed;
+
+        /* The time limit is checked every 16 keys like in the active
+         * expire cycle, ustime() is not free. */
+        if (timelimit && !(total_freed % 16) && ustime()-start > timelimit)
+            break;
     }
     latencyEndMonitor(latency);
     latencyAddSampleIfNeeded("eviction-cycle",latency);
+    *freed = mem_freed;
+    if (evicted) *evicted = total_freed;
     return C_OK;
+}
 
-cant_free:
-    /* We are here if we are not able to reclaim memory. There is only one
-     * last thing we can try: check if the lazyfree thread has jobs in queue
-     * and wait... */
-    while(bioPendingJobsOfType(BIO_LAZY_FREE)) {
-        if (((mem_reported - zmalloc_used_memory()) + mem_freed) >= mem_tofree)
-            break;
-        usleep(1000);
+/* Proactive eviction: when maxmemory-eviction-watermark is set, this function
+ * is called by serverCron() and evicts keys as soon as the memory used gets
+ * over the watermark percentage of maxmemory, spending at most
+ * PROACTIVE_EVICTION_TIME_PERC percent of the CPU time per cron period. The
+ * writes between the watermark and maxmemory then find free memory and don't
+ * have to evict keys themselves, which with big values or many keys written
+ * in a burst makes the latency of the writes jump.
+ *
+ * Like every access to the keyspace this runs in the main thread, the
+ * release of the evicted values can be moved to the lazyfree thread with
+ * lazyfree-lazy-eviction. */
+void proactiveEvictionCycle(void) {
+    unsigned long long limit;
+    size_t mem_tofree, mem_freed;
+    long long evicted = 0, timelimit;
+
+    if (!server.maxmemory || !server.maxmemory_eviction_watermark ||
+        server.maxmemory_eviction_watermark >= 100 ||
+        server.maxmemory_policy == MAXMEMORY_NO_EVICTION ||
+        clientsArePaused())
+    {
+        server.eviction_lag_start = 0;
+        return;
     }
-    return C_ERR;
+
+    limit = server.maxmemory/100*server.maxmemory_eviction_watermark;
+    if (getMemoryStateForLimit(limit,NULL,NULL,&mem_tofree,NULL) == C_OK) {
+        server.eviction_lag_start = 0;
+        return;
+    }
+
+    /* Track for how long the memory was over the watermark: a lag that
+     * keeps growing means that the writes are faster than the proactive
+     * eviction, and the writes evict keys themselves once over maxmemory. */
+    if (server.eviction_lag_start == 0)
+        server.eviction_lag_start = server.mstime;
+
+    timelimit = 1000000*PROACTIVE_EVICTION_TIME_PERC/server.hz/100;
+    evictKeys(limit,mem_tofree,timelimit,&mem_freed,&evicted);
+    server.stat_evictedkeys_proactive += evicted;
+
+    if (getMemoryStateForLimit(limit,NULL,NULL,NULL,NULL) == C_OK) {
+        long long lag = mstime()-server.eviction_lag_start;
+
+        if (lag > server.stat_eviction_lag_max)
+            server.stat_eviction_lag_max = lag;
+        server.eviction_lag_start = 0;
+    }
+}
+
+/* The current eviction lag in milliseconds for INFO: for how long the memory
+ * used has been over the proactive eviction watermark, 0 if it is not. */
+long long proactiveEvictionLag(void) {
+    if (server.eviction_lag_start == 0) return 0;
+    return mstime()-server.eviction_lag_start;
 }
 
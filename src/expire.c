@@ -60,6 +60,13 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     if (now > t) {
         sds key = dictGetKey(de);
         robj *keyobj = createStringObject(key, sdslen(key));
+        long long lag = now - t;
+
+        /* Track how long the key stayed in memory after expiring. */
+        server.stat_expired_lag_sum += lag;
+        server.stat_expired_lag_count++;
+        if (lag > server.stat_expired_lag_max)
+            server.stat_expired_lag_max = lag;
 
         propagateExpire(db, keyobj, server.lazyfree_lazy_expire);
         if (server.lazyfree_lazy_expire)
@@ -79,6 +86,296 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     }
 }
 
+/*-----------------------------------------------------------------------------
+ * Expire index
+ *
+ * Sampling db->expires at random works well when a good part of the keys with
+ * a TTL are already expired, but with a large keyspace where just a few
+ * percent of the keys are expired the cycle stops early, and the dead keys
+ * may hold memory for hours. When active-expire-index is enabled every DB
+ * also indexes its keys with an expire by expire time, so that the active
+ * expire cycle reclaims them oldest first, doing work only for keys that
+ * are actually expired.
+ *
+ * The index is a radix tree where the key is the big endian number of a
+ * bucket of 2^EXPIRE_INDEX_BUCKET_BITS milliseconds and the value a dict
+ * with the names of the keys expiring in that bucket. Like db->expires the
+ * dicts don't own the key names, that are shared with the main dictionary.
+ * A bucket is processed only when it is entirely in the past, so every key
+ * it contains is already expired.
+ *
+ * 过期键索引：按过期时间分桶，activeExpireCycle 按过期时间顺序回收过期键
+ *----------------------------------------------------------------------------*/
+
+static uint64_t expireIndexBucket(long long when) {
+    if (when < 0) when = 0;
+    return (uint64_t)when >> EXPIRE_INDEX_BUCKET_BITS;
+}
+
+static void expireIndexEncodeBucket(unsigned char *buf, uint64_t bucket) {
+    for (int j = 7; j >= 0; j--) {
+        buf[j] = bucket & 0xff;
+        bucket >>= 8;
+    }
+}
+
+static uint64_t expireIndexDecodeBucket(unsigned char *buf) {
+    uint64_t bucket = 0;
+    for (int j = 0; j < 8; j++) bucket = (bucket << 8) | buf[j];
+    return bucket;
+}
+
+/* Add 'key', that must be the sds shared with the main dictionary, to the
+ * expire index of 'db' with the expire time 'when'. Does nothing if the
+ * index is disabled. */
+void expireIndexAdd(redisDb *db, sds key, long long when) {
+    unsigned char buf[8];
+    dict *d;
+
+    if (!server.active_expire_index) return;
+    if (db->expires_index == NULL) db->expires_index = raxNew();
+    expireIndexEncodeBucket(buf, expireIndexBucket(when));
+    d = raxFind(db->expires_index, buf, sizeof(buf));
+    if (d == raxNotFound) {
+        d = dictCreate(&keyptrDictType, NULL);
+        raxInsert(db->expires_index, buf, sizeof(buf), d, NULL);
+    }
+    dictAdd(d, key, NULL);
+}
+
+/* Remove 'key' from the bucket of the expire time 'when', releasing the
+ * bucket if it remains empty. */
+static void expireIndexUnlink(redisDb *db, sds key, long long when) {
+    unsigned char buf[8];
+    dict *d;
+
+    expireIndexEncodeBucket(buf, expireIndexBucket(when));
+    d = raxFind(db->expires_index, buf, sizeof(buf));
+    if (d == raxNotFound) return;
+    dictDelete(d, key);
+    if (dictSize(d) == 0) {
+        dictRelease(d);
+        raxRemove(db->expires_index, buf, sizeof(buf), NULL);
+    }
+}
+
+/* Remove 'key' from the expire index of 'db' if it has an expire set. This
+ * must be called before the entry of 'key' in db->expires is deleted or
+ * updated, since its expire time is needed to locate the bucket. */
+void expireIndexDel(redisDb *db, sds key) {
+    dictEntry *de;
+
+    if (db->expires_index == NULL) return;
+    if ((de = dictFind(db->expires, key)) == NULL) return;
+    expireIndexUnlink(db, key, dictGetSignedIntegerVal(de));
+}
+
+/* Called by active defragmentation after the key name 'oldkey' was moved to
+ * 'newkey' in the main dictionary and in db->expires. */
+void expireIndexReplaceKeyPtr(redisDb *db, sds oldkey, sds newkey, uint64_t hash) {
+    unsigned char buf[8];
+    dictEntry *de, **deref;
+    dict *d;
+
+    if (db->expires_index == NULL) return;
+    if ((de = dictFind(db->expires, newkey)) == NULL) return;
+    expireIndexEncodeBucket(buf, expireIndexBucket(dictGetSignedIntegerVal(de)));
+    d = raxFind(db->expires_index, buf, sizeof(buf));
+    if (d != raxNotFound &&
+        (deref = dictFindEntryRefByPtrAndHash(d, oldkey, hash)) != NULL)
+        (*deref)->key = newkey;
+}
+
+/* Release an expire index. The key names are not touched, so this can also
+ * be called from the lazyfree thread after the keys were released. */
+void expireIndexRelease(rax *index) {
+    if (index) raxFreeWithCallback(index, (void (*)(void *)) dictRelease);
+}
+
+/* Drop the expire index of 'db', used when the DB is emptied. */
+void expireIndexFlush(redisDb *db) {
+    expireIndexRelease(db->expires_index);
+    db->expires_index = NULL;
+}
+
+/* CONFIG SET active-expire-index yes: index the keys with an expire that
+ * already exist. This is O(N) in the number of such keys. */
+void expireIndexEnable(void) {
+    if (server.active_expire_index) return;
+    server.active_expire_index = 1;
+    for (int j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db + j;
+        dictIterator *di = dictGetIterator(db->expires);
+        dictEntry *de;
+
+        while ((de = dictNext(di)) != NULL)
+            expireIndexAdd(db, dictGetKey(de), dictGetSignedIntegerVal(de));
+        dictReleaseIterator(di);
+    }
+}
+
+void expireIndexDisable(void) {
+    server.active_expire_index = 0;
+    for (int j = 0; j < server.dbnum; j++)
+        expireIndexFlush(server.db + j);
+}
+
+/* Return the number of milliseconds since the oldest key still in the
+ * expire indexes expired, with the bucket granularity, or 0 if there are no
+ * keys in a bucket that is entirely in the past. This is the lag of the
+ * index based expire cycle, reported by INFO as expire_index_backlog_ms. */
+long long expireIndexBacklog(void) {
+    long long now = mstime(), backlog = 0;
+
+    for (int j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db + j;
+        raxIterator ri;
+        uint64_t bucket;
+
+        if (db->expires_index == NULL || raxSize(db->expires_index) == 0)
+            continue;
+        raxStart(&ri, db->expires_index);
+        raxSeek(&ri, "^", NULL, 0);
+        raxNext(&ri);
+        bucket = expireIndexDecodeBucket(ri.key);
+        raxStop(&ri);
+        if (bucket >= expireIndexBucket(now)) continue;
+        long long oldest = (long long)(bucket << EXPIRE_INDEX_BUCKET_BITS);
+        if (now - oldest > backlog) backlog = now - oldest;
+    }
+    return backlog;
+}
+
+/* Reclaim the expired keys of 'db' walking its expire index from the oldest
+ * bucket, until a bucket not entirely in the past is found or the time limit
+ * is reached, in which case *timelimit_exit is set. The keys of a bucket are
+ * collected EXPIRE_INDEX_BATCH at a time, since expiring them modifies the
+ * bucket dict. */
+static void activeExpireIndexCycle(redisDb *db, long long start,
+                                  long long timelimit, int *timelimit_exit) {
+    while (db->expires_index && raxSize(db->expires_index)) {
+        robj *keys[EXPIRE_INDEX_BATCH];
+        int numkeys = 0;
+        long long now = mstime();
+        raxIterator ri;
+        dictIterator *di;
+        dictEntry *de;
+        uint64_t bucket;
+        dict *d;
+
+        raxStart(&ri, db->expires_index);
+        raxSeek(&ri, "^", NULL, 0);
+        raxNext(&ri);
+        bucket = expireIndexDecodeBucket(ri.key);
+        d = ri.data;
+        raxStop(&ri);
+
+        /* The next bucket may still contain keys not yet expired. */
+        if (bucket >= expireIndexBucket(now)) break;
+
+        di = dictGetIterator(d);
+        while (numkeys < EXPIRE_INDEX_BATCH && (de = dictNext(di)) != NULL) {
+            sds key = dictGetKey(de);
+            keys[numkeys++] = createStringObject(key, sdslen(key));
+        }
+        dictReleaseIterator(di);
+
+        for (int j = 0; j < numkeys; j++) {
+            de = dictFind(db->expires, keys[j]->ptr);
+            if ((de == NULL || !activeExpireCycleTryExpire(db, de, now)) &&
+                db->expires_index) {
+                /* Never expected: drop the entry so that the bucket can't
+                 * stall the index. */
+                expireIndexUnlink(db, keys[j]->ptr,
+                                  (long long)(bucket << EXPIRE_INDEX_BUCKET_BITS));
+            }
+            decrRefCount(keys[j]);
+        }
+
+        if (ustime() - start > timelimit) {
+            *timelimit_exit = 1;
+            server.stat_expired_time_cap_reached_count++;
+            break;
+        }
+    }
+}
+
+/* Update the average TTL of 'db' from a few random keys with an expire. The
+ * index based cycle never samples db->expires, so this keeps avg_ttl
+ * meaningful in INFO keyspace. */
+static void activeExpireSampleTTL(redisDb *db) {
+    long long now = mstime(), ttl_sum = 0;
+    int ttl_samples = 0, num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+
+    if (dictSize(db->expires) == 0) {
+        db->avg_ttl = 0;
+        return;
+    }
+    while (num--) {
+        dictEntry *de = dictGetRandomKey(db->expires);
+        long long ttl = dictGetSignedIntegerVal(de) - now;
+
+        if (ttl > 0) {
+            ttl_sum += ttl;
+            ttl_samples++;
+        }
+    }
+    if (ttl_samples) {
+        long long avg_ttl = ttl_sum / ttl_samples;
+
+        if (db->avg_ttl == 0) db->avg_ttl = avg_ttl;
+        db->avg_ttl = (db->avg_ttl / 50) * 49 + (avg_ttl / 50);
+    }
+}
+
+/* Expire the fields of the hashes of 'db' having fields with a TTL, using
+ * the same adaptive sampling of the keys cycle on db->hexpires: the loop is
+ * repeated while more than 25% of the sampled hashes had expired fields, or
+ * while a hash had more than ACTIVE_EXPIRE_CYCLE_FIELDS_PER_KEY expired
+ * fields, the most deleted at every lookup of a hash. */
+static void activeExpireHashFieldsCycle(redisDb *db, long long start,
+                                        long long timelimit, int *timelimit_exit) {
+    int iteration = 0, expired, more;
+
+    if (*timelimit_exit) return;
+    do {
+        unsigned long num = dictSize(db->hexpires), slots;
+        long long now = mstime();
+
+        if (num == 0) break;
+        slots = dictSlots(db->hexpires);
+        if (slots > DICT_HT_INITIAL_SIZE && (num * 100 / slots < 1)) break;
+
+        expired = more = 0;
+        if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
+            num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+        while (num--) {
+            dictEntry *de;
+            hashFieldExpires *hfe;
+            robj *keyobj;
+            int fields;
+
+            if ((de = dictGetRandomKey(db->hexpires)) == NULL) break;
+            hfe = dictGetVal(de);
+            if (hashFieldExpiresMin(hfe) > now) continue;
+            keyobj = createStringObject(dictGetKey(de), sdslen(dictGetKey(de)));
+            fields = hashExpireFields(db, keyobj, now,
+                                      ACTIVE_EXPIRE_CYCLE_FIELDS_PER_KEY);
+            if (fields) expired++;
+            if (fields == ACTIVE_EXPIRE_CYCLE_FIELDS_PER_KEY) more = 1;
+            decrRefCount(keyobj);
+        }
+
+        if (((++iteration & 0xf) == 0 || more) &&
+            ustime() - start > timelimit)
+        {
+            *timelimit_exit = 1;
+            server.stat_expired_time_cap_reached_count++;
+            break;
+        }
+    } while (more || expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP / 4);
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -99,7 +396,12 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
  *
  * If type is ACTIVE_EXPIRE_CYCLE_SLOW, that normal expire cycle is
  * executed, where the time limit is a percentage of the REDIS_HZ period
- * as specified by the ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC define. */
+ * as specified by the ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC define.
+ *
+ * When active-expire-index is enabled the DBs having an expire index are
+ * processed in expire time order by activeExpireIndexCycle() instead of
+ * sampling, with the same time limit. The fields of hashes with fields TTLs
+ * are expired after the keys of every DB. */
 
 void activeExpireCycle(int type) {
     /* This function has some global state in order to continue the work
@@ -168,6 +470,13 @@ void activeExpireCycle(int type) {
          * distribute the time evenly across DBs. */
         current_db++;
 
+        if (server.active_expire_index && db->expires_index) {
+            activeExpireIndexCycle(db, start, timelimit, &timelimit_exit);
+            activeExpireSampleTTL(db);
+            activeExpireHashFieldsCycle(db, start, timelimit, &timelimit_exit);
+            continue;
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
@@ -248,6 +557,8 @@ void activeExpireCycle(int type) {
              * 若有 5 个以上过期 key，则继续直至超时时间超过 25% 的 CPU 时间，若没有 5 个过期 key，则跳过
              */
         } while (expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP / 4);
+
+        activeExpireHashFieldsCycle(db, start, timelimit, &timelimit_exit);
     }
 
     elapsed = ustime() - start;
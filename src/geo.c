@@ -43,8 +43,14 @@ int zslValueLteMax(double value, zrangespec *spec);
  *   - geoadd - add coordinates for value to geoset
  *   - georadius - search radius by coordinates in geoset
  *   - georadiusbymember - search radius based on geoset member position
+ *   - geosearch - search radius or box around coordinates or a member
+ *   - geosearchstore - like geosearch, storing the result into a key
  * ==================================================================== */
 
+#define SORT_NONE 0
+#define SORT_ASC 1
+#define SORT_DESC 2
+
 /* ====================================================================
  * geoArray implementation
  * ==================================================================== */
@@ -56,6 +62,9 @@ geoArray *geoArrayCreate(void) {
     ga->array = NULL;
     ga->buckets = 0;
     ga->used = 0;
+    ga->limit = 0;
+    ga->sort = SORT_NONE;
+    ga->any = 0;
     return ga;
 }
 
@@ -71,6 +80,51 @@ geoPoint *geoArrayAppend(geoArray *ga) {
     return gp;
 }
 
+/* When the array is limited to 'limit' points and not in ANY mode, it is
+ * organized as a binary heap having at the root the worst of the retained
+ * points: the farthest for SORT_ASC, the nearest for SORT_DESC. This way
+ * a query with COUNT only retains 'limit' points instead of materializing
+ * and sorting all the points found inside the search area.
+ *
+ * Return non zero if the distance 'a' is worse than 'b'. */
+static int geoArrayWorse(geoArray *ga, double a, double b) {
+    return (ga->sort == SORT_DESC) ? a < b : a > b;
+}
+
+static void geoArrayHeapUp(geoArray *ga, size_t j) {
+    geoPoint gp = ga->array[j];
+
+    while (j > 0) {
+        size_t parent = (j-1)/2;
+        if (!geoArrayWorse(ga,gp.dist,ga->array[parent].dist)) break;
+        ga->array[j] = ga->array[parent];
+        j = parent;
+    }
+    ga->array[j] = gp;
+}
+
+static void geoArrayHeapDown(geoArray *ga, size_t j) {
+    geoPoint gp = ga->array[j];
+
+    while (1) {
+        size_t child = j*2+1;
+        if (child >= ga->used) break;
+        if (child+1 < ga->used &&
+            geoArrayWorse(ga,ga->array[child+1].dist,ga->array[child].dist))
+            child++;
+        if (!geoArrayWorse(ga,ga->array[child].dist,gp.dist)) break;
+        ga->array[j] = ga->array[child];
+        j = child;
+    }
+    ga->array[j] = gp;
+}
+
+/* Return non zero if no more points are needed: this only happens with the
+ * ANY option once 'limit' points were found. */
+static int geoArrayIsComplete(geoArray *ga) {
+    return ga->any && ga->limit && ga->used >= ga->limit;
+}
+
 /* Destroy a geoArray created with geoArrayCreate(). */
 void geoArrayFree(geoArray *ga) {
     size_t i;
@@ -171,6 +225,38 @@ double extractDistanceOrReply(client *c, robj **argv,
     return distance * to_meters;
 }
 
+/* Input Argument Helper.
+ * Extract width and height from the specified three arguments starting at
+ * 'argv' that should be in the form: <width> <height> <unit>, and return
+ * them in meters by reference. *conversion is populated like it happens in
+ * extractDistanceOrReply().
+ *
+ * On error C_ERR is returned and an error is sent to the client. */
+int extractBoxOrReply(client *c, robj **argv, double *conversion,
+                      double *width, double *height) {
+    double w, h, to_meters;
+
+    if (getDoubleFromObjectOrReply(c, argv[0], &w,
+                                   "need numeric width") != C_OK ||
+        getDoubleFromObjectOrReply(c, argv[1], &h,
+                                   "need numeric height") != C_OK) {
+        return C_ERR;
+    }
+
+    if (w < 0 || h < 0) {
+        addReplyError(c,"height or width cannot be negative");
+        return C_ERR;
+    }
+
+    to_meters = extractUnitOrReply(c,argv[2]);
+    if (to_meters < 0) return C_ERR;
+
+    if (conversion) *conversion = to_meters;
+    *width = w * to_meters;
+    *height = h * to_meters;
+    return C_OK;
+}
+
 /* The default addReplyDouble has too much accuracy.  We use this
  * for returning location distances. "5.2145 meters away" is nicer
  * than "5.2144992818115 meters away." We provide 4 digits after the dot
@@ -183,30 +269,42 @@ void addReplyDoubleDistance(client *c, double d) {
 }
 
 /* Helper function for geoGetPointsInRange(): given a sorted set score
- * representing a point, and another point (the center of our search) and
- * a radius, appends this entry as a geoPoint into the specified geoArray
- * only if the point is within the search area.
+ * representing a point, and the search shape, appends this entry as a
+ * geoPoint into the specified geoArray only if the point is within the
+ * search area. If the array is limited and full, the point replaces the
+ * worst retained point if it is better, otherwise it is rejected.
  *
- * returns C_OK if the point is included, or REIDS_ERR if it is outside. */
-int geoAppendIfWithinRadius(geoArray *ga, double lon, double lat, double radius, double score, sds member) {
+ * returns C_OK if the point is included, or C_ERR if it is outside or
+ * rejected, in which case the caller still owns 'member'. */
+int geoAppendIfWithinShape(geoArray *ga, GeoShape *shape, double score, sds member) {
     double distance, xy[2];
+    int heap = ga->limit && !ga->any, replace = 0;
+    geoPoint *gp;
 
     if (!decodeGeohash(score,xy)) return C_ERR; /* Can't decode. */
-    /* Note that geohashGetDistanceIfInRadiusWGS84() takes arguments in
-     * reverse order: longitude first, latitude later. */
-    if (!geohashGetDistanceIfInRadiusWGS84(lon,lat, xy[0], xy[1],
-                                           radius, &distance))
-    {
+    if (!geohashGetDistanceIfInShape(shape, xy[0], xy[1], &distance))
         return C_ERR;
+
+    if (heap && ga->used == ga->limit) {
+        /* Full heap: replace the root if the new point is better. */
+        if (!geoArrayWorse(ga,ga->array[0].dist,distance)) return C_ERR;
+        sdsfree(ga->array[0].member);
+        gp = ga->array;
+        replace = 1;
+    } else {
+        gp = geoArrayAppend(ga);
     }
 
-    /* Append the new element. */
-    geoPoint *gp = geoArrayAppend(ga);
     gp->longitude = xy[0];
     gp->latitude = xy[1];
     gp->dist = distance;
     gp->member = member;
     gp->score = score;
+
+    if (replace)
+        geoArrayHeapDown(ga,0);
+    else if (heap)
+        geoArrayHeapUp(ga,ga->used-1);
     return C_OK;
 }
 
@@ -214,15 +312,14 @@ int geoAppendIfWithinRadius(geoArray *ga, double lon, double lat, double radius,
  * 'max', appending them into the array of geoPoint structures 'gparray'.
  * The command returns the number of elements added to the array.
  *
- * Elements which are farest than 'radius' from the specified 'x' and 'y'
- * coordinates are not included.
+ * Elements which are outside the search 'shape' are not included.
  *
  * The ability of this function to append to an existing set of points is
  * important for good performances because querying by radius is performed
  * using multiple queries to the sorted set, that we later need to sort
  * via qsort. Similarly we need to be able to reject points outside the search
  * radius area ASAP in order to allocate and process more points than needed. */
-int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double lat, double radius, geoArray *ga) {
+int geoGetPointsInRange(robj *zobj, double min, double max, GeoShape *shape, geoArray *ga) {
     /* minex 0 = include min in range; maxex 1 = exclude max in range */
     /* That's: min <= val < max */
     zrangespec range = { .min = min, .max = max, .minex = 0, .maxex = 1 };
@@ -243,7 +340,7 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
         }
 
         sptr = ziplistNext(zl, eptr);
-        while (eptr) {
+        while (eptr && !geoArrayIsComplete(ga)) {
             score = zzlGetScore(sptr);
 
             /* If we fell out of range, break. */
@@ -254,7 +351,7 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             ziplistGet(eptr, &vstr, &vlen, &vlong);
             member = (vstr == NULL) ? sdsfromlonglong(vlong) :
                                       sdsnewlen(vstr,vlen);
-            if (geoAppendIfWithinRadius(ga,lon,lat,radius,score,member)
+            if (geoAppendIfWithinShape(ga,shape,score,member)
                 == C_ERR) sdsfree(member);
             zzlNext(zl, &eptr, &sptr);
         }
@@ -268,14 +365,14 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             return 0;
         }
 
-        while (ln) {
+        while (ln && !geoArrayIsComplete(ga)) {
             sds ele = ln->ele;
             /* Abort when the node is no longer in range. */
             if (!zslValueLteMax(ln->score, &range))
                 break;
 
             ele = sdsdup(ele);
-            if (geoAppendIfWithinRadius(ga,lon,lat,radius,ln->score,ele)
+            if (geoAppendIfWithinShape(ga,shape,ln->score,ele)
                 == C_ERR) sdsfree(ele);
             ln = ln->level[0].forward;
         }
@@ -312,70 +409,40 @@ void scoresOfGeoHashBox(GeoHashBits hash, GeoHashFix52Bits *min, GeoHashFix52Bit
     *max = geohashAlign52Bits(hash);
 }
 
-/* Obtain all members between the min/max of this geohash bounding box.
- * Populate a geoArray of GeoPoints by calling geoGetPointsInRange().
- * Return the number of points added to the array. */
-int membersOfGeoHashBox(robj *zobj, GeoHashBits hash, geoArray *ga, double lon, double lat, double radius) {
+/* Score range of a cell, see membersOfShape(). */
+typedef struct geoScoreRange {
     GeoHashFix52Bits min, max;
+} geoScoreRange;
 
-    scoresOfGeoHashBox(hash,&min,&max);
-    return geoGetPointsInRange(zobj, min, max, lon, lat, radius, ga);
-}
-
-/* Search all eight neighbors + self geohash box */
-int membersOfAllNeighbors(robj *zobj, GeoHashRadius n, double lon, double lat, double radius, geoArray *ga) {
-    GeoHashBits neighbors[9];
-    unsigned int i, count = 0, last_processed = 0;
-    int debugmsg = 0;
-
-    neighbors[0] = n.hash;
-    neighbors[1] = n.neighbors.north;
-    neighbors[2] = n.neighbors.south;
-    neighbors[3] = n.neighbors.east;
-    neighbors[4] = n.neighbors.west;
-    neighbors[5] = n.neighbors.north_east;
-    neighbors[6] = n.neighbors.north_west;
-    neighbors[7] = n.neighbors.south_east;
-    neighbors[8] = n.neighbors.south_west;
-
-    /* For each neighbor (*and* our own hashbox), get all the matching
-     * members and add them to the potential result list. */
-    for (i = 0; i < sizeof(neighbors) / sizeof(*neighbors); i++) {
-        if (HASHISZERO(neighbors[i])) {
-            if (debugmsg) D("neighbors[%d] is zero",i);
-            continue;
-        }
-
-        /* Debugging info. */
-        if (debugmsg) {
-            GeoHashRange long_range, lat_range;
-            geohashGetCoordRange(&long_range,&lat_range);
-            GeoHashArea myarea = {{0}};
-            geohashDecode(long_range, lat_range, neighbors[i], &myarea);
-
-            /* Dump center square. */
-            D("neighbors[%d]:\n",i);
-            D("area.longitude.min: %f\n", myarea.longitude.min);
-            D("area.longitude.max: %f\n", myarea.longitude.max);
-            D("area.latitude.min: %f\n", myarea.latitude.min);
-            D("area.latitude.max: %f\n", myarea.latitude.max);
-            D("\n");
-        }
+static int geoScoreRangeCompare(const void *a, const void *b) {
+    const geoScoreRange *ra = a, *rb = b;
+    if (ra->min > rb->min) return 1;
+    else if (ra->min == rb->min) return 0;
+    else return -1;
+}
 
-        /* When a huge Radius (in the 5000 km range or more) is used,
-         * adjacent neighbors can be the same, leading to duplicated
-         * elements. Skip every range which is the same as the one
-         * processed previously. */
-        if (last_processed &&
-            neighbors[i].bits == neighbors[last_processed].bits &&
-            neighbors[i].step == neighbors[last_processed].step)
-        {
-            if (debugmsg)
-                D("Skipping processing of %d, same as previous\n",i);
-            continue;
-        }
-        count += membersOfGeoHashBox(zobj, neighbors[i], ga, lon, lat, radius);
-        last_processed = i;
+/* Search all the cells covering the search shape, populating the geoArray
+ * via geoGetPointsInRange(). Cells are turned into score ranges that are
+ * sorted and merged when contiguous or overlapping, so that a group of
+ * adjacent cells is scanned with a single sorted set range lookup.
+ * Return the number of points added to the array. */
+int membersOfShape(robj *zobj, GeoShape *shape, geoArray *ga) {
+    GeoHashCover cover;
+    geoScoreRange ranges[GEO_COVER_MAX_CELLS];
+    int i, j, count = 0;
+
+    geohashCoverShape(shape,&cover);
+    if (cover.count == 0) return 0;
+    for (i = 0; i < cover.count; i++)
+        scoresOfGeoHashBox(cover.cells[i],&ranges[i].min,&ranges[i].max);
+    qsort(ranges,cover.count,sizeof(geoScoreRange),geoScoreRangeCompare);
+
+    for (i = 0; i < cover.count; i = j) {
+        GeoHashFix52Bits max = ranges[i].max;
+        for (j = i+1; j < cover.count && ranges[j].min <= max; j++)
+            if (ranges[j].max > max) max = ranges[j].max;
+        count += geoGetPointsInRange(zobj, ranges[i].min, max, shape, ga);
+        if (geoArrayIsComplete(ga)) break;
     }
     return count;
 }
@@ -448,58 +515,64 @@ void geoaddCommand(client *c) {
     zaddCommand(c);
 }
 
-#define SORT_NONE 0
-#define SORT_ASC 1
-#define SORT_DESC 2
-
 #define RADIUS_COORDS (1<<0)    /* Search around coordinates. */
 #define RADIUS_MEMBER (1<<1)    /* Search around member. */
 #define RADIUS_NOSTORE (1<<2)   /* Do not acceot STORE/STOREDIST option. */
+#define GEOSEARCH (1<<3)        /* GEOSEARCH arguments: FROM... BY... */
+#define GEOSEARCHSTORE (1<<4)   /* GEOSEARCHSTORE: only STOREDIST option. */
 
 /* GEORADIUS key x y radius unit [WITHDIST] [WITHHASH] [WITHCOORD] [ASC|DESC]
- *                               [COUNT count] [STORE key] [STOREDIST key]
- * GEORADIUSBYMEMBER key member radius unit ... options ... */
-void georadiusGeneric(client *c, int flags) {
-    robj *key = c->argv[1];
+ *                               [COUNT count [ANY]] [STORE key] [STOREDIST key]
+ * GEORADIUSBYMEMBER key member radius unit ... options ...
+ * GEOSEARCH key [FROMMEMBER member] [FROMLONLAT long lat]
+ *               [BYRADIUS radius unit] [BYBOX width height unit]
+ *               [WITHCOORD] [WITHDIST] [WITHHASH] [COUNT count [ANY]] [ASC|DESC]
+ * GEOSEARCHSTORE dest_key src_key [FROMMEMBER member] [FROMLONLAT long lat]
+ *               [BYRADIUS radius unit] [BYBOX width height unit]
+ *               [COUNT count [ANY]] [ASC|DESC] [STOREDIST]
+ *
+ * 'srcKeyIndex' is the index of the key holding the geo set in argv. */
+void georadiusGeneric(client *c, int srcKeyIndex, int flags) {
     robj *storekey = NULL;
     int storedist = 0; /* 0 for STORE, 1 for STOREDIST. */
 
-    /* Look up the requested zset */
-    robj *zobj = NULL;
-    if ((zobj = lookupKeyReadOrReply(c, key, shared.emptymultibulk)) == NULL ||
-        checkType(c, zobj, OBJ_ZSET)) {
-        return;
-    }
+    /* Look up the requested zset. A missing key is only handled after
+     * the arguments are validated. */
+    robj *zobj = lookupKeyRead(c->db, c->argv[srcKeyIndex]);
+    if (zobj && checkType(c, zobj, OBJ_ZSET)) return;
 
-    /* Find long/lat to use for radius search based on inquiry type */
+    /* Find the center and the shape of the search based on inquiry type. */
     int base_args;
-    double xy[2] = { 0 };
+    GeoShape shape = {0};
+    robj *member = NULL;
+    shape.conversion = 1;
     if (flags & RADIUS_COORDS) {
         base_args = 6;
-        if (extractLongLatOrReply(c, c->argv + 2, xy) == C_ERR)
+        shape.type = GEO_SHAPE_CIRCLE;
+        if (extractLongLatOrReply(c, c->argv + 2, shape.xy) == C_ERR)
             return;
+        if ((shape.radius = extractDistanceOrReply(c, c->argv+base_args-2,
+                                &shape.conversion)) < 0) return;
     } else if (flags & RADIUS_MEMBER) {
         base_args = 5;
-        robj *member = c->argv[2];
-        if (longLatFromMember(zobj, member, xy) == C_ERR) {
-            addReplyError(c, "could not decode requested zset member");
-            return;
-        }
+        shape.type = GEO_SHAPE_CIRCLE;
+        member = c->argv[2];
+        if ((shape.radius = extractDistanceOrReply(c, c->argv+base_args-2,
+                                &shape.conversion)) < 0) return;
+    } else if (flags & GEOSEARCH) {
+        base_args = (flags & GEOSEARCHSTORE) ? 3 : 2;
+        if (flags & GEOSEARCHSTORE) storekey = c->argv[1];
     } else {
         addReplyError(c, "Unknown georadius search type");
         return;
     }
 
-    /* Extract radius and units from arguments */
-    double radius_meters = 0, conversion = 1;
-    if ((radius_meters = extractDistanceOrReply(c, c->argv + base_args - 2,
-                                                &conversion)) < 0) {
-        return;
-    }
-
     /* Discover and populate all optional parameters. */
     int withdist = 0, withhash = 0, withcoords = 0;
+    int frommember = 0, fromloc = 0, byradius = 0, bybox = 0;
     int sort = SORT_NONE;
+    int any = 0; /* any=1 means a limited search, stop as soon as enough
+                    results were found. */
     long long count = 0;
     if (c->argc > base_args) {
         int remaining = c->argc - base_args;
@@ -511,6 +584,8 @@ void georadiusGeneric(client *c, int flags) {
                 withhash = 1;
             } else if (!strcasecmp(arg, "withcoord")) {
                 withcoords = 1;
+            } else if (!strcasecmp(arg, "any")) {
+                any = 1;
             } else if (!strcasecmp(arg, "asc")) {
                 sort = SORT_ASC;
             } else if (!strcasecmp(arg, "desc")) {
@@ -525,18 +600,63 @@ void georadiusGeneric(client *c, int flags) {
                 i++;
             } else if (!strcasecmp(arg, "store") &&
                        (i+1) < remaining &&
-                       !(flags & RADIUS_NOSTORE))
+                       !(flags & RADIUS_NOSTORE) &&
+                       !(flags & GEOSEARCH))
             {
                 storekey = c->argv[base_args+i+1];
                 storedist = 0;
                 i++;
             } else if (!strcasecmp(arg, "storedist") &&
                        (i+1) < remaining &&
-                       !(flags & RADIUS_NOSTORE))
+                       !(flags & RADIUS_NOSTORE) &&
+                       !(flags & GEOSEARCH))
             {
                 storekey = c->argv[base_args+i+1];
                 storedist = 1;
                 i++;
+            } else if (!strcasecmp(arg, "storedist") &&
+                       (flags & GEOSEARCHSTORE))
+            {
+                storedist = 1;
+            } else if (!strcasecmp(arg, "frommember") &&
+                       (i+1) < remaining &&
+                       (flags & GEOSEARCH) &&
+                       !fromloc)
+            {
+                member = c->argv[base_args+i+1];
+                frommember = 1;
+                i++;
+            } else if (!strcasecmp(arg, "fromlonlat") &&
+                       (i+2) < remaining &&
+                       (flags & GEOSEARCH) &&
+                       !frommember)
+            {
+                if (extractLongLatOrReply(c, c->argv+base_args+i+1,
+                                          shape.xy) == C_ERR) return;
+                fromloc = 1;
+                i += 2;
+            } else if (!strcasecmp(arg, "byradius") &&
+                       (i+2) < remaining &&
+                       (flags & GEOSEARCH) &&
+                       !bybox)
+            {
+                if ((shape.radius = extractDistanceOrReply(c,
+                        c->argv+base_args+i+1, &shape.conversion)) < 0)
+                    return;
+                shape.type = GEO_SHAPE_CIRCLE;
+                byradius = 1;
+                i += 2;
+            } else if (!strcasecmp(arg, "bybox") &&
+                       (i+3) < remaining &&
+                       (flags & GEOSEARCH) &&
+                       !byradius)
+            {
+                if (extractBoxOrReply(c, c->argv+base_args+i+1,
+                        &shape.conversion, &shape.width,
+                        &shape.height) == C_ERR) return;
+                shape.type = GEO_SHAPE_BOX;
+                bybox = 1;
+                i += 3;
             } else {
                 addReply(c, shared.syntaxerr);
                 return;
@@ -546,23 +666,68 @@ void georadiusGeneric(client *c, int flags) {
 
     /* Trap options not compatible with STORE and STOREDIST. */
     if (storekey && (withdist || withhash || withcoords)) {
-        addReplyError(c,
-            "STORE option in GEORADIUS is not compatible with "
-            "WITHDIST, WITHHASH and WITHCOORDS options");
+        addReplyErrorFormat(c,
+            "%s is not compatible with WITHDIST, WITHHASH and WITHCOORDS "
+            "options", (flags & GEOSEARCHSTORE) ? "GEOSEARCHSTORE" :
+                                                  "STORE option in GEORADIUS");
         return;
     }
 
-    /* COUNT without ordering does not make much sense, force ASC
-     * ordering if COUNT was specified but no sorting was requested. */
-    if (count != 0 && sort == SORT_NONE) sort = SORT_ASC;
+    if ((flags & GEOSEARCH) && !(frommember || fromloc)) {
+        addReplyErrorFormat(c,
+            "exactly one of FROMMEMBER or FROMLONLAT can be specified for %s",
+            c->cmd->name);
+        return;
+    }
 
-    /* Get all neighbor geohash boxes for our radius search */
-    GeoHashRadius georadius =
-        geohashGetAreasByRadiusWGS84(xy[0], xy[1], radius_meters);
+    if ((flags & GEOSEARCH) && !(byradius || bybox)) {
+        addReplyErrorFormat(c,
+            "exactly one of BYRADIUS and BYBOX can be specified for %s",
+            c->cmd->name);
+        return;
+    }
 
-    /* Search the zset for all matching points */
+    if (any && !count) {
+        addReplyErrorFormat(c, "the ANY argument requires COUNT argument");
+        return;
+    }
+
+    /* Return ASAP when src key does not exist. */
+    if (zobj == NULL) {
+        if (storekey) {
+            /* The target key is deleted, like for an empty result. */
+            if (dbDelete(c->db,storekey)) {
+                signalModifiedKey(c->db,storekey);
+                notifyKeyspaceEvent(NOTIFY_GENERIC,"del",storekey,c->db->id);
+                server.dirty++;
+            }
+            addReply(c,shared.czero);
+        } else {
+            addReply(c,shared.emptymultibulk);
+        }
+        return;
+    }
+
+    /* Resolve the center of the search when it is a member. */
+    if (member && longLatFromMember(zobj, member, shape.xy) == C_ERR) {
+        addReplyError(c, "could not decode requested zset member");
+        return;
+    }
+
+    /* COUNT without ordering does not make much sense (we need to
+     * sort in order to return the closest N entries),
+     * force ASC ordering if COUNT was specified but no sorting was
+     * requested. Note that this is not needed for ANY option. */
+    if (count != 0 && sort == SORT_NONE && !any) sort = SORT_ASC;
+
+    /* Search the zset for all matching points. With COUNT only the best
+     * 'count' points are retained while scanning, and with ANY the scan
+     * stops as soon as 'count' points are found. */
     geoArray *ga = geoArrayCreate();
-    membersOfAllNeighbors(zobj, georadius, xy[0], xy[1], radius_meters, ga);
+    ga->limit = count;
+    ga->sort = sort;
+    ga->any = any;
+    membersOfShape(zobj, &shape, ga);
 
     /* If no matching results, the user gets an empty reply. */
     if (ga->used == 0 && storekey == NULL) {
@@ -607,7 +772,7 @@ void georadiusGeneric(client *c, int flags) {
         int i;
         for (i = 0; i < returned_items; i++) {
             geoPoint *gp = ga->array+i;
-            gp->dist /= conversion; /* Fix according to unit. */
+            gp->dist /= shape.conversion; /* Fix according to unit. */
 
             /* If we have options in option_length, return each sub-result
              * as a nested multi-bulk.  Add 1 to account for result value
@@ -645,7 +810,7 @@ void georadiusGeneric(client *c, int flags) {
         for (i = 0; i < returned_items; i++) {
             zskiplistNode *znode;
             geoPoint *gp = ga->array+i;
-            gp->dist /= conversion; /* Fix according to unit. */
+            gp->dist /= shape.conversion; /* Fix according to unit. */
             double score = storedist ? gp->dist : gp->score;
             size_t elelen = sdslen(gp->member);
 
@@ -659,8 +824,10 @@ void georadiusGeneric(client *c, int flags) {
             zsetConvertToZiplistIfNeeded(zobj,maxelelen);
             setKey(c->db,storekey,zobj);
             decrRefCount(zobj);
-            notifyKeyspaceEvent(NOTIFY_LIST,"georadiusstore",storekey,
-                                c->db->id);
+            notifyKeyspaceEvent(NOTIFY_LIST,
+                                (flags & GEOSEARCH) ? "geosearchstore" :
+                                                      "georadiusstore",
+                                storekey,c->db->id);
             server.dirty += returned_items;
         } else if (dbDelete(c->db,storekey)) {
             signalModifiedKey(c->db,storekey);
@@ -674,22 +841,32 @@ void georadiusGeneric(client *c, int flags) {
 
 /* GEORADIUS wrapper function. */
 void georadiusCommand(client *c) {
-    georadiusGeneric(c, RADIUS_COORDS);
+    georadiusGeneric(c, 1, RADIUS_COORDS);
 }
 
 /* GEORADIUSBYMEMBER wrapper function. */
 void georadiusbymemberCommand(client *c) {
-    georadiusGeneric(c, RADIUS_MEMBER);
+    georadiusGeneric(c, 1, RADIUS_MEMBER);
 }
 
 /* GEORADIUS_RO wrapper function. */
 void georadiusroCommand(client *c) {
-    georadiusGeneric(c, RADIUS_COORDS|RADIUS_NOSTORE);
+    georadiusGeneric(c, 1, RADIUS_COORDS|RADIUS_NOSTORE);
 }
 
 /* GEORADIUSBYMEMBER_RO wrapper function. */
 void georadiusbymemberroCommand(client *c) {
-    georadiusGeneric(c, RADIUS_MEMBER|RADIUS_NOSTORE);
+    georadiusGeneric(c, 1, RADIUS_MEMBER|RADIUS_NOSTORE);
+}
+
+/* GEOSEARCH wrapper function. */
+void geosearchCommand(client *c) {
+    georadiusGeneric(c, 1, GEOSEARCH);
+}
+
+/* GEOSEARCHSTORE wrapper function. */
+void geosearchstoreCommand(client *c) {
+    georadiusGeneric(c, 2, GEOSEARCH|GEOSEARCHSTORE);
 }
 
 /* GEOHASH key ele1 ele2 ... eleN
@@ -17,6 +17,9 @@ typedef struct geoArray {
     struct geoPoint *array;
     size_t buckets;
     size_t used;
+    size_t limit;   /* Max number of points to retain, 0 = unlimited. */
+    int sort;       /* SORT_ASC / SORT_DESC: points to retain if limited. */
+    int any;        /* Stop at the first 'limit' points found. */
 } geoArray;
 
 #endif
@@ -221,6 +221,16 @@ int geohashDecodeToLongLatWGS84(const GeoHashBits hash, double *xy) {
     return geohashDecodeToLongLatType(hash, xy);
 }
 
+/* Return in 'hash' the cell of the grid at the specified step having the
+ * given longitude and latitude indexes, both in the range 0 .. 2^step-1.
+ * This is what geohashEncode() computes from the coordinates, and allows
+ * to enumerate all the cells of a grid region without decoding them. */
+void geohashFromCellIndex(uint32_t long_idx, uint32_t lat_idx, uint8_t step,
+                          GeoHashBits *hash) {
+    hash->bits = interleave64(lat_idx, long_idx);
+    hash->step = step;
+}
+
 static void geohash_move_x(GeoHashBits *hash, int8_t d) {
     if (d == 0)
         return;
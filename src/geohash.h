@@ -111,6 +111,8 @@ int geohashDecodeToLongLatType(const GeoHashBits hash, double *xy);
 int geohashDecodeToLongLatWGS84(const GeoHashBits hash, double *xy);
 int geohashDecodeToLongLatMercator(const GeoHashBits hash, double *xy);
 void geohashNeighbors(const GeoHashBits *hash, GeoHashNeighbors *neighbors);
+void geohashFromCellIndex(uint32_t long_idx, uint32_t lat_idx, uint8_t step,
+                          GeoHashBits *hash);
 
 #if defined(__cplusplus)
 }
@@ -233,3 +233,235 @@ int geohashGetDistanceIfInRadiusWGS84(double x1, double y1, double x2,
                                       double *distance) {
     return geohashGetDistanceIfInRadius(x1, y1, x2, y2, radius, distance);
 }
+
+/* Distance in meters along a meridian between two latitudes. */
+static double geohashGetLatDistance(double lat1d, double lat2d) {
+    return EARTH_RADIUS_IN_METERS * fabs(deg_rad(lat2d) - deg_rad(lat1d));
+}
+
+/* Check if the point x,y (longitude, latitude) is inside the search shape.
+ * If so its distance from the center of the shape is returned by reference
+ * and 1 is returned, otherwise 0 is returned.
+ *
+ * For boxes the height is measured along the meridian, and the width at the
+ * latitude of the point, so the box gets wider in longitude toward the
+ * poles, like a rectangle drawn on the map would. */
+int geohashGetDistanceIfInShape(const GeoShape *shape, double x, double y,
+                                double *distance) {
+    if (shape->type == GEO_SHAPE_CIRCLE) {
+        return geohashGetDistanceIfInRadiusWGS84(shape->xy[0], shape->xy[1],
+                                                 x, y, shape->radius,
+                                                 distance);
+    }
+
+    /* The latitude distance is cheaper to compute: check it first. */
+    if (geohashGetLatDistance(shape->xy[1], y) > shape->height/2) return 0;
+    if (geohashGetDistance(shape->xy[0], y, x, y) > shape->width/2) return 0;
+    *distance = geohashGetDistance(shape->xy[0], shape->xy[1], x, y);
+    return 1;
+}
+
+/* Return the bounding box of the search shape, with the same layout used
+ * by geohashBoundingBox(). Unlike geohashBoundingBox() the box is exact on
+ * the sphere for any size of the shape:
+ *
+ * - The longitude range may extend below -180 or above +180 when the shape
+ *   crosses the antimeridian, and is exactly -180 .. +180 when the shape
+ *   contains a pole or is larger than half of the world.
+ * - The latitude range is clamped to the limits we are able to index. */
+int geohashShapeBoundingBox(const GeoShape *shape, double *bounds) {
+    double lon = shape->xy[0], lat = shape->xy[1];
+    double dlat, dlon = 180, s;
+
+    if (!bounds) return 0;
+
+    if (shape->type == GEO_SHAPE_CIRCLE) {
+        /* The widest parallel of a spherical cap is not the one of the
+         * center: the half width in longitude is asin(sin(r)/cos(lat)),
+         * being 'r' the angular radius. */
+        double r = shape->radius/EARTH_RADIUS_IN_METERS;
+        dlat = rad_deg(r);
+        if (lat+dlat < 90 && lat-dlat > -90) {
+            s = sin(r)/cos(deg_rad(lat));
+            if (s < 1) dlon = rad_deg(asin(s));
+        }
+    } else {
+        /* The box is widest in longitude at its most poleward latitude. */
+        double hw = shape->width/4/EARTH_RADIUS_IN_METERS;
+        double poleward;
+        dlat = rad_deg(shape->height/2/EARTH_RADIUS_IN_METERS);
+        poleward = fabs(lat)+dlat;
+        if (poleward < 90 && hw < M_PI/2) {
+            s = sin(hw)/cos(deg_rad(poleward));
+            if (s < 1) dlon = rad_deg(2*asin(s));
+        }
+    }
+
+    if (dlon >= 180) {
+        bounds[0] = GEO_LONG_MIN;
+        bounds[2] = GEO_LONG_MAX;
+    } else {
+        bounds[0] = lon - dlon;
+        bounds[2] = lon + dlon;
+    }
+    bounds[1] = lat - dlat;
+    bounds[3] = lat + dlat;
+    if (bounds[1] < GEO_LAT_MIN) bounds[1] = GEO_LAT_MIN;
+    if (bounds[3] > GEO_LAT_MAX) bounds[3] = GEO_LAT_MAX;
+    return 1;
+}
+
+/* Return the index, at the specified step, of the grid cell containing the
+ * coordinate 'v' in the range min .. max. This is the same truncation
+ * performed by geohashEncode(). */
+static uint32_t geohashCellIndex(double v, double min, double max,
+                                 uint8_t step) {
+    double idx = floor((v - min) / (max - min) * (1ULL << step));
+    if (idx < 0) return 0;
+    if (idx >= (1ULL << step)) return (1ULL << step) - 1;
+    return idx;
+}
+
+/* Minimum distance between the point lon,lat and the segment of the
+ * meridian 'mlon' going from latitude 'lat1' to 'lat2'. Along a meridian
+ * the distance from the point has a single minimum, at the latitude where
+ * the great circle through the point crosses the meridian at a right angle:
+ * if such latitude is outside the segment, the minimum is at one of its
+ * ends. */
+static double geohashGetMeridianDistance(double lon, double lat, double mlon,
+                                         double lat1, double lat2) {
+    double latr = deg_rad(lat);
+    double foot = rad_deg(atan2(sin(latr),
+                                cos(latr)*cos(deg_rad(mlon - lon))));
+    double d = geohashGetDistance(lon, lat, mlon, lat1);
+    double d2 = geohashGetDistance(lon, lat, mlon, lat2);
+
+    if (d2 < d) d = d2;
+    if (foot > lat1 && foot < lat2) {
+        d2 = geohashGetDistance(lon, lat, mlon, foot);
+        if (d2 < d) d = d2;
+    }
+    return d;
+}
+
+/* Tolerate rounding errors when excluding cells, a cell is discarded only
+ * when it is clearly outside the shape. */
+#define GEO_COVER_SLACK 0.01 /* meters */
+
+/* Return 1 if the area may contain points belonging to the shape, 0 if
+ * for sure it does not. */
+static int geohashAreaIntersectsShape(const GeoShape *shape,
+                                      const GeoHashArea *area) {
+    double lon = shape->xy[0], lat = shape->xy[1];
+    double lonmin = area->longitude.min, lonmax = area->longitude.max;
+
+    if (shape->type == GEO_SHAPE_CIRCLE) {
+        /* The nearest point of the area is inside it when the center is,
+         * otherwise it is on the border. When the center is within the
+         * longitude span of the area it is on the nearest parallel edge,
+         * else on one of the two meridian edges, since along the parallels
+         * the distance grows moving away from the center longitude. */
+        double d;
+        if (lon >= lonmin && lon <= lonmax) {
+            if (lat < area->latitude.min)
+                d = geohashGetLatDistance(lat, area->latitude.min);
+            else if (lat > area->latitude.max)
+                d = geohashGetLatDistance(lat, area->latitude.max);
+            else
+                d = 0;
+        } else {
+            double d2;
+            d = geohashGetMeridianDistance(lon, lat, lonmin,
+                        area->latitude.min, area->latitude.max);
+            d2 = geohashGetMeridianDistance(lon, lat, lonmax,
+                        area->latitude.min, area->latitude.max);
+            if (d2 < d) d = d2;
+        }
+        return d <= shape->radius + GEO_COVER_SLACK;
+    } else {
+        /* Restrict the area to the latitudes of the box, then test the
+         * point of the area nearest in longitude to the center, at the most
+         * poleward of such latitudes, where the box is the widest. */
+        double dlat = rad_deg(shape->height/2/EARTH_RADIUS_IN_METERS);
+        double lat1 = area->latitude.min, lat2 = area->latitude.max, far, d;
+
+        if (lat1 < lat - dlat) lat1 = lat - dlat;
+        if (lat2 > lat + dlat) lat2 = lat + dlat;
+        if (lat1 > lat2) return 0;
+        far = fabs(lat1) > fabs(lat2) ? lat1 : lat2;
+        if (lon >= lonmin && lon <= lonmax) return 1;
+        d = geohashGetDistance(lon, far, lonmin, far);
+        if (d <= shape->width/2 + GEO_COVER_SLACK) return 1;
+        d = geohashGetDistance(lon, far, lonmax, far);
+        return d <= shape->width/2 + GEO_COVER_SLACK;
+    }
+}
+
+/* Compute the set of cells covering the search shape.
+ *
+ * Instead of using the 9 cells around the center at a step estimated from
+ * the radius like geohashGetAreasByRadius() does, the bounding box of the
+ * shape is divided into the cells of the finest step that keeps them no more
+ * than GEO_COVER_MAX_CELLS, so that the covered area stays close to the one
+ * of the shape whatever its size and latitude is. Then the cells that do not
+ * intersect the shape (like the corners of the bounding box of a circle) are
+ * discarded. The same cell may be reported twice for shapes crossing the
+ * antimeridian at low steps: callers should merge the resulting ranges. */
+void geohashCoverShape(const GeoShape *shape, GeoHashCover *cover) {
+    GeoHashRange long_range, lat_range;
+    double bounds[4], lon[4];
+    uint32_t lon_idx[4], lat_idx[2];
+    int ranges = 1, step, j;
+
+    geohashGetCoordRange(&long_range,&lat_range);
+    geohashShapeBoundingBox(shape,bounds);
+
+    /* Split the longitude range when it crosses the antimeridian. */
+    lon[0] = bounds[0];
+    lon[1] = bounds[2];
+    if (bounds[0] < GEO_LONG_MIN) {
+        lon[0] = bounds[0] + 360;
+        lon[1] = GEO_LONG_MAX;
+        lon[2] = GEO_LONG_MIN;
+        lon[3] = bounds[2];
+        ranges = 2;
+    } else if (bounds[2] > GEO_LONG_MAX) {
+        lon[1] = GEO_LONG_MAX;
+        lon[2] = GEO_LONG_MIN;
+        lon[3] = bounds[2] - 360;
+        ranges = 2;
+    }
+
+    /* Find the finest step at which the bounding box spans at most
+     * GEO_COVER_MAX_CELLS cells. At step 1 the whole world is just 4 cells
+     * so the loop always terminates with a valid step. */
+    for (step = GEO_STEP_MAX; step >= 1; step--) {
+        uint64_t cells = 0;
+
+        lat_idx[0] = geohashCellIndex(bounds[1],lat_range.min,lat_range.max,step);
+        lat_idx[1] = geohashCellIndex(bounds[3],lat_range.min,lat_range.max,step);
+        for (j = 0; j < ranges*2; j += 2) {
+            lon_idx[j] = geohashCellIndex(lon[j],long_range.min,long_range.max,step);
+            lon_idx[j+1] = geohashCellIndex(lon[j+1],long_range.min,long_range.max,step);
+            cells += (uint64_t)(lon_idx[j+1]-lon_idx[j]+1) *
+                     (lat_idx[1]-lat_idx[0]+1);
+        }
+        if (cells <= GEO_COVER_MAX_CELLS) break;
+    }
+
+    cover->count = 0;
+    for (j = 0; j < ranges*2; j += 2) {
+        uint32_t x, y;
+        for (x = lon_idx[j]; x <= lon_idx[j+1]; x++) {
+            for (y = lat_idx[0]; y <= lat_idx[1]; y++) {
+                GeoHashBits hash;
+                GeoHashArea area;
+
+                geohashFromCellIndex(x,y,step,&hash);
+                geohashDecode(long_range,lat_range,hash,&area);
+                if (!geohashAreaIntersectsShape(shape,&area)) continue;
+                cover->cells[cover->count++] = hash;
+            }
+        }
+    }
+}
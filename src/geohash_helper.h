@@ -47,6 +47,32 @@ typedef struct {
     GeoHashNeighbors neighbors;
 } GeoHashRadius;
 
+/* Search shapes. The center and the size of the shape are always expressed
+ * in degrees and meters, 'conversion' is only used to report distances in
+ * the unit requested by the user. */
+#define GEO_SHAPE_CIRCLE 1
+#define GEO_SHAPE_BOX 2
+
+typedef struct {
+    int type;           /* GEO_SHAPE_CIRCLE or GEO_SHAPE_BOX. */
+    double xy[2];       /* Center: longitude, latitude. */
+    double conversion;  /* Meters per unit of the query. */
+    double radius;      /* GEO_SHAPE_CIRCLE: radius in meters. */
+    double width;       /* GEO_SHAPE_BOX: width in meters. */
+    double height;      /* GEO_SHAPE_BOX: height in meters. */
+} GeoShape;
+
+/* Set of geohash cells covering a search shape. All the cells have the
+ * same step, which is the finest that keeps the bounding box of the shape
+ * within GEO_COVER_MAX_CELLS cells: cells not intersecting the shape are
+ * then discarded. */
+#define GEO_COVER_MAX_CELLS 32
+
+typedef struct {
+    int count;
+    GeoHashBits cells[GEO_COVER_MAX_CELLS];
+} GeoHashCover;
+
 int GeoHashBitsComparator(const GeoHashBits *a, const GeoHashBits *b);
 uint8_t geohashEstimateStepsByRadius(double range_meters, double lat);
 int geohashBoundingBox(double longitude, double latitude, double radius_meters,
@@ -66,5 +92,9 @@ int geohashGetDistanceIfInRadius(double x1, double y1,
 int geohashGetDistanceIfInRadiusWGS84(double x1, double y1, double x2,
                                       double y2, double radius,
                                       double *distance);
+int geohashGetDistanceIfInShape(const GeoShape *shape, double x, double y,
+                                double *distance);
+int geohashShapeBoundingBox(const GeoShape *shape, double *bounds);
+void geohashCoverShape(const GeoShape *shape, GeoHashCover *cover);
 
 #endif /* GEOHASH_HELPER_HPP_ */
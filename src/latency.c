@@ -35,6 +35,11 @@
 
 #include "server.h"
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
 /* Dictionary type for latency events. */
 int dictStringKeyCompare(void *privdata, const void *key1, const void *key2) {
     UNUSED(privdata);
@@ -82,6 +87,40 @@ int THPGetAnonHugePagesSize(void) {
     return zmalloc_get_smap_bytes_by_field("AnonHugePages:",-1);
 }
 
+/* Count the data TLB load misses of the calling thread, in user space, with
+ * the CPU performance counters. The counter is not available in many virtual
+ * machines and containers, or when kernel.perf_event_paranoid forbids it:
+ * in this case TLBMissCounterRead() just returns -1. */
+static int tlb_miss_fd = -1;
+
+void TLBMissCounterInit(void) {
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    struct perf_event_attr attr;
+    unsigned long flags = 0;
+
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+#ifdef PERF_FLAG_FD_CLOEXEC
+    flags = PERF_FLAG_FD_CLOEXEC;
+#endif
+    tlb_miss_fd = syscall(SYS_perf_event_open,&attr,0,-1,-1,flags);
+#endif
+}
+
+long long TLBMissCounterRead(void) {
+    uint64_t count;
+
+    if (tlb_miss_fd == -1) return -1;
+    if (read(tlb_miss_fd,&count,sizeof(count)) != sizeof(count)) return -1;
+    return count;
+}
+
 /* ---------------------------- Latency API --------------------------------- */
 
 /* Latency monitor initialization. We just need to create the dictionary
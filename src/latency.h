@@ -64,6 +64,8 @@ struct latencyStats {
 void latencyMonitorInit(void);
 void latencyAddSample(char *event, mstime_t latency);
 int THPIsEnabled(void);
+void TLBMissCounterInit(void);
+long long TLBMissCounterRead(void);
 
 /* Latency monitoring macros. */
 
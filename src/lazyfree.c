@@ -54,11 +54,15 @@ size_t lazyfreeGetFreeEffort(robj *obj) {
 int dbAsyncDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+    if (dictSize(db->expires) > 0) {
+        expireIndexDel(db,key->ptr);
+        dictDelete(db->expires,key->ptr);
+    }
 
     /* If the value is composed of a few allocations, to free in a lazy way
      * is actually just slower... So under a certain limit we just free
      * the object synchronously. */
+    hashFieldExpiresDelKey(db,key->ptr);
     dictEntry *de = dictUnlink(db->dict,key->ptr);
     if (de) {
         robj *val = dictGetVal(de);
@@ -82,34 +86,67 @@ int dbAsyncDelete(redisDb *db, robj *key) {
     /* Release the key-val pair, or just the key if we set the val
      * field to NULL in order to lazy free it later. */
     if (de) {
+        if (server.cluster_enabled) slotToKeyDel(dictGetKey(de));
+        memTrackDel(db,dictGetKey(de));
         dictFreeUnlinkedEntry(db->dict,de);
-        if (server.cluster_enabled) slotToKeyDel(key);
         return 1;
     } else {
         return 0;
     }
 }
 
+/* Release the hash fields expire times of an emptied DB in the lazyfree
+ * thread: the keys are shared with the main dictionary, the dict type only
+ * frees the values. */
+static void lazyfreeFreeFieldExpiresFromBioThread(void *arg) {
+    dict *hexpires = arg;
+    size_t numkeys = dictSize(hexpires);
+    dictRelease(hexpires);
+    atomicDecr(lazyfree_objects,numkeys);
+}
+
 /* Empty a Redis DB asynchronously. What the function does actually is to
  * create a new empty set of hash tables and scheduling the old ones for
- * lazy freeing. */
+ * lazy freeing. The expire index, the hash fields expire times and the memory
+ * tracking dicts, if any, are released by separated jobs. */
 void emptyDbAsync(redisDb *db) {
     dict *oldht1 = db->dict, *oldht2 = db->expires;
+    rax *oldindex = db->expires_index;
     db->dict = dictCreate(&dbDictType,NULL);
     db->expires = dictCreate(&keyptrDictType,NULL);
+    db->expires_index = NULL;
     atomicIncr(lazyfree_objects,dictSize(oldht1));
     bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,oldht1,oldht2);
+    if (oldindex) {
+        atomicIncr(lazyfree_objects,1);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,oldindex,NULL);
+    }
+    if (dictSize(db->hexpires)) {
+        dict *oldhexpires = db->hexpires;
+        db->hexpires = dictCreate(&hashFieldExpiresDictType,NULL);
+        atomicIncr(lazyfree_objects,dictSize(oldhexpires));
+        bioCreateLazyFreeJob(lazyfreeFreeFieldExpiresFromBioThread,oldhexpires);
+    }
+    if (db->memstats) {
+        dbMemStats *ms = db->memstats;
+        db->memstats = memTrackCreate();
+        /* The stale set only holds the keys written in the last second. */
+        dictRelease(ms->stale);
+        atomicIncr(lazyfree_objects,dictSize(ms->keys));
+        bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,ms->keys,ms->prefixes);
+        zfree(ms);
+    }
 }
 
 /* Empty the slots-keys map of Redis CLuster by creating a new empty one
- * and scheduiling the old for lazy freeing. */
+ * and scheduiling the old for lazy freeing. The slot dicts don't own the
+ * key names, so they can be released after the keys themselves. */
 void slotToKeyFlushAsync(void) {
-    rax *old = server.cluster->slots_to_keys;
+    dict **old = server.cluster->slots_to_keys;
 
-    server.cluster->slots_to_keys = raxNew();
-    memset(server.cluster->slots_keys_count,0,
-           sizeof(server.cluster->slots_keys_count));
-    atomicIncr(lazyfree_objects,old->numele);
+    clusterSlotMigrationFlushed();
+    server.cluster->slots_to_keys = zcalloc(sizeof(dict*)*CLUSTER_SLOTS);
+    atomicIncr(lazyfree_objects,1);
     bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,NULL,old);
 }
 
@@ -132,10 +169,17 @@ void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
     atomicDecr(lazyfree_objects,numkeys);
 }
 
-/* Release the skiplist mapping Redis Cluster keys to slots in the
+/* Release the per slot dicts mapping Redis Cluster keys to slots in the
  * lazyfree thread. */
-void lazyfreeFreeSlotsMapFromBioThread(rax *rt) {
-    size_t len = rt->numele;
-    raxFree(rt);
-    atomicDecr(lazyfree_objects,len);
+void lazyfreeFreeSlotsMapFromBioThread(dict **slots) {
+    for (int j = 0; j < CLUSTER_SLOTS; j++)
+        if (slots[j]) dictRelease(slots[j]);
+    zfree(slots);
+    atomicDecr(lazyfree_objects,1);
+}
+
+/* Release the expire index of an emptied DB in the lazyfree thread. */
+void lazyfreeFreeExpireIndexFromBioThread(rax *index) {
+    expireIndexRelease(index);
+    atomicDecr(lazyfree_objects,1);
 }
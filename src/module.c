@@ -943,9 +943,11 @@ RedisModuleString *moduleAssertUnsharedString(RedisModuleString *str) {
             "for API usage correctness.");
         return NULL;
     }
-    if (str->encoding == OBJ_ENCODING_EMBSTR) {
+    if (str->encoding == OBJ_ENCODING_EMBSTR ||
+        str->encoding == OBJ_ENCODING_INTERNED) {
         /* Note: here we "leak" the additional allocation that was
-         * used in order to store the embedded string in the object. */
+         * used in order to store the embedded string in the object.
+         * The sds of an interned value is shared, so it is copied too. */
         str->ptr = sdsnewlen(str->ptr,sdslen(str->ptr));
         str->encoding = OBJ_ENCODING_RAW;
     } else if (str->encoding == OBJ_ENCODING_INT) {
@@ -2667,6 +2669,7 @@ RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const ch
     c->db = ctx->client->db;
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = c->lastcmd = cmd;
     /* We handle the above format error only when the client is setup so that
      * we can free it normally. */
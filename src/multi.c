@@ -171,7 +171,7 @@ void execCommandPropagateMulti(client *c) {
 void execCommand(client *c) {
     int j;
     robj **orig_argv;
-    int orig_argc;
+    int orig_argc, orig_argv_len;
     struct redisCommand *orig_cmd;
     // 是否需要将MULTI/EXEC命令传播到slave节点/AOF
     int must_propagate = 0; /* Need to propagate MULTI/EXEC to AOF / slaves? */
@@ -214,11 +214,13 @@ void execCommand(client *c) {
     unwatchAllKeys(c); /* Unwatch ASAP otherwise we'll waste CPU cycles */
     orig_argv = c->argv;
     orig_argc = c->argc;
+    orig_argv_len = c->argv_len;
     orig_cmd = c->cmd;
     addReplyMultiBulkLen(c, c->mstate.count);
     for (j = 0; j < c->mstate.count; j++) {
         c->argc = c->mstate.commands[j].argc;
         c->argv = c->mstate.commands[j].argv;
+        c->argv_len = c->argc;
         c->cmd = c->mstate.commands[j].cmd;
 
         /* Propagate a MULTI request once we encounter the first command which
@@ -241,6 +243,7 @@ void execCommand(client *c) {
     }
     c->argv = orig_argv;
     c->argc = orig_argc;
+    c->argv_len = orig_argv_len;
     c->cmd = orig_cmd;
     // 清除事务状态
     discardTransaction(c);
@@ -131,6 +131,8 @@ client *createClient(int fd) {
     c->reqtype = 0;
     c->argc = 0;
     c->argv = NULL;
+    c->argv_len = 0;
+    c->argv_pool_len = 0;
     c->cmd = c->lastcmd = NULL;
     c->multibulklen = 0;
     c->bulklen = -1;
@@ -147,6 +149,8 @@ client *createClient(int fd) {
     c->slave_listening_port = 0;
     c->slave_ip[0] = '\0';
     c->slave_capa = SLAVE_CAPA_NONE;
+    c->ref_repl_buf_node = NULL;
+    c->ref_block_pos = 0;
     c->reply = listCreate();
     c->reply_bytes = 0;
     c->obuf_soft_limit_reached_time = 0;
@@ -607,12 +611,26 @@ void copyClientOutputBuffer(client *dst, client *src) {
     memcpy(dst->buf,src->buf,src->bufpos);
     dst->bufpos = src->bufpos;
     dst->reply_bytes = src->reply_bytes;
+    /* The replication stream is shared, just reference the same data. */
+    if (src->ref_repl_buf_node) {
+        dst->ref_repl_buf_node = src->ref_repl_buf_node;
+        dst->ref_block_pos = src->ref_block_pos;
+        ((replBufBlock *)listNodeValue(src->ref_repl_buf_node))->refcount++;
+    }
 }
 
 /* Return true if the specified client has pending reply buffers to write to
  * the socket. */
 int clientHasPendingReplies(client *c) {
-    return c->bufpos || listLength(c->reply);
+    if (c->bufpos || listLength(c->reply)) return 1;
+
+    /* Slaves may still have to send part of the replication buffer. */
+    if (c->ref_repl_buf_node) {
+        replBufBlock *o = listNodeValue(c->ref_repl_buf_node);
+        return c->ref_block_pos < o->used ||
+               listNextNode(c->ref_repl_buf_node) != NULL;
+    }
+    return 0;
 }
 
 #define MAX_ACCEPTS_PER_CALL 1000
@@ -726,14 +744,59 @@ void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 }
 
+/* Return true if the argument 'o' can be kept in the argv pool of the
+ * client to be reused by the next commands: we must be its only owner, and
+ * it must be a small string whose buffer can be overwritten. */
+static int argvObjectIsReusable(robj *o) {
+    if (o->refcount != 1 || o->type != OBJ_STRING) return 0;
+    if (o->encoding == OBJ_ENCODING_EMBSTR) return 1;
+    return o->encoding == OBJ_ENCODING_RAW &&
+           sdsalloc(o->ptr) <= PROTO_ARGV_POOL_MAX_LEN;
+}
+
 static void freeClientArgv(client *c) {
     int j;
-    for (j = 0; j < c->argc; j++)
-        decrRefCount(c->argv[j]);
+    for (j = 0; j < c->argc; j++) {
+        robj *o = c->argv[j];
+
+        if (c->argv_pool_len < PROTO_ARGV_POOL_SIZE && argvObjectIsReusable(o))
+            c->argv_pool[c->argv_pool_len++] = o;
+        else
+            decrRefCount(o);
+    }
     c->argc = 0;
     c->cmd = NULL;
 }
 
+static void freeClientArgvPool(client *c) {
+    while (c->argv_pool_len)
+        decrRefCount(c->argv_pool[--c->argv_pool_len]);
+}
+
+/* Create the string object for a command argument, like createStringObject()
+ * would, but reusing an object of the argv pool when possible. */
+static robj *createArgvStringObject(client *c, const char *ptr, size_t len) {
+    for (int j = c->argv_pool_len-1; j >= 0; j--) {
+        robj *o = c->argv_pool[j];
+
+        if (overwriteStringObject(o,ptr,len)) {
+            c->argv_pool[j] = c->argv_pool[--c->argv_pool_len];
+            return o;
+        }
+    }
+    return createStringObject(ptr,len);
+}
+
+/* Make sure c->argv can hold 'argc' arguments. The array is reused among
+ * commands, unless it grew too big for a past command. */
+static void clientSetupArgv(client *c, int argc) {
+    if (c->argv_len >= argc &&
+        (c->argv_len <= PROTO_ARGV_KEEP_LEN || argc > c->argv_len/2)) return;
+    zfree(c->argv);
+    c->argv_len = argc < PROTO_ARGV_POOL_SIZE ? PROTO_ARGV_POOL_SIZE : argc;
+    c->argv = zmalloc(sizeof(robj*)*c->argv_len);
+}
+
 /* Close all the slaves connections. This is useful in chained replication
  * when we resync with our own master and want to force all our slaves to
  * resync with us as well. */
@@ -763,6 +826,9 @@ void unlinkClient(client *c) {
             c->client_list_node = NULL;
         }
 
+        /* The slave IO thread may be reading from the master socket. */
+        if (c->flags & CLIENT_MASTER) replicationStopMasterReader();
+
         /* Unregister async I/O handlers and close the socket. */
         aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
         aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
@@ -853,6 +919,7 @@ void freeClient(client *c) {
         ln = listSearchKey(l,c);
         serverAssert(ln != NULL);
         listDelNode(l,ln);
+        slaveReleaseReplBuffer(c);
         /* We need to remember the time when we started to have zero
          * attached slaves, as after some time we'll free the replication
          * backlog. */
@@ -877,6 +944,7 @@ void freeClient(client *c) {
      * and finally release the client structure itself. */
     if (c->name) decrRefCount(c->name);
     zfree(c->argv);
+    freeClientArgvPool(c);
     freeClientMultiState(c);
     sdsfree(c->peerid);
     zfree(c);
@@ -928,7 +996,7 @@ int writeToClient(int fd, client *c, int handler_installed) {
                 c->bufpos = 0;
                 c->sentlen = 0;
             }
-        } else {
+        } else if (listLength(c->reply)) {
             o = listNodeValue(listFirst(c->reply));
             objlen = sdslen(o);
 
@@ -952,6 +1020,27 @@ int writeToClient(int fd, client *c, int handler_installed) {
                 if (listLength(c->reply) == 0)
                     serverAssert(c->reply_bytes == 0);
             }
+        } else {
+            /* Slave: send the shared replication buffer, moving the
+             * reference to the next block once this one is consumed. */
+            listNode *next;
+            replBufBlock *o = listNodeValue(c->ref_repl_buf_node);
+
+            if (c->ref_block_pos < o->used) {
+                nwritten = write(fd, o->buf + c->ref_block_pos,
+                                 o->used - c->ref_block_pos);
+                if (nwritten <= 0) break;
+                c->ref_block_pos += nwritten;
+                totwritten += nwritten;
+            }
+            next = listNextNode(c->ref_repl_buf_node);
+            if (c->ref_block_pos == o->used && next) {
+                o->refcount--;
+                ((replBufBlock *)listNodeValue(next))->refcount++;
+                c->ref_repl_buf_node = next;
+                c->ref_block_pos = 0;
+                incrementalTrimReplicationBacklog();
+            }
         }
         /* Note that we avoid to send more than NET_MAX_WRITES_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
@@ -1145,10 +1234,7 @@ int processInlineBuffer(client *c) {
     sdsrange(c->querybuf,querylen+2,-1);
 
     /* Setup argv array on client structure */
-    if (argc) {
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*)*argc);
-    }
+    if (argc) clientSetupArgv(c,argc);
 
     /*
      * Create redis objects for all arguments.
@@ -1253,8 +1339,7 @@ int processMultibulkBuffer(client *c) {
         c->multibulklen = ll;
 
         /* Setup argv array on client structure */
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+        clientSetupArgv(c,c->multibulklen);
     }
 
     serverAssertWithInfo(c,NULL,c->multibulklen > 0);
@@ -1331,7 +1416,7 @@ int processMultibulkBuffer(client *c) {
                 pos = 0;
             } else {
                 c->argv[c->argc++] =
-                    createStringObject(c->querybuf+pos,c->bulklen);
+                    createArgvStringObject(c,c->querybuf+pos,c->bulklen);
                 pos += c->bulklen+2;
             }
             c->bulklen = -1;
@@ -1849,6 +1934,7 @@ void rewriteClientCommandVector(client *c, int argc, ...) {
     /* Replace argv and argc with our new versions. */
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
     va_end(ap);
@@ -1860,6 +1946,7 @@ void replaceClientCommandVector(client *c, int argc, robj **argv) {
     zfree(c->argv);
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
 }
@@ -1881,7 +1968,10 @@ void rewriteClientCommandArgument(client *c, int i, robj *newval) {
     robj *oldval;
 
     if (i >= c->argc) {
-        c->argv = zrealloc(c->argv,sizeof(robj*)*(i+1));
+        if (i >= c->argv_len) {
+            c->argv = zrealloc(c->argv,sizeof(robj*)*(i+1));
+            c->argv_len = i+1;
+        }
         c->argc = i+1;
         c->argv[i] = NULL;
     }
@@ -1915,7 +2005,10 @@ unsigned long getClientOutputBufferMemoryUsage(client *c) {
     /* The +5 above means we assume an sds16 hdr, may not be true
      * but is not going to be a problem. */
 
-    return c->reply_bytes + (list_item_size*listLength(c->reply));
+    /* For slaves the part of the shared replication buffer not sent yet is
+     * accounted as well, since it is retained because of them. */
+    return c->reply_bytes + (list_item_size*listLength(c->reply)) +
+           slaveReplBufferPendingBytes(c);
 }
 
 /* Get the class of a client, used in order to enforce limits to different
@@ -2006,7 +2099,8 @@ int checkClientOutputBufferLimits(client *c) {
  * lower level functions pushing data inside the client output buffers. */
 void asyncCloseClientOnOutputBufferLimitReached(client *c) {
     serverAssert(c->reply_bytes < SIZE_MAX-(1024*64));
-    if (c->reply_bytes == 0 || c->flags & CLIENT_CLOSE_ASAP) return;
+    if ((c->reply_bytes == 0 && c->ref_repl_buf_node == NULL) ||
+        c->flags & CLIENT_CLOSE_ASAP) return;
     if (checkClientOutputBufferLimits(c)) {
         sds client = catClientInfoString(sdsempty(),c);
 
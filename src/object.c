@@ -128,6 +128,29 @@ robj *createStringObject(const char *ptr, size_t len) {
         return createRawStringObject(ptr, len);
 }
 
+/* Turn the string object 'o', that must not be referenced by anything else,
+ * into the object createStringObject(ptr,len) would return, without any
+ * allocation. This is possible only if the encoding is the one
+ * createStringObject() would use and the sds buffer is big enough: an EMBSTR
+ * object can't grow past the length it was created for. Returns 1 if the
+ * object was overwritten, 0 otherwise. */
+int overwriteStringObject(robj *o, const char *ptr, size_t len) {
+    int encoding = len <= OBJ_ENCODING_EMBSTR_SIZE_LIMIT ?
+                   OBJ_ENCODING_EMBSTR : OBJ_ENCODING_RAW;
+
+    if (o->type != OBJ_STRING || o->encoding != encoding ||
+        sdsalloc(o->ptr) < len) return 0;
+    memcpy(o->ptr, ptr, len);
+    sdssetlen(o->ptr, len);
+    ((char *) o->ptr)[len] = '\0';
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+        o->lru = (LFUGetTimeInMinutes() << 8) | LFU_INIT_VAL;
+    } else {
+        o->lru = LRU_CLOCK();
+    }
+    return 1;
+}
+
 /* Create a string object from a long long value. When possible returns a
  * shared integer object, or at least an integer encoded one.
  *
@@ -203,6 +226,7 @@ robj *dupStringObject(const robj *o) {
         case OBJ_ENCODING_RAW:
             return createRawStringObject(o->ptr, sdslen(o->ptr));
         case OBJ_ENCODING_EMBSTR:
+        case OBJ_ENCODING_INTERNED:
             return createEmbeddedStringObject(o->ptr, sdslen(o->ptr));
         case OBJ_ENCODING_INT:
             d = createObject(OBJ_STRING, NULL);
@@ -449,11 +473,123 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llval) {
     }
 }
 
+/* Interned values.
+ *
+ * Keyspaces where many keys hold one of a few small values ("true", "0",
+ * "pending", ...) waste memory with a copy of the same string for every key.
+ * When intern-values-max-entries is not zero the values not longer than
+ * intern-values-max-len bytes that are set often are kept, up to
+ * intern-values-max-entries of them, in server.interned_values as shared
+ * objects, and tryObjectEncoding() returns them instead of new copies. Like
+ * the shared integers interned objects are never freed.
+ *
+ * Since entries are never released, a value is interned only after it was
+ * set INTERN_ADMIT_COUNT times: server.intern_candidates counts how many
+ * times the values not interned yet were seen. The candidates table is
+ * bounded, when it is full the counters are halved and the values no longer
+ * counted are removed, so values set just once or twice, like timestamps,
+ * don't fill the interned values table.
+ *
+ * A shared object has a single LRU/LFU field, so when a maxmemory policy
+ * needs it per key only the string is shared: every key gets its own small
+ * OBJ_ENCODING_INTERNED object with its own LRU/LFU field, pointing to the
+ * sds of the interned value. The sds is not owned by the object, so unlike
+ * an EMBSTR object it can't be modified nor reused in place. */
+
+#define INTERN_ADMIT_COUNT 4
+#define INTERN_CANDIDATES_MIN 1024
+#define INTERN_CANDIDATES_MAX (1024*1024)
+
+void internedValuesInit(void) {
+    server.interned_values = dictCreate(&keyptrDictType, NULL);
+    server.intern_candidates = dictCreate(&setDictType, NULL);
+}
+
+/* Halve the counters of the intern candidates, removing the ones reaching
+ * zero, until the table has room for a new candidate. */
+static void internCandidatesAge(unsigned long max) {
+    while (dictSize(server.intern_candidates) >= max) {
+        dictIterator *di = dictGetSafeIterator(server.intern_candidates);
+        dictEntry *de;
+
+        while ((de = dictNext(di)) != NULL) {
+            uint64_t count = dictGetUnsignedIntegerVal(de) / 2;
+
+            if (count == 0)
+                dictDelete(server.intern_candidates, dictGetKey(de));
+            else
+                dictSetUnsignedIntegerVal(de, count);
+        }
+        dictReleaseIterator(di);
+    }
+}
+
+/* Count one more occurrence of the value 's', not interned yet. Return 1 if
+ * the value was seen often enough to be interned, 0 otherwise. */
+static int internValueAdmit(sds s) {
+    unsigned long max = server.intern_values_max_entries * 4;
+    dictEntry *de;
+    uint64_t count;
+
+    if (max < INTERN_CANDIDATES_MIN) max = INTERN_CANDIDATES_MIN;
+    if (max > INTERN_CANDIDATES_MAX) max = INTERN_CANDIDATES_MAX;
+    if ((de = dictFind(server.intern_candidates, s)) == NULL) {
+        internCandidatesAge(max);
+        de = dictAddRaw(server.intern_candidates, sdsnewlen(s, sdslen(s)), NULL);
+        dictSetUnsignedIntegerVal(de, 0);
+    }
+    count = dictGetUnsignedIntegerVal(de) + 1;
+    if (count < INTERN_ADMIT_COUNT) {
+        dictSetUnsignedIntegerVal(de, count);
+        return 0;
+    }
+    dictDelete(server.intern_candidates, s);
+    return 1;
+}
+
+/* Return the interned version of the string object 'o' or NULL if the value
+ * is not interned and can't be interned. 'o' is released on success. */
+static robj *tryInternStringObject(robj *o, long value, int isint) {
+    sds s = o->ptr;
+    robj *shared, *new;
+    dictEntry *de;
+    int share_object = server.maxmemory == 0 ||
+        !(server.maxmemory_policy & MAXMEMORY_FLAG_NO_SHARED_INTEGERS);
+
+    /* An INT encoded object has no string to share. */
+    if (isint && !share_object) return NULL;
+    if ((de = dictFind(server.interned_values, s)) != NULL) {
+        shared = dictGetVal(de);
+    } else {
+        if (dictSize(server.interned_values) >= server.intern_values_max_entries ||
+            !internValueAdmit(s)) return NULL;
+        if (isint) {
+            shared = createObject(OBJ_STRING, (void *) value);
+            shared->encoding = OBJ_ENCODING_INT;
+            dictAdd(server.interned_values, sdsnewlen(s, sdslen(s)), shared);
+        } else {
+            shared = createEmbeddedStringObject(s, sdslen(s));
+            dictAdd(server.interned_values, shared->ptr, shared);
+        }
+        makeObjectShared(shared);
+    }
+
+    if (share_object) {
+        new = shared;
+    } else {
+        new = createObject(OBJ_STRING, shared->ptr);
+        new->encoding = OBJ_ENCODING_INTERNED;
+    }
+    decrRefCount(o);
+    return new;
+}
+
 /* Try to encode a string object in order to save space */
 robj *tryObjectEncoding(robj *o) {
     long value;
     sds s = o->ptr;
     size_t len;
+    robj *emb;
 
     /* Make sure this is a string object, the only type we encode
      * in this function. Other types use encoded memory efficient
@@ -487,6 +623,10 @@ robj *tryObjectEncoding(robj *o) {
             decrRefCount(o);
             incrRefCount(shared.integers[value]);
             return shared.integers[value];
+        } else if (server.intern_values_max_entries &&
+                   len <= (size_t) server.intern_values_max_len &&
+                   (emb = tryInternStringObject(o, value, 1)) != NULL) {
+            return emb;
         } else {
             if (o->encoding == OBJ_ENCODING_RAW) sdsfree(o->ptr);
             o->encoding = OBJ_ENCODING_INT;
@@ -500,8 +640,10 @@ robj *tryObjectEncoding(robj *o) {
      * In this representation the object and the SDS string are allocated
      * in the same chunk of memory to save space and cache misses. */
     if (len <= OBJ_ENCODING_EMBSTR_SIZE_LIMIT) {
-        robj *emb;
-
+        if (server.intern_values_max_entries &&
+            len <= (size_t) server.intern_values_max_len &&
+            (emb = tryInternStringObject(o, 0, 0)) != NULL)
+            return emb;
         if (o->encoding == OBJ_ENCODING_EMBSTR) return o;
         emb = createEmbeddedStringObject(s, sdslen(s));
         decrRefCount(o);
@@ -774,6 +916,8 @@ char *strEncoding(int encoding) {
             return "skiplist";
         case OBJ_ENCODING_EMBSTR:
             return "embstr";
+        case OBJ_ENCODING_INTERNED:
+            return "interned";
         default:
             return "unknown";
     }
@@ -825,6 +969,8 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
             asize = sdsAllocSize(o->ptr) + sizeof(*o);
         } else if (o->encoding == OBJ_ENCODING_EMBSTR) {
             asize = sdslen(o->ptr) + 2 + sizeof(*o);
+        } else if (o->encoding == OBJ_ENCODING_INTERNED) {
+            asize = sizeof(*o);
         } else {
             serverPanic("Unknown string encoding");
         }
@@ -833,11 +979,12 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
             quicklist *ql = o->ptr;
             quicklistNode *node = ql->head;
             asize = sizeof(*o) + sizeof(quicklist);
-            do {
+            while (node != NULL && samples < sample_size) {
                 elesize += sizeof(quicklistNode) + ziplistBlobLen(node->zl);
                 samples++;
-            } while ((node = node->next) && samples < sample_size);
-            asize += (double) elesize / samples * ql->len;
+                node = node->next;
+            }
+            if (samples) asize += (double) elesize / samples * ql->len;
         } else if (o->encoding == OBJ_ENCODING_ZIPLIST) {
             asize = sizeof(*o) + ziplistBlobLen(o->ptr);
         } else {
@@ -940,6 +1087,7 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
                 streamCG *cg = ri.data;
                 asize += sizeof(*cg);
                 asize += streamRadixTreeMemoryUsage(cg->pel);
+                asize += streamRadixTreeMemoryUsage(cg->pel_by_time);
                 asize += sizeof(streamNACK) * raxSize(cg->pel);
 
                 /* For each consumer we also need to add the basic data
@@ -1012,7 +1160,7 @@ struct redisMemOverhead *getMemoryOverheadData(void) {
 
     mem = 0;
     if (server.repl_backlog)
-        mem += zmalloc_size(server.repl_backlog);
+        mem += zmalloc_size(server.repl_backlog) + server.repl_buffer_mem;
     mh->repl_backlog = mem;
     mem_total += mem;
 
@@ -1024,7 +1172,9 @@ struct redisMemOverhead *getMemoryOverheadData(void) {
         listRewind(server.slaves, &li);
         while ((ln = listNext(&li))) {
             client *c = listNodeValue(ln);
-            mem += getClientOutputBufferMemoryUsage(c);
+            /* The shared replication buffer is accounted as backlog. */
+            mem += getClientOutputBufferMemoryUsage(c) -
+                   slaveReplBufferPendingBytes(c);
             mem += sdsAllocSize(c->querybuf);
             mem += sizeof(client);
         }
@@ -1242,6 +1392,303 @@ void objectSetLRUOrLFU(robj *val, long long lfu_freq, long long lru_idle,
     }
 }
 
+/* ============================= Memory tracking ============================ */
+
+/* When memory-tracking is enabled every DB keeps in db->memstats an estimate
+ * of the memory used by each key, computed like MEMORY USAGE does with the
+ * default number of samples, and the totals of these estimates by value type
+ * and by key prefix, so MEMORY PREFIXES can report where the memory goes
+ * without scanning the keyspace. The figures are estimates: aggregate values
+ * are sampled, and are not the exact sizes reported by the allocator.
+ *
+ * The estimate of a key is computed when the key is created or overwritten,
+ * and refreshed when the key is modified (see signalModifiedKey()), but at
+ * most once per second: a key modified again in the same second is added to
+ * the 'stale' set, that memTrackCron() refreshes once per second, so a hot
+ * key doesn't pay for an estimate at every write.
+ *
+ * The prefix of a key is the part of the name up to and including the first
+ * occurrence of one of the memory-tracking-delimiters characters, so with the
+ * default delimiter "user:1000:name" is accounted in "user:". Keys without a
+ * delimiter in the first MEMTRACK_PREFIX_MAX_LEN bytes are accounted in the
+ * empty prefix. */
+#define MEMTRACK_PREFIX_MAX_LEN 128
+#define MEMTRACK_STALE_PER_CALL 10000
+
+/* The value of a key in ms->keys packs the estimate, the low bits of the
+ * unix time of the estimate, and the value type. */
+#define MEMTRACK_TYPE_BITS 4
+#define MEMTRACK_TIME_BITS 16
+#define MEMTRACK_BYTES_SHIFT (MEMTRACK_TYPE_BITS+MEMTRACK_TIME_BITS)
+#define MEMTRACK_TYPE(v) ((int)((v) & ((1 << MEMTRACK_TYPE_BITS) - 1)))
+#define MEMTRACK_TIME(v) (((v) >> MEMTRACK_TYPE_BITS) & \
+                          ((1 << MEMTRACK_TIME_BITS) - 1))
+#define MEMTRACK_BYTES(v) ((long long) ((v) >> MEMTRACK_BYTES_SHIFT))
+#define MEMTRACK_NOW() ((uint64_t) server.unixtime & \
+                        ((1 << MEMTRACK_TIME_BITS) - 1))
+
+static const char *memTrackTypeName[OBJ_TYPE_COUNT] = {
+        "string", "list", "set", "zset", "hash", "module", "stream"
+};
+
+dbMemStats *memTrackCreate(void) {
+    dbMemStats *ms = zcalloc(sizeof(*ms));
+    ms->keys = dictCreate(&keyptrDictType, NULL);
+    ms->prefixes = dictCreate(&memPrefixDictType, NULL);
+    ms->stale = dictCreate(&keyptrDictType, NULL);
+    return ms;
+}
+
+void memTrackRelease(dbMemStats *ms) {
+    if (ms == NULL) return;
+    dictRelease(ms->stale);
+    dictRelease(ms->keys);
+    dictRelease(ms->prefixes);
+    zfree(ms);
+}
+
+/* Return the length of the prefix of 'key'. */
+static size_t memTrackPrefixLen(sds key) {
+    size_t len = sdslen(key), j;
+
+    if (len > MEMTRACK_PREFIX_MAX_LEN) len = MEMTRACK_PREFIX_MAX_LEN;
+    for (j = 0; j < len; j++) {
+        if (key[j] != '\0' &&
+            strchr(server.memory_tracking_delimiters, key[j]) != NULL)
+            return j + 1;
+    }
+    return 0;
+}
+
+/* Add 'keys' and 'bytes', that may be negative, to the stats of the type
+ * 'type' and of the prefix of 'key'. Prefixes with no keys are removed. */
+static void memTrackAccount(dbMemStats *ms, sds key, int type,
+                            long long keys, long long bytes) {
+    static sds prefix = NULL;
+    memPrefixStats *ps;
+    dictEntry *de;
+
+    ms->type_keys[type] += keys;
+    ms->type_bytes[type] += bytes;
+
+    if (prefix == NULL) prefix = sdsempty();
+    sdsclear(prefix);
+    prefix = sdscatlen(prefix, key, memTrackPrefixLen(key));
+    if ((de = dictFind(ms->prefixes, prefix)) == NULL) {
+        if (keys <= 0) return;
+        ps = zcalloc(sizeof(*ps));
+        dictAdd(ms->prefixes, sdsdup(prefix), ps);
+    } else {
+        ps = dictGetVal(de);
+    }
+    ps->keys += keys;
+    ps->bytes += bytes;
+    if (ps->keys == 0) dictDelete(ms->prefixes, prefix);
+}
+
+/* Account the key 'key' with value 'val', replacing its previous estimate
+ * if the key was already tracked. 'key' must be the sds stored in db->dict,
+ * since the tracking dict references it without owning it. */
+void memTrackKey(redisDb *db, sds key, robj *val) {
+    dbMemStats *ms = db->memstats;
+    dictEntry *de, *existing;
+    uint64_t bytes;
+
+    if (ms == NULL) return;
+    bytes = objectComputeSize(val, OBJ_COMPUTE_SIZE_DEF_SAMPLES) +
+            sdsAllocSize(key) + sizeof(dictEntry);
+    de = dictAddRaw(ms->keys, key, &existing);
+    memTrackAccount(ms, key, val->type, 1, bytes);
+    if (de == NULL) {
+        uint64_t old = dictGetUnsignedIntegerVal(existing);
+
+        memTrackAccount(ms, key, MEMTRACK_TYPE(old), -1, -MEMTRACK_BYTES(old));
+        /* The key name may be a new sds after an overwrite. */
+        if (existing->key != key) {
+            dictDelete(ms->stale, existing->key);
+            existing->key = key;
+        }
+        de = existing;
+    }
+    dictSetUnsignedIntegerVal(de, (bytes << MEMTRACK_BYTES_SHIFT) |
+                                  (MEMTRACK_NOW() << MEMTRACK_TYPE_BITS) |
+                                  val->type);
+}
+
+/* Like memTrackKey() but looking up the key by name, used after the value
+ * of a key was modified in place. If the estimate of the key was already
+ * computed in this second, the key is just marked as stale, see the top
+ * of this section. */
+void memTrackKeyByName(redisDb *db, sds key) {
+    dbMemStats *ms = db->memstats;
+    dictEntry *de, *tde;
+
+    if (ms == NULL) return;
+    if ((de = dictFind(db->dict, key)) == NULL) return;
+    if ((tde = dictFind(ms->keys, key)) != NULL &&
+        MEMTRACK_TIME(dictGetUnsignedIntegerVal(tde)) == MEMTRACK_NOW())
+    {
+        dictAdd(ms->stale, dictGetKey(de), NULL);
+        return;
+    }
+    memTrackKey(db, dictGetKey(de), dictGetVal(de));
+}
+
+/* Called once per second by serverCron(): refresh the estimates of the keys
+ * that were modified after their last estimate, up to
+ * MEMTRACK_STALE_PER_CALL keys per DB. */
+void memTrackCron(void) {
+    for (int j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db + j;
+        dbMemStats *ms = db->memstats;
+        int count = MEMTRACK_STALE_PER_CALL;
+
+        if (ms == NULL) continue;
+        while (count-- && dictSize(ms->stale)) {
+            dictEntry *de = dictGetRandomKey(ms->stale);
+            sds key = dictGetKey(de);
+
+            dictDelete(ms->stale, key);
+            if ((de = dictFind(db->dict, key)) != NULL)
+                memTrackKey(db, dictGetKey(de), dictGetVal(de));
+        }
+    }
+}
+
+/* Stop tracking 'key', that is going to be removed from the DB. */
+void memTrackDel(redisDb *db, sds key) {
+    dbMemStats *ms = db->memstats;
+    dictEntry *de;
+    uint64_t old;
+
+    if (ms == NULL) return;
+    if ((de = dictFind(ms->keys, key)) == NULL) return;
+    old = dictGetUnsignedIntegerVal(de);
+    memTrackAccount(ms, key, MEMTRACK_TYPE(old), -1, -MEMTRACK_BYTES(old));
+    dictDelete(ms->stale, key);
+    dictDelete(ms->keys, key);
+}
+
+/* Reset the stats of 'db', used when the DB is emptied. */
+void memTrackFlush(redisDb *db) {
+    dbMemStats *ms = db->memstats;
+
+    if (ms == NULL) return;
+    dictEmpty(ms->stale, NULL);
+    dictEmpty(ms->keys, NULL);
+    dictEmpty(ms->prefixes, NULL);
+    memset(ms->type_keys, 0, sizeof(ms->type_keys));
+    memset(ms->type_bytes, 0, sizeof(ms->type_bytes));
+}
+
+/* Start tracking the DBs that are not tracked yet, accounting all their
+ * keys. This blocks the server for a time proportional to the number of
+ * keys. */
+void memTrackEnable(void) {
+    for (int j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db + j;
+        dictIterator *di;
+        dictEntry *de;
+
+        if (db->memstats) continue;
+        db->memstats = memTrackCreate();
+        di = dictGetIterator(db->dict);
+        while ((de = dictNext(di)) != NULL)
+            memTrackKey(db, dictGetKey(de), dictGetVal(de));
+        dictReleaseIterator(di);
+    }
+}
+
+void memTrackDisable(void) {
+    for (int j = 0; j < server.dbnum; j++) {
+        memTrackRelease(server.db[j].memstats);
+        server.db[j].memstats = NULL;
+    }
+}
+
+static int memTrackComparePrefixes(const void *a, const void *b) {
+    const memPrefixStats *pa = dictGetVal(*(dictEntry **) a),
+            *pb = dictGetVal(*(dictEntry **) b);
+
+    if (pa->bytes == pb->bytes) return 0;
+    return pa->bytes > pb->bytes ? -1 : 1;
+}
+
+/* MEMORY PREFIXES [COUNT <count>]: reply with the 'count' key prefixes
+ * using more memory, summing all the DBs, as an array of
+ * [prefix, keys, bytes] entries. */
+static void memoryPrefixesCommand(client *c) {
+    long long count = 10;
+    dict *all;
+    dictIterator *di;
+    dictEntry *de, **entries;
+    unsigned long j, n = 0;
+
+    for (int i = 2; i < c->argc; i++) {
+        if (!strcasecmp(c->argv[i]->ptr, "count") && i + 1 < c->argc) {
+            if (getLongLongFromObjectOrReply(c, c->argv[i + 1], &count, NULL)
+                != C_OK)
+                return;
+            if (count <= 0) {
+                addReplyError(c, "COUNT must be > 0");
+                return;
+            }
+            i++;
+        } else {
+            addReply(c, shared.syntaxerr);
+            return;
+        }
+    }
+    if (!server.memory_tracking) {
+        addReplyError(c, "Memory tracking is disabled, "
+                         "enable it with CONFIG SET memory-tracking yes");
+        return;
+    }
+
+    /* Sum the stats of the prefixes of all the DBs. */
+    all = dictCreate(&memPrefixDictType, NULL);
+    for (int i = 0; i < server.dbnum; i++) {
+        if (server.db[i].memstats == NULL) continue;
+        di = dictGetIterator(server.db[i].memstats->prefixes);
+        while ((de = dictNext(di)) != NULL) {
+            memPrefixStats *ps = dictGetVal(de), *sum;
+            dictEntry *existing, *new;
+
+            new = dictAddRaw(all, dictGetKey(de), &existing);
+            if (new) {
+                new->key = sdsdup(dictGetKey(de));
+                sum = zcalloc(sizeof(*sum));
+                dictSetVal(all, new, sum);
+            } else {
+                sum = dictGetVal(existing);
+            }
+            sum->keys += ps->keys;
+            sum->bytes += ps->bytes;
+        }
+        dictReleaseIterator(di);
+    }
+
+    entries = zmalloc(sizeof(dictEntry *) * (dictSize(all) + 1));
+    di = dictGetIterator(all);
+    while ((de = dictNext(di)) != NULL) entries[n++] = de;
+    dictReleaseIterator(di);
+    qsort(entries, n, sizeof(dictEntry *), memTrackComparePrefixes);
+
+    if ((unsigned long long) count < n) n = count;
+    addReplyMultiBulkLen(c, n);
+    for (j = 0; j < n; j++) {
+        memPrefixStats *ps = dictGetVal(entries[j]);
+        sds prefix = dictGetKey(entries[j]);
+
+        addReplyMultiBulkLen(c, 3);
+        addReplyBulkCBuffer(c, prefix, sdslen(prefix));
+        addReplyLongLong(c, ps->keys);
+        addReplyLongLong(c, ps->bytes);
+    }
+    zfree(entries);
+    dictRelease(all);
+}
+
 /* ======================= The OBJECT and MEMORY commands =================== */
 
 /* This is a helper function for the OBJECT command. We need to lookup keys
@@ -1298,6 +1745,11 @@ void objectCommand(client *c) {
         if ((o = objectCommandLookupOrReply(c, c->argv[2], shared.nullbulk))
             == NULL)
             return;
+        /* With TinyLFU the frequency is the estimation of the sketch. */
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_TINYLFU) {
+            addReplyLongLong(c, evictionSketchFrequency(c->argv[2]->ptr));
+            return;
+        }
         if (!(server.maxmemory_policy & MAXMEMORY_FLAG_LFU)) {
             addReplyError(c,
                           "An LFU maxmemory policy is not selected, access frequency not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
@@ -1317,7 +1769,8 @@ void objectCommand(client *c) {
 /* The memory command will eventually be a complete interface for the
  * memory introspection capabilities of Redis.
  *
- * Usage: MEMORY usage <key> */
+ * Usage: MEMORY usage <key>
+ *        MEMORY prefixes [COUNT <count>] */
 void memoryCommand(client *c) {
     robj *o;
 
@@ -1346,11 +1799,13 @@ void memoryCommand(client *c) {
         size_t usage = objectComputeSize(o, samples);
         usage += sdsAllocSize(c->argv[2]->ptr);
         usage += sizeof(dictEntry);
+        if (o->type == OBJ_HASH)
+            usage += hashFieldExpiresMemoryUsage(c->db, c->argv[2], samples);
         addReplyLongLong(c, usage);
     } else if (!strcasecmp(c->argv[1]->ptr, "stats") && c->argc == 2) {
         struct redisMemOverhead *mh = getMemoryOverheadData();
 
-        addReplyMultiBulkLen(c, (24 + mh->num_dbs) * 2);
+        addReplyMultiBulkLen(c, (24 + mh->num_dbs + (server.memory_tracking != 0)) * 2);
 
         addReplyBulkCString(c, "peak.allocated");
         addReplyLongLong(c, mh->peak_allocated);
@@ -1395,6 +1850,20 @@ void memoryCommand(client *c) {
         addReplyBulkCString(c, "keys.bytes-per-key");
         addReplyLongLong(c, mh->bytes_per_key);
 
+        if (server.memory_tracking) {
+            addReplyBulkCString(c, "keys.bytes-by-type");
+            addReplyMultiBulkLen(c, OBJ_TYPE_COUNT * 2);
+            for (int t = 0; t < OBJ_TYPE_COUNT; t++) {
+                unsigned long long bytes = 0;
+
+                for (int j = 0; j < server.dbnum; j++)
+                    if (server.db[j].memstats)
+                        bytes += server.db[j].memstats->type_bytes[t];
+                addReplyBulkCString(c, memTrackTypeName[t]);
+                addReplyLongLong(c, bytes);
+            }
+        }
+
         addReplyBulkCString(c, "dataset.bytes");
         addReplyLongLong(c, mh->dataset);
 
@@ -1438,6 +1907,8 @@ void memoryCommand(client *c) {
         addReplyLongLong(c, mh->total_frag_bytes);
 
         freeMemoryOverheadData(mh);
+    } else if (!strcasecmp(c->argv[1]->ptr, "prefixes") && c->argc >= 2) {
+        memoryPrefixesCommand(c);
     } else if (!strcasecmp(c->argv[1]->ptr, "malloc-stats") && c->argc == 2) {
 #if defined(USE_JEMALLOC)
         sds info = sdsempty();
@@ -1467,13 +1938,15 @@ void memoryCommand(client *c) {
         /* Nothing to do for other allocators. */
 #endif
     } else if (!strcasecmp(c->argv[1]->ptr, "help") && c->argc == 2) {
-        addReplyMultiBulkLen(c, 5);
+        addReplyMultiBulkLen(c, 6);
         addReplyBulkCString(c,
                             "MEMORY DOCTOR                        - Outputs memory problems report");
         addReplyBulkCString(c,
                             "MEMORY USAGE <key> [SAMPLES <count>] - Estimate memory usage of key");
         addReplyBulkCString(c,
                             "MEMORY STATS                         - Show memory usage details");
+        addReplyBulkCString(c,
+                            "MEMORY PREFIXES [COUNT <count>]      - Show the key prefixes using more memory (estimated)");
         addReplyBulkCString(c,
                             "MEMORY PURGE                         - Ask the allocator to release memory");
         addReplyBulkCString(c,
@@ -95,13 +95,29 @@ typedef struct quicklistLZF {
     char compressed[];
 } quicklistLZF;
 
+/* Bookmarks are allocated with realloc at the end of the quicklist struct,
+ * so they cost no memory to the lists that don't use them. A bookmark keeps
+ * pointing to a valid node when the list is modified: if its node is
+ * deleted it moves to the next one, or it is deleted if there is none.
+ * They are meant for the iteration of very big lists in portions, for
+ * instance by the active defrag, and their number should be kept small,
+ * since every node deletion has to look for them. */
+#define QL_BM_BITS 4
+#define QL_MAX_BM ((1 << QL_BM_BITS)-1)
+typedef struct quicklistBookmark {
+    quicklistNode *node;
+    char *name;
+} quicklistBookmark;
+
 /*
  * quicklist is a 40 byte struct (on 64-bit systems) describing a quicklist.
  * 'count' is the number of total entries.
  * 'len' is the number of quicklist nodes.
  * 'compress' is: -1 if compression disabled, otherwise it's the number
  *                of quicklistNodes to leave uncompressed at ends of quicklist.
- * 'fill' is the user-requested (or default) fill factor. 
+ * 'fill' is the user-requested (or default) fill factor.
+ * 'bookmark_count' is the number of bookmarks, see above: the count fits in
+ *                  the padding of the struct, so its size doesn't change.
  *
  * quicklist是一个描述快速列表的40字节结构（在64位系统上）。
  * 'count'是总条目数。
@@ -122,6 +138,8 @@ typedef struct quicklist {
     int fill : 16;              /* fill factor for individual nodes */
     // 节点压缩深度设置，由 list-compress-depth 给定
     unsigned int compress : 16; /* depth of end nodes not to compress;0=off */
+    unsigned int bookmark_count : QL_BM_BITS;
+    quicklistBookmark bookmarks[];
 } quicklist;
 
 /**
@@ -221,6 +239,14 @@ unsigned long quicklistCount(const quicklist *ql);
 int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
 size_t quicklistGetLzf(const quicklistNode *node, void **data);
 
+/* Bookmarks */
+int quicklistBookmarkCreate(quicklist **ql_ref, const char *name, quicklistNode *node);
+int quicklistBookmarkDelete(quicklist *ql, const char *name);
+quicklistNode *quicklistBookmarkFind(quicklist *ql, const char *name);
+void quicklistBookmarkReplaceNode(quicklist *ql, quicklistNode *old_node,
+                                  quicklistNode *new_node);
+void quicklistBookmarksClear(quicklist *ql);
+
 #ifdef REDIS_TEST
 int quicklistTest(int argc, char *argv[]);
 #endif
@@ -1046,6 +1046,69 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime) {
     return 1;
 }
 
+/* Save the expire times of the fields of the hash at 'key', if any, as an
+ * RDB_OPCODE_FIELD_EXPIRES preceding the key: the number of fields followed
+ * by the field, unix time in milliseconds pairs. Returns 0 if the hash has
+ * no fields with an expire, -1 on error. */
+int rdbSaveFieldExpires(rio *rdb, redisDb *db, robj *key) {
+    hashFieldExpiresIterator it;
+    hashFieldExpires *hfe;
+    dictEntry *de;
+    long long when;
+    sds field;
+
+    if (dictSize(db->hexpires) == 0 ||
+        (de = dictFind(db->hexpires, key->ptr)) == NULL) return 0;
+    hfe = dictGetVal(de);
+    if (rdbSaveType(rdb, RDB_OPCODE_FIELD_EXPIRES) == -1) return -1;
+    if (rdbSaveLen(rdb, hashFieldExpiresLength(hfe)) == -1) return -1;
+
+    hashFieldExpiresInitIterator(&it, hfe);
+    while (hashFieldExpiresNext(&it, &field, &when) == C_OK) {
+        if (rdbSaveRawString(rdb, (unsigned char *) field, sdslen(field)) == -1 ||
+            rdbSaveMillisecondTime(rdb, when) == -1) {
+            sdsfree(field);
+            return -1;
+        }
+        sdsfree(field);
+    }
+    return 1;
+}
+
+/* Load the fields expire times saved by rdbSaveFieldExpires() as a ziplist
+ * of field, time pairs, see hashFieldExpiresRestore(). Returns NULL on
+ * error. The times are not read with rdbLoadMillisecondTime(), that exits
+ * on short reads, since this is also used by RESTORE. */
+unsigned char *rdbLoadFieldExpires(rio *rdb) {
+    unsigned char *zl;
+    uint64_t len;
+
+    if ((len = rdbLoadLen(rdb, NULL)) == RDB_LENERR) return NULL;
+    zl = ziplistNew();
+    while (len--) {
+        char buf[LONG_STR_SIZE];
+        int64_t t64;
+        sds field;
+        int blen;
+
+        if ((field = rdbGenericLoadStringObject(rdb, RDB_LOAD_SDS, NULL)) == NULL) {
+            zfree(zl);
+            return NULL;
+        }
+        if (rioRead(rdb, &t64, 8) == 0) {
+            sdsfree(field);
+            zfree(zl);
+            return NULL;
+        }
+        memrev64ifbe(&t64);
+        blen = ll2string(buf, sizeof(buf), t64);
+        zl = ziplistPush(zl, (unsigned char *) field, sdslen(field), ZIPLIST_TAIL);
+        zl = ziplistPush(zl, (unsigned char *) buf, blen, ZIPLIST_TAIL);
+        sdsfree(field);
+    }
+    return zl;
+}
+
 /* Save an AUX field. */
 ssize_t rdbSaveAuxField(rio *rdb, void *key, size_t keylen, void *val, size_t vallen) {
     ssize_t ret, len = 0;
@@ -1151,6 +1214,7 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
 
             initStaticStringObject(key, keystr);
             expire = getExpire(db, &key);
+            if (rdbSaveFieldExpires(rdb, db, &key) == -1) goto werr;
             if (rdbSaveKeyValuePair(rdb, &key, o, expire) == -1) goto werr;
 
             /*
@@ -1256,8 +1320,8 @@ int rdbSave(char *filename, rdbSaveInfo *rsi) {
         return C_ERR;
     }
 
-    // TODO: 这个方法不知道要干嘛？
-    //rioInitWithFilerioInitWithFile(&rdb, fp);
+    // 初始化基于文件的 rio 对象
+    rioInitWithFile(&rdb, fp);
 
     // rdb 保存是否逐步增加 fsync
     if (server.rdb_save_incremental_fsync)
@@ -1761,6 +1825,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 if (!raxInsert(cgroup->pel, rawid, sizeof(rawid), nack, NULL))
                     rdbExitReportCorruptRDB("Duplicated gobal PEL entry "
                                             "loading stream consumer group");
+                streamIndexNACK(cgroup, rawid, nack);
             }
 
             /* Now that we loaded our global PEL, we need to load the
@@ -1857,17 +1922,23 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 void startLoading(FILE *fp) {
     struct stat sb;
 
-    /* Load the DB */
-    server.loading = 1;
-    server.loading_start_time = time(NULL);
-    server.loading_loaded_bytes = 0;
     if (fstat(fileno(fp), &sb) == -1) {
-        server.loading_total_bytes = 0;
+        startLoadingBytes(0);
     } else {
-        server.loading_total_bytes = sb.st_size;
+        startLoadingBytes(sb.st_size);
     }
 }
 
+/* Like startLoading() but for a payload that is not a file, such as the
+ * RDB read from the master socket. 'total_bytes' is zero if the size of
+ * the payload is not known in advance. */
+void startLoadingBytes(off_t total_bytes) {
+    server.loading = 1;
+    server.loading_start_time = time(NULL);
+    server.loading_loaded_bytes = 0;
+    server.loading_total_bytes = total_bytes;
+}
+
 /* Refresh the loading progress info */
 void loadingProgress(off_t pos) {
     server.loading_loaded_bytes = pos;
@@ -1902,9 +1973,17 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
 /* Load an RDB file from the rio stream 'rdb'. On success C_OK is returned,
  * otherwise C_ERR is returned and 'errno' is set accordingly. */
 int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
+    return rdbLoadRioIntoDbs(rdb, rsi, loading_aof, server.db);
+}
+
+/* Like rdbLoadRio() but the keys are added to the 'dbs' array of
+ * server.dbnum databases instead of server.db. This is used by the
+ * replicas in order to load the dataset sent by the master while the old
+ * one is still in place. */
+int rdbLoadRioIntoDbs(rio *rdb, rdbSaveInfo *rsi, int loading_aof, redisDb *dbs) {
     uint64_t dbid;
     int type, rdbver;
-    redisDb *db = server.db + 0;
+    redisDb *db = dbs + 0;
     char buf[1024];
 
     rdb->update_cksum = rdbLoadProgressCallback;
@@ -1927,6 +2006,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
     /* Key-specific attributes, set by opcodes before the key type. */
     long long lru_idle = -1, lfu_freq = -1, expiretime = -1, now = mstime();
     long long lru_clock = LRU_CLOCK();
+    unsigned char *field_expires = NULL;
 
     while (1) {
         robj *key, *val;
@@ -1950,6 +2030,11 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
              * with RDB v3. Like EXPIRETIME but no with more precision. */
             expiretime = rdbLoadMillisecondTime(rdb, rdbver);
             continue; /* Read next opcode. */
+        } else if (type == RDB_OPCODE_FIELD_EXPIRES) {
+            /* FIELD_EXPIRES: expire times of the fields of the next key. */
+            if (field_expires) zfree(field_expires);
+            if ((field_expires = rdbLoadFieldExpires(rdb)) == NULL) goto eoferr;
+            continue; /* Read next opcode. */
         } else if (type == RDB_OPCODE_FREQ) {
             /* FREQ: LFU frequency. */
             uint8_t byte;
@@ -1975,7 +2060,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
                           "databases. Exiting\n", server.dbnum);
                 exit(1);
             }
-            db = server.db + dbid;
+            db = dbs + dbid;
             continue; /* Read next opcode. */
         } else if (type == RDB_OPCODE_RESIZEDB) {
             /* RESIZEDB: Hint about the size of the keys in the currently
@@ -2082,6 +2167,10 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
 
             /* Set the expire time if needed */
             if (expiretime != -1) setExpire(NULL, db, key, expiretime);
+            if (field_expires) {
+                hashFieldExpiresRestore(db, key, field_expires);
+                field_expires = NULL;
+            }
 
             /* Set usage information (for eviction). */
             objectSetLRUOrLFU(val, lfu_freq, lru_idle, lru_clock);
@@ -2096,6 +2185,10 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
         expiretime = -1;
         lfu_freq = -1;
         lru_idle = -1;
+        if (field_expires) {
+            zfree(field_expires);
+            field_expires = NULL;
+        }
     }
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5) {
@@ -2115,6 +2208,13 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof) {
     return C_OK;
 
     eoferr: /* unexpected end of file is handled here with a fatal exit */
+    if (server.masterhost && server.repl_state == REPL_STATE_TRANSFER) {
+        /* A replica loading the payload of the master can just drop the
+         * link and retry the synchronization. */
+        serverLog(LL_WARNING, "Short read loading the DB sent by the MASTER: %s",
+                  errno ? strerror(errno) : "unexpected EOF");
+        return C_ERR;
+    }
     serverLog(LL_WARNING, "Short read or OOM loading DB. Unrecoverable error, aborting now.");
     rdbExitReportCorruptRDB("Unexpected EOF reading RDB file");
     return C_ERR; /* Just to avoid warning */
@@ -2369,6 +2469,8 @@ int rdbSaveToSlavesSockets(rdbSaveInfo *rsi) {
         rio slave_sockets;
 
         rioInitWithFdset(&slave_sockets, fds, numfds);
+        rioFdsetSetMaxStall(&slave_sockets,
+                            (long long) server.repl_diskless_sync_max_stall * 1000);
         zfree(fds);
 
         closeListeningSockets(0);
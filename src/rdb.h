@@ -96,7 +96,15 @@
 /* Test if a type is an object type. */
 #define rdbIsObjectType(t) ((t >= 0 && t <= 7) || (t >= 9 && t <= 15))
 
-/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). Opcodes
+ * are allocated by upstream downward from 255, the opcodes of this tree
+ * start at 200 to stay clear of them.
+ *
+ * RDB_OPCODE_FIELD_EXPIRES is only written before hashes having fields with
+ * a TTL, so the RDB version is not bumped: files and DUMP payloads without
+ * such hashes can still be loaded by other 5.x servers, that fail on the
+ * unknown opcode otherwise. */
+#define RDB_OPCODE_FIELD_EXPIRES 200 /* Hash fields expire times. */
 #define RDB_OPCODE_MODULE_AUX 247   /* Module auxiliary data. */
 #define RDB_OPCODE_IDLE       248   /* LRU idle time. */
 #define RDB_OPCODE_FREQ       249   /* LFU frequency. */
@@ -202,6 +210,8 @@ size_t rdbSavedObjectLen(robj *o);
 robj *rdbLoadObject(int type, rio *rdb);
 void backgroundSaveDoneHandler(int exitcode, int bysignal);
 int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime);
+int rdbSaveFieldExpires(rio *rdb, redisDb *db, robj *key);
+unsigned char *rdbLoadFieldExpires(rio *rdb);
 robj *rdbLoadStringObject(rio *rdb);
 ssize_t rdbSaveStringObject(rio *rdb, robj *obj);
 ssize_t rdbSaveRawString(rio *rdb, unsigned char *s, size_t len);
@@ -219,6 +229,7 @@ int rdbLoadBinaryFloatValue(rio *rdb, float *val);
  * @return
  */
 int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, int loading_aof);
+int rdbLoadRioIntoDbs(rio *rdb, rdbSaveInfo *rsi, int loading_aof, redisDb *dbs);
 rdbSaveInfo *rdbPopulateSaveInfo(rdbSaveInfo *rsi);
 
 #endif
@@ -39,15 +39,96 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <assert.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <math.h>
 
 #include <sds.h> /* Use hiredis sds. */
 #include "ae.h"
 #include "hiredis.h"
 #include "adlist.h"
 #include "zmalloc.h"
+#include "atomicvar.h"
 
 #define UNUSED(V) ((void) V)
 #define RANDPTR_INITIAL_SIZE 8
+#define MAX_THREADS 500
+
+/* Cluster mode: keys embed the "__tag__" placeholder, replaced before every
+ * request by a fixed size numeric hash tag served by the client node. */
+#define CLUSTER_SLOTS 16384
+#define CLUSTER_TAG_LEN 7 /* strlen("__tag__") */
+#define CLUSTER_TAGS_MIN 200000 /* Tags examined, at least one per node. */
+#define CLUSTER_TAGS_MAX 10000000 /* Every 7 digits tag. */
+
+/* Latencies are recorded, in microseconds, in a log-linear histogram in the
+ * style of HdrHistogram: values below 2*LATENCY_HIST_SUB are exact, then
+ * every power of two range is split in LATENCY_HIST_SUB buckets, so that
+ * the error is always below 1/LATENCY_HIST_SUB (< 1%), up to 2^36 usec. */
+#define LATENCY_HIST_SUB_BITS 7
+#define LATENCY_HIST_SUB (1<<LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS 36
+#define LATENCY_HIST_BUCKETS \
+    ((LATENCY_HIST_MAX_BITS-LATENCY_HIST_SUB_BITS+1)*LATENCY_HIST_SUB)
+
+typedef struct latencyHistogram {
+    long long total;            /* Number of values recorded. */
+    long long counts[LATENCY_HIST_BUCKETS];
+} latencyHistogram;
+
+/* Distributions of the keys (__rand_int__ and --mix keys), see
+ * randomKey(), and of the value sizes of --mix, see randomValueSize(). */
+#define KEY_DIST_UNIFORM 0
+#define KEY_DIST_ZIPF 1
+#define KEY_DIST_HOTSPOT 2
+
+#define VALUE_DIST_FIXED 0
+#define VALUE_DIST_UNIFORM 1
+#define VALUE_DIST_EXPONENTIAL 2
+#define VALUE_DIST_MAX_MEAN_MULT 16 /* Exponential sizes cap, times the mean. */
+
+/* A command of the --mix workload. Every kind of value has its own keys,
+ * so that commands of the mix don't fail with WRONGTYPE. The arguments
+ * "$key", "$member", "$value" and "$score" are replaced at every request. */
+typedef struct mixCommand {
+    const char *name;
+    const char *keyprefix;
+    int argc;
+    const char *argv[5];
+} mixCommand;
+
+static mixCommand mixCommandTable[] = {
+    {"get","key",2,{"GET","$key"}},
+    {"set","key",3,{"SET","$key","$value"}},
+    {"incr","counter",2,{"INCR","$key"}},
+    {"del","key",2,{"DEL","$key"}},
+    {"lpush","list",3,{"LPUSH","$key","$value"}},
+    {"rpush","list",3,{"RPUSH","$key","$value"}},
+    {"lpop","list",2,{"LPOP","$key"}},
+    {"rpop","list",2,{"RPOP","$key"}},
+    {"lrange","list",4,{"LRANGE","$key","0","99"}},
+    {"sadd","set",3,{"SADD","$key","$member"}},
+    {"spop","set",2,{"SPOP","$key"}},
+    {"sismember","set",3,{"SISMEMBER","$key","$member"}},
+    {"hset","hash",4,{"HSET","$key","$member","$value"}},
+    {"hget","hash",3,{"HGET","$key","$member"}},
+    {"hgetall","hash",2,{"HGETALL","$key"}},
+    {"zadd","zset",4,{"ZADD","$key","$score","$member"}},
+    {"zincrby","zset",4,{"ZINCRBY","$key","1","$member"}},
+    {"zrange","zset",4,{"ZRANGE","$key","0","9"}},
+    {"zrevrange","zset",4,{"ZREVRANGE","$key","0","9"}},
+    {"zscore","zset",3,{"ZSCORE","$key","$member"}},
+    {NULL,NULL,0,{NULL}}
+};
+
+typedef struct mixEntry {
+    mixCommand *cmd;
+    double weight;
+    latencyHistogram *latency;
+} mixEntry;
+
+/* Size of the datasets created for the SORT and GEORADIUS tests. */
+#define DATASET_ELEMENTS 10000
 
 static struct config {
     aeEventLoop *el;
@@ -68,7 +149,7 @@ static struct config {
     int showerrors;
     long long start;
     long long totlatency;
-    long long *latency;
+    latencyHistogram *latency;
     const char *title;
     list *clients;
     int quiet;
@@ -79,8 +160,57 @@ static struct config {
     sds dbnumstr;
     char *tests;
     char *auth;
+    int num_threads;
+    struct benchmarkThread **threads;
+    pthread_mutex_t liveclients_mutex;
+    long long end;              /* When the last request completed. */
+    int cluster_mode;
+    int cluster_node_count;
+    struct clusterNode **cluster_nodes;
+    int next_node;              /* Node of the next client created. */
+    const char *tag;            /* Hash tag appended to the default keys. */
+    int json;
+    int csv_header;             /* CSV header already printed. */
+    long long interval;         /* Milliseconds between interval reports. */
+    long long interval_start;   /* Start of the current interval. */
+    long long interval_requests; /* requests_finished at interval_start. */
+    long long *interval_counts; /* Histogram counts at interval_start. */
+    int key_dist;               /* KEY_DIST_* */
+    double zipf_exponent;
+    double zipf_hx1, zipf_hxn, zipf_s; /* Precomputed, see randomZipf(). */
+    double hotspot_keys;        /* Fraction of the keyspace that is hot... */
+    double hotspot_requests;    /* ...and fraction of requests it gets. */
+    int value_dist;             /* VALUE_DIST_* */
+    int value_min, value_max;
+    double value_mean;
+    char *value_data;           /* value_max bytes of payload. */
+    mixEntry *mix;              /* --mix commands, NULL if not used. */
+    int mix_count;
+    double mix_weight;          /* Sum of the weights of the mix. */
+    long long rps;              /* --rps target, 0 = closed loop. */
 } config;
 
+/* With --threads every thread runs its own event loop, serving a part of
+ * the clients. The request counters are shared and updated atomically. */
+typedef struct benchmarkThread {
+    int index;
+    pthread_t thread;
+    aeEventLoop *el;
+} benchmarkThread;
+
+/* A master of the cluster, as reported by CLUSTER SLOTS. */
+typedef struct clusterNode {
+    int index;                  /* Position in config.cluster_nodes. */
+    char *ip;
+    int port;
+    sds name;                   /* "ip:port", used in the reports. */
+    int *tags;                  /* Hash tags hashing to slots of this node. */
+    int tags_count;
+    long long requests_finished;
+    long long redirects;        /* -MOVED / -ASK replies received. */
+    latencyHistogram *latency;
+} clusterNode;
+
 typedef struct _client {
     redisContext *context;
     sds obuf;
@@ -95,11 +225,23 @@ typedef struct _client {
                                such as auth and select are prefixed to the pipeline of
                                benchmark commands and discarded after the first send. */
     int prefixlen;          /* Size in bytes of the pending prefix commands */
+    char **tagptr;          /* Pointers to __tag__ strings inside the command buf */
+    size_t taglen;          /* Number of pointers in client->tagptr */
+    int thread_id;          /* Thread serving the client, -1 without threads. */
+    clusterNode *cluster_node; /* Node the client is connected to (cluster mode). */
+    int *mix_cmds;          /* --mix entry of every request of the pipeline. */
+    long long next_start;   /* --rps: when the next request should start. */
+    long long send_timer;   /* --rps: timer waiting for next_start, or -1. */
 } *client;
 
+#define CLIENT_GET_EVENTLOOP(c) \
+    ((c)->thread_id >= 0 ? config.threads[(c)->thread_id]->el : config.el)
+
 /* Prototypes */
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+static client createClient(char *cmd, size_t len, client from, int thread_id);
 static void createMissingClients(client c);
+int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData);
 
 /* Implementation */
 static long long ustime(void) {
@@ -122,18 +264,323 @@ static long long mstime(void) {
     return mst;
 }
 
+/* ----------------------------- Latency histogram -------------------------- */
+
+static latencyHistogram *createLatencyHistogram(void) {
+    return zcalloc(sizeof(latencyHistogram));
+}
+
+static void resetLatencyHistogram(latencyHistogram *h) {
+    memset(h,0,sizeof(*h));
+}
+
+static int latencyHistogramIndex(long long usec) {
+    int msb, shift;
+
+    if (usec < 2*LATENCY_HIST_SUB) return usec < 0 ? 0 : usec;
+    if (usec >= 1LL<<LATENCY_HIST_MAX_BITS) usec = (1LL<<LATENCY_HIST_MAX_BITS)-1;
+    msb = 63-__builtin_clzll(usec);
+    shift = msb-LATENCY_HIST_SUB_BITS;
+    return shift*LATENCY_HIST_SUB + (usec>>shift);
+}
+
+/* Highest value recorded in the bucket 'idx'. */
+static long long latencyHistogramValue(int idx) {
+    int shift;
+
+    if (idx < 2*LATENCY_HIST_SUB) return idx;
+    shift = idx/LATENCY_HIST_SUB-1;
+    return (((long long)idx-shift*LATENCY_HIST_SUB+1)<<shift)-1;
+}
+
+/* Record a latency. Histograms are shared among threads, so the counters
+ * are updated atomically. */
+static void latencyHistogramRecord(latencyHistogram *h, long long usec) {
+    atomicIncr(h->counts[latencyHistogramIndex(usec)],1);
+    atomicIncr(h->total,1);
+}
+
+/* Copy the counts of 'h' in 'counts', returning the number of values. */
+static long long latencyHistogramSnapshot(latencyHistogram *h, long long *counts) {
+    long long total = 0;
+    int j;
+
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        atomicGet(h->counts[j],counts[j]);
+        total += counts[j];
+    }
+    return total;
+}
+
+/* Return the latency, in milliseconds, at the percentile 'perc' of the
+ * 'total' values in 'counts', 0 if there are none. */
+static double latencyPercentile(long long *counts, long long total, double perc) {
+    long long rank = (long long)(perc*total/100+0.5), seen = 0;
+    int j, last = 0;
+
+    if (total == 0) return 0;
+    if (rank < 1) rank = 1;
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        if (counts[j] == 0) continue;
+        seen += counts[j];
+        last = j;
+        if (seen >= rank) break;
+    }
+    return (double)latencyHistogramValue(last)/1000;
+}
+
+/* ----------------------------- Workload models ----------------------------- */
+
+/* Random number in [0,1) with 62 bits of randomness. */
+static double randomDouble(void) {
+    unsigned long long r = ((unsigned long long)random() << 31) ^ random();
+    return (double)r/((double)(1ULL<<62));
+}
+
+/* Zipf sampling by rejection-inversion (W. Hormann, G. Derflinger, 1996),
+ * that works in constant time and space for any keyspace and exponent.
+ * zipfH() is the density, zipfHIntegral() its integral and
+ * zipfHIntegralInverse() the inverse of the latter. */
+static double zipfHelper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x)/x : 1-x*(0.5-x*(1.0/3-0.25*x));
+}
+
+static double zipfHelper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x)/x : 1+x*0.5*(1+x*(1.0/3)*(1+0.25*x));
+}
+
+static double zipfH(double x) {
+    return exp(-config.zipf_exponent*log(x));
+}
+
+static double zipfHIntegral(double x) {
+    double logx = log(x);
+    return zipfHelper2((1-config.zipf_exponent)*logx)*logx;
+}
+
+static double zipfHIntegralInverse(double x) {
+    double t = x*(1-config.zipf_exponent);
+    if (t < -1) t = -1;
+    return exp(zipfHelper1(t)*x);
+}
+
+static void initZipf(long long n) {
+    config.zipf_hx1 = zipfHIntegral(1.5)-1;
+    config.zipf_hxn = zipfHIntegral(n+0.5);
+    config.zipf_s = 2-zipfHIntegralInverse(zipfHIntegral(2.5)-zipfH(2));
+}
+
+/* Return a rank in [1,n], rank 1 being the most popular. */
+static long long randomZipf(long long n) {
+    while (1) {
+        double u = config.zipf_hxn+randomDouble()*(config.zipf_hx1-config.zipf_hxn);
+        double x = zipfHIntegralInverse(u);
+        long long k = (long long)(x+0.5);
+
+        if (k < 1) k = 1;
+        else if (k > n) k = n;
+        if (k-x <= config.zipf_s || u >= zipfHIntegral(k+0.5)-zipfH(k))
+            return k;
+    }
+}
+
+/* Return a key in [0,keyspacelen) according to --key-dist. */
+static long long randomKey(void) {
+    long long n = config.randomkeys_keyspacelen ? config.randomkeys_keyspacelen : 1;
+
+    switch(config.key_dist) {
+    case KEY_DIST_ZIPF:
+        return randomZipf(n)-1;
+    case KEY_DIST_HOTSPOT: {
+        long long hot = (long long)(n*config.hotspot_keys);
+        if (hot < 1) hot = 1;
+        if (hot >= n || randomDouble() < config.hotspot_requests)
+            return (long long)(randomDouble()*hot);
+        return hot+(long long)(randomDouble()*(n-hot));
+    }
+    default:
+        return (long long)(randomDouble()*n);
+    }
+}
+
+/* Return the size of a --mix value according to --value-size. */
+static int randomValueSize(void) {
+    double size;
+
+    switch(config.value_dist) {
+    case VALUE_DIST_UNIFORM:
+        return config.value_min+
+            (int)(randomDouble()*(config.value_max-config.value_min+1));
+    case VALUE_DIST_EXPONENTIAL:
+        size = -config.value_mean*log(1-randomDouble());
+        if (size < 1) size = 1;
+        if (size > config.value_max) size = config.value_max;
+        return (int)size;
+    default:
+        return config.value_max;
+    }
+}
+
+/* Fill the request buffer of 'c' with 'pipeline' commands picked at random
+ * from the --mix, with their keys, members and values. The prefix commands
+ * not sent yet are preserved. */
+static void buildMixRequest(client c) {
+    const char *argv[5];
+    size_t argvlen[5];
+    char key[64], member[32], score[32];
+    int j, k;
+
+    sdssetlen(c->obuf,c->prefixlen);
+    c->obuf[c->prefixlen] = '\0';
+    for (j = 0; j < config.pipeline; j++) {
+        double r = randomDouble()*config.mix_weight;
+        mixCommand *cmd;
+        char *buf;
+        int len;
+
+        for (k = 0; k < config.mix_count-1; k++) {
+            if (r < config.mix[k].weight) break;
+            r -= config.mix[k].weight;
+        }
+        c->mix_cmds[j] = k;
+        cmd = config.mix[k].cmd;
+        for (k = 0; k < cmd->argc; k++) {
+            const char *arg = cmd->argv[k];
+
+            if (!strcmp(arg,"$key")) {
+                if (config.cluster_mode) {
+                    clusterNode *node = c->cluster_node;
+                    snprintf(key,sizeof(key),"%s:{%0*d}:%012lld",
+                        cmd->keyprefix,CLUSTER_TAG_LEN,
+                        node->tags[random() % node->tags_count],randomKey());
+                } else {
+                    snprintf(key,sizeof(key),"%s:%012lld",
+                        cmd->keyprefix,randomKey());
+                }
+                argv[k] = key;
+                argvlen[k] = strlen(key);
+            } else if (!strcmp(arg,"$member")) {
+                snprintf(member,sizeof(member),"element:%012lld",randomKey());
+                argv[k] = member;
+                argvlen[k] = strlen(member);
+            } else if (!strcmp(arg,"$score")) {
+                snprintf(score,sizeof(score),"%ld",random());
+                argv[k] = score;
+                argvlen[k] = strlen(score);
+            } else if (!strcmp(arg,"$value")) {
+                argv[k] = config.value_data;
+                argvlen[k] = randomValueSize();
+            } else {
+                argv[k] = arg;
+                argvlen[k] = strlen(arg);
+            }
+        }
+        len = redisFormatCommandArgv(&buf,cmd->argc,argv,argvlen);
+        c->obuf = sdscatlen(c->obuf,buf,len);
+        free(buf);
+    }
+}
+
+/* Parse the --mix argument, in the form "get:80,set:15,zadd:5". */
+static int parseMix(const char *spec) {
+    int count, j;
+    sds *parts = sdssplitlen(spec,strlen(spec),",",1,&count);
+
+    config.mix = zcalloc(sizeof(mixEntry)*count);
+    config.mix_count = 0;
+    config.mix_weight = 0;
+    for (j = 0; j < count; j++) {
+        char *colon = strchr(parts[j],':');
+        mixCommand *cmd;
+        double weight = 1;
+
+        if (colon) {
+            *colon = '\0';
+            weight = strtod(colon+1,NULL);
+        }
+        for (cmd = mixCommandTable; cmd->name; cmd++)
+            if (!strcasecmp(cmd->name,parts[j])) break;
+        if (cmd->name == NULL || weight <= 0) {
+            fprintf(stderr,"Invalid --mix command \"%s\", available commands:",
+                parts[j]);
+            for (cmd = mixCommandTable; cmd->name; cmd++)
+                fprintf(stderr," %s",cmd->name);
+            fprintf(stderr,"\n");
+            sdsfreesplitres(parts,count);
+            return 0;
+        }
+        config.mix[config.mix_count].cmd = cmd;
+        config.mix[config.mix_count].weight = weight;
+        config.mix[config.mix_count].latency = createLatencyHistogram();
+        config.mix_count++;
+        config.mix_weight += weight;
+    }
+    sdsfreesplitres(parts,count);
+    return config.mix_count > 0;
+}
+
+/* Parse --key-dist: uniform, zipf:<exponent> or hotspot:<keys>:<requests>
+ * where <keys> and <requests> are fractions in (0,1). */
+static int parseKeyDist(const char *spec) {
+    if (!strcasecmp(spec,"uniform")) {
+        config.key_dist = KEY_DIST_UNIFORM;
+    } else if (!strncasecmp(spec,"zipf:",5)) {
+        config.key_dist = KEY_DIST_ZIPF;
+        config.zipf_exponent = strtod(spec+5,NULL);
+        if (config.zipf_exponent <= 0) return 0;
+    } else if (!strncasecmp(spec,"hotspot:",8)) {
+        config.key_dist = KEY_DIST_HOTSPOT;
+        if (sscanf(spec+8,"%lf:%lf",&config.hotspot_keys,
+                   &config.hotspot_requests) != 2) return 0;
+        if (config.hotspot_keys <= 0 || config.hotspot_keys >= 1 ||
+            config.hotspot_requests <= 0 || config.hotspot_requests > 1)
+            return 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* Parse --value-size: <bytes>, uniform:<min>:<max> or exponential:<mean>. */
+static int parseValueSize(const char *spec) {
+    if (!strncasecmp(spec,"uniform:",8)) {
+        config.value_dist = VALUE_DIST_UNIFORM;
+        if (sscanf(spec+8,"%d:%d",&config.value_min,&config.value_max) != 2)
+            return 0;
+        if (config.value_min < 1 || config.value_max < config.value_min)
+            return 0;
+    } else if (!strncasecmp(spec,"exponential:",12)) {
+        config.value_dist = VALUE_DIST_EXPONENTIAL;
+        config.value_mean = strtod(spec+12,NULL);
+        if (config.value_mean < 1) return 0;
+        config.value_max = config.value_mean*VALUE_DIST_MAX_MEAN_MULT;
+    } else {
+        config.value_dist = VALUE_DIST_FIXED;
+        config.value_max = atoi(spec);
+        if (config.value_max < 1) return 0;
+    }
+    if (config.value_max > 1024*1024*1024) return 0;
+    return 1;
+}
+
 static void freeClient(client c) {
+    aeEventLoop *el = CLIENT_GET_EVENTLOOP(c);
     listNode *ln;
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
+    if (c->send_timer != -1) aeDeleteTimeEvent(el,c->send_timer);
+    aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(el,c->context->fd,AE_READABLE);
     redisFree(c->context);
     sdsfree(c->obuf);
     zfree(c->randptr);
+    zfree(c->tagptr);
+    zfree(c->mix_cmds);
     zfree(c);
+    if (config.num_threads) pthread_mutex_lock(&config.liveclients_mutex);
     config.liveclients--;
     ln = listSearchKey(config.clients,c);
     assert(ln != NULL);
     listDelNode(config.clients,ln);
+    if (config.num_threads) pthread_mutex_unlock(&config.liveclients_mutex);
 }
 
 static void freeAllClients(void) {
@@ -147,9 +594,10 @@ static void freeAllClients(void) {
 }
 
 static void resetClient(client c) {
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
-    aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    aeEventLoop *el = CLIENT_GET_EVENTLOOP(c);
+    aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(el,c->context->fd,AE_READABLE);
+    aeCreateFileEvent(el,c->context->fd,AE_WRITABLE,writeHandler,c);
     c->written = 0;
     c->pending = config.pipeline;
 }
@@ -159,7 +607,7 @@ static void randomizeClientKey(client c) {
 
     for (i = 0; i < c->randlen; i++) {
         char *p = c->randptr[i]+11;
-        size_t r = random() % config.randomkeys_keyspacelen;
+        size_t r = randomKey();
         size_t j;
 
         for (j = 0; j < 12; j++) {
@@ -170,18 +618,36 @@ static void randomizeClientKey(client c) {
     }
 }
 
+/* Write in the command buffer of 'c' a hash tag served by the client node,
+ * so that the keys of the request don't get redirected. The same tag is
+ * used for all the keys, so multi keys commands hit a single slot. */
+static void setClusterKeyHashTag(client c) {
+    clusterNode *node = c->cluster_node;
+    char tag[CLUSTER_TAG_LEN+1];
+    size_t i;
+
+    snprintf(tag,sizeof(tag),"%0*d",CLUSTER_TAG_LEN,
+        node->tags[random() % node->tags_count]);
+    for (i = 0; i < c->taglen; i++)
+        memcpy(c->tagptr[i],tag,CLUSTER_TAG_LEN);
+}
+
 static void clientDone(client c) {
-    if (config.requests_finished == config.requests) {
+    int requests_finished;
+
+    atomicGet(config.requests_finished,requests_finished);
+    if (requests_finished >= config.requests) {
+        aeEventLoop *el = CLIENT_GET_EVENTLOOP(c);
         freeClient(c);
-        aeStop(config.el);
+        aeStop(el);
         return;
     }
     if (config.keepalive) {
         resetClient(c);
     } else {
-        config.liveclients--;
-        createMissingClients(c);
-        config.liveclients++;
+        /* Replace the client with a new connection, served by the same
+         * thread since the event loop of the others can't be touched. */
+        createClient(NULL,0,c,c->thread_id);
         freeClient(c);
     }
 }
@@ -213,6 +679,13 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                     exit(1);
                 }
 
+                if (config.cluster_mode) {
+                    redisReply *r = reply;
+                    if (r->type == REDIS_REPLY_ERROR &&
+                        (!strncmp(r->str,"MOVED",5) || !strncmp(r->str,"ASK",3)))
+                        atomicIncr(c->cluster_node->redirects,1);
+                }
+
                 if (config.showerrors) {
                     static time_t lasterr_time = 0;
                     time_t now = time(NULL);
@@ -236,13 +709,30 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                         * we need to randomize. */
                         for (j = 0; j < c->randlen; j++)
                             c->randptr[j] -= c->prefixlen;
+                        for (j = 0; j < c->taglen; j++)
+                            c->tagptr[j] -= c->prefixlen;
                         c->prefixlen = 0;
                     }
                     continue;
                 }
 
-                if (config.requests_finished < config.requests)
-                    config.latency[config.requests_finished++] = c->latency;
+                int requests_finished;
+                atomicGetIncr(config.requests_finished,requests_finished,1);
+                if (requests_finished < config.requests) {
+                    latencyHistogramRecord(config.latency,c->latency);
+                    if (config.mix) {
+                        int idx = c->mix_cmds[config.pipeline-c->pending];
+                        latencyHistogramRecord(config.mix[idx].latency,
+                                               c->latency);
+                    }
+                    if (config.cluster_mode) {
+                        latencyHistogramRecord(c->cluster_node->latency,
+                                               c->latency);
+                        atomicIncr(c->cluster_node->requests_finished,1);
+                    }
+                    if (requests_finished == config.requests-1)
+                        config.end = mstime();
+                }
                 c->pending--;
                 if (c->pending == 0) {
                     clientDone(c);
@@ -255,24 +745,63 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 }
 
+/* --rps: the time of the next request of the client came. */
+static int clientSendTimer(aeEventLoop *el, long long id, void *privdata) {
+    client c = privdata;
+    UNUSED(id);
+
+    c->send_timer = -1;
+    aeCreateFileEvent(el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    return AE_NOMORE;
+}
+
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     client c = privdata;
-    UNUSED(el);
     UNUSED(fd);
     UNUSED(mask);
 
     /* Initialize request when nothing was written. */
     if (c->written == 0) {
+        long long now = ustime();
+
+        /* With --rps every client sends a request every
+         * numclients*pipeline/rps seconds: wait if it's too early. */
+        if (config.rps) {
+            long long interval = 1000000LL*config.numclients*config.pipeline/
+                                 config.rps;
+            if (c->next_start == 0)
+                c->next_start = now+(long long)(randomDouble()*interval);
+            if (c->next_start-now >= 1000) {
+                aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+                c->send_timer = aeCreateTimeEvent(el,
+                    (c->next_start-now)/1000,clientSendTimer,c,NULL);
+                return;
+            }
+        }
+
         /* Enforce upper bound to number of requests. */
-        if (config.requests_issued++ >= config.requests) {
+        int requests_issued;
+        atomicGetIncr(config.requests_issued,requests_issued,1);
+        if (requests_issued >= config.requests) {
             freeClient(c);
             return;
         }
 
         /* Really initialize: randomize keys and set start time. */
+        if (config.mix) buildMixRequest(c);
         if (config.randomkeys) randomizeClientKey(c);
-        c->start = ustime();
+        if (c->taglen) setClusterKeyHashTag(c);
+        c->start = now;
         c->latency = -1;
+
+        /* When late, the latency is measured from the time the request
+         * should have been sent, otherwise a slow server would also slow
+         * down the load, hiding its latency (coordinated omission). */
+        if (config.rps) {
+            if (c->next_start < now) c->start = c->next_start;
+            c->next_start += 1000000LL*config.numclients*config.pipeline/
+                             config.rps;
+        }
     }
 
     if (sdslen(c->obuf) > c->written) {
@@ -286,8 +815,8 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         c->written += nwritten;
         if (sdslen(c->obuf) == c->written) {
-            aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-            aeCreateFileEvent(config.el,c->context->fd,AE_READABLE,readHandler,c);
+            aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+            aeCreateFileEvent(el,c->context->fd,AE_READABLE,readHandler,c);
         }
     }
 }
@@ -312,20 +841,42 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
  * 2) The offsets of the __rand_int__ elements inside the command line, used
  *    for arguments randomization.
  *
- * Even when cloning another client, prefix commands are applied if needed.*/
-static client createClient(char *cmd, size_t len, client from) {
+ * Even when cloning another client, prefix commands are applied if needed.
+ *
+ * The client is served by the thread 'thread_id', or by the next thread in
+ * a round robin fashion if -1 is given. In cluster mode it connects to the
+ * next node, again in a round robin fashion. */
+static client createClient(char *cmd, size_t len, client from, int thread_id) {
     int j;
     client c = zmalloc(sizeof(struct _client));
+    const char *ip = config.hostip;
+    int port = config.hostport;
+
+    c->cluster_node = NULL;
+    if (config.cluster_mode) {
+        int node_idx;
+        atomicGetIncr(config.next_node,node_idx,1);
+        c->cluster_node =
+            config.cluster_nodes[node_idx % config.cluster_node_count];
+        ip = c->cluster_node->ip;
+        port = c->cluster_node->port;
+    }
+    c->thread_id = -1;
+    if (config.num_threads) {
+        static int next_thread = 0;
+        if (thread_id < 0) thread_id = next_thread++ % config.num_threads;
+        c->thread_id = thread_id;
+    }
 
-    if (config.hostsocket == NULL) {
-        c->context = redisConnectNonBlock(config.hostip,config.hostport);
+    if (config.hostsocket == NULL || config.cluster_mode) {
+        c->context = redisConnectNonBlock(ip,port);
     } else {
         c->context = redisConnectUnixNonBlock(config.hostsocket);
     }
     if (c->context->err) {
         fprintf(stderr,"Could not connect to Redis at ");
-        if (config.hostsocket == NULL)
-            fprintf(stderr,"%s:%d: %s\n",config.hostip,config.hostport,c->context->errstr);
+        if (config.hostsocket == NULL || config.cluster_mode)
+            fprintf(stderr,"%s:%d: %s\n",ip,port,c->context->errstr);
         else
             fprintf(stderr,"%s: %s\n",config.hostsocket,c->context->errstr);
         exit(1);
@@ -373,6 +924,11 @@ static client createClient(char *cmd, size_t len, client from) {
     c->pending = config.pipeline+c->prefix_pending;
     c->randptr = NULL;
     c->randlen = 0;
+    c->tagptr = NULL;
+    c->taglen = 0;
+    c->mix_cmds = config.mix ? zmalloc(sizeof(int)*config.pipeline) : NULL;
+    c->next_start = 0;
+    c->send_timer = -1;
 
     /* Find substrings in the output buffer that need to be randomized. */
     if (config.randomkeys) {
@@ -403,10 +959,33 @@ static client createClient(char *cmd, size_t len, client from) {
             }
         }
     }
+
+    /* Find the hash tags to set, in cluster mode. */
+    if (config.cluster_mode) {
+        if (from) {
+            c->taglen = from->taglen;
+            c->tagptr = zmalloc(sizeof(char*)*(c->taglen+1));
+            for (j = 0; j < (int)c->taglen; j++) {
+                c->tagptr[j] = c->obuf + (from->tagptr[j]-from->obuf);
+                c->tagptr[j] += c->prefixlen - from->prefixlen;
+            }
+        } else {
+            char *p = c->obuf;
+
+            while ((p = strstr(p,"__tag__")) != NULL) {
+                c->tagptr = zrealloc(c->tagptr,sizeof(char*)*(c->taglen+1));
+                c->tagptr[c->taglen++] = p;
+                p += CLUSTER_TAG_LEN;
+            }
+        }
+    }
     if (config.idlemode == 0)
-        aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
+        aeCreateFileEvent(CLIENT_GET_EVENTLOOP(c),c->context->fd,AE_WRITABLE,
+            writeHandler,c);
+    if (config.num_threads) pthread_mutex_lock(&config.liveclients_mutex);
     listAddNodeTail(config.clients,c);
     config.liveclients++;
+    if (config.num_threads) pthread_mutex_unlock(&config.liveclients_mutex);
     return c;
 }
 
@@ -414,7 +993,7 @@ static void createMissingClients(client c) {
     int n = 0;
 
     while(config.liveclients < config.numclients) {
-        createClient(NULL,0,c);
+        createClient(NULL,0,c,-1);
 
         /* Listen backlog is quite limited on most systems */
         if (++n > 64) {
@@ -424,38 +1003,297 @@ static void createMissingClients(client c) {
     }
 }
 
-static int compareLatency(const void *a, const void *b) {
-    return (*(long long*)a)-(*(long long*)b);
+/* Print 'str' as a JSON string. */
+static void printJsonString(const char *str) {
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') printf("\\%c",*str);
+        else if ((unsigned char)*str < 0x20) printf("\\u%04x",*str);
+        else putchar(*str);
+    }
+    putchar('"');
+}
+
+/* The percentiles shown in every report. */
+static const double reportPercentiles[] = {50,99,99.9,99.99,100};
+static const char *reportPercentileNames[] = {"p50","p99","p99.9","p99.99","max"};
+#define REPORT_PERCENTILES (sizeof(reportPercentiles)/sizeof(double))
+
+static void printPercentilesText(long long *counts, long long total) {
+    size_t j;
+
+    for (j = 0; j < REPORT_PERCENTILES; j++)
+        printf("%s%s=%.3f", j ? " " : "", reportPercentileNames[j],
+            latencyPercentile(counts,total,reportPercentiles[j]));
+}
+
+static void printPercentilesJson(long long *counts, long long total) {
+    size_t j;
+
+    printf("\"latency_ms\":{");
+    for (j = 0; j < REPORT_PERCENTILES; j++)
+        printf("%s\"%s\":%.3f", j ? "," : "", reportPercentileNames[j],
+            latencyPercentile(counts,total,reportPercentiles[j]));
+    printf("}");
+}
+
+/* Show the cumulative distribution in the HdrHistogram way: the percentile
+ * of each line halves the distance from 100% of the previous one. */
+static void showLatencyDistribution(long long *counts, long long total) {
+    double perc = 0;
+    long long prev = -1;
+
+    printf("Latency by percentile distribution:\n");
+    while (total) {
+        double ms = latencyPercentile(counts,total,perc);
+        long long usec = (long long)(ms*1000+0.5);
+
+        if (usec != prev) {
+            long long cumulative = 0;
+            int j;
+            for (j = 0; j < LATENCY_HIST_BUCKETS &&
+                        latencyHistogramValue(j) <= usec; j++)
+                cumulative += counts[j];
+            printf("%.3f%% <= %.3f milliseconds (cumulative count %lld)\n",
+                (double)cumulative*100/total, ms, cumulative);
+            prev = usec;
+        }
+        if (perc >= 100 || (100-perc)*total < 100) break;
+        perc += (100-perc)/2;
+    }
+    if (total && prev != (long long)(latencyPercentile(counts,total,100)*1000+0.5)) {
+        printf("%.3f%% <= %.3f milliseconds (cumulative count %lld)\n",
+            100.0, latencyPercentile(counts,total,100), total);
+    }
+}
+
+/* Show the throughput and the latency percentiles of every cluster node. */
+static void showClusterNodesReport(long long *counts) {
+    int i;
+
+    printf("  %d cluster nodes:\n", config.cluster_node_count);
+    for (i = 0; i < config.cluster_node_count; i++) {
+        clusterNode *node = config.cluster_nodes[i];
+        long long total = latencyHistogramSnapshot(node->latency,counts);
+
+        printf("    %s: %lld requests, %.2f requests per second, ",
+            node->name, total, (float)total/((float)config.totlatency/1000));
+        printPercentilesText(counts,total);
+        printf(" ms");
+        if (node->redirects)
+            printf(", %lld redirects", node->redirects);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/* Show the share of the requests and the latency percentiles of every
+ * command of the --mix. */
+static void showMixReport(long long *counts, long long requests) {
+    int i;
+
+    printf("  %d commands mix:\n", config.mix_count);
+    for (i = 0; i < config.mix_count; i++) {
+        long long total = latencyHistogramSnapshot(config.mix[i].latency,counts);
+
+        printf("    %s: %lld requests (%.2f%%), ",
+            config.mix[i].cmd->name, total,
+            requests ? (double)total*100/requests : 0);
+        printPercentilesText(counts,total);
+        printf(" ms\n");
+    }
+    printf("\n");
 }
 
 static void showLatencyReport(void) {
-    int i, curlat = 0;
-    float perc, reqpersec;
+    long long *counts = zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+    long long total = latencyHistogramSnapshot(config.latency,counts);
+    float reqpersec;
+    size_t j;
+    int i;
 
     reqpersec = (float)config.requests_finished/((float)config.totlatency/1000);
-    if (!config.quiet && !config.csv) {
+    if (config.json) {
+        printf("{\"test\":");
+        printJsonString(config.title);
+        printf(",\"requests\":%d,\"seconds\":%.3f,\"rps\":%.2f,",
+            config.requests_finished, (float)config.totlatency/1000, reqpersec);
+        printPercentilesJson(counts,total);
+        if (config.cluster_mode) {
+            long long *node_counts =
+                zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+            printf(",\"nodes\":[");
+            for (i = 0; i < config.cluster_node_count; i++) {
+                clusterNode *node = config.cluster_nodes[i];
+                long long node_total =
+                    latencyHistogramSnapshot(node->latency,node_counts);
+                printf("%s{\"node\":\"%s\",\"requests\":%lld,\"rps\":%.2f,"
+                       "\"redirects\":%lld,", i ? "," : "", node->name,
+                    node_total,
+                    (float)node_total/((float)config.totlatency/1000),
+                    node->redirects);
+                printPercentilesJson(node_counts,node_total);
+                printf("}");
+            }
+            printf("]");
+            zfree(node_counts);
+        }
+        if (config.mix) {
+            long long *cmd_counts =
+                zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+            printf(",\"commands\":[");
+            for (i = 0; i < config.mix_count; i++) {
+                long long cmd_total =
+                    latencyHistogramSnapshot(config.mix[i].latency,cmd_counts);
+                printf("%s{\"command\":\"%s\",\"requests\":%lld,",
+                    i ? "," : "", config.mix[i].cmd->name, cmd_total);
+                printPercentilesJson(cmd_counts,cmd_total);
+                printf("}");
+            }
+            printf("]");
+            zfree(cmd_counts);
+        }
+        printf("}\n");
+    } else if (!config.quiet && !config.csv) {
         printf("====== %s ======\n", config.title);
         printf("  %d requests completed in %.2f seconds\n", config.requests_finished,
             (float)config.totlatency/1000);
         printf("  %d parallel clients\n", config.numclients);
-        printf("  %d bytes payload\n", config.datasize);
+        if (config.mix && config.value_dist == VALUE_DIST_UNIFORM)
+            printf("  %d to %d bytes payload\n", config.value_min, config.value_max);
+        else if (config.mix && config.value_dist == VALUE_DIST_EXPONENTIAL)
+            printf("  %.0f bytes payload on average\n", config.value_mean);
+        else
+            printf("  %d bytes payload\n", config.mix ? config.value_max :
+                                                        config.datasize);
         printf("  keep alive: %d\n", config.keepalive);
+        if (config.num_threads)
+            printf("  threads: %d\n", config.num_threads);
         printf("\n");
-
-        qsort(config.latency,config.requests,sizeof(long long),compareLatency);
-        for (i = 0; i < config.requests; i++) {
-            if (config.latency[i]/1000 != curlat || i == (config.requests-1)) {
-                curlat = config.latency[i]/1000;
-                perc = ((float)(i+1)*100)/config.requests;
-                printf("%.2f%% <= %d milliseconds\n", perc, curlat);
-            }
+        if (config.cluster_mode) {
+            long long *node_counts =
+                zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+            showClusterNodesReport(node_counts);
+            zfree(node_counts);
+        }
+        if (config.mix) {
+            long long *cmd_counts =
+                zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+            showMixReport(cmd_counts,total);
+            zfree(cmd_counts);
         }
+        if (config.rps)
+            printf("  target: %lld requests per second\n\n", config.rps);
+
+        showLatencyDistribution(counts,total);
+        printf("\n");
+        printPercentilesText(counts,total);
+        printf(" milliseconds\n");
         printf("%.2f requests per second\n\n", reqpersec);
     } else if (config.csv) {
-        printf("\"%s\",\"%.2f\"\n", config.title, reqpersec);
+        if (!config.csv_header) {
+            printf("\"test\",\"rps\"");
+            for (j = 0; j < REPORT_PERCENTILES; j++)
+                printf(",\"%s_latency_ms\"",reportPercentileNames[j]);
+            printf("\n");
+            config.csv_header = 1;
+        }
+        printf("\"%s\",\"%.2f\"", config.title, reqpersec);
+        for (j = 0; j < REPORT_PERCENTILES; j++)
+            printf(",\"%.3f\"",
+                latencyPercentile(counts,total,reportPercentiles[j]));
+        printf("\n");
     } else {
-        printf("%s: %.2f requests per second\n", config.title, reqpersec);
+        printf("%s: %.2f requests per second, ", config.title, reqpersec);
+        printPercentilesText(counts,total);
+        printf(" ms\n");
     }
+    zfree(counts);
+}
+
+/* Show the throughput and the latency percentiles of the requests completed
+ * since the previous call, for the --interval time series mode. */
+static void showIntervalReport(long long now) {
+    long long *counts = zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+    long long total, requests;
+    float dt = (float)(now-config.interval_start)/1000;
+    int j, requests_finished;
+
+    latencyHistogramSnapshot(config.latency,counts);
+    total = 0;
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        long long count = counts[j];
+        counts[j] -= config.interval_counts[j];
+        config.interval_counts[j] = count;
+        total += counts[j];
+    }
+    atomicGet(config.requests_finished,requests_finished);
+    requests = requests_finished-config.interval_requests;
+    config.interval_requests = requests_finished;
+    config.interval_start = now;
+
+    if (config.json) {
+        printf("{\"test\":");
+        printJsonString(config.title);
+        printf(",\"interval\":true,\"time\":%.3f,\"rps\":%.2f,",
+            (float)(now-config.start)/1000, requests/dt);
+        printPercentilesJson(counts,total);
+        printf("}\n");
+    } else {
+        printf("%s: %.1fs %.2f requests per second, ", config.title,
+            (float)(now-config.start)/1000, requests/dt);
+        printPercentilesText(counts,total);
+        printf(" ms\n");
+    }
+    fflush(stdout);
+    zfree(counts);
+}
+
+static void *execBenchmarkThread(void *ptr) {
+    benchmarkThread *thread = ptr;
+    aeMain(thread->el);
+    return NULL;
+}
+
+static benchmarkThread *createBenchmarkThread(int index) {
+    benchmarkThread *thread = zmalloc(sizeof(*thread));
+    thread->index = index;
+    thread->el = aeCreateEventLoop(1024*10);
+    aeCreateTimeEvent(thread->el,1,showThroughput,thread,NULL);
+    return thread;
+}
+
+static void initBenchmarkThreads(void) {
+    int i;
+
+    config.threads = zmalloc(config.num_threads*sizeof(benchmarkThread*));
+    for (i = 0; i < config.num_threads; i++)
+        config.threads[i] = createBenchmarkThread(i);
+}
+
+static void startBenchmarkThreads(void) {
+    int i;
+
+    for (i = 0; i < config.num_threads; i++) {
+        benchmarkThread *t = config.threads[i];
+        if (pthread_create(&t->thread,NULL,execBenchmarkThread,t)) {
+            fprintf(stderr,"FATAL: Failed to start thread %d.\n",i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < config.num_threads; i++)
+        pthread_join(config.threads[i]->thread,NULL);
+}
+
+static void freeBenchmarkThreads(void) {
+    int i;
+
+    for (i = 0; i < config.num_threads; i++) {
+        aeDeleteEventLoop(config.threads[i]->el);
+        zfree(config.threads[i]);
+    }
+    zfree(config.threads);
+    config.threads = NULL;
 }
 
 static void benchmark(char *title, char *cmd, int len) {
@@ -464,16 +1302,47 @@ static void benchmark(char *title, char *cmd, int len) {
     config.title = title;
     config.requests_issued = 0;
     config.requests_finished = 0;
+    config.end = 0;
+    resetLatencyHistogram(config.latency);
+    if (config.mix) {
+        int i;
+        for (i = 0; i < config.mix_count; i++)
+            resetLatencyHistogram(config.mix[i].latency);
+    }
+    if (config.cluster_mode) {
+        int i;
+        for (i = 0; i < config.cluster_node_count; i++) {
+            config.cluster_nodes[i]->requests_finished = 0;
+            config.cluster_nodes[i]->redirects = 0;
+            resetLatencyHistogram(config.cluster_nodes[i]->latency);
+        }
+    }
+    if (config.interval) {
+        config.interval_requests = 0;
+        memset(config.interval_counts,0,sizeof(long long)*LATENCY_HIST_BUCKETS);
+    }
 
-    c = createClient(cmd,len,NULL);
+    if (config.num_threads) initBenchmarkThreads();
+    c = createClient(cmd,len,NULL,-1);
     createMissingClients(c);
 
     config.start = mstime();
-    aeMain(config.el);
-    config.totlatency = mstime()-config.start;
+    config.interval_start = config.start;
+    if (config.num_threads) {
+        /* Threads notice the end of the test only at their next cron, so
+         * use the completion time of the last request. */
+        startBenchmarkThreads();
+        config.totlatency = (config.end ? config.end : mstime())-config.start;
+    } else {
+        aeMain(config.el);
+        config.totlatency = mstime()-config.start;
+    }
+    if (config.requests_finished > config.requests)
+        config.requests_finished = config.requests;
 
     showLatencyReport();
     freeAllClients();
+    if (config.num_threads) freeBenchmarkThreads();
 }
 
 /* Returns number of consumed options. */
@@ -525,6 +1394,12 @@ int parseOptions(int argc, const char **argv) {
             config.quiet = 1;
         } else if (!strcmp(argv[i],"--csv")) {
             config.csv = 1;
+        } else if (!strcmp(argv[i],"--json")) {
+            config.json = 1;
+        } else if (!strcmp(argv[i],"--interval")) {
+            if (lastarg) goto invalid;
+            config.interval = atoi(argv[++i]);
+            if (config.interval < 0) config.interval = 0;
         } else if (!strcmp(argv[i],"-l")) {
             config.loop = 1;
         } else if (!strcmp(argv[i],"-I")) {
@@ -546,6 +1421,29 @@ int parseOptions(int argc, const char **argv) {
             if (lastarg) goto invalid;
             config.dbnum = atoi(argv[++i]);
             config.dbnumstr = sdsfromlonglong(config.dbnum);
+        } else if (!strcmp(argv[i],"--threads")) {
+            if (lastarg) goto invalid;
+            config.num_threads = atoi(argv[++i]);
+            if (config.num_threads > MAX_THREADS) {
+                printf("WARNING: too many threads, limiting threads to %d.\n",
+                       MAX_THREADS);
+                config.num_threads = MAX_THREADS;
+            } else if (config.num_threads < 0) config.num_threads = 0;
+        } else if (!strcmp(argv[i],"--cluster")) {
+            config.cluster_mode = 1;
+        } else if (!strcmp(argv[i],"--mix")) {
+            if (lastarg) goto invalid;
+            if (!parseMix(argv[++i])) exit(1);
+        } else if (!strcmp(argv[i],"--key-dist")) {
+            if (lastarg) goto invalid;
+            if (!parseKeyDist(argv[++i])) goto invalid;
+        } else if (!strcmp(argv[i],"--value-size")) {
+            if (lastarg) goto invalid;
+            if (!parseValueSize(argv[++i])) goto invalid;
+        } else if (!strcmp(argv[i],"--rps")) {
+            if (lastarg) goto invalid;
+            config.rps = strtoll(argv[++i],NULL,10);
+            if (config.rps < 0) config.rps = 0;
         } else if (!strcmp(argv[i],"--help")) {
             exit_status = 0;
             goto usage;
@@ -585,11 +1483,46 @@ usage:
 " -e                 If server replies with errors, show them on stdout.\n"
 "                    (no more than 1 error per second is displayed)\n"
 " -q                 Quiet. Just show query/sec values\n"
-" --csv              Output in CSV format\n"
+" --csv              Output in CSV format, with the latency percentiles\n"
+" --json             Output a JSON object for every test, with the latency\n"
+"                    percentiles (and every node ones in cluster mode)\n"
+" --interval <ms>    Also show throughput and latency percentiles of the\n"
+"                    requests completed in the last <ms> milliseconds, every\n"
+"                    <ms> milliseconds (the output is checked every 250 ms)\n"
+" --mix <cmd:weight,...>  Run a single test sending a weighted mix of\n"
+"                    commands, like get:80,set:15,zadd:5, with keys in the\n"
+"                    -r keyspace. Available commands: get set incr del lpush\n"
+"                    rpush lpop rpop lrange sadd spop sismember hset hget\n"
+"                    hgetall zadd zincrby zrange zrevrange zscore.\n"
+" --key-dist <dist>  Distribution of the keys in the -r keyspace, for\n"
+"                    __rand_int__ and --mix: uniform (default),\n"
+"                    zipf:<exponent> (like zipf:0.99), or\n"
+"                    hotspot:<keys>:<requests> where a <keys> fraction of the\n"
+"                    keyspace gets a <requests> fraction of the requests\n"
+"                    (like hotspot:0.01:0.9).\n"
+" --value-size <size> Size of the --mix values: <bytes>, uniform:<min>:<max>\n"
+"                    or exponential:<mean> (default -d bytes).\n"
+" --rps <requests>   Open loop mode: send <requests> per second in total,\n"
+"                    whatever the server latency. Latencies are measured\n"
+"                    from the time each request should have been sent.\n"
 " -l                 Loop. Run the tests forever\n"
 " -t <tests>         Only run the comma separated list of tests. The test\n"
 "                    names are the same as the ones produced as output.\n"
-" -I                 Idle mode. Just open N idle connections and wait.\n\n"
+"                    The sort, sort_limit, georadius and georadius_count\n"
+"                    tests create the mysortlist and mygeoset keys, so they\n"
+"                    only run when explicitly listed.\n"
+" -I                 Idle mode. Just open N idle connections and wait.\n"
+" --threads <num>    Enable multi-thread mode: the clients are served by\n"
+"                    <num> threads, each one with its own event loop.\n"
+" --cluster          Enable cluster mode: the cluster layout is fetched with\n"
+"                    CLUSTER SLOTS from the node given with -h / -p, and the\n"
+"                    clients are spread among the masters. The string\n"
+"                    __tag__ is replaced before every request with a hash\n"
+"                    tag served by the node of the client, the default tests\n"
+"                    add {__tag__} to all their keys. Throughput and latency\n"
+"                    are also reported for every node.\n\n"
+    );
+    printf(
 "Examples:\n\n"
 " Run the benchmark with the default configuration against 127.0.0.1:6379:\n"
 "   $ redis-benchmark\n\n"
@@ -603,6 +1536,13 @@ usage:
 "   $ redis-benchmark -r 10000 -n 10000 eval 'return redis.call(\"ping\")' 0\n\n"
 " Fill a list with 10000 random elements:\n"
 "   $ redis-benchmark -r 10000 -n 10000 lpush mylist __rand_int__\n\n"
+" Benchmark SET and GET against a cluster, using 4 threads:\n"
+"   $ redis-benchmark --cluster --threads 4 -p 30001 -t set,get -r 100000\n\n"
+" Benchmark a specific command line against a cluster:\n"
+"   $ redis-benchmark --cluster -r 10000 lpush {__tag__}:list __rand_int__\n\n"
+" Reproduce a read heavy load with hot keys at 50000 requests per second:\n"
+"   $ redis-benchmark --mix get:80,set:15,zadd:5 -r 1000000 \\\n"
+"     --key-dist zipf:0.99 --value-size uniform:16:1024 --rps 50000\n\n"
 " On user specified command lines __rand_int__ is replaced with a random integer\n"
 " with a range of values selected by the -r option.\n"
     );
@@ -610,27 +1550,175 @@ usage:
 }
 
 int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData) {
-    UNUSED(eventLoop);
+    benchmarkThread *thread = clientData;
+    int liveclients, requests_finished;
     UNUSED(id);
-    UNUSED(clientData);
 
-    if (config.liveclients == 0 && config.requests_finished != config.requests) {
+    atomicGet(config.requests_finished,requests_finished);
+    if (config.num_threads) pthread_mutex_lock(&config.liveclients_mutex);
+    liveclients = config.liveclients;
+    if (config.num_threads) pthread_mutex_unlock(&config.liveclients_mutex);
+    if (liveclients == 0 && requests_finished < config.requests) {
         fprintf(stderr,"All clients disconnected... aborting.\n");
         exit(1);
     }
-    if (config.csv) return 250;
+    if (thread && requests_finished >= config.requests) {
+        aeStop(eventLoop);
+        return AE_NOMORE;
+    }
+    /* With threads only the first one shows the throughput. */
+    if (thread && thread->index != 0) return 250;
+    if (config.interval && config.idlemode == 0) {
+        long long now = mstime();
+        if (now-config.interval_start >= config.interval)
+            showIntervalReport(now);
+    }
+    if (config.csv || config.json) return 250;
     if (config.idlemode == 1) {
         printf("clients: %d\r", config.liveclients);
         fflush(stdout);
 	return 250;
     }
     float dt = (float)(mstime()-config.start)/1000.0;
-    float rps = (float)config.requests_finished/dt;
+    float rps = dt > 0 ? (float)requests_finished/dt : 0;
     printf("%s: %.2f\r", config.title, rps);
     fflush(stdout);
     return 250; /* every 250ms */
 }
 
+/* Execute a command with a blocking connection, in order to create the
+ * dataset some of the default tests run against. The arguments are the
+ * same as redisCommand(). Exits on error. */
+static void prepareDataset(const char *fmt, ...) {
+    redisContext *ctx;
+    redisReply *reply;
+    va_list ap;
+
+    if (config.hostsocket == NULL)
+        ctx = redisConnect(config.hostip,config.hostport);
+    else
+        ctx = redisConnectUnix(config.hostsocket);
+    if (ctx == NULL || ctx->err) {
+        fprintf(stderr,"Could not connect to Redis at ");
+        if (config.hostsocket == NULL)
+            fprintf(stderr,"%s:%d: %s\n",config.hostip,config.hostport,
+                ctx ? ctx->errstr : "out of memory");
+        else
+            fprintf(stderr,"%s: %s\n",config.hostsocket,
+                ctx ? ctx->errstr : "out of memory");
+        exit(1);
+    }
+    if (config.auth) {
+        reply = redisCommand(ctx,"AUTH %s",config.auth);
+        if (reply) freeReplyObject(reply);
+    }
+    if (config.dbnum != 0) {
+        reply = redisCommand(ctx,"SELECT %d",config.dbnum);
+        if (reply) freeReplyObject(reply);
+    }
+
+    va_start(ap,fmt);
+    reply = redisvCommand(ctx,fmt,ap);
+    va_end(ap);
+    if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+        fprintf(stderr,"Error creating the test dataset: %s\n",
+            reply ? reply->str : ctx->errstr);
+        exit(1);
+    }
+    freeReplyObject(reply);
+    redisFree(ctx);
+}
+
+/* Return the node serving at ip:port, creating it if needed. */
+static clusterNode *getClusterNode(const char *ip, int port) {
+    clusterNode *node;
+    int i;
+
+    for (i = 0; i < config.cluster_node_count; i++) {
+        node = config.cluster_nodes[i];
+        if (node->port == port && !strcmp(node->ip,ip)) return node;
+    }
+    node = zcalloc(sizeof(*node));
+    node->index = config.cluster_node_count;
+    node->ip = zstrdup(ip);
+    node->port = port;
+    node->name = sdscatprintf(sdsempty(),"%s:%d",ip,port);
+    node->latency = createLatencyHistogram();
+    config.cluster_nodes = zrealloc(config.cluster_nodes,
+        sizeof(clusterNode*)*(config.cluster_node_count+1));
+    config.cluster_nodes[config.cluster_node_count++] = node;
+    return node;
+}
+
+uint16_t crc16(const char *buf, int len);
+
+/* Fetch the masters of the cluster and their slots with CLUSTER SLOTS from
+ * the node at -h / -p, then find for every master the hash tags mapping to
+ * one of its slots. Exits on error. */
+static void fetchClusterConfiguration(void) {
+    clusterNode *owner[CLUSTER_SLOTS] = {NULL};
+    redisContext *ctx;
+    redisReply *reply;
+    int missing, tag;
+    size_t i;
+    long long j;
+
+    ctx = redisConnect(config.hostip,config.hostport);
+    if (ctx == NULL || ctx->err) {
+        fprintf(stderr,"Could not connect to Redis at %s:%d: %s\n",
+            config.hostip,config.hostport,ctx ? ctx->errstr : "out of memory");
+        exit(1);
+    }
+    if (config.auth) {
+        reply = redisCommand(ctx,"AUTH %s",config.auth);
+        if (reply) freeReplyObject(reply);
+    }
+    reply = redisCommand(ctx,"CLUSTER SLOTS");
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY ||
+        reply->elements == 0)
+    {
+        fprintf(stderr,"Cluster mode: can't fetch the cluster slots: %s\n",
+            reply == NULL ? ctx->errstr :
+            (reply->type == REDIS_REPLY_ERROR ? reply->str : "no slots"));
+        exit(1);
+    }
+    for (i = 0; i < reply->elements; i++) {
+        redisReply *r = reply->element[i], *master;
+        const char *ip;
+
+        if (r->type != REDIS_REPLY_ARRAY || r->elements < 3) continue;
+        master = r->element[2];
+        /* A node not knowing its own address reports an empty IP. */
+        ip = master->element[0]->len ? master->element[0]->str : config.hostip;
+        clusterNode *node = getClusterNode(ip,master->element[1]->integer);
+        for (j = r->element[0]->integer; j <= r->element[1]->integer; j++)
+            owner[j] = node;
+    }
+    freeReplyObject(reply);
+    redisFree(ctx);
+
+    /* Examine at least CLUSTER_TAGS_MIN tags, so that requests are spread
+     * among the slots of every node, and go on until every node got one. */
+    missing = config.cluster_node_count;
+    for (tag = 0; tag < CLUSTER_TAGS_MAX; tag++) {
+        char buf[CLUSTER_TAG_LEN+1];
+        clusterNode *node;
+
+        if (tag >= CLUSTER_TAGS_MIN && missing == 0) break;
+        snprintf(buf,sizeof(buf),"%0*d",CLUSTER_TAG_LEN,tag);
+        node = owner[crc16(buf,CLUSTER_TAG_LEN) & (CLUSTER_SLOTS-1)];
+        if (node == NULL) continue;
+        if (node->tags_count == 0) missing--;
+        node->tags = zrealloc(node->tags,sizeof(int)*(node->tags_count+1));
+        node->tags[node->tags_count++] = tag;
+    }
+    if (missing) {
+        fprintf(stderr,"Cluster mode: no hash tag found for some node.\n");
+        exit(1);
+    }
+    config.tag = ":{__tag__}";
+}
+
 /* Return true if the named test was selected using the -t command line
  * switch, or if all the tests are selected (no -t passed by user). */
 int test_is_selected(char *name) {
@@ -645,6 +1733,12 @@ int test_is_selected(char *name) {
     return strstr(config.tests,buf) != NULL;
 }
 
+/* Like test_is_selected(), but false when no -t was passed: used by the
+ * tests that write their own dataset into the target server. */
+int test_is_explicitly_selected(char *name) {
+    return config.tests != NULL && test_is_selected(name);
+}
+
 int main(int argc, const char **argv) {
     int i;
     char *data, *cmd;
@@ -679,12 +1773,39 @@ int main(int argc, const char **argv) {
     config.tests = NULL;
     config.dbnum = 0;
     config.auth = NULL;
+    config.num_threads = 0;
+    config.threads = NULL;
+    config.cluster_mode = 0;
+    config.cluster_node_count = 0;
+    config.cluster_nodes = NULL;
+    config.json = 0;
+    config.csv_header = 0;
+    config.interval = 0;
+    config.interval_counts = NULL;
+    config.key_dist = KEY_DIST_UNIFORM;
+    config.value_dist = VALUE_DIST_FIXED;
+    config.value_max = 0;
+    config.value_data = NULL;
+    config.mix = NULL;
+    config.mix_count = 0;
+    config.rps = 0;
+    config.next_node = 0;
+    config.tag = "";
 
     i = parseOptions(argc,argv);
     argc -= i;
     argv += i;
 
-    config.latency = zmalloc(sizeof(long long)*config.requests);
+    config.latency = createLatencyHistogram();
+    if (config.interval)
+        config.interval_counts = zmalloc(sizeof(long long)*LATENCY_HIST_BUCKETS);
+    if (config.num_threads) pthread_mutex_init(&config.liveclients_mutex,NULL);
+    if (config.cluster_mode) fetchClusterConfiguration();
+    if (config.key_dist == KEY_DIST_ZIPF)
+        initZipf(config.randomkeys_keyspacelen ? config.randomkeys_keyspacelen : 1);
+    if (config.value_max == 0) config.value_max = config.datasize;
+    config.value_data = zmalloc(config.value_max);
+    memset(config.value_data,'x',config.value_max);
 
     if (config.keepalive == 0) {
         printf("WARNING: keepalive disabled, you probably need 'echo 1 > /proc/sys/net/ipv4/tcp_tw_reuse' for Linux and 'sudo sysctl -w net.inet.tcp.msl=1000' for Mac OS X in order to use a lot of clients/requests\n");
@@ -692,12 +1813,26 @@ int main(int argc, const char **argv) {
 
     if (config.idlemode) {
         printf("Creating %d idle connections and waiting forever (Ctrl+C when done)\n", config.numclients);
-        c = createClient("",0,NULL); /* will never receive a reply */
+        c = createClient("",0,NULL,-1); /* will never receive a reply */
         createMissingClients(c);
         aeMain(config.el);
         /* and will wait for every */
     }
 
+    /* Run the --mix workload. */
+    if (config.mix) {
+        sds title = sdsnew("MIX");
+        for (i = 0; i < config.mix_count; i++) {
+            title = sdscatprintf(title,"%s%s:%g",i ? "," : " ",
+                config.mix[i].cmd->name,config.mix[i].weight);
+        }
+        do {
+            benchmark(title,NULL,0);
+        } while(config.loop);
+
+        return 0;
+    }
+
     /* Run benchmark with command in the remainder of the arguments. */
     if (argc) {
         sds title = sdsnew(argv[0]);
@@ -731,63 +1866,64 @@ int main(int argc, const char **argv) {
         }
 
         if (test_is_selected("set")) {
-            len = redisFormatCommand(&cmd,"SET key:__rand_int__ %s",data);
+            len = redisFormatCommand(&cmd,"SET key%s:__rand_int__ %s",config.tag,data);
             benchmark("SET",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("get")) {
-            len = redisFormatCommand(&cmd,"GET key:__rand_int__");
+            len = redisFormatCommand(&cmd,"GET key%s:__rand_int__",config.tag);
             benchmark("GET",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("incr")) {
-            len = redisFormatCommand(&cmd,"INCR counter:__rand_int__");
+            len = redisFormatCommand(&cmd,"INCR counter%s:__rand_int__",config.tag);
             benchmark("INCR",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lpush")) {
-            len = redisFormatCommand(&cmd,"LPUSH mylist %s",data);
+            len = redisFormatCommand(&cmd,"LPUSH mylist%s %s",config.tag,data);
             benchmark("LPUSH",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("rpush")) {
-            len = redisFormatCommand(&cmd,"RPUSH mylist %s",data);
+            len = redisFormatCommand(&cmd,"RPUSH mylist%s %s",config.tag,data);
             benchmark("RPUSH",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lpop")) {
-            len = redisFormatCommand(&cmd,"LPOP mylist");
+            len = redisFormatCommand(&cmd,"LPOP mylist%s",config.tag);
             benchmark("LPOP",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("rpop")) {
-            len = redisFormatCommand(&cmd,"RPOP mylist");
+            len = redisFormatCommand(&cmd,"RPOP mylist%s",config.tag);
             benchmark("RPOP",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("sadd")) {
             len = redisFormatCommand(&cmd,
-                "SADD myset element:__rand_int__");
+                "SADD myset%s element:__rand_int__",config.tag);
             benchmark("SADD",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("hset")) {
             len = redisFormatCommand(&cmd,
-                "HSET myset:__rand_int__ element:__rand_int__ %s",data);
+                "HSET myset%s:__rand_int__ element:__rand_int__ %s",
+                config.tag,data);
             benchmark("HSET",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("spop")) {
-            len = redisFormatCommand(&cmd,"SPOP myset");
+            len = redisFormatCommand(&cmd,"SPOP myset%s",config.tag);
             benchmark("SPOP",cmd,len);
             free(cmd);
         }
@@ -798,48 +1934,87 @@ int main(int argc, const char **argv) {
             test_is_selected("lrange_500") ||
             test_is_selected("lrange_600"))
         {
-            len = redisFormatCommand(&cmd,"LPUSH mylist %s",data);
+            len = redisFormatCommand(&cmd,"LPUSH mylist%s %s",config.tag,data);
             benchmark("LPUSH (needed to benchmark LRANGE)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_100")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 99");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 99",config.tag);
             benchmark("LRANGE_100 (first 100 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_300")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 299");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 299",config.tag);
             benchmark("LRANGE_300 (first 300 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_500")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 449");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 449",config.tag);
             benchmark("LRANGE_500 (first 450 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_600")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 599");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 599",config.tag);
             benchmark("LRANGE_600 (first 600 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("mset")) {
             const char *argv[21];
+            sds key = sdscatprintf(sdsempty(),"key%s:__rand_int__",config.tag);
             argv[0] = "MSET";
             for (i = 1; i < 21; i += 2) {
-                argv[i] = "key:__rand_int__";
+                argv[i] = key;
                 argv[i+1] = data;
             }
             len = redisFormatCommandArgv(&cmd,21,argv,NULL);
             benchmark("MSET (10 keys)",cmd,len);
             free(cmd);
+            sdsfree(key);
+        }
+
+        /* The SORT and GEORADIUS datasets live in a single key, that in
+         * cluster mode would be served by a single node. Since they write
+         * such keys the tests only run when requested with -t. */
+        if (!config.cluster_mode &&
+            (test_is_explicitly_selected("sort") ||
+             test_is_explicitly_selected("sort_limit"))) {
+            prepareDataset("EVAL %s 1 mysortlist %d",
+                "redis.call('del',KEYS[1]) "
+                "for i=1,tonumber(ARGV[1]) do "
+                "redis.call('rpush',KEYS[1],math.random(1000000000)) end",
+                DATASET_ELEMENTS);
+            len = redisFormatCommand(&cmd,"SORT mysortlist LIMIT 0 10");
+            benchmark("SORT LIMIT 0 10 (10000 elements)",cmd,len);
+            free(cmd);
+
+            len = redisFormatCommand(&cmd,"SORT mysortlist ALPHA LIMIT 0 10");
+            benchmark("SORT ALPHA LIMIT 0 10 (10000 elements)",cmd,len);
+            free(cmd);
+        }
+
+        if (!config.cluster_mode &&
+            (test_is_explicitly_selected("georadius") ||
+             test_is_explicitly_selected("georadius_count")))
+        {
+            prepareDataset("EVAL %s 1 mygeoset %d",
+                "redis.call('del',KEYS[1]) "
+                "for i=1,tonumber(ARGV[1]) do "
+                "redis.call('geoadd',KEYS[1],"
+                "13.361389+(math.random()-0.5)*0.3,"
+                "38.115556+(math.random()-0.5)*0.2,i) end",
+                DATASET_ELEMENTS);
+            len = redisFormatCommand(&cmd,
+                "GEORADIUS mygeoset 13.361389 38.115556 20 km COUNT 10");
+            benchmark("GEORADIUS COUNT 10 (10000 points in radius)",cmd,len);
+            free(cmd);
         }
 
-        if (!config.csv) printf("\n");
+        if (!config.csv && !config.json) printf("\n");
     } while(config.loop);
 
     return 0;
@@ -234,6 +234,12 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
             /* IDLE: LRU idle time. */
             if (rdbLoadLen(&rdb,NULL) == RDB_LENERR) goto eoferr;
             continue; /* Read next opcode. */
+        } else if (type == RDB_OPCODE_FIELD_EXPIRES) {
+            /* FIELD_EXPIRES: hash fields expire times. */
+            unsigned char *zl = rdbLoadFieldExpires(&rdb);
+            if (zl == NULL) goto eoferr;
+            zfree(zl);
+            continue; /* Read next opcode. */
         } else if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
@@ -2859,7 +2859,84 @@ static int clusterManagerMigrateKeysInSlot(clusterManagerNode *source,
     return success;
 }
 
-/* Move slots between source and target nodes using MIGRATE.
+/* Move all the keys of the slot with CLUSTER MIGRATESLOT, that streams them
+ * from the source node in background, and wait for the slot to be handed
+ * over to the target. The slot must already be importing / migrating.
+ * Returns 1 on success, 0 on error, -1 if the source node does not
+ * support the command and the keys must be moved with MIGRATE. */
+static int clusterManagerMigrateSlotInBackground(clusterManagerNode *source,
+                                                 int slot, int timeout,
+                                                 int verbose, char **err) {
+    redisReply *reply = CLUSTER_MANAGER_COMMAND(source, "CLUSTER "
+                                                        "MIGRATESLOT %d "
+                                                        "TIMEOUT %d",
+                                                slot, timeout);
+    int success = -1;
+    if (reply == NULL) return 0;
+    if (reply->type == REDIS_REPLY_ERROR) {
+        if (strstr(reply->str, "Unknown subcommand") == NULL) {
+            success = 0;
+            if (err != NULL) {
+                *err = zmalloc((reply->len + 1) * sizeof(char));
+                strcpy(*err, reply->str);
+                CLUSTER_MANAGER_PRINT_REPLY_ERROR(source, *err);
+            }
+        }
+        freeReplyObject(reply);
+        return success;
+    }
+    freeReplyObject(reply);
+
+    /* Poll the migration state until it is done or failed. */
+    while (success == -1) {
+        usleep(10000);
+        reply = CLUSTER_MANAGER_COMMAND(source, "CLUSTER MIGRATESLOT STATUS");
+        if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+            success = 0;
+            break;
+        }
+        size_t i, j;
+        for (i = 0; i < reply->elements; i++) {
+            redisReply *m = reply->element[i];
+            char *state = NULL, *error = NULL;
+            long long mslot = -1;
+            for (j = 0; j + 1 < m->elements; j += 2) {
+                char *field = m->element[j]->str;
+                redisReply *value = m->element[j + 1];
+                if (!strcmp(field, "slot")) mslot = value->integer;
+                else if (!strcmp(field, "state")) state = value->str;
+                else if (!strcmp(field, "error") &&
+                         value->type == REDIS_REPLY_STRING)
+                    error = value->str;
+            }
+            if (mslot != slot || state == NULL) continue;
+            if (!strcmp(state, "done")) {
+                success = 1;
+            } else if (!strcmp(state, "failed")) {
+                success = 0;
+                if (err != NULL && error != NULL) {
+                    *err = zmalloc((strlen(error) + 1) * sizeof(char));
+                    strcpy(*err, error);
+                    CLUSTER_MANAGER_PRINT_REPLY_ERROR(source, *err);
+                }
+            } else if (verbose) {
+                printf(".");
+                fflush(stdout);
+            }
+            break;
+        }
+        if (i == reply->elements) success = 0; /* Cancelled by someone. */
+        freeReplyObject(reply);
+    }
+    /* Forget the migration, it is no longer needed in the status. */
+    reply = CLUSTER_MANAGER_COMMAND(source, "CLUSTER MIGRATESLOT CANCEL %d",
+                                    slot);
+    if (reply != NULL) freeReplyObject(reply);
+    return success;
+}
+
+/* Move slots between source and target nodes using CLUSTER MIGRATESLOT,
+ * or MIGRATE if the source node does not support it.
  * 
  * Options:
  * CLUSTER_MANAGER_OPT_VERBOSE -- Print a dot for every moved key.
@@ -2890,8 +2967,16 @@ static int clusterManagerMoveSlot(clusterManagerNode *source,
                                         "migrating", err);
         if (!success) return 0;
     }
-    success = clusterManagerMigrateKeysInSlot(source, target, slot, timeout,
-                                              pipeline, print_dots, err);
+    success = -1;
+    if (!option_cold) {
+        success = clusterManagerMigrateSlotInBackground(source, slot, timeout,
+                                                        print_dots, err);
+    }
+    if (success == -1) {
+        success = clusterManagerMigrateKeysInSlot(source, target, slot,
+                                                  timeout, pipeline,
+                                                  print_dots, err);
+    }
     if (!(opts & CLUSTER_MANAGER_OPT_QUIET)) printf("\n");
     if (!success) return 0;
     /* Set the new node as the owner of the slot in all the known nodes. */
@@ -36,6 +36,9 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 
 void replicationDiscardCachedMaster(void);
 
@@ -46,6 +49,9 @@ void replicationSendAck(void);
 void putSlaveOnline(client *slave);
 
 int cancelReplicationHandshake(void);
+void readSyncBulkPayloadFromSocket(int fd, char *eofmark);
+void replicationFinishSync(rdbSaveInfo *rsi, int aof_is_enabled);
+int useDisklessLoad(void);
 
 /* --------------------------- Utility functions ---------------------------- */
 
@@ -78,13 +84,14 @@ char *replicationGetSlaveName(client *c) {
 /* ---------------------------------- MASTER -------------------------------- */
 
 /**
- * 创建 backlog 的 buffer
+ * 创建 backlog，backlog 只是对共享复制缓冲区中最老数据块的一个引用
  */
 void createReplicationBacklog(void) {
     serverAssert(server.repl_backlog == NULL);
-    server.repl_backlog = zmalloc(server.repl_backlog_size);
+    serverAssert(listLength(server.repl_buffer_blocks) == 0);
+    server.repl_backlog = zmalloc(sizeof(replBacklog));
+    server.repl_backlog->ref_repl_buf_node = NULL;
     server.repl_backlog_histlen = 0;
-    server.repl_backlog_idx = 0;
 
     /* We don't have any data inside our buffer, but virtually the first
      * byte we have is the next byte that will be generated for the
@@ -94,11 +101,9 @@ void createReplicationBacklog(void) {
 
 /*
  * This function is called when the user modifies the replication backlog
- * size at runtime. It is up to the function to both update the
- * server.repl_backlog_size and to resize the buffer and setup it so that
- * it contains the same data as the previous one (possibly less data, but
- * the most recent bytes, or the same data and more free space in case the
- * buffer is enlarged).
+ * size at runtime. Since the backlog is made of blocks shared with the
+ * slaves nothing needs to be copied: growing just stops trimming for a
+ * while, shrinking releases the oldest blocks not needed anymore.
  *
  * 调整复制备份日志的大小，当replication backlog被修改的时候
  */
@@ -108,19 +113,7 @@ void resizeReplicationBacklog(long long newsize) {
     if (server.repl_backlog_size == newsize) return;
 
     server.repl_backlog_size = newsize;
-    if (server.repl_backlog != NULL) {
-        /* What we actually do is to flush the old buffer and realloc a new
-         * empty one. It will refill with new data incrementally.
-         * The reason is that copying a few gigabytes adds latency and even
-         * worse often we need to alloc additional space before freeing the
-         * old buffer. */
-        zfree(server.repl_backlog);
-        server.repl_backlog = zmalloc(server.repl_backlog_size);
-        server.repl_backlog_histlen = 0;
-        server.repl_backlog_idx = 0;
-        /* Next byte we have is... the next since the buffer is empty. */
-        server.repl_backlog_off = server.master_repl_offset + 1;
-    }
+    incrementalTrimReplicationBacklog();
 }
 
 /**
@@ -128,41 +121,163 @@ void resizeReplicationBacklog(long long newsize) {
  */
 void freeReplicationBacklog(void) {
     serverAssert(listLength(server.slaves) == 0);
+    if (server.repl_backlog == NULL) return;
+
+    /* Without slaves every block is only referenced by the backlog. */
+    listEmpty(server.repl_buffer_blocks);
+    server.repl_buffer_mem = 0;
     zfree(server.repl_backlog);
     server.repl_backlog = NULL;
 }
 
+/* Release the blocks at the head of the replication buffer that are not
+ * referenced by any slave and that are not needed to keep at least
+ * repl-backlog-size bytes of history. The backlog can hence be larger than
+ * configured while some slave still has to receive its oldest blocks. */
+void incrementalTrimReplicationBacklog(void) {
+    if (server.repl_backlog == NULL ||
+        server.repl_backlog->ref_repl_buf_node == NULL) return;
+
+    while (listLength(server.repl_buffer_blocks) > 1) {
+        listNode *first = listFirst(server.repl_buffer_blocks);
+        listNode *next = listNextNode(first);
+        replBufBlock *fo = listNodeValue(first);
+        replBufBlock *no = listNodeValue(next);
+
+        serverAssert(first == server.repl_backlog->ref_repl_buf_node);
+        if (fo->refcount > 1) break; /* Still needed by some slave. */
+        if (server.repl_backlog_histlen - (long long) fo->used <
+            server.repl_backlog_size) break;
+
+        no->refcount++;
+        server.repl_backlog->ref_repl_buf_node = next;
+        server.repl_backlog_histlen -= fo->used;
+        server.repl_backlog_off = no->repl_offset;
+        server.repl_buffer_mem -= sizeof(replBufBlock) + fo->size;
+        listDelNode(server.repl_buffer_blocks, first);
+    }
+}
+
+/* Drop the reference the slave holds on the replication buffer, so that
+ * the blocks it did not send yet can be released. */
+void slaveReleaseReplBuffer(client *c) {
+    replBufBlock *o;
+
+    if (c->ref_repl_buf_node == NULL) return;
+    o = listNodeValue(c->ref_repl_buf_node);
+    o->refcount--;
+    c->ref_repl_buf_node = NULL;
+    c->ref_block_pos = 0;
+    incrementalTrimReplicationBacklog();
+}
+
+/* Bytes of the shared replication buffer the slave still has to send. */
+size_t slaveReplBufferPendingBytes(client *c) {
+    replBufBlock *cur, *last;
+
+    if (c->ref_repl_buf_node == NULL) return 0;
+    cur = listNodeValue(c->ref_repl_buf_node);
+    last = listNodeValue(listLast(server.repl_buffer_blocks));
+    return (last->repl_offset + last->used) -
+           (cur->repl_offset + c->ref_block_pos);
+}
+
 /*
  * Add data to the replication backlog.
  * This function also increments the global replication offset stored at
  * server.master_repl_offset, because there is no case where we want to feed
  * the backlog without incrementing the offset.
  *
+ * The data is appended once to the shared replication buffer: slaves that
+ * are receiving the replication stream just reference the blocks, so this
+ * is also how the stream is sent to slaves.
+ *
  * 往备份日志中添加添加数据操作，会引起 master_repl_offset 偏移量的增加
  */
 void feedReplicationBacklog(void *ptr, size_t len) {
     unsigned char *p = ptr;
+    listNode *ln, *start_node = NULL;
+    size_t start_pos = 0;
+    int add_new_block = 0;
+    replBufBlock *tail;
+    listIter li;
 
-    server.master_repl_offset += len;
+    if (server.repl_backlog == NULL) return;
+
+    /* Flag the slaves as having pending writes before the data is added,
+     * as prepareClientToWrite() only does it for clients without any. */
+    listRewind(server.slaves, &li);
+    while ((ln = listNext(&li))) {
+        client *slave = ln->value;
+        if (slave->replstate == SLAVE_STATE_WAIT_BGSAVE_START) continue;
+        prepareClientToWrite(slave);
+    }
+
+    /* Fill the free space of the last block first. */
+    ln = listLast(server.repl_buffer_blocks);
+    tail = ln ? listNodeValue(ln) : NULL;
+    if (tail && tail->used < tail->size) {
+        size_t avail = tail->size - tail->used;
+        size_t copy = (avail >= len) ? len : avail;
+
+        memcpy(tail->buf + tail->used, p, copy);
+        start_node = ln;
+        start_pos = tail->used;
+        tail->used += copy;
+        p += copy;
+        len -= copy;
+        server.master_repl_offset += copy;
+        server.repl_backlog_histlen += copy;
+    }
+
+    /* Then put what remains into a new block. */
+    if (len) {
+        size_t size = (len > PROTO_REPLY_CHUNK_BYTES) ?
+                      len : PROTO_REPLY_CHUNK_BYTES;
+
+        tail = zmalloc(sizeof(replBufBlock) + size);
+        tail->refcount = 0;
+        tail->repl_offset = server.master_repl_offset + 1;
+        tail->size = size;
+        tail->used = len;
+        memcpy(tail->buf, p, len);
+        listAddNodeTail(server.repl_buffer_blocks, tail);
+        server.repl_buffer_mem += sizeof(replBufBlock) + size;
+        server.master_repl_offset += len;
+        server.repl_backlog_histlen += len;
+        add_new_block = 1;
+        if (start_node == NULL) {
+            start_node = listLast(server.repl_buffer_blocks);
+            start_pos = 0;
+        }
+    }
+    if (start_node == NULL) return; /* Empty write. */
+
+    /* The backlog starts referencing the buffer with its first byte. */
+    if (server.repl_backlog->ref_repl_buf_node == NULL) {
+        server.repl_backlog->ref_repl_buf_node = start_node;
+        ((replBufBlock *) listNodeValue(start_node))->refcount++;
+        server.repl_backlog_off = server.master_repl_offset -
+                                  server.repl_backlog_histlen + 1;
+    }
+
+    /* Slaves not referencing the buffer yet (they just started to receive
+     * the stream) start from the data we just added. */
+    listRewind(server.slaves, &li);
+    while ((ln = listNext(&li))) {
+        client *slave = ln->value;
 
-    /* This is a circular buffer, so write as much data we can at every
-     * iteration and rewind the "idx" index if we reach the limit. */
-    while (len) {
-        size_t thislen = server.repl_backlog_size - server.repl_backlog_idx;
-        if (thislen > len) thislen = len;
-        memcpy(server.repl_backlog + server.repl_backlog_idx, p, thislen);
-        server.repl_backlog_idx += thislen;
-        if (server.repl_backlog_idx == server.repl_backlog_size)
-            server.repl_backlog_idx = 0;
-        len -= thislen;
-        p += thislen;
-        server.repl_backlog_histlen += thislen;
+        /* Don't feed slaves that are still waiting for BGSAVE to start */
+        if (slave->replstate == SLAVE_STATE_WAIT_BGSAVE_START) continue;
+        if (slave->ref_repl_buf_node == NULL) {
+            slave->ref_repl_buf_node = start_node;
+            slave->ref_block_pos = start_pos;
+            ((replBufBlock *) listNodeValue(start_node))->refcount++;
+        }
+        /* The pending output only grows with new blocks. */
+        if (add_new_block) asyncCloseClientOnOutputBufferLimitReached(slave);
     }
-    if (server.repl_backlog_histlen > server.repl_backlog_size)
-        server.repl_backlog_histlen = server.repl_backlog_size;
-    /* Set the offset of the first byte we have in the backlog. */
-    server.repl_backlog_off = server.master_repl_offset -
-                              server.repl_backlog_histlen + 1;
+    incrementalTrimReplicationBacklog();
 }
 
 /*
@@ -196,10 +311,9 @@ void feedReplicationBacklogWithObject(robj *o) {
  * TODO：主从复制：将主数据库复制到从数据库
  */
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
-    listNode *ln;
-    listIter li;
     int j, len;
     char llstr[LONG_STR_SIZE];
+    char aux[LONG_STR_SIZE + 3];
 
     /*
      * If the instance is not a top level master, return ASAP: we'll just proxy
@@ -211,13 +325,13 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
      */
     if (server.masterhost != NULL) return;
 
-    /* If there aren't slaves, and there is no backlog buffer to populate,
-     * we can return ASAP. */
-    if (server.repl_backlog == NULL && listLength(slaves) == 0) return;
-
     /* We can't have slaves attached and no backlog. */
     serverAssert(!(listLength(slaves) != 0 && server.repl_backlog == NULL));
 
+    /* The backlog and the slaves share the same buffer: if there is no
+     * backlog to populate there is nobody to feed, return ASAP. */
+    if (server.repl_backlog == NULL) return;
+
     /* Send SELECT command to every slave if needed. */
     if (server.slaveseldb != dictid) {
         robj *selectcmd;
@@ -235,68 +349,38 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
                                                   dictid_len, llstr));
         }
 
-        /* Add the SELECT command into the backlog. */
-        if (server.repl_backlog) feedReplicationBacklogWithObject(selectcmd);
-
-        /* Send it to slaves. */
-        listRewind(slaves, &li);
-        while ((ln = listNext(&li))) {
-            client *slave = ln->value;
-            if (slave->replstate == SLAVE_STATE_WAIT_BGSAVE_START) continue;
-            addReply(slave, selectcmd);
-        }
+        /* Add the SELECT command into the backlog (and so to slaves). */
+        feedReplicationBacklogWithObject(selectcmd);
 
         if (dictid < 0 || dictid >= PROTO_SHARED_SELECT_CMDS)
             decrRefCount(selectcmd);
     }
     server.slaveseldb = dictid;
 
-    /* Write the command to the replication backlog if any. */
-    if (server.repl_backlog) {
-        char aux[LONG_STR_SIZE + 3];
+    /* Write the command to the replication backlog, that is, to the
+     * buffer shared with the slaves. Slaves waiting for the initial SYNC
+     * keep referencing it until the RDB is transferred. */
+
+    /* Add the multi bulk reply length. */
+    aux[0] = '*';
+    len = ll2string(aux + 1, sizeof(aux) - 1, argc);
+    aux[len + 1] = '\r';
+    aux[len + 2] = '\n';
+    feedReplicationBacklog(aux, len + 3);
+
+    for (j = 0; j < argc; j++) {
+        long objlen = stringObjectLen(argv[j]);
 
-        /* Add the multi bulk reply length. */
-        aux[0] = '*';
-        len = ll2string(aux + 1, sizeof(aux) - 1, argc);
+        /* We need to feed the buffer with the object as a bulk reply
+         * not just as a plain string, so create the $..CRLF payload len
+         * and add the final CRLF */
+        aux[0] = '$';
+        len = ll2string(aux + 1, sizeof(aux) - 1, objlen);
         aux[len + 1] = '\r';
         aux[len + 2] = '\n';
         feedReplicationBacklog(aux, len + 3);
-
-        for (j = 0; j < argc; j++) {
-            long objlen = stringObjectLen(argv[j]);
-
-            /* We need to feed the buffer with the object as a bulk reply
-             * not just as a plain string, so create the $..CRLF payload len
-             * and add the final CRLF */
-            aux[0] = '$';
-            len = ll2string(aux + 1, sizeof(aux) - 1, objlen);
-            aux[len + 1] = '\r';
-            aux[len + 2] = '\n';
-            feedReplicationBacklog(aux, len + 3);
-            feedReplicationBacklogWithObject(argv[j]);
-            feedReplicationBacklog(aux + len + 1, 2);
-        }
-    }
-
-    /* Write the command to every slave. */
-    listRewind(slaves, &li);
-    while ((ln = listNext(&li))) {
-        client *slave = ln->value;
-
-        /* Don't feed slaves that are still waiting for BGSAVE to start */
-        if (slave->replstate == SLAVE_STATE_WAIT_BGSAVE_START) continue;
-
-        /* Feed slaves that are waiting for the initial SYNC (so these commands
-         * are queued in the output buffer until the initial SYNC completes),
-         * or are already in sync with the master. */
-
-        /* Add the multi bulk length. */
-        addReplyMultiBulkLen(slave, argc);
-
-        /* Finally any additional argument that was not stored inside the
-         * static buffer if any (from j to argc). */
-        for (j = 0; j < argc; j++)
-            addReplyBulk(slave, argv[j]);
+        feedReplicationBacklogWithObject(argv[j]);
+        feedReplicationBacklog(aux + len + 1, 2);
     }
 }
 
@@ -305,9 +389,6 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
 #include <ctype.h>
 
 void replicationFeedSlavesFromMasterStream(list *slaves, char *buf, size_t buflen) {
-    listNode *ln;
-    listIter li;
-
     /* Debugging: this is handy to see the stream sent from master
      * to slaves. Disabled with if(0). */
     if (0) {
@@ -318,15 +399,9 @@ void replicationFeedSlavesFromMasterStream(list *slaves, char *buf, size_t bufle
         printf("\n");
     }
 
-    if (server.repl_backlog) feedReplicationBacklog(buf, buflen);
-    listRewind(slaves, &li);
-    while ((ln = listNext(&li))) {
-        client *slave = ln->value;
-
-        /* Don't feed slaves that are still waiting for BGSAVE to start */
-        if (slave->replstate == SLAVE_STATE_WAIT_BGSAVE_START) continue;
-        addReplyString(slave, buf, buflen);
-    }
+    /* Sub-slaves read the stream from the backlog blocks. */
+    serverAssert(!(listLength(slaves) != 0 && server.repl_backlog == NULL));
+    feedReplicationBacklog(buf, buflen);
 }
 
 /**
@@ -384,7 +459,9 @@ void replicationFeedMonitors(client *c, list *monitors, int dictid, robj **argv,
  * slave从客户单添加备份日志
  */
 long long addReplyReplicationBacklog(client *c, long long offset) {
-    long long j, skip, len;
+    long long skip;
+    listNode *ln;
+    replBufBlock *o = NULL;
 
     serverLog(LL_DEBUG, "[PSYNC] Slave request offset: %lld", offset);
 
@@ -399,37 +476,30 @@ long long addReplyReplicationBacklog(client *c, long long offset) {
               server.repl_backlog_off);
     serverLog(LL_DEBUG, "[PSYNC] History len: %lld",
               server.repl_backlog_histlen);
-    serverLog(LL_DEBUG, "[PSYNC] Current index: %lld",
-              server.repl_backlog_idx);
 
     /* Compute the amount of bytes we need to discard. */
     skip = offset - server.repl_backlog_off;
     serverLog(LL_DEBUG, "[PSYNC] Skipping: %lld", skip);
 
-    /* Point j to the oldest byte, that is actually our
-     * server.repl_backlog_off byte. */
-    j = (server.repl_backlog_idx +
-         (server.repl_backlog_size - server.repl_backlog_histlen)) %
-        server.repl_backlog_size;
-    serverLog(LL_DEBUG, "[PSYNC] Index of first byte: %lld", j);
-
-    /* Discard the amount of data to seek to the specified 'offset'. */
-    j = (j + skip) % server.repl_backlog_size;
-
-    /* Feed slave with data. Since it is a circular buffer we have to
-     * split the reply in two parts if we are cross-boundary. */
-    len = server.repl_backlog_histlen - skip;
-    serverLog(LL_DEBUG, "[PSYNC] Reply total length: %lld", len);
-    while (len) {
-        long long thislen =
-                ((server.repl_backlog_size - j) < len) ?
-                (server.repl_backlog_size - j) : len;
-
-        serverLog(LL_DEBUG, "[PSYNC] addReply() length: %lld", thislen);
-        addReplySds(c, sdsnewlen(server.repl_backlog + j, thislen));
-        len -= thislen;
-        j = 0;
-    }
+    /* Seek the block holding 'offset'. Blocks are immutable and shared, so
+     * instead of copying the data into the output buffer the slave just
+     * references the block, exactly like slaves fed by
+     * feedReplicationBacklog(). If the slave already has everything it
+     * will start to reference the buffer with the next write. */
+    ln = server.repl_backlog->ref_repl_buf_node;
+    while (ln) {
+        o = listNodeValue(ln);
+        if (offset < o->repl_offset + (long long) o->used) break;
+        ln = listNextNode(ln);
+    }
+    if (ln) {
+        prepareClientToWrite(c);
+        c->ref_repl_buf_node = ln;
+        c->ref_block_pos = offset - o->repl_offset;
+        o->refcount++;
+    }
+    serverLog(LL_DEBUG, "[PSYNC] Reply total length: %lld",
+              server.repl_backlog_histlen - skip);
     return server.repl_backlog_histlen - skip;
 }
 
@@ -1146,6 +1216,8 @@ void replicationCreateMasterClient(int fd, int dbid) {
     if (server.master->reploff == -1)
         server.master->flags |= CLIENT_PRE_PSYNC;
     if (dbid != -1) selectDb(server.master, dbid);
+    if (fd != -1 && server.repl_slave_io_thread)
+        replicationStartMasterReader(server.master);
 }
 
 void restartAOF() {
@@ -1236,6 +1308,12 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
         return;
     }
 
+    /* No temp file: the payload is parsed straight from the socket. */
+    if (server.repl_transfer_tmpfile == NULL) {
+        readSyncBulkPayloadFromSocket(fd, usemark ? eofmark : NULL);
+        return;
+    }
+
     /* Read bulk data */
     if (usemark) {
         readlen = sizeof(buf);
@@ -1354,28 +1432,10 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
             if (aof_is_enabled) restartAOF();
             return;
         }
-        /* Final setup of the connected slave <- master link */
         zfree(server.repl_transfer_tmpfile);
+        server.repl_transfer_tmpfile = NULL;
         close(server.repl_transfer_fd);
-        replicationCreateMasterClient(server.repl_transfer_s, rsi.repl_stream_db);
-        server.repl_state = REPL_STATE_CONNECTED;
-        /* After a full resynchroniziation we use the replication ID and
-         * offset of the master. The secondary ID / offset are cleared since
-         * we are starting a new history. */
-        memcpy(server.replid, server.master->replid, sizeof(server.replid));
-        server.master_repl_offset = server.master->reploff;
-        clearReplicationId2();
-        /* Let's create the replication backlog if needed. Slaves need to
-         * accumulate the backlog regardless of the fact they have sub-slaves
-         * or not, in order to behave correctly if they are promoted to
-         * masters after a failover. */
-        if (server.repl_backlog == NULL) createReplicationBacklog();
-
-        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Finished with success");
-        /* Restart the AOF subsystem now that we finished the sync. This
-         * will trigger an AOF rewrite, and when done will start appending
-         * to the new file. */
-        if (aof_is_enabled) restartAOF();
+        replicationFinishSync(&rsi, aof_is_enabled);
     }
     return;
 
@@ -1384,6 +1444,148 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
     return;
 }
 
+/* Final setup of the connected slave <- master link, once the payload of
+ * the master was loaded. */
+void replicationFinishSync(rdbSaveInfo *rsi, int aof_is_enabled) {
+    replicationCreateMasterClient(server.repl_transfer_s, rsi->repl_stream_db);
+    server.repl_state = REPL_STATE_CONNECTED;
+    /* After a full resynchroniziation we use the replication ID and
+     * offset of the master. The secondary ID / offset are cleared since
+     * we are starting a new history. */
+    memcpy(server.replid, server.master->replid, sizeof(server.replid));
+    server.master_repl_offset = server.master->reploff;
+    clearReplicationId2();
+    /* Let's create the replication backlog if needed. Slaves need to
+     * accumulate the backlog regardless of the fact they have sub-slaves
+     * or not, in order to behave correctly if they are promoted to
+     * masters after a failover. */
+    if (server.repl_backlog == NULL) createReplicationBacklog();
+
+    serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Finished with success");
+    /* Restart the AOF subsystem now that we finished the sync. This
+     * will trigger an AOF rewrite, and when done will start appending
+     * to the new file. */
+    if (aof_is_enabled) restartAOF();
+}
+
+/* Return true if the RDB sent by the master should be parsed straight from
+ * the socket instead of being saved to a temp file first, according to
+ * the repl-diskless-load option. */
+int useDisklessLoad(void) {
+    if (server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB) return 1;
+    if (server.repl_diskless_load == REPL_DISKLESS_LOAD_WHEN_DB_EMPTY) {
+        for (int j = 0; j < server.dbnum; j++)
+            if (dictSize(server.db[j].dict)) return 0;
+        return 1;
+    }
+    return 0;
+}
+
+/* Diskless load: parse the RDB payload of the master directly from the
+ * socket 'fd', that is switched to blocking mode with a receive timeout
+ * for the duration of the load. 'eofmark' is the delimiter announced by the
+ * master with the $EOF:<mark> format, or NULL if the size of the payload
+ * is known (server.repl_transfer_size).
+ *
+ * In swapdb mode (and out of cluster mode, since the hash slots map only
+ * tracks server.db) the keys are loaded into temp databases while the old
+ * dataset keeps serving read only commands, and the two are swapped only
+ * once the load succeeded: on failures the old dataset is left in place.
+ * Otherwise the old dataset is flushed before the load starts. */
+void readSyncBulkPayloadFromSocket(int fd, char *eofmark) {
+    int aof_is_enabled = server.aof_state != AOF_OFF;
+    int async = server.repl_diskless_load == REPL_DISKLESS_LOAD_SWAPDB &&
+                !server.cluster_enabled;
+    int flush_flags = server.repl_slave_lazy_flush ? EMPTYDB_ASYNC :
+                                                     EMPTYDB_NO_FLAGS;
+    rdbSaveInfo rsi = RDB_SAVE_INFO_INIT;
+    redisDb *dbs = server.db;
+    rio rdb;
+
+    /* The readable handler is deleted since rdbLoadRio() processes events
+     * from time to time, and the socket is read synchronously from now on. */
+    aeDeleteFileEvent(server.el, fd, AE_READABLE);
+    anetBlock(NULL, fd);
+    anetRecvTimeout(NULL, fd, server.repl_timeout * 1000);
+    rioInitWithFd(&rdb, fd, eofmark ? 0 : server.repl_transfer_size);
+
+    /* We need to stop any AOFRW fork before flusing and parsing RDB,
+     * otherwise we'll create a copy-on-write disaster. */
+    if (aof_is_enabled) stopAppendOnly();
+    if (async) {
+        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Loading DB from socket "
+                             "into temp databases");
+        dbs = createTempDbs();
+        server.loading_async = 1;
+    } else {
+        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Flushing old data");
+        signalFlushedDb(-1);
+        emptyDb(-1, flush_flags, replicationEmptyDbCallback);
+        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Loading DB from socket");
+    }
+
+    startLoadingBytes(eofmark ? 0 : server.repl_transfer_size);
+    int retval = rdbLoadRioIntoDbs(&rdb, &rsi, 0, dbs);
+    if (retval == C_OK && eofmark) {
+        /* The payload is followed by the delimiter announced by the
+         * master, that must match. */
+        char lastbytes[CONFIG_RUN_ID_SIZE];
+        if (rioRead(&rdb, lastbytes, CONFIG_RUN_ID_SIZE) == 0 ||
+            memcmp(lastbytes, eofmark, CONFIG_RUN_ID_SIZE) != 0)
+        {
+            serverLog(LL_WARNING, "Replication stream EOF marker mismatch");
+            retval = C_ERR;
+        }
+    }
+    stopLoading();
+    server.loading_async = 0;
+    server.stat_net_input_bytes += rdb.io.fd.read_so_far;
+    server.repl_transfer_read = rdb.io.fd.read_so_far;
+    off_t consumed = rioTell(&rdb);
+    size_t unread = rioFreeFd(&rdb);
+
+    /* The payload must end exactly where the master said: bytes read after
+     * it (or the EOF mark), or a payload shorter than the announced size,
+     * mean the transfer is truncated or misframed and can't be trusted. */
+    if (retval == C_OK && (unread ||
+        (!eofmark && consumed != server.repl_transfer_size)))
+    {
+        serverLog(LL_WARNING, "MASTER <-> SLAVE sync: the RDB payload ended "
+                  "at byte %lld, with %zu unexpected bytes read after it",
+                  (long long)consumed, unread);
+        retval = C_ERR;
+    }
+
+    if (retval != C_OK) {
+        serverLog(LL_WARNING, "Failed trying to load the MASTER synchronization DB from socket");
+        if (async) {
+            serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Discarding the "
+                                 "partially loaded data, old data kept");
+            discardTempDbs(dbs, flush_flags);
+        } else {
+            emptyDb(-1, flush_flags, replicationEmptyDbCallback);
+        }
+        cancelReplicationHandshake();
+        /* Re-enable the AOF if we disabled it earlier, in order to restore
+         * the original configuration. */
+        if (aof_is_enabled) restartAOF();
+        return;
+    }
+
+    if (async) {
+        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Swapping the old data "
+                             "with the new one");
+        swapTempDbs(dbs);
+        discardTempDbs(dbs, flush_flags);
+    }
+
+    /* Back to the non blocking socket used by the master client. */
+    anetRecvTimeout(NULL, fd, 0);
+    anetNonBlock(NULL, fd);
+    server.repl_transfer_lastio = server.unixtime;
+    replicationFinishSync(&rsi, aof_is_enabled);
+}
+
 /* Send a synchronous command to the master. Used to send AUTH and
  * REPLCONF commands before starting the replication with SYNC.
  *
@@ -1902,15 +2104,17 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
     }
 
-    /* Prepare a suitable temp file for bulk transfer */
-    while (maxtries--) {
+    /* Prepare a suitable temp file for bulk transfer, unless the payload
+     * is going to be parsed straight from the socket. */
+    int diskless_load = useDisklessLoad();
+    while (!diskless_load && maxtries--) {
         snprintf(tmpfile, 256,
                  "temp-%d.%ld.rdb", (int) server.unixtime, (long int) getpid());
         dfd = open(tmpfile, O_CREAT | O_WRONLY | O_EXCL, 0644);
         if (dfd != -1) break;
         sleep(1);
     }
-    if (dfd == -1) {
+    if (dfd == -1 && !diskless_load) {
         serverLog(LL_WARNING, "Opening the temp file needed for MASTER <-> SLAVE synchronization: %s", strerror(errno));
         goto error;
     }
@@ -1930,7 +2134,7 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
     server.repl_transfer_last_fsync_off = 0;
     server.repl_transfer_fd = dfd;
     server.repl_transfer_lastio = server.unixtime;
-    server.repl_transfer_tmpfile = zstrdup(tmpfile);
+    server.repl_transfer_tmpfile = (dfd != -1) ? zstrdup(tmpfile) : NULL;
     return;
 
     error:
@@ -1994,9 +2198,12 @@ void undoConnectWithMaster(void) {
 void replicationAbortSyncTransfer(void) {
     serverAssert(server.repl_state == REPL_STATE_TRANSFER);
     undoConnectWithMaster();
-    close(server.repl_transfer_fd);
-    unlink(server.repl_transfer_tmpfile);
-    zfree(server.repl_transfer_tmpfile);
+    if (server.repl_transfer_tmpfile) {
+        close(server.repl_transfer_fd);
+        unlink(server.repl_transfer_tmpfile);
+        zfree(server.repl_transfer_tmpfile);
+        server.repl_transfer_tmpfile = NULL;
+    }
 }
 
 /* This function aborts a non blocking replication attempt if there is one
@@ -2333,7 +2540,9 @@ void replicationResurrectCachedMaster(int newfd) {
 
     /* Re-add to the list of clients. */
     linkClient(server.master);
-    if (aeCreateFileEvent(server.el, newfd, AE_READABLE,
+    if (!(server.repl_slave_io_thread &&
+          replicationStartMasterReader(server.master) == C_OK) &&
+        aeCreateFileEvent(server.el, newfd, AE_READABLE,
                           readQueryFromClient, server.master)) {
         serverLog(LL_WARNING, "Error resurrecting the cached master, impossible to add the readable handler: %s",
                   strerror(errno));
@@ -2352,6 +2561,482 @@ void replicationResurrectCachedMaster(int newfd) {
     }
 }
 
+/* ---------------------------- SLAVE IO THREAD ----------------------------- */
+
+/* With slave-io-thread enabled the socket of the master is read by a
+ * dedicated thread, that also parses the replication stream into commands
+ * ready to be executed. The main thread takes the parsed commands in batches
+ * and executes them in the same order, exactly like processInputBuffer()
+ * would do with the commands read from the socket, so the offsets, the
+ * proxying to sub-slaves and MULTI/EXEC are handled the usual way.
+ *
+ * 从节点用单独的线程读取并解析主节点发来的复制流，主线程只负责按顺序执行解析好的命令。 */
+
+#define REPL_READER_MAX_QUEUED (1024*1024*32) /* Parsed bytes not taken yet. */
+
+typedef struct replReaderCmd {
+    int argc;
+    robj **argv;
+    size_t len;             /* Bytes of the replication stream it used. */
+} replReaderCmd;
+
+typedef struct replReaderBatch {
+    sds raw;                /* The replication stream of the batch. */
+    int numcmds;            /* Number of parsed commands. */
+    int cmdpos;             /* Next command to execute. */
+    replReaderCmd *cmds;
+    long long ctime;        /* Milliseconds time the batch was read. */
+} replReaderBatch;
+
+static struct {
+    int active;             /* The thread is running. */
+    pthread_t thread;
+    int fd;                 /* Socket of the master. */
+    int notify_pipe[2];     /* Written by the thread to wake up the main one. */
+    pthread_mutex_t lock;   /* Protects the fields below up to 'err'. */
+    pthread_cond_t cond;    /* Queue drained or stop requested. */
+    list *queue;            /* Batches parsed and not taken yet. */
+    size_t queued_bytes;
+    int stop;               /* Set by the main thread to stop the reader. */
+    int done;               /* The thread exited because of EOF / errors. */
+    int protocol_error;
+    char err[128];
+    /* Only accessed by the main thread. */
+    list *applying;         /* Batches taken by the main thread. */
+    size_t pending_bytes;   /* Bytes of 'applying' not executed yet. */
+} replReader;
+
+static void replReaderFreeBatch(void *ptr) {
+    replReaderBatch *b = ptr;
+    int j, i;
+
+    for (j = b->cmdpos; j < b->numcmds; j++) {
+        for (i = 0; i < b->cmds[j].argc; i++)
+            decrRefCount(b->cmds[j].argv[i]);
+        zfree(b->cmds[j].argv);
+    }
+    zfree(b->cmds);
+    sdsfree(b->raw);
+    zfree(b);
+}
+
+/* Check that a whole command is available at 'p'. Returns the length of
+ * the command, 0 if more data is needed (setting '*need' to the buffer
+ * length to wait for, when known) or -1 on protocol error. The master only
+ * sends multi bulk commands and, at most, empty inline commands. */
+static long replReaderCommandLen(char *p, size_t len, size_t *need,
+                                 long long *argc) {
+    char *newline;
+    long long ll;
+    size_t pos;
+
+    *argc = 0;
+    if (p[0] != '*') {
+        if (p[0] == '\n') return 1;
+        if (p[0] != '\r') return -1;
+        if (len < 2) return 0;
+        return (p[1] == '\n') ? 2 : -1;
+    }
+
+    newline = memchr(p, '\r', len);
+    if (newline == NULL || newline + 1 >= p + len)
+        return (len > PROTO_INLINE_MAX_SIZE) ? -1 : 0;
+    if (!string2ll(p + 1, newline - (p + 1), &ll) || ll > 1024 * 1024)
+        return -1;
+    pos = newline - p + 2;
+    if (ll <= 0) return pos;
+    *argc = ll;
+
+    while (ll--) {
+        long long bulklen;
+
+        if (pos >= len) return 0;
+        newline = memchr(p + pos, '\r', len - pos);
+        if (newline == NULL || newline + 1 >= p + len)
+            return (len - pos > PROTO_INLINE_MAX_SIZE) ? -1 : 0;
+        if (p[pos] != '$' ||
+            !string2ll(p + pos + 1, newline - (p + pos + 1), &bulklen) ||
+            bulklen < 0 || bulklen > server.proto_max_bulk_len)
+            return -1;
+        pos = newline - p + 2;
+        if (len - pos < (size_t) bulklen + 2) {
+            *need = pos + bulklen + 2;
+            return 0;
+        }
+        pos += bulklen + 2;
+    }
+    return pos;
+}
+
+/* Create the arguments of a command already validated by
+ * replReaderCommandLen(). */
+static void replReaderParseCommand(char *p, replReaderCmd *cmd, long long argc) {
+    char *newline;
+    long long bulklen;
+    int j;
+
+    cmd->argc = argc;
+    cmd->argv = argc ? zmalloc(sizeof(robj *) * argc) : NULL;
+    p = strchr(p, '\n') + 1;
+    for (j = 0; j < argc; j++) {
+        newline = strchr(p, '\r');
+        string2ll(p + 1, newline - (p + 1), &bulklen);
+        p = newline + 2;
+        cmd->argv[j] = createStringObject(p, bulklen);
+        p += bulklen + 2;
+    }
+}
+
+/* Parse the complete commands at the start of 'buf' into a new batch,
+ * removing them from the buffer. Returns NULL when there are none. */
+static replReaderBatch *replReaderParseBuffer(sds buf, size_t *need, int *err) {
+    replReaderBatch *b = NULL;
+    size_t pos = 0, len = sdslen(buf);
+    int allocated = 0;
+
+    *need = 0;
+    *err = 0;
+    while (pos < len) {
+        long long argc;
+        long cmdlen = replReaderCommandLen(buf + pos, len - pos, need, &argc);
+
+        if (cmdlen == -1) {
+            *err = 1;
+            break;
+        }
+        if (cmdlen == 0) break; /* '*need' is relative to the trimmed buffer. */
+        if (b == NULL) {
+            b = zmalloc(sizeof(*b));
+            b->numcmds = b->cmdpos = 0;
+            b->cmds = NULL;
+        }
+        if (b->numcmds == allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            b->cmds = zrealloc(b->cmds, sizeof(replReaderCmd) * allocated);
+        }
+        replReaderParseCommand(buf + pos, b->cmds + b->numcmds, argc);
+        b->cmds[b->numcmds++].len = cmdlen;
+        pos += cmdlen;
+    }
+    if (b) {
+        b->raw = sdsnewlen(buf, pos);
+        b->ctime = mstime();
+        sdsrange(buf, pos, -1);
+    }
+    return b;
+}
+
+static void *replReaderThreadMain(void *arg) {
+    sds buf = sdsempty();
+    size_t need = 0;
+    char err[sizeof(replReader.err)];
+    int protocol_error = 0;
+    sigset_t sigset;
+    UNUSED(arg);
+
+    /* Like the bio threads, make sure SIGALRM (watchdog) goes to the
+     * main thread. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    err[0] = '\0';
+    while (1) {
+        struct pollfd pfd;
+        replReaderBatch *b;
+        ssize_t nread;
+        int notify = 0;
+
+        pthread_mutex_lock(&replReader.lock);
+        int stop = replReader.stop;
+        pthread_mutex_unlock(&replReader.lock);
+        if (stop) break;
+
+        pfd.fd = replReader.fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) <= 0) continue;
+
+        buf = sdsMakeRoomFor(buf, PROTO_IOBUF_LEN);
+        nread = read(replReader.fd, buf + sdslen(buf), PROTO_IOBUF_LEN);
+        if (nread == -1) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            snprintf(err, sizeof(err), "Reading from master: %s",
+                     strerror(errno));
+            break;
+        } else if (nread == 0) {
+            snprintf(err, sizeof(err), "Master closed connection");
+            break;
+        }
+        sdsIncrLen(buf, nread);
+        if (sdslen(buf) < need) continue;
+
+        b = replReaderParseBuffer(buf, &need, &protocol_error);
+        if (b) {
+            pthread_mutex_lock(&replReader.lock);
+            while (replReader.queued_bytes >= REPL_READER_MAX_QUEUED &&
+                   !replReader.stop)
+                pthread_cond_wait(&replReader.cond, &replReader.lock);
+            listAddNodeTail(replReader.queue, b);
+            notify = listLength(replReader.queue) == 1;
+            replReader.queued_bytes += sdslen(b->raw);
+            pthread_mutex_unlock(&replReader.lock);
+            if (notify && write(replReader.notify_pipe[1], "x", 1) < 1) {
+                /* Nothing to do: the main thread is already woken up. */
+            }
+        }
+        if (protocol_error) {
+            snprintf(err, sizeof(err), "Protocol error from master");
+            break;
+        }
+    }
+    sdsfree(buf);
+
+    pthread_mutex_lock(&replReader.lock);
+    replReader.done = 1;
+    replReader.protocol_error = protocol_error;
+    memcpy(replReader.err, err, sizeof(err));
+    pthread_mutex_unlock(&replReader.lock);
+    if (write(replReader.notify_pipe[1], "x", 1) < 1) {
+        /* Nothing to do. */
+    }
+    return NULL;
+}
+
+/* Execute the commands taken from the reader thread. Returns C_ERR if the
+ * execution had to stop (clients paused, master blocked or freed). */
+static int replReaderApply(client *c) {
+    size_t fed = 0; /* Bytes of pending_querybuf already proxied. */
+    int retval = C_OK;
+
+    server.current_client = c;
+    while (listLength(replReader.applying)) {
+        listNode *ln = listFirst(replReader.applying);
+        replReaderBatch *b = listNodeValue(ln);
+        replReaderCmd *cmd;
+
+        if (b->cmdpos == b->numcmds) {
+            listDelNode(replReader.applying, ln);
+            continue;
+        }
+
+        /* Same conditions of processInputBuffer(). */
+        if (clientsArePaused() || c->flags & CLIENT_BLOCKED ||
+            c->flags & (CLIENT_CLOSE_AFTER_REPLY | CLIENT_CLOSE_ASAP)) {
+            retval = C_ERR;
+            break;
+        }
+
+        cmd = b->cmds + b->cmdpos++;
+        replReader.pending_bytes -= cmd->len;
+        if (cmd->argc == 0) continue;
+
+        /* The client takes ownership of the arguments. */
+        zfree(c->argv);
+        c->argv = cmd->argv;
+        c->argc = cmd->argc;
+        c->argv_len = cmd->argc;
+        cmd->argv = NULL;
+        cmd->argc = 0;
+        if (processCommand(c) == C_OK) {
+            if (!(c->flags & CLIENT_MULTI)) {
+                /* Update the applied replication offset of our master, and
+                 * propagate what was applied to the sub-slaves and the
+                 * backlog, like readQueryFromClient() does. This is done
+                 * command by command, since the master may be freed by the
+                 * next one, and the bytes already applied must reach the
+                 * sub-slaves anyway. */
+                long long prev_offset = c->reploff;
+                c->reploff = c->read_reploff - replReader.pending_bytes;
+                if (c->reploff > prev_offset) {
+                    size_t applied = c->reploff - prev_offset;
+                    replicationFeedSlavesFromMasterStream(server.slaves,
+                        c->pending_querybuf+fed, applied);
+                    fed += applied;
+                }
+            }
+            if (!(c->flags & CLIENT_BLOCKED) || c->btype != BLOCKED_MODULE)
+                resetClient(c);
+        }
+
+        /* The master may have been freed (and the reader stopped) while
+         * executing the command: its pending_querybuf is gone or was
+         * cleared, there is nothing left to trim. */
+        if (server.current_client == NULL || !replReader.active ||
+            server.master != c)
+            return C_ERR;
+    }
+    server.current_client = NULL;
+    if (fed) sdsrange(c->pending_querybuf, fed, -1);
+    return retval;
+}
+
+/* Take the batches parsed by the reader thread and execute them. Called
+ * when the thread notifies new data, and before sleeping, to resume the
+ * execution after it had to be suspended. */
+void replicationProcessMasterReader(void) {
+    client *c = server.master;
+
+    if (!replReader.active || c == NULL) return;
+    while (1) {
+        if (listLength(replReader.applying) == 0) {
+            list *taken;
+            listNode *ln;
+            listIter li;
+            int done, protocol_error;
+
+            pthread_mutex_lock(&replReader.lock);
+            taken = replReader.queue;
+            replReader.queue = replReader.applying;
+            replReader.applying = taken;
+            replReader.queued_bytes = 0;
+            done = replReader.done;
+            protocol_error = replReader.protocol_error;
+            pthread_cond_signal(&replReader.cond);
+            pthread_mutex_unlock(&replReader.lock);
+
+            if (listLength(taken) == 0) {
+                if (done) {
+                    serverLog(protocol_error ? LL_WARNING : LL_VERBOSE,
+                              "%s", replReader.err);
+                    freeClient(c);
+                }
+                return;
+            }
+
+            /* Account the batches like readQueryFromClient() does with
+             * the data read from the socket. */
+            listRewind(taken, &li);
+            while ((ln = listNext(&li))) {
+                replReaderBatch *b = listNodeValue(ln);
+                size_t len = sdslen(b->raw);
+
+                c->pending_querybuf = sdscatsds(c->pending_querybuf, b->raw);
+                c->read_reploff += len;
+                replReader.pending_bytes += len;
+                server.stat_net_input_bytes += len;
+            }
+            c->lastinteraction = server.unixtime;
+        }
+        if (replReaderApply(c) == C_ERR) return;
+    }
+}
+
+static void replReaderNotifyHandler(aeEventLoop *el, int fd, void *privdata,
+                                    int mask) {
+    char buf[64];
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+    replicationProcessMasterReader();
+}
+
+/* Start reading the replication stream of 'c', our master, in the reader
+ * thread instead of the readable event handler. */
+int replicationStartMasterReader(client *c) {
+    serverAssert(!replReader.active);
+    if (pipe(replReader.notify_pipe) == -1) {
+        serverLog(LL_WARNING, "Can't create the slave IO thread pipe: %s",
+                  strerror(errno));
+        return C_ERR;
+    }
+    anetNonBlock(NULL, replReader.notify_pipe[0]);
+    anetNonBlock(NULL, replReader.notify_pipe[1]);
+    if (aeCreateFileEvent(server.el, replReader.notify_pipe[0], AE_READABLE,
+                          replReaderNotifyHandler, NULL) == AE_ERR) {
+        close(replReader.notify_pipe[0]);
+        close(replReader.notify_pipe[1]);
+        return C_ERR;
+    }
+
+    pthread_mutex_init(&replReader.lock, NULL);
+    pthread_cond_init(&replReader.cond, NULL);
+    replReader.queue = listCreate();
+    replReader.applying = listCreate();
+    listSetFreeMethod(replReader.queue, replReaderFreeBatch);
+    listSetFreeMethod(replReader.applying, replReaderFreeBatch);
+    replReader.queued_bytes = 0;
+    replReader.pending_bytes = 0;
+    replReader.stop = 0;
+    replReader.done = 0;
+    replReader.protocol_error = 0;
+    replReader.err[0] = '\0';
+    replReader.fd = c->fd;
+
+    if (pthread_create(&replReader.thread, NULL, replReaderThreadMain,
+                       NULL) != 0) {
+        serverLog(LL_WARNING, "Can't create the slave IO thread");
+        aeDeleteFileEvent(server.el, replReader.notify_pipe[0], AE_READABLE);
+        close(replReader.notify_pipe[0]);
+        close(replReader.notify_pipe[1]);
+        listRelease(replReader.queue);
+        listRelease(replReader.applying);
+        pthread_mutex_destroy(&replReader.lock);
+        pthread_cond_destroy(&replReader.cond);
+        return C_ERR;
+    }
+    aeDeleteFileEvent(server.el, c->fd, AE_READABLE);
+    replReader.active = 1;
+    serverLog(LL_NOTICE, "MASTER <-> SLAVE: reading the replication stream "
+                         "in the slave IO thread.");
+    return C_OK;
+}
+
+/* Stop the reader thread, discarding what was read and not executed. It is
+ * called when the socket of the master is about to be closed. */
+void replicationStopMasterReader(void) {
+    if (!replReader.active) return;
+
+    pthread_mutex_lock(&replReader.lock);
+    replReader.stop = 1;
+    pthread_cond_signal(&replReader.cond);
+    pthread_mutex_unlock(&replReader.lock);
+    shutdown(replReader.fd, SHUT_RD); /* Wake up poll() ASAP. */
+    pthread_join(replReader.thread, NULL);
+
+    aeDeleteFileEvent(server.el, replReader.notify_pipe[0], AE_READABLE);
+    close(replReader.notify_pipe[0]);
+    close(replReader.notify_pipe[1]);
+    listRelease(replReader.queue);
+    listRelease(replReader.applying);
+    pthread_mutex_destroy(&replReader.lock);
+    pthread_cond_destroy(&replReader.cond);
+    replReader.queued_bytes = 0;
+    replReader.pending_bytes = 0;
+    replReader.active = 0;
+}
+
+/* Replication lag of the slave: bytes received from the master and not
+ * executed yet, and age in milliseconds of the oldest of them (only known
+ * with the IO thread, zero otherwise). */
+void replicationGetApplyLag(long long *lag_bytes, long long *lag_ms,
+                            long long *read_offset) {
+    *lag_bytes = *lag_ms = 0;
+    *read_offset = server.master ? server.master->read_reploff : 0;
+    if (server.master == NULL) return;
+
+    *lag_bytes = server.master->read_reploff - server.master->reploff;
+    if (replReader.active) {
+        long long ctime = 0;
+        listNode *ln = listFirst(replReader.applying);
+
+        if (ln) ctime = ((replReaderBatch *) listNodeValue(ln))->ctime;
+        pthread_mutex_lock(&replReader.lock);
+        *lag_bytes += replReader.queued_bytes;
+        *read_offset += replReader.queued_bytes;
+        if (!ctime && (ln = listFirst(replReader.queue)) != NULL)
+            ctime = ((replReaderBatch *) listNodeValue(ln))->ctime;
+        pthread_mutex_unlock(&replReader.lock);
+        if (ctime) *lag_ms = mstime() - ctime;
+    }
+}
+
+int replicationMasterReaderActive(void) {
+    return replReader.active;
+}
+
 /* ------------------------- MIN-SLAVES-TO-WRITE  --------------------------- */
 
 /*
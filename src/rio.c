@@ -49,6 +49,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
 #include "rio.h"
 #include "util.h"
 #include "crc64.h"
@@ -159,6 +161,194 @@ void rioInitWithFile(rio *r, FILE *fp) {
 
 /* ------------------- File descriptors set implementation ------------------- */
 
+/* The data written to a fdset is sent to every fd by a dedicated writer
+ * thread, so that each fd proceeds at its own speed: a slow receiver does
+ * not delay the others as long as it stays within RIO_FDSET_MAX_LAG bytes
+ * from the data produced so far. The buffered data is a list of blocks
+ * shared by all the writers, and a block is released once every writer
+ * sent it or its thread exited.
+ *
+ * When a writer lags more than RIO_FDSET_MAX_LAG bytes the producer waits
+ * for it. If this happens while some other writer is idle, the waited time
+ * is accounted to the laggard, and once it exceeds the 'max_stall' limit
+ * set with rioFdsetSetMaxStall() the laggard is dropped (its state set to
+ * ETIMEDOUT), so that the other fds are no longer throttled. */
+#define RIO_FDSET_MAX_LAG (1024*1024*8)
+
+typedef struct rioFdsetBlock {
+    struct rioFdsetBlock *next;
+    off_t start;        /* Offset of the first byte of the block. */
+    size_t len;
+    char data[];
+} rioFdsetBlock;
+
+typedef struct rioFdsetWriter {
+    pthread_t thread;
+    struct rioFdsetFanout *fo;
+    int idx;                /* Index of the fd in io.fdset.fds. */
+    int started;            /* The thread was created. */
+    int done;               /* The thread is not going to write anymore. */
+    rioFdsetBlock *cur;     /* Block being written, NULL if none yet. */
+    size_t cur_pos;         /* Bytes of 'cur' already written. */
+    off_t written;          /* Total bytes written to the fd. */
+    long long stall;        /* Microseconds the others waited for us. */
+} rioFdsetWriter;
+
+typedef struct rioFdsetFanout {
+    pthread_mutex_t lock;
+    pthread_cond_t produced;    /* New data or closing, for the writers. */
+    pthread_cond_t consumed;    /* Progress of some writer. */
+    rioFdsetBlock *head, *tail;
+    off_t produced_bytes;       /* Total bytes appended to the list. */
+    int closing;                /* No more data will be produced. */
+    long long max_stall;        /* Laggard drop limit in us, 0 = never. */
+    int *fds;
+    int *state;
+    int numfds;
+    rioFdsetWriter *writers;
+} rioFdsetFanout;
+
+/* Writer thread: send the blocks to its fd until the producer is closing
+ * and everything was written, or an error occurs. */
+static void *rioFdsetWriterMain(void *arg) {
+    rioFdsetWriter *w = arg;
+    rioFdsetFanout *fo = w->fo;
+    int fd = fo->fds[w->idx];
+
+    pthread_mutex_lock(&fo->lock);
+    while(fo->state[w->idx] == 0) {
+        if (w->cur == NULL) w->cur = fo->head;
+        if (w->cur && w->cur_pos == w->cur->len && w->cur->next) {
+            w->cur = w->cur->next;
+            w->cur_pos = 0;
+        }
+        if (w->cur == NULL || w->cur_pos == w->cur->len) {
+            if (fo->closing) break;
+            pthread_cond_wait(&fo->produced,&fo->lock);
+            continue;
+        }
+
+        /* The block can't be released while we write it, since our
+         * 'written' offset is still inside it. */
+        char *p = w->cur->data + w->cur_pos;
+        size_t count = w->cur->len - w->cur_pos;
+        pthread_mutex_unlock(&fo->lock);
+        ssize_t retval = write(fd,p,count);
+        int err = errno;
+        pthread_mutex_lock(&fo->lock);
+
+        if (retval <= 0) {
+            /* With blocking sockets, which is the sole user of this
+             * rio target, EWOULDBLOCK is returned only because of
+             * the SO_SNDTIMEO socket option, so we translate the error
+             * into one more recognizable by the user. */
+            if (retval == -1 && err == EWOULDBLOCK) err = ETIMEDOUT;
+            if (fo->state[w->idx] == 0) fo->state[w->idx] = err ? err : EIO;
+            break;
+        }
+        w->cur_pos += retval;
+        w->written += retval;
+        pthread_cond_signal(&fo->consumed);
+    }
+    w->done = 1;
+    pthread_cond_signal(&fo->consumed);
+    pthread_mutex_unlock(&fo->lock);
+    return NULL;
+}
+
+/* Release the blocks that every writer already sent. Called with the lock
+ * held. Writers in error still count until their thread is done: a dropped
+ * laggard may still be inside write() with a pointer into its current block,
+ * so its blocks are pinned until the shutdown() of its fd makes it exit. */
+static void rioFdsetReleaseBlocks(rioFdsetFanout *fo) {
+    off_t min = fo->produced_bytes;
+    for (int j = 0; j < fo->numfds; j++) {
+        rioFdsetWriter *w = fo->writers+j;
+        if (!w->done && w->written < min) min = w->written;
+    }
+    while(fo->head && fo->head->next &&
+          fo->head->start + (off_t)fo->head->len <= min)
+    {
+        rioFdsetBlock *b = fo->head;
+        for (int j = 0; j < fo->numfds; j++) {
+            rioFdsetWriter *w = fo->writers+j;
+            if (w->cur == b) {
+                w->cur = b->next;
+                w->cur_pos = 0;
+            }
+        }
+        fo->head = b->next;
+        zfree(b);
+    }
+}
+
+/* Return the live writer with the smallest 'written' offset, or NULL if
+ * all the writers are in error. '*idle' is set to 1 if some other live
+ * writer already sent all the data. Called with the lock held. */
+static rioFdsetWriter *rioFdsetLaggard(rioFdsetFanout *fo, int *idle) {
+    rioFdsetWriter *laggard = NULL;
+    *idle = 0;
+    for (int j = 0; j < fo->numfds; j++) {
+        rioFdsetWriter *w = fo->writers+j;
+        if (fo->state[j] != 0 || w->done) continue;
+        if (w->written == fo->produced_bytes) *idle = 1;
+        if (laggard == NULL || w->written < laggard->written) laggard = w;
+    }
+    return laggard;
+}
+
+/* Wait until every live writer is within 'maxlag' bytes from the data
+ * produced, dropping the laggards as explained at the top of this section.
+ * Returns 0 if all the writers are in error. Called with the lock held. */
+static int rioFdsetWaitWriters(rioFdsetFanout *fo, off_t maxlag) {
+    while(1) {
+        int idle;
+        rioFdsetReleaseBlocks(fo);
+        rioFdsetWriter *laggard = rioFdsetLaggard(fo,&idle);
+        if (laggard == NULL) return 0;
+        if (fo->produced_bytes - laggard->written <= maxlag) return 1;
+
+        long long start = ustime();
+        struct timespec deadline;
+        long long until = start + 100000; /* Recheck every 100 ms. */
+        deadline.tv_sec = until / 1000000;
+        deadline.tv_nsec = (until % 1000000) * 1000;
+        pthread_cond_timedwait(&fo->consumed,&fo->lock,&deadline);
+
+        if (!idle || fo->state[laggard->idx] != 0 || laggard->done) continue;
+        laggard->stall += ustime() - start;
+        if (fo->max_stall && laggard->stall > fo->max_stall) {
+            serverLog(LL_WARNING,
+                "Diskless replication: dropping the slave on fd %d, it "
+                "delayed the other slaves for too long.",
+                fo->fds[laggard->idx]);
+            fo->state[laggard->idx] = ETIMEDOUT;
+            /* Unblock the writer if it is in the middle of a write. */
+            shutdown(fo->fds[laggard->idx],SHUT_RDWR);
+        }
+    }
+}
+
+/* Append 'len' bytes to the list of blocks shared by the writers. */
+static int rioFdsetProduce(rio *r, const void *buf, size_t len) {
+    rioFdsetFanout *fo = r->io.fdset.fanout;
+    rioFdsetBlock *b = zmalloc(sizeof(*b)+len);
+    b->next = NULL;
+    b->len = len;
+    memcpy(b->data,buf,len);
+
+    pthread_mutex_lock(&fo->lock);
+    b->start = fo->produced_bytes;
+    if (fo->tail) fo->tail->next = b; else fo->head = b;
+    fo->tail = b;
+    fo->produced_bytes += len;
+    pthread_cond_broadcast(&fo->produced);
+    int retval = rioFdsetWaitWriters(fo,RIO_FDSET_MAX_LAG);
+    pthread_mutex_unlock(&fo->lock);
+    r->io.fdset.pos += len;
+    return retval;
+}
+
 /* Returns 1 or 0 for success/failure.
  * The function returns success as long as we are able to correctly write
  * to at least one file descriptor.
@@ -167,66 +357,21 @@ void rioInitWithFile(rio *r, FILE *fp) {
  * if there is some pending buffer, so this function is also used in order
  * to implement rioFdsetFlush(). */
 static size_t rioFdsetWrite(rio *r, const void *buf, size_t len) {
-    ssize_t retval;
-    int j;
-    unsigned char *p = (unsigned char*) buf;
     int doflush = (buf == NULL && len == 0);
 
     /* To start we always append to our buffer. If it gets larger than
-     * a given size, we actually write to the sockets. */
+     * a given size, we hand it to the writer threads. */
     if (len) {
         r->io.fdset.buf = sdscatlen(r->io.fdset.buf,buf,len);
-        len = 0; /* Prevent entering the while below if we don't flush. */
         if (sdslen(r->io.fdset.buf) > PROTO_IOBUF_LEN) doflush = 1;
     }
 
-    if (doflush) {
-        p = (unsigned char*) r->io.fdset.buf;
-        len = sdslen(r->io.fdset.buf);
+    if (doflush && sdslen(r->io.fdset.buf)) {
+        int retval = rioFdsetProduce(r,r->io.fdset.buf,
+                                     sdslen(r->io.fdset.buf));
+        sdsclear(r->io.fdset.buf);
+        if (retval == 0) return 0; /* All the FDs in error. */
     }
-
-    /* Write in little chunchs so that when there are big writes we
-     * parallelize while the kernel is sending data in background to
-     * the TCP socket. */
-    while(len) {
-        size_t count = len < 1024 ? len : 1024;
-        int broken = 0;
-        for (j = 0; j < r->io.fdset.numfds; j++) {
-            if (r->io.fdset.state[j] != 0) {
-                /* Skip FDs alraedy in error. */
-                broken++;
-                continue;
-            }
-
-            /* Make sure to write 'count' bytes to the socket regardless
-             * of short writes. */
-            size_t nwritten = 0;
-            while(nwritten != count) {
-                retval = write(r->io.fdset.fds[j],p+nwritten,count-nwritten);
-                if (retval <= 0) {
-                    /* With blocking sockets, which is the sole user of this
-                     * rio target, EWOULDBLOCK is returned only because of
-                     * the SO_SNDTIMEO socket option, so we translate the error
-                     * into one more recognizable by the user. */
-                    if (retval == -1 && errno == EWOULDBLOCK) errno = ETIMEDOUT;
-                    break;
-                }
-                nwritten += retval;
-            }
-
-            if (nwritten != count) {
-                /* Mark this FD as broken. */
-                r->io.fdset.state[j] = errno;
-                if (r->io.fdset.state[j] == 0) r->io.fdset.state[j] = EIO;
-            }
-        }
-        if (broken == r->io.fdset.numfds) return 0; /* All the FDs in error. */
-        p += count;
-        len -= count;
-        r->io.fdset.pos += count;
-    }
-
-    if (doflush) sdsclear(r->io.fdset.buf);
     return 1;
 }
 
@@ -244,11 +389,16 @@ static off_t rioFdsetTell(rio *r) {
 }
 
 /* Flushes any buffer to target device if applicable. Returns 1 on success
- * and 0 on failures. */
+ * and 0 on failures. Here the pending buffer is handed to the writers, and
+ * we wait for all of them to send everything (or fail). */
 static int rioFdsetFlush(rio *r) {
-    /* Our flush is implemented by the write method, that recognizes a
-     * buffer set to NULL with a count of zero as a flush request. */
-    return rioFdsetWrite(r,NULL,0);
+    rioFdsetFanout *fo = r->io.fdset.fanout;
+    if (rioFdsetWrite(r,NULL,0) == 0) return 0;
+
+    pthread_mutex_lock(&fo->lock);
+    int retval = rioFdsetWaitWriters(fo,0);
+    pthread_mutex_unlock(&fo->lock);
+    return retval;
 }
 
 static const rio rioFdsetIO = {
@@ -274,15 +424,169 @@ void rioInitWithFdset(rio *r, int *fds, int numfds) {
     r->io.fdset.numfds = numfds;
     r->io.fdset.pos = 0;
     r->io.fdset.buf = sdsempty();
+
+    /* Start one writer thread per fd. */
+    rioFdsetFanout *fo = zcalloc(sizeof(*fo));
+    pthread_mutex_init(&fo->lock,NULL);
+    pthread_cond_init(&fo->produced,NULL);
+    pthread_cond_init(&fo->consumed,NULL);
+    fo->fds = r->io.fdset.fds;
+    fo->state = r->io.fdset.state;
+    fo->numfds = numfds;
+    fo->writers = zcalloc(sizeof(rioFdsetWriter)*numfds);
+    r->io.fdset.fanout = fo;
+    for (j = 0; j < numfds; j++) {
+        rioFdsetWriter *w = fo->writers+j;
+        w->fo = fo;
+        w->idx = j;
+        if (pthread_create(&w->thread,NULL,rioFdsetWriterMain,w) != 0) {
+            fo->state[j] = EAGAIN;
+            w->done = 1;
+        } else {
+            w->started = 1;
+        }
+    }
+}
+
+/* Drop the fds that delay the others for more than 'ms' milliseconds
+ * overall, see the top of this section. Zero means never. */
+void rioFdsetSetMaxStall(rio *r, long long ms) {
+    serverAssert(r->read == rioFdsetIO.read);
+    rioFdsetFanout *fo = r->io.fdset.fanout;
+    pthread_mutex_lock(&fo->lock);
+    fo->max_stall = ms*1000;
+    pthread_mutex_unlock(&fo->lock);
 }
 
 /* release the rio stream. */
 void rioFreeFdset(rio *r) {
+    rioFdsetFanout *fo = r->io.fdset.fanout;
+    int j;
+
+    /* Stop the writers: the ones not done yet exit as soon as they sent
+     * all the data. */
+    pthread_mutex_lock(&fo->lock);
+    fo->closing = 1;
+    pthread_cond_broadcast(&fo->produced);
+    pthread_mutex_unlock(&fo->lock);
+    for (j = 0; j < fo->numfds; j++) {
+        rioFdsetWriter *w = fo->writers+j;
+        if (w->started) pthread_join(w->thread,NULL);
+    }
+    while(fo->head) {
+        rioFdsetBlock *next = fo->head->next;
+        zfree(fo->head);
+        fo->head = next;
+    }
+    pthread_mutex_destroy(&fo->lock);
+    pthread_cond_destroy(&fo->produced);
+    pthread_cond_destroy(&fo->consumed);
+    zfree(fo->writers);
+    zfree(fo);
+
     zfree(r->io.fdset.fds);
     zfree(r->io.fdset.state);
     sdsfree(r->io.fdset.buf);
 }
 
+/* ------------------------ Single FD read implementation ------------------- */
+
+/* Returns 1 or 0 for success/failure.
+ * The fd is expected to be blocking with a receive timeout: the function
+ * reads from it until 'len' bytes are available in the buffer, reading in
+ * chunks of PROTO_IOBUF_LEN bytes but never past 'read_limit', so that no
+ * byte following the payload is consumed. */
+static size_t rioFdRead(rio *r, void *buf, size_t len) {
+    size_t avail = sdslen(r->io.fd.buf)-r->io.fd.pos;
+
+    if (len > avail) {
+        /* Discard the consumed part of the buffer and make room for the
+         * missing bytes. */
+        sdsrange(r->io.fd.buf,r->io.fd.pos,-1);
+        r->io.fd.pos = 0;
+        if (sdsavail(r->io.fd.buf) < len-avail)
+            r->io.fd.buf = sdsMakeRoomFor(r->io.fd.buf,
+                len-avail > PROTO_IOBUF_LEN ? len-avail : PROTO_IOBUF_LEN);
+    }
+
+    while(len > avail) {
+        size_t toread = sdsavail(r->io.fd.buf);
+        if (r->io.fd.read_limit) {
+            size_t left = r->io.fd.read_limit - r->io.fd.read_so_far;
+            if (left < len-avail) {
+                errno = EOVERFLOW;
+                return 0;
+            }
+            if (toread > left) toread = left;
+        }
+        ssize_t retval = read(r->io.fd.fd,
+                              r->io.fd.buf+sdslen(r->io.fd.buf),toread);
+        if (retval <= 0) {
+            /* EWOULDBLOCK is only returned because of the SO_RCVTIMEO
+             * socket option: translate it like rioFdsetWrite() does. */
+            if (retval == -1 && errno == EWOULDBLOCK) errno = ETIMEDOUT;
+            if (retval == 0) errno = ECONNRESET;
+            return 0;
+        }
+        sdsIncrLen(r->io.fd.buf,retval);
+        r->io.fd.read_so_far += retval;
+        avail += retval;
+    }
+
+    memcpy(buf,r->io.fd.buf+r->io.fd.pos,len);
+    r->io.fd.pos += len;
+    return 1;
+}
+
+/* Returns 1 or 0 for success/failure. */
+static size_t rioFdWrite(rio *r, const void *buf, size_t len) {
+    UNUSED(r);
+    UNUSED(buf);
+    UNUSED(len);
+    return 0; /* Error, this target does not support writing. */
+}
+
+/* Returns the number of bytes consumed so far. */
+static off_t rioFdTell(rio *r) {
+    return r->io.fd.read_so_far - (sdslen(r->io.fd.buf)-r->io.fd.pos);
+}
+
+/* Flushes any buffer to target device if applicable. Returns 1 on success
+ * and 0 on failures. */
+static int rioFdFlush(rio *r) {
+    UNUSED(r);
+    return 1; /* Nothing to do, this target is read only. */
+}
+
+static const rio rioFdIO = {
+    rioFdRead,
+    rioFdWrite,
+    rioFdTell,
+    rioFdFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+void rioInitWithFd(rio *r, int fd, size_t read_limit) {
+    *r = rioFdIO;
+    r->io.fd.fd = fd;
+    r->io.fd.pos = 0;
+    r->io.fd.buf = sdsempty();
+    r->io.fd.read_limit = read_limit;
+    r->io.fd.read_so_far = 0;
+}
+
+/* Release the rio stream. Returns the number of bytes that were read from
+ * the fd but not consumed, that are discarded. */
+size_t rioFreeFd(rio *r) {
+    size_t unread = sdslen(r->io.fd.buf)-r->io.fd.pos;
+    sdsfree(r->io.fd.buf);
+    return unread;
+}
+
 /* ---------------------------- Generic functions ---------------------------- */
 
 /*
@@ -84,7 +84,16 @@ struct _rio {
             int numfds;
             off_t pos;
             sds buf;
+            struct rioFdsetFanout *fanout; /* Writer threads, see rio.c. */
         } fdset;
+        /* Single FD source (used to read the RDB sent by the master). */
+        struct {
+            int fd;             /* File descriptor, blocking. */
+            off_t pos;          /* Bytes of 'buf' already consumed. */
+            sds buf;            /* Data read from the fd, not consumed yet. */
+            size_t read_limit;  /* Don't read past this offset, 0 = no limit. */
+            size_t read_so_far; /* Bytes read from the fd so far. */
+        } fd;
     } io;
 };
 
@@ -131,8 +140,11 @@ static inline int rioFlush(rio *r) {
 void rioInitWithFile(rio *r, FILE *fp);
 void rioInitWithBuffer(rio *r, sds s);
 void rioInitWithFdset(rio *r, int *fds, int numfds);
+void rioInitWithFd(rio *r, int fd, size_t read_limit);
 
+void rioFdsetSetMaxStall(rio *r, long long ms);
 void rioFreeFdset(rio *r);
+size_t rioFreeFd(rio *r);
 
 size_t rioWriteBulkCount(rio *r, char prefix, long count);
 size_t rioWriteBulkString(rio *r, const char *buf, size_t len);
@@ -442,6 +442,7 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
     /* Setup our fake client for command execution */
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argv_size;
 
     /* Log the command if debugging is active. */
     if (ldb.active && ldb.step) {
@@ -55,6 +55,10 @@
 #include <sys/utsname.h>
 #include <locale.h>
 #include <sys/socket.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 /* Our shared "common" objects */
 
@@ -217,6 +221,15 @@ struct redisCommand redisCommandTable[] = {
         {"hgetall",              hgetallCommand,             2,  "r",    0, NULL,               1, 1,  1, 0, 0},
         {"hexists",              hexistsCommand,             3,  "rF",   0, NULL,               1, 1,  1, 0, 0},
         {"hscan",                hscanCommand,               -3, "rR",   0, NULL,               1, 1,  1, 0, 0},
+        {"hexpire",              hexpireCommand,             -6, "wF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hpexpire",             hpexpireCommand,            -6, "wF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hexpireat",            hexpireatCommand,           -6, "wF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hpexpireat",           hpexpireatCommand,          -6, "wF",   0, NULL,               1, 1,  1, 0, 0},
+        {"httl",                 httlCommand,                -5, "rF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hpttl",                hpttlCommand,               -5, "rF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hexpiretime",          hexpiretimeCommand,         -5, "rF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hpexpiretime",         hpexpiretimeCommand,        -5, "rF",   0, NULL,               1, 1,  1, 0, 0},
+        {"hpersist",             hpersistCommand,            -5, "wF",   0, NULL,               1, 1,  1, 0, 0},
         {"incrby",               incrbyCommand,              3,  "wmF",  0, NULL,               1, 1,  1, 0, 0},
         {"decrby",               decrbyCommand,              3,  "wmF",  0, NULL,               1, 1,  1, 0, 0},
         {"incrbyfloat",          incrbyfloatCommand,         3,  "wmF",  0, NULL,               1, 1,  1, 0, 0},
@@ -298,6 +311,8 @@ struct redisCommand redisCommandTable[] = {
         {"georadius_ro",         georadiusroCommand,         -6, "r",    0, georadiusGetKeys,   1, 1,  1, 0, 0},
         {"georadiusbymember",    georadiusbymemberCommand,   -5, "w",    0, georadiusGetKeys,   1, 1,  1, 0, 0},
         {"georadiusbymember_ro", georadiusbymemberroCommand, -5, "r",    0, georadiusGetKeys,   1, 1,  1, 0, 0},
+        {"geosearch",            geosearchCommand,           -7, "r",    0, NULL,               1, 1,  1, 0, 0},
+        {"geosearchstore",       geosearchstoreCommand,      -8, "wm",   0, NULL,               1, 2,  1, 0, 0},
         {"geohash",              geohashCommand,             -2, "r",    0, NULL,               1, 1,  1, 0, 0},
         {"geopos",               geoposCommand,              -2, "r",    0, NULL,               1, 1,  1, 0, 0},
         {"geodist",              geodistCommand,             -4, "r",    0, NULL,               1, 1,  1, 0, 0},
@@ -316,6 +331,7 @@ struct redisCommand redisCommandTable[] = {
         {"xack",                 xackCommand,                -3, "wF",   0, NULL,               1, 1,  1, 0, 0},
         {"xpending",             xpendingCommand,            -3, "r",    0, NULL,               1, 1,  1, 0, 0},
         {"xclaim",               xclaimCommand,              -5, "wF",   0, NULL,               1, 1,  1, 0, 0},
+        {"xautoclaim",           xautoclaimCommand,          -6, "wF",   0, NULL,               1, 1,  1, 0, 0},
         {"xinfo",                xinfoCommand,               -2, "r",    0, NULL,               2, 2,  1, 0, 0},
         {"xdel",                 xdelCommand,                -2, "wF",   0, NULL,               1, 1,  1, 0, 0},
         {"xtrim",                xtrimCommand,               -2, "wF",   0, NULL,               1, 1,  1, 0, 0},
@@ -621,6 +637,43 @@ dictType keyptrDictType = {
         NULL                        /* val destructor */
 };
 
+void dictHashFieldExpiresDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    hashFieldExpiresFree(val);
+}
+
+/* Db->hexpires, keys are the sds strings of db->dict. */
+dictType hashFieldExpiresDictType = {
+        dictSdsHash,                /* hash function */
+        NULL,                       /* key dup */
+        NULL,                       /* val dup */
+        dictSdsKeyCompare,          /* key compare */
+        NULL,                       /* key destructor */
+        dictHashFieldExpiresDestructor /* val destructor */
+};
+
+/* Expire times of the fields of a big hash, field (sds) -> unix time in
+ * milliseconds stored in the s64 of the entry. */
+dictType fieldExpireDictType = {
+        dictSdsHash,                /* hash function */
+        NULL,                       /* key dup */
+        NULL,                       /* val dup */
+        dictSdsKeyCompare,          /* key compare */
+        dictSdsDestructor,          /* key destructor */
+        NULL                        /* val destructor */
+};
+
+/* db->memstats->prefixes, key prefix (sds) -> memPrefixStats. */
+dictType memPrefixDictType = {
+        dictSdsHash,                /* hash function */
+        NULL,                       /* key dup */
+        NULL,                       /* val dup */
+        dictSdsKeyCompare,          /* key compare */
+        dictSdsDestructor,          /* key destructor */
+        dictVanillaFree             /* val destructor */
+};
+
 /* Command table. sds string -> command struct pointer. */
 dictType commandTableDictType = {
         dictSdsCaseHash,            /* hash function */
@@ -726,6 +779,8 @@ void tryResizeHashTables(int dbid) {
         dictResize(server.db[dbid].dict);
     if (htNeedsResize(server.db[dbid].expires))
         dictResize(server.db[dbid].expires);
+    if (htNeedsResize(server.db[dbid].hexpires))
+        dictResize(server.db[dbid].hexpires);
 }
 
 /*
@@ -909,6 +964,10 @@ void databasesCron(void) {
         expireSlaveKeys();
     }
 
+    /* Evict keys before reaching maxmemory if a watermark is configured.
+     * Slaves get the DELs of the evicted keys from the master. */
+    if (server.masterhost == NULL) proactiveEvictionCycle();
+
     /* Defrag keys gradually. */
     if (server.active_defrag_enabled)
         activeDefragCycle();
@@ -1250,6 +1309,16 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
         migrateCloseTimedoutSockets();
     }
 
+    /* Resize or release the TinyLFU frequency sketch if needed. */
+    run_with_period(1000) {
+        evictionSketchCron();
+    }
+
+    /* Refresh the memory estimates of the keys modified too often. */
+    run_with_period(1000) {
+        memTrackCron();
+    }
+
     /* Start a scheduled BGSAVE if the corresponding flag is set. This is
      * useful when we are forced to postpone a BGSAVE because an AOF
      * rewrite is in progress.
@@ -1316,10 +1385,17 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
      * blocking commands. */
     moduleHandleBlockedClients();
 
+    /* Serve the clients whose background SORT was completed. */
+    sortHandleCompletedJobs();
+
     /* Try to process pending commands for clients that were just unblocked. */
     if (listLength(server.unblocked_clients))
         processUnblockedClients();
 
+    /* Resume executing the commands parsed by the slave IO thread, if it
+     * was suspended because the master was blocked or clients paused. */
+    if (server.master) replicationProcessMasterReader();
+
     /* Write the AOF buffer on disk */
     flushAppendOnlyFile(0);
 
@@ -1417,6 +1493,8 @@ void createSharedObjects(void) {
     shared.punsubscribebulk = createStringObject("$12\r\npunsubscribe\r\n", 19);
     shared.del = createStringObject("DEL", 3);
     shared.unlink = createStringObject("UNLINK", 6);
+    shared.hdel = createStringObject("HDEL", 4);
+    shared.hpexpireat = createStringObject("HPEXPIREAT", 10);
     shared.rpop = createStringObject("RPOP", 4);
     shared.lpop = createStringObject("LPOP", 4);
     shared.lpush = createStringObject("LPUSH", 5);
@@ -1487,9 +1565,11 @@ void initServerConfig(void) {
     server.active_defrag_cycle_max = CONFIG_DEFAULT_DEFRAG_CYCLE_MAX;
     server.active_defrag_max_scan_fields = CONFIG_DEFAULT_DEFRAG_MAX_SCAN_FIELDS;
     server.proto_max_bulk_len = CONFIG_DEFAULT_PROTO_MAX_BULK_LEN;
+    server.sort_async_min_elements = CONFIG_DEFAULT_SORT_ASYNC_MIN_ELEMENTS;
     server.client_max_querybuf_len = PROTO_MAX_QUERYBUF_LEN;
     server.saveparams = NULL;
     server.loading = 0;
+    server.loading_async = 0;
     server.logfile = zstrdup(CONFIG_DEFAULT_LOGFILE);
     server.syslog_enabled = CONFIG_DEFAULT_SYSLOG_ENABLED;
     server.syslog_ident = zstrdup(CONFIG_DEFAULT_SYSLOG_IDENT);
@@ -1535,6 +1615,8 @@ void initServerConfig(void) {
     server.maxmemory_samples = CONFIG_DEFAULT_MAXMEMORY_SAMPLES;
     server.lfu_log_factor = CONFIG_DEFAULT_LFU_LOG_FACTOR;
     server.lfu_decay_time = CONFIG_DEFAULT_LFU_DECAY_TIME;
+    server.maxmemory_eviction_watermark = CONFIG_DEFAULT_MAXMEMORY_EVICTION_WATERMARK;
+    server.eviction_lag_start = 0;
     server.hash_max_ziplist_entries = OBJ_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
@@ -1552,6 +1634,7 @@ void initServerConfig(void) {
     server.cluster_slave_validity_factor = CLUSTER_DEFAULT_SLAVE_VALIDITY;
     server.cluster_require_full_coverage = CLUSTER_DEFAULT_REQUIRE_FULL_COVERAGE;
     server.cluster_slave_no_failover = CLUSTER_DEFAULT_SLAVE_NO_FAILOVER;
+    server.cluster_compact_bus = CLUSTER_DEFAULT_COMPACT_BUS;
     server.cluster_configfile = zstrdup(CONFIG_DEFAULT_CLUSTER_CONFIG_FILE);
     server.cluster_announce_ip = CONFIG_DEFAULT_CLUSTER_ANNOUNCE_IP;
     server.cluster_announce_port = CONFIG_DEFAULT_CLUSTER_ANNOUNCE_PORT;
@@ -1561,6 +1644,13 @@ void initServerConfig(void) {
     server.loading_process_events_interval_bytes = (1024 * 1024 * 2);
     server.lazyfree_lazy_eviction = CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION;
     server.lazyfree_lazy_expire = CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE;
+    server.active_expire_index = CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX;
+    server.memory_tracking = CONFIG_DEFAULT_MEMORY_TRACKING;
+    server.intern_values_max_entries = CONFIG_DEFAULT_INTERN_VALUES_MAX_ENTRIES;
+    server.intern_values_max_len = CONFIG_DEFAULT_INTERN_VALUES_MAX_LEN;
+    server.memory_tracking_delimiters = zstrdup(CONFIG_DEFAULT_MEMORY_TRACKING_DELIMITERS);
+    server.numa_node = CONFIG_DEFAULT_NUMA_NODE;
+    server.hugepages_tables = CONFIG_DEFAULT_HUGEPAGES_TABLES;
     server.lazyfree_lazy_server_del = CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
     server.always_show_logo = CONFIG_DEFAULT_ALWAYS_SHOW_LOGO;
     server.lua_time_limit = LUA_SCRIPT_TIME_LIMIT;
@@ -1586,10 +1676,13 @@ void initServerConfig(void) {
     server.repl_serve_stale_data = CONFIG_DEFAULT_SLAVE_SERVE_STALE_DATA;
     server.repl_slave_ro = CONFIG_DEFAULT_SLAVE_READ_ONLY;
     server.repl_slave_lazy_flush = CONFIG_DEFAULT_SLAVE_LAZY_FLUSH;
+    server.repl_diskless_load = CONFIG_DEFAULT_REPL_DISKLESS_LOAD;
+    server.repl_slave_io_thread = CONFIG_DEFAULT_SLAVE_IO_THREAD;
     server.repl_down_since = 0; /* Never connected, repl is down since EVER. */
     server.repl_disable_tcp_nodelay = CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY;
     server.repl_diskless_sync = CONFIG_DEFAULT_REPL_DISKLESS_SYNC;
     server.repl_diskless_sync_delay = CONFIG_DEFAULT_REPL_DISKLESS_SYNC_DELAY;
+    server.repl_diskless_sync_max_stall = CONFIG_DEFAULT_REPL_DISKLESS_SYNC_MAX_STALL;
     server.repl_ping_slave_period = CONFIG_DEFAULT_REPL_PING_SLAVE_PERIOD;
     server.repl_timeout = CONFIG_DEFAULT_REPL_TIMEOUT;
     server.repl_min_slaves_to_write = CONFIG_DEFAULT_MIN_SLAVES_TO_WRITE;
@@ -1603,7 +1696,6 @@ void initServerConfig(void) {
     server.repl_backlog = NULL;
     server.repl_backlog_size = CONFIG_DEFAULT_REPL_BACKLOG_SIZE;
     server.repl_backlog_histlen = 0;
-    server.repl_backlog_idx = 0;
     server.repl_backlog_off = 0;
     server.repl_backlog_time_limit = CONFIG_DEFAULT_REPL_BACKLOG_TIME_LIMIT;
     server.repl_no_slaves_since = time(NULL);
@@ -1642,6 +1734,8 @@ void initServerConfig(void) {
     server.expireCommand = lookupCommandByCString("expire");
     server.pexpireCommand = lookupCommandByCString("pexpire");
     server.xclaimCommand = lookupCommandByCString("xclaim");
+    server.rpushCommand = lookupCommandByCString("rpush");
+    server.hdelCommand = lookupCommandByCString("hdel");
 
     // todo: slowlog 慢日志
     /* Slow log 和日志相关的配置 */
@@ -1912,9 +2006,16 @@ void resetServerStats(void) {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_expired_fields = 0;
     server.stat_expired_stale_perc = 0;
     server.stat_expired_time_cap_reached_count = 0;
+    server.stat_expired_lag_sum = 0;
+    server.stat_expired_lag_count = 0;
+    server.stat_expired_lag_max = 0;
     server.stat_evictedkeys = 0;
+    server.stat_evictedkeys_proactive = 0;
+    server.stat_eviction_fg_usec = 0;
+    server.stat_eviction_lag_max = 0;
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
     server.stat_active_defrag_hits = 0;
@@ -1928,6 +2029,7 @@ void resetServerStats(void) {
     server.stat_sync_full = 0;
     server.stat_sync_partial_ok = 0;
     server.stat_sync_partial_err = 0;
+    server.stat_sort_async = 0;
     for (j = 0; j < STATS_METRIC_COUNT; j++) {
         server.inst_metric[j].idx = 0;
         server.inst_metric[j].last_sample_time = mstime();
@@ -1962,6 +2064,9 @@ void initServer(void) {
     server.clients = listCreate();
     server.clients_to_close = listCreate();
     server.slaves = listCreate();
+    server.repl_buffer_blocks = listCreate();
+    listSetFreeMethod(server.repl_buffer_blocks, zfree);
+    server.repl_buffer_mem = 0;
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
@@ -2010,6 +2115,9 @@ void initServer(void) {
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType, NULL);
         server.db[j].expires = dictCreate(&keyptrDictType, NULL);
+        server.db[j].expires_index = NULL;
+        server.db[j].hexpires = dictCreate(&hashFieldExpiresDictType,NULL);
+        server.db[j].memstats = server.memory_tracking ? memTrackCreate() : NULL;
         server.db[j].blocking_keys = dictCreate(&keylistDictType, NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType, NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType, NULL);
@@ -2018,6 +2126,8 @@ void initServer(void) {
         server.db[j].defrag_later = listCreate();
     }
     evictionPoolAlloc(); /* Initialize the LRU keys pool. */
+    zarenaInit(&server.cmd_arena, CMD_ARENA_BLOCK_SIZE);
+    internedValuesInit();
     server.pubsub_channels = dictCreate(&keylistDictType, NULL);
     server.pubsub_patterns = listCreate();
     listSetFreeMethod(server.pubsub_patterns, freePubsubPattern);
@@ -2098,6 +2208,9 @@ void initServer(void) {
                 "blocked clients subsystem.");
     }
 
+    /* Setup the awake pipe and the state used by background SORT. */
+    sortAsyncInit();
+
     /* Open the AOF file if needed. */
     if (server.aof_state == AOF_ON) {
         server.aof_fd = open(server.aof_filename,
@@ -2127,6 +2240,7 @@ void initServer(void) {
     // todo: slowlog 初始化
     slowlogInit();
     latencyMonitorInit();
+    TLBMissCounterInit();
     // todo: aof 后台线程初始化
     bioInit();
     server.initial_memory_usage = zmalloc_used_memory();
@@ -2355,6 +2469,20 @@ void preventCommandReplication(client *c) {
     c->flags |= CLIENT_PREVENT_REPL_PROP;
 }
 
+/* Allocate memory that is only used while the current command executes,
+ * like the temporary arrays of SORT or SUNION. It is released all together
+ * when the command implementation returns to call(), so it must not be
+ * freed with zfree() nor referenced by anything that outlives the command.
+ * Commands nest (EXEC, scripts, modules), so every call() releases just
+ * what was allocated by its own command. */
+void *cmdArenaAlloc(size_t size) {
+    return zarenaAlloc(&server.cmd_arena, size);
+}
+
+void *cmdArenaCalloc(size_t size) {
+    return zarenaCalloc(&server.cmd_arena, size);
+}
+
 /* Call() is the core of Redis execution of a command.
  *
  * The following flags can be passed:
@@ -2416,7 +2544,9 @@ void call(client *c, int flags) {
     // todo: 所有命令执行都会在这里记录命令执行的时间，即用了多少微秒
     start = ustime();
     // todo: 命令真正执行的地方
+    zarenaMark arena_mark = zarenaGetMark(&server.cmd_arena);
     c->cmd->proc(c);
+    zarenaRelease(&server.cmd_arena, arena_mark);
     // 记录命令执行的时间
     duration = ustime() - start;
 
@@ -2709,11 +2839,15 @@ int processCommand(client *c) {
 
     /*
      * Loading DB? Return an error if the command has not the
-     * CMD_LOADING flag.
+     * CMD_LOADING flag. While a slave loads the master payload into temp
+     * databases (repl-diskless-load swapdb) the old dataset is still in
+     * place, so read only commands are served as well.
      *
      * 加载DB？ 如果命令没有，则返回错误CMD_LOADING标志。
      */
-    if (server.loading && !(c->cmd->flags & CMD_LOADING)) {
+    if (server.loading && !(c->cmd->flags & CMD_LOADING) &&
+        !(server.loading_async && (c->cmd->flags & CMD_READONLY)))
+    {
         addReply(c, shared.loadingerr);
         return C_OK;
     }
@@ -3187,6 +3321,9 @@ sds genRedisInfoString(char *section) {
         const char *evict_policy = evictPolicyToString();
         long long memory_lua = (long long) lua_gc(server.lua, LUA_GCCOUNT, 0) * 1024;
         struct redisMemOverhead *mh = getMemoryOverheadData();
+        size_t huge_tables, huge_bytes, huge_hugetlb_bytes;
+
+        zmalloc_get_huge_stats(&huge_tables,&huge_bytes,&huge_hugetlb_bytes);
 
         /* Peak memory is updated from time to time by serverCron() so it
          * may happen that the instantaneous value is slightly bigger than
@@ -3236,7 +3373,11 @@ sds genRedisInfoString(char *section) {
                             "mem_fragmentation_bytes:%zu\r\n"
                             "mem_allocator:%s\r\n"
                             "active_defrag_running:%d\r\n"
-                            "lazyfree_pending_objects:%zu\r\n",
+                            "lazyfree_pending_objects:%zu\r\n"
+                            "interned_values:%lu\r\n"
+                            "hugepage_tables:%zu\r\n"
+                            "hugepage_tables_bytes:%zu\r\n"
+                            "hugepage_tables_hugetlb_bytes:%zu\r\n",
                             zmalloc_used,
                             hmem,
                             server.cron_malloc_stats.process_rss,
@@ -3268,7 +3409,11 @@ sds genRedisInfoString(char *section) {
                             mh->total_frag_bytes, /* named so for backwards compatibility */
                             ZMALLOC_LIB,
                             server.active_defrag_running,
-                            lazyfreeGetPendingObjectsCount()
+                            lazyfreeGetPendingObjectsCount(),
+                            dictSize(server.interned_values),
+                            huge_tables,
+                            huge_bytes,
+                            huge_hugetlb_bytes
         );
         freeMemoryOverheadData(mh);
     }
@@ -3279,6 +3424,7 @@ sds genRedisInfoString(char *section) {
         info = sdscatprintf(info,
                             "# Persistence\r\n"
                             "loading:%d\r\n"
+                            "async_loading:%d\r\n"
                             "rdb_changes_since_last_save:%lld\r\n"
                             "rdb_bgsave_in_progress:%d\r\n"
                             "rdb_last_save_time:%jd\r\n"
@@ -3295,6 +3441,7 @@ sds genRedisInfoString(char *section) {
                             "aof_last_write_status:%s\r\n"
                             "aof_last_cow_size:%zu\r\n",
                             server.loading,
+                            server.loading_async,
                             server.dirty,
                             server.rdb_child_pid != -1,
                             (intmax_t) server.lastsave,
@@ -3379,10 +3526,19 @@ sds genRedisInfoString(char *section) {
                             "sync_full:%lld\r\n"
                             "sync_partial_ok:%lld\r\n"
                             "sync_partial_err:%lld\r\n"
+                            "sort_async_jobs:%lld\r\n"
                             "expired_keys:%lld\r\n"
+                            "expired_fields:%lld\r\n"
                             "expired_stale_perc:%.2f\r\n"
                             "expired_time_cap_reached_count:%lld\r\n"
+                            "expired_lag_avg_ms:%.2f\r\n"
+                            "expired_lag_max_ms:%lld\r\n"
+                            "expire_index_backlog_ms:%lld\r\n"
                             "evicted_keys:%lld\r\n"
+                            "evicted_keys_proactive:%lld\r\n"
+                            "eviction_foreground_usec:%lld\r\n"
+                            "eviction_lag_ms:%lld\r\n"
+                            "eviction_lag_max_ms:%lld\r\n"
                             "keyspace_hits:%lld\r\n"
                             "keyspace_misses:%lld\r\n"
                             "pubsub_channels:%ld\r\n"
@@ -3405,10 +3561,21 @@ sds genRedisInfoString(char *section) {
                             server.stat_sync_full,
                             server.stat_sync_partial_ok,
                             server.stat_sync_partial_err,
+                            server.stat_sort_async,
                             server.stat_expiredkeys,
+                            server.stat_expired_fields,
                             server.stat_expired_stale_perc * 100,
                             server.stat_expired_time_cap_reached_count,
+                            server.stat_expired_lag_count ?
+                                (double) server.stat_expired_lag_sum /
+                                server.stat_expired_lag_count : 0,
+                            server.stat_expired_lag_max,
+                            expireIndexBacklog(),
                             server.stat_evictedkeys,
+                            server.stat_evictedkeys_proactive,
+                            server.stat_eviction_fg_usec,
+                            proactiveEvictionLag(),
+                            server.stat_eviction_lag_max,
                             server.stat_keyspace_hits,
                             server.stat_keyspace_misses,
                             dictSize(server.pubsub_channels),
@@ -3453,6 +3620,19 @@ sds genRedisInfoString(char *section) {
                                 slave_repl_offset
             );
 
+            if (server.master) {
+                long long lag_bytes, lag_ms, read_offset;
+
+                replicationGetApplyLag(&lag_bytes, &lag_ms, &read_offset);
+                info = sdscatprintf(info,
+                                    "slave_read_repl_offset:%lld\r\n"
+                                    "slave_apply_lag_bytes:%lld\r\n"
+                                    "slave_apply_lag_ms:%lld\r\n"
+                                    "slave_io_thread:%d\r\n",
+                                    read_offset, lag_bytes, lag_ms,
+                                    replicationMasterReaderActive());
+            }
+
             if (server.repl_state == REPL_STATE_TRANSFER) {
                 info = sdscatprintf(info,
                                     "master_sync_left_bytes:%lld\r\n"
@@ -3563,6 +3743,38 @@ sds genRedisInfoString(char *section) {
                             (float) c_ru.ru_utime.tv_sec + (float) c_ru.ru_utime.tv_usec / 1000000);
     }
 
+    /* NUMA placement. Only reported when requested explicitly, since the
+     * kernel walks all the pages of the process to produce numa_maps. */
+    if (!strcasecmp(section, "numa")) {
+        size_t node_bytes[64], total = 0;
+        long long tlb_misses = TLBMissCounterRead();
+        int nodes = zmalloc_get_numa_bytes(node_bytes, 64);
+
+        if (nodes < 0) nodes = 0;
+        if (sections++) info = sdscat(info, "\r\n");
+        info = sdscatprintf(info,
+                            "# Numa\r\n"
+                            "numa_node:%d\r\n"
+                            "dtlb_load_misses:%lld\r\n"
+                            "dtlb_load_misses_per_command:%.2f\r\n"
+                            "numa_nodes:%d\r\n",
+                            server.numa_node,
+                            tlb_misses,
+                            (tlb_misses <= 0 || server.stat_numcommands == 0) ? 0 :
+                            ((float) tlb_misses / server.stat_numcommands),
+                            nodes);
+        for (j = 0; j < nodes; j++) {
+            total += node_bytes[j];
+            info = sdscatprintf(info, "node%d_bytes:%zu\r\n", j, node_bytes[j]);
+        }
+        /* Share of the resident memory placed on the node we are bound to. */
+        if (server.numa_node != -1 && total) {
+            size_t local = server.numa_node < nodes ? node_bytes[server.numa_node] : 0;
+            info = sdscatprintf(info, "numa_local_ratio:%.2f\r\n",
+                                (float) local / total);
+        }
+    }
+
     /* Command statistics */
     if (allsections || !strcasecmp(section, "commandstats")) {
         if (sections++) info = sdscat(info, "\r\n");
@@ -3603,8 +3815,13 @@ sds genRedisInfoString(char *section) {
             vkeys = dictSize(server.db[j].expires);
             if (keys || vkeys) {
                 info = sdscatprintf(info,
-                                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
+                                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld",
                                     j, keys, vkeys, server.db[j].avg_ttl);
+                /* Hashes with fields having a TTL. */
+                if (dictSize(server.db[j].hexpires))
+                    info = sdscatprintf(info, ",subexpiry=%lu",
+                                        dictSize(server.db[j].hexpires));
+                info = sdscatlen(info, "\r\n", 2);
             }
         }
     }
@@ -3653,8 +3870,50 @@ void linuxMemoryWarnings(void) {
     }
     if (THPIsEnabled()) {
         serverLog(LL_WARNING,"WARNING you have Transparent Huge Pages (THP) support enabled in your kernel. This will create latency and memory usage issues with Redis. To fix this issue run the command 'echo never > /sys/kernel/mm/transparent_hugepage/enabled' as root, and add it to your /etc/rc.local in order to retain the setting after a reboot. Redis must be restarted after THP is disabled.");
+    } else if (server.hugepages_tables) {
+        serverLog(LL_WARNING,"WARNING hugepages-tables is enabled but Transparent Huge Pages are disabled in your kernel: only the hugetlbfs pages reserved with 'sysctl vm.nr_hugepages' will be used for the tables.");
     }
 }
+
+/* Run on the CPUs of the NUMA node 'node' and prefer the memory of that node
+ * for the new allocations. The threads created later inherit both settings,
+ * so this must be called before initServer() starts the background threads.
+ * The system calls are used directly so that libnuma is not needed.
+ * Returns C_ERR if the node does not exist or the kernel refuses the policy. */
+#define REDIS_MPOL_PREFERRED 1 /* See set_mempolicy(2). */
+int linuxBindNumaNode(int node) {
+    char path[128], buf[4096], *p;
+    unsigned long nodemask[1024/(8*sizeof(unsigned long))];
+    cpu_set_t cpus;
+    FILE *fp;
+
+    snprintf(path,sizeof(path),"/sys/devices/system/node/node%d/cpulist",node);
+    if ((fp = fopen(path,"r")) == NULL) return C_ERR;
+    if (fgets(buf,sizeof(buf),fp) == NULL) buf[0] = '\0';
+    fclose(fp);
+
+    /* The list looks like "0-7,16-23". Nodes having only memory have no
+     * CPUs at all: in this case we just set the memory policy. */
+    CPU_ZERO(&cpus);
+    p = buf;
+    while (*p >= '0' && *p <= '9') {
+        long first = strtol(p,&p,10), last = first;
+
+        if (*p == '-') last = strtol(p+1,&p,10);
+        for (; first <= last && first < CPU_SETSIZE; first++)
+            CPU_SET(first,&cpus);
+        if (*p == ',') p++;
+    }
+    if (CPU_COUNT(&cpus) && sched_setaffinity(0,sizeof(cpus),&cpus) == -1)
+        return C_ERR;
+
+    memset(nodemask,0,sizeof(nodemask));
+    nodemask[node/(8*sizeof(unsigned long))] |=
+        1UL << (node%(8*sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy,REDIS_MPOL_PREFERRED,nodemask,
+                sizeof(nodemask)*8+1) == -1) return C_ERR;
+    return C_OK;
+}
 #endif /* __linux__ */
 
 void createPidFile(void) {
@@ -4156,6 +4415,18 @@ int main(int argc, char **argv) {
     server.supervised = redisIsSupervised(server.supervised_mode);
     int background = server.daemonize && !server.supervised;
     if (background) daemonize();
+    if (server.numa_node != -1) {
+#ifdef __linux__
+        if (linuxBindNumaNode(server.numa_node) == C_OK) {
+            serverLog(LL_NOTICE,"Bound to NUMA node %d", server.numa_node);
+        } else {
+            serverLog(LL_WARNING,"Unable to bind to NUMA node %d: %s",
+                      server.numa_node, strerror(errno));
+        }
+#else
+        serverLog(LL_WARNING,"numa-node is only supported on Linux");
+#endif
+    }
     // todo: 对 server 进行初始化
     initServer();
     if (background || server.pidfile) createPidFile();
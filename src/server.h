@@ -126,7 +126,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_RDB_CHECKSUM 1
 #define CONFIG_DEFAULT_RDB_FILENAME "dump.rdb"
 #define CONFIG_DEFAULT_REPL_DISKLESS_SYNC 0
+#define CONFIG_DEFAULT_REPL_DISKLESS_LOAD REPL_DISKLESS_LOAD_DISABLED
 #define CONFIG_DEFAULT_REPL_DISKLESS_SYNC_DELAY 5
+#define CONFIG_DEFAULT_REPL_DISKLESS_SYNC_MAX_STALL 10
 #define CONFIG_DEFAULT_SLAVE_SERVE_STALE_DATA 1
 #define CONFIG_DEFAULT_SLAVE_READ_ONLY 1
 #define CONFIG_DEFAULT_SLAVE_ANNOUNCE_IP NULL
@@ -136,6 +138,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_MAXMEMORY_SAMPLES 5
 #define CONFIG_DEFAULT_LFU_LOG_FACTOR 10
 #define CONFIG_DEFAULT_LFU_DECAY_TIME 1
+#define CONFIG_DEFAULT_MAXMEMORY_EVICTION_WATERMARK 0 /* Disabled. */
+#define PROACTIVE_EVICTION_TIME_PERC 25 /* CPU max % for proactive eviction. */
 #define CONFIG_DEFAULT_AOF_FILENAME "appendonly.aof"
 #define CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define CONFIG_DEFAULT_AOF_LOAD_TRUNCATED 1
@@ -151,8 +155,16 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_MIN_RESERVED_FDS 32
 #define CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD 0
 #define CONFIG_DEFAULT_SLAVE_LAZY_FLUSH 0
+#define CONFIG_DEFAULT_SLAVE_IO_THREAD 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
+#define CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX 0
+#define CONFIG_DEFAULT_MEMORY_TRACKING 0
+#define CONFIG_DEFAULT_MEMORY_TRACKING_DELIMITERS ":"
+#define CONFIG_DEFAULT_INTERN_VALUES_MAX_ENTRIES 0
+#define CONFIG_DEFAULT_INTERN_VALUES_MAX_LEN 32
+#define CONFIG_DEFAULT_NUMA_NODE -1
+#define CONFIG_DEFAULT_HUGEPAGES_TABLES 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
 #define CONFIG_DEFAULT_ALWAYS_SHOW_LOGO 0
 #define CONFIG_DEFAULT_ACTIVE_DEFRAG 0
@@ -163,12 +175,16 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_DEFRAG_CYCLE_MAX 75 /* 75% CPU max (at upper threshold) */
 #define CONFIG_DEFAULT_DEFRAG_MAX_SCAN_FIELDS 1000 /* keys with more than 1000 fields will be processed separately */
 #define CONFIG_DEFAULT_PROTO_MAX_BULK_LEN (512ll*1024*1024) /* Bulk request max size */
+#define CONFIG_DEFAULT_SORT_ASYNC_MIN_ELEMENTS 0 /* Background SORT disabled. */
 
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
+#define ACTIVE_EXPIRE_CYCLE_FIELDS_PER_KEY 1000 /* Hash fields per lookup. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
 #define ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC 25 /* CPU max % for keys collection */
 #define ACTIVE_EXPIRE_CYCLE_SLOW 0
 #define ACTIVE_EXPIRE_CYCLE_FAST 1
+#define EXPIRE_INDEX_BUCKET_BITS 7 /* 128 ms buckets in the expire index. */
+#define EXPIRE_INDEX_BATCH 16 /* Keys expired between time limit checks. */
 
 /* Instantaneous metrics tracking. */
 #define STATS_METRIC_SAMPLES 16     /* Number of samples per metric. */
@@ -183,8 +199,12 @@ typedef long long mstime_t; /* millisecond time type. */
 #define PROTO_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
 #define PROTO_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define PROTO_MBULK_BIG_ARG     (1024*32)
+#define PROTO_ARGV_POOL_SIZE    8   /* Argument objects kept for reuse. */
+#define PROTO_ARGV_POOL_MAX_LEN 128 /* Max string length of pooled arguments. */
+#define PROTO_ARGV_KEEP_LEN     1024 /* Max argv slots kept between commands. */
 #define LONG_STR_SIZE      21          /* Bytes needed for long -> str + '\0' */
 #define REDIS_AUTOSYNC_BYTES (1024*1024*32) /* fdatasync every 32MB */
+#define CMD_ARENA_BLOCK_SIZE (16*1024) /* See cmdArenaAlloc(). */
 
 /* When configuring the server eventloop, we setup it so that the total number
  * of file descriptors we can handle are server.maxclients + RESERVED_FDS +
@@ -260,7 +280,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define BLOCKED_MODULE 3  /* Blocked by a loadable module. */
 #define BLOCKED_STREAM 4  /* XREAD. */
 #define BLOCKED_ZSET 5    /* BZPOP et al. */
-#define BLOCKED_NUM 6     /* Number of blocked states. */
+#define BLOCKED_SORT 6    /* SORT running in the background. */
+#define BLOCKED_NUM 7     /* Number of blocked states. */
 
 /* Client request types */
 #define PROTO_REQ_INLINE 1
@@ -320,6 +341,11 @@ typedef long long mstime_t; /* millisecond time type. */
 #define SLAVE_CAPA_EOF (1<<0)    /* Can parse the RDB EOF streaming format. */
 #define SLAVE_CAPA_PSYNC2 (1<<1) /* Supports PSYNC2 protocol. */
 
+/* Slave diskless load modes (repl-diskless-load). */
+#define REPL_DISKLESS_LOAD_DISABLED 0   /* Save the RDB on disk, then load. */
+#define REPL_DISKLESS_LOAD_WHEN_DB_EMPTY 1 /* Socket load if no keys. */
+#define REPL_DISKLESS_LOAD_SWAPDB 2     /* Socket load into temp dbs. */
+
 /* Synchronous read timeout - slave side */
 #define CONFIG_REPL_SYNCIO_TIMEOUT 5
 
@@ -385,6 +411,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define MAXMEMORY_FLAG_LRU (1<<0)
 #define MAXMEMORY_FLAG_LFU (1<<1)
 #define MAXMEMORY_FLAG_ALLKEYS (1<<2)
+#define MAXMEMORY_FLAG_TINYLFU (1<<3) /* LRU clock + frequency sketch. */
 #define MAXMEMORY_FLAG_NO_SHARED_INTEGERS \
     (MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_LFU)
 
@@ -396,6 +423,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define MAXMEMORY_ALLKEYS_LFU ((5<<8)|MAXMEMORY_FLAG_LFU|MAXMEMORY_FLAG_ALLKEYS)
 #define MAXMEMORY_ALLKEYS_RANDOM ((6<<8)|MAXMEMORY_FLAG_ALLKEYS)
 #define MAXMEMORY_NO_EVICTION (7<<8)
+#define MAXMEMORY_VOLATILE_TINYLFU ((8<<8)|MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_TINYLFU)
+#define MAXMEMORY_ALLKEYS_TINYLFU ((9<<8)|MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_TINYLFU|MAXMEMORY_FLAG_ALLKEYS)
 
 #define CONFIG_DEFAULT_MAXMEMORY_POLICY MAXMEMORY_NO_EVICTION
 
@@ -485,6 +514,7 @@ typedef long long mstime_t; /* millisecond time type. */
  * encoding version. */
 #define OBJ_MODULE 5    /* Module object. */
 #define OBJ_STREAM 6    /* Stream object. */
+#define OBJ_TYPE_COUNT 7 /* Number of object types. */
 
 /* Extract encver / signature from a module type ID. */
 #define REDISMODULE_TYPE_ENCVER_BITS 10
@@ -601,6 +631,7 @@ typedef struct RedisModuleDigest {
 #define OBJ_ENCODING_EMBSTR 8  /* Embedded sds string encoding */
 #define OBJ_ENCODING_QUICKLIST 9 /* Encoded as linked list of ziplists */
 #define OBJ_ENCODING_STREAM 10 /* Encoded as a radix tree of listpacks */
+#define OBJ_ENCODING_INTERNED 11 /* Sds of an interned value, not owned */
 
 #define LRU_BITS 24
 #define LRU_CLOCK_MAX ((1<<LRU_BITS)-1) /* Max value of obj->lru */
@@ -681,6 +712,10 @@ typedef struct redisDb {
     dict *dict;                 /* The keyspace for this DB */
     // 超时设置的键集合
     dict *expires;              /* Timeout of keys with a timeout set */
+    // 按过期时间排序的过期键索引，active-expire-index 关闭时为 NULL
+    rax *expires_index;         /* Expire time bucket -> keys, or NULL */
+    // 设置了字段过期时间的 hash 键集合
+    dict *hexpires;             /* Hash keys with fields TTLs -> hashFieldExpires */
     // 客户端等待数据的 key
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP)*/
     // 被阻塞的 key 接收到 push
@@ -692,8 +727,34 @@ typedef struct redisDb {
     long long avg_ttl;          /* Average TTL, just for stats */
     // 逐渐尝试逐个碎片整理的键名列表
     list *defrag_later;         /* List of key names to attempt to defrag one by one, gradually. */
+    // 按 key 前缀和类型统计的内存，memory-tracking 关闭时为 NULL
+    struct dbMemStats *memstats; /* Memory by key prefix and type, or NULL */
 } redisDb;
 
+/* Expire times of the fields of a hash having fields with a TTL, stored in
+ * db->hexpires: a sorted set of the fields scored by their unix time in
+ * milliseconds, so that the fields expiring first can be found without
+ * scanning all of them. See the "Hash field expires" section of t_hash.c. */
+typedef struct hashFieldExpires {
+    robj *times;        /* Sorted set of field -> expire time. */
+} hashFieldExpires;
+
+/* Memory accounting of the keys of a DB by key prefix and value type, kept
+ * when memory-tracking is enabled. See the "Memory tracking" section of
+ * object.c. */
+typedef struct dbMemStats {
+    dict *keys;         /* Key -> memory estimate and type of the value. */
+    dict *prefixes;     /* Key prefix -> memPrefixStats. */
+    dict *stale;        /* Keys modified since their last estimate. */
+    unsigned long long type_keys[OBJ_TYPE_COUNT];  /* Keys by value type. */
+    unsigned long long type_bytes[OBJ_TYPE_COUNT]; /* Bytes by value type. */
+} dbMemStats;
+
+typedef struct memPrefixStats {
+    unsigned long long keys;    /* Keys with this prefix. */
+    unsigned long long bytes;   /* Memory used by the keys with this prefix. */
+} memPrefixStats;
+
  /**
   * 客户端事务命令结构体
   * Client MULTI/EXEC state 
@@ -762,6 +823,9 @@ typedef struct blockingState {
     void *module_blocked_handle; /* RedisModuleBlockedClient structure.
                                     which is opaque for the Redis core, only
                                     handled in module.c. */
+
+    /* BLOCKED_SORT */
+    void *sort_job;         /* sortJob structure, only handled in sort.c. */
 } blockingState;
 
 /* 
@@ -789,6 +853,27 @@ typedef struct readyList {
  * With multiplexing we need to take per-client state.
  * Clients are taken in a linked list.
  */
+/* The replication stream is stored once, in a list of immutable blocks
+ * shared by the replication backlog and the output of every slave: each of
+ * them holds a reference to the first block it still needs, and a block is
+ * released as soon as it is no longer referenced and it is not needed any
+ * more to serve the backlog.
+ *
+ * 复制流只保存一份：backlog 和所有 slave 的输出缓冲区共享同一个带引用计数的块链表，
+ * 而不是各自拷贝一份。 */
+typedef struct replBufBlock {
+    int refcount;           /* Backlog and slaves pointing to this block. */
+    long long repl_offset;  /* Replication offset of buf[0]. */
+    size_t size, used;      /* Allocated and used bytes of buf. */
+    char buf[];
+} replBufBlock;
+
+/* The backlog is just a reference to the oldest block it retains. The node
+ * is NULL until the first byte is fed. */
+typedef struct replBacklog {
+    listNode *ref_repl_buf_node;
+} replBacklog;
+
 typedef struct client {
     uint64_t id;            /* Client incremental unique ID. */
     // 客户端连接的 socket ，也就是句柄
@@ -806,6 +891,10 @@ typedef struct client {
     int argc;               /* Num of arguments of current command. */
     // client 当前的命令参数
     robj **argv;            /* Arguments of current command. */
+    int argv_len;           /* Size of the argv array (may be > argc). */
+    // 可以重用的参数对象，避免每个命令都分配和释放参数
+    robj *argv_pool[PROTO_ARGV_POOL_SIZE]; /* Argument objects to reuse. */
+    int argv_pool_len;      /* Number of objects in argv_pool. */
     // 这里就是 redisCommand
     struct redisCommand *cmd, *lastcmd;  /* Last command executed. */
     int reqtype;            /* Request protocol type: PROTO_REQ_* */
@@ -836,6 +925,8 @@ typedef struct client {
     long long psync_initial_offset; /* FULLRESYNC reply offset other slaves
                                        copying this slave output buffer
                                        should use. */
+    listNode *ref_repl_buf_node; /* Next replBufBlock to send, if slave. */
+    size_t ref_block_pos;   /* Bytes of that block already sent. */
     char replid[CONFIG_RUN_ID_SIZE+1]; /* Master replication ID (if master). */
     int slave_listening_port; /* As configured with: SLAVECONF listening-port */
     char slave_ip[NET_IP_STR_LEN]; /* Optionally given by REPLCONF ip-address */
@@ -891,7 +982,7 @@ struct sharedObjectsStruct {
     *masterdownerr, *roslaveerr, *execaborterr, *noautherr, *noreplicaserr,
     *busykeyerr, *oomerr, *plus, *messagebulk, *pmessagebulk, *subscribebulk,
     *unsubscribebulk, *psubscribebulk, *punsubscribebulk, *del, *unlink,
-    *rpop, *lpop, *lpush, *zpopmin, *zpopmax, *emptyscan,
+    *rpop, *lpop, *lpush, *zpopmin, *zpopmax, *emptyscan, *hdel, *hpexpireat,
     *select[PROTO_SHARED_SELECT_CMDS],
     // todo: 存了 [0, OBJ_SHARED_INTEGERS) 的数字常量
     *integers[OBJ_SHARED_INTEGERS],
@@ -1071,6 +1162,15 @@ struct redisServer {
     unsigned int lruclock;      /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int active_expire_index;    /* Keep db->expires_index for activeExpireCycle() */
+    int memory_tracking;        /* Keep db->memstats for MEMORY PREFIXES. */
+    dict *interned_values;      /* Small string values shared by the keys. */
+    dict *intern_candidates;    /* Values seen but not interned yet. */
+    unsigned long intern_values_max_entries; /* Max size of interned_values. */
+    int intern_values_max_len;  /* Max length of the interned values. */
+    char *memory_tracking_delimiters; /* Chars ending the key prefixes. */
+    int numa_node;              /* NUMA node to run on, -1 if not bound. */
+    int hugepages_tables;       /* Big dict tables on huge pages. */
     int active_defrag_running;  /* Active defragmentation running (holds current scan aggressiveness) */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
@@ -1114,6 +1214,7 @@ struct redisServer {
     int protected_mode;         /* Don't accept external connections. */
     /* RDB / AOF loading information */
     int loading;                /* We are loading data from disk if true */
+    int loading_async;          /* Old dataset still served while loading */
     off_t loading_total_bytes;
     off_t loading_loaded_bytes;
     time_t loading_start_time;
@@ -1122,15 +1223,23 @@ struct redisServer {
     struct redisCommand *delCommand, *multiCommand, *lpushCommand,
                         *lpopCommand, *rpopCommand, *zpopminCommand,
                         *zpopmaxCommand, *sremCommand, *execCommand,
-                        *expireCommand, *pexpireCommand, *xclaimCommand;
+                        *expireCommand, *pexpireCommand, *xclaimCommand,
+                        *rpushCommand, *hdelCommand;
     /* Fields used only for stats */
     time_t stat_starttime;          /* Server start time */
     long long stat_numcommands;     /* Number of processed commands */
     long long stat_numconnections;  /* Number of connections received */
     long long stat_expiredkeys;     /* Number of expired keys */
+    long long stat_expired_fields;  /* Number of expired hash fields */
     double stat_expired_stale_perc; /* Percentage of keys probably expired */
     long long stat_expired_time_cap_reached_count; /* Early expire cylce stops.*/
+    long long stat_expired_lag_sum; /* Sum of ms between expire and reclaim. */
+    long long stat_expired_lag_count; /* Keys accounted in the sum above. */
+    long long stat_expired_lag_max; /* Max ms between expire and reclaim. */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
+    long long stat_evictedkeys_proactive; /* Evicted by proactive eviction. */
+    long long stat_eviction_fg_usec; /* Time spent evicting inside commands. */
+    long long stat_eviction_lag_max; /* Max ms over the eviction watermark. */
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
     long long stat_keyspace_misses; /* Number of failed lookups of keys */
     long long stat_active_defrag_hits;      /* number of allocations moved */
@@ -1145,6 +1254,7 @@ struct redisServer {
     long long stat_sync_full;       /* Number of full resyncs with slaves. */
     long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
     long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
+    long long stat_sort_async;      /* Number of SORTs sorted in background. */
 
     // 服务器中的慢查询日志队列
     list *slowlog;                  /* SLOWLOG list of commands */
@@ -1267,6 +1377,7 @@ struct redisServer {
     } child_info_data;
     /* Propagation of commands in AOF / replication */
     redisOpArray also_propagate;    /* Additional command to propagate. */
+    zarena cmd_arena;               /* Transient allocations of commands. */
     /* Logging */
     char *logfile;                  /* Path of log file */
     int syslog_enabled;             /* Is syslog enabled? */
@@ -1282,13 +1393,14 @@ struct redisServer {
      * TODO：ping 主节点每隔 n 秒对从节点发送一次 ping 命令
      */
     int repl_ping_slave_period;     /* Master pings the slave every N seconds */
-    char *repl_backlog;             /* Replication backlog for partial syncs */
-    long long repl_backlog_size;    /* Backlog circular buffer size */
+    replBacklog *repl_backlog;      /* Replication backlog for partial syncs */
+    long long repl_backlog_size;    /* Backlog size: bytes of history to keep */
     long long repl_backlog_histlen; /* Backlog actual data length */
-    long long repl_backlog_idx;     /* Backlog circular buffer current offset,
-                                       that is the next byte will'll write to.*/
     long long repl_backlog_off;     /* Replication "master offset" of first
                                        byte in the replication backlog buffer.*/
+    list *repl_buffer_blocks;       /* Shared replication buffer: replBufBlock
+                                       list referenced by backlog and slaves. */
+    size_t repl_buffer_mem;         /* Memory used by repl_buffer_blocks. */
     time_t repl_backlog_time_limit; /* Time without slaves after the backlog
                                        gets released. */
     time_t repl_no_slaves_since;    /* We have no slaves since that time.
@@ -1298,6 +1410,8 @@ struct redisServer {
     int repl_good_slaves_count;     /* Number of slaves with lag <= max_lag. */
     int repl_diskless_sync;         /* Send RDB to slaves sockets directly. */
     int repl_diskless_sync_delay;   /* Delay to start a diskless repl BGSAVE. */
+    int repl_diskless_sync_max_stall; /* Drop a diskless sync slave that delays
+                                         the others for more seconds. */
     /* Replication (slave) */
     char *masterauth;               /* AUTH with this password with master */
     char *masterhost;               /* Hostname of master */
@@ -1327,6 +1441,10 @@ struct redisServer {
     char master_replid[CONFIG_RUN_ID_SIZE+1];  /* Master PSYNC runid. */
     long long master_initial_offset;           /* Master PSYNC offset. */
     int repl_slave_lazy_flush;          /* Lazy FLUSHALL before loading DB? */
+    int repl_diskless_load;             /* Load the master RDB from the socket:
+                                           REPL_DISKLESS_LOAD_* modes. */
+    int repl_slave_io_thread;           /* Read and parse the master stream
+                                           in a dedicated thread? */
     /* Replication script cache. */
     dict *repl_scriptcache_dict;        /* SHA1 all slaves are aware of. */
     list *repl_scriptcache_fifo;        /* First in, first out LRU eviction. */
@@ -1341,6 +1459,10 @@ struct redisServer {
     int maxmemory_samples;          /* Pricision of random sampling */
     int lfu_log_factor;             /* LFU logarithmic counter factor. */
     int lfu_decay_time;             /* LFU counter decay factor. */
+    int maxmemory_eviction_watermark; /* % of maxmemory where the proactive
+                                         eviction starts, 0 = disabled. */
+    long long eviction_lag_start;   /* Time the memory went over the
+                                       watermark, 0 if under it. */
     long long proto_max_bulk_len;   /* Protocol bulk length maximum size. */
     /* Blocked clients */
     unsigned int blocked_clients;   /* # of clients executing a blocking cmd.*/
@@ -1353,6 +1475,9 @@ struct redisServer {
     int sort_alpha;
     int sort_bypattern;
     int sort_store;
+    long long sort_async_min_elements; /* Sort in background at this size. */
+    int sort_async_pipe[2];     /* Pipe used to wake up the event loop once a
+                                   background SORT completed. */
     /* Zip structure config, see redis.conf for more information  */
     size_t hash_max_ziplist_entries;
     size_t hash_max_ziplist_value;
@@ -1396,6 +1521,7 @@ struct redisServer {
                                           there is at least an uncovered slot.*/
     int cluster_slave_no_failover;  /* Prevent slave from starting a failover
                                        if the master is in failure state. */
+    int cluster_compact_bus;    /* Use compact PING/PONG when supported. */
     char *cluster_announce_ip;  /* IP address to announce on cluster bus. */
     int cluster_announce_port;     /* base port to announce on cluster bus. */
     int cluster_announce_bus_port; /* bus port to announce on cluster bus. */
@@ -1541,6 +1667,12 @@ typedef struct {
     dictEntry *de;
 } hashTypeIterator;
 
+typedef struct {
+    hashFieldExpires *hfe;
+    unsigned char *eptr, *sptr; /* Ziplist cursor. */
+    zskiplistNode *ln;          /* Skiplist cursor. */
+} hashFieldExpiresIterator;
+
 #include "stream.h"  /* Stream data type header file. */
 
 #define OBJ_HASH_KEY 1
@@ -1564,6 +1696,10 @@ extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
 extern dictType keyptrDictType;
+extern dictType hashFieldExpiresDictType;
+extern dictType fieldExpireDictType;
+extern dictType memPrefixDictType;
+extern dictType keylistDictType;
 extern dictType modulesDictType;
 
 /*-----------------------------------------------------------------------------
@@ -1653,6 +1789,7 @@ int clientsArePaused(void);
 int processEventsWhileBlocked(void);
 int handleClientsWithPendingWrites(void);
 int clientHasPendingReplies(client *c);
+int prepareClientToWrite(client *c);
 void unlinkClient(client *c);
 int writeToClient(int fd, client *c, int handler_installed);
 void linkClient(client *c);
@@ -1699,6 +1836,7 @@ void decrRefCount(robj *o);
 void decrRefCountVoid(void *o);
 void incrRefCount(robj *o);
 robj *makeObjectShared(robj *o);
+void internedValuesInit(void);
 robj *resetRefCount(robj *obj);
 void freeStringObject(robj *o);
 void freeListObject(robj *o);
@@ -1707,6 +1845,7 @@ void freeZsetObject(robj *o);
 void freeHashObject(robj *o);
 robj *createObject(int type, void *ptr);
 robj *createStringObject(const char *ptr, size_t len);
+int overwriteStringObject(robj *o, const char *ptr, size_t len);
 robj *createRawStringObject(const char *ptr, size_t len);
 robj *createEmbeddedStringObject(const char *ptr, size_t len);
 robj *dupStringObject(const robj *o);
@@ -1736,11 +1875,12 @@ int getLongLongFromObject(robj *o, long long *target);
 int getLongDoubleFromObject(robj *o, long double *target);
 int getLongDoubleFromObjectOrReply(client *c, robj *o, long double *target, const char *msg);
 char *strEncoding(int encoding);
+size_t objectComputeSize(robj *o, size_t sample_size);
 int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long long estimateObjectIdleTime(robj *o);
-#define sdsEncodedObject(objptr) (objptr->encoding == OBJ_ENCODING_RAW || objptr->encoding == OBJ_ENCODING_EMBSTR)
+#define sdsEncodedObject(objptr) (objptr->encoding == OBJ_ENCODING_RAW || objptr->encoding == OBJ_ENCODING_EMBSTR || objptr->encoding == OBJ_ENCODING_INTERNED)
 
 /* Synchronous I/O with timeout */
 ssize_t syncWrite(int fd, char *ptr, ssize_t size, long long timeout);
@@ -1776,9 +1916,19 @@ void clearReplicationId2(void);
 void chopReplicationBacklog(void);
 void replicationCacheMasterUsingMyself(void);
 void feedReplicationBacklog(void *ptr, size_t len);
+void incrementalTrimReplicationBacklog(void);
+int replicationStartMasterReader(client *c);
+void replicationStopMasterReader(void);
+void replicationProcessMasterReader(void);
+int replicationMasterReaderActive(void);
+void replicationGetApplyLag(long long *lag_bytes, long long *lag_ms,
+                            long long *read_offset);
+void slaveReleaseReplBuffer(client *c);
+size_t slaveReplBufferPendingBytes(client *c);
 
 /* Generic persistence functions */
 void startLoading(FILE *fp);
+void startLoadingBytes(off_t total_bytes);
 void loadingProgress(off_t pos);
 void stopLoading(void);
 
@@ -1872,12 +2022,16 @@ int zslLexValueLteMax(sds value, zlexrangespec *spec);
 /* Core functions */
 int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *level);
 int freeMemoryIfNeeded(void);
+void proactiveEvictionCycle(void);
+long long proactiveEvictionLag(void);
 int processCommand(client *c);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
 struct redisCommand *lookupCommandByCString(char *s);
 struct redisCommand *lookupCommandOrOriginal(sds name);
 void call(client *c, int flags);
+void *cmdArenaAlloc(size_t size);
+void *cmdArenaCalloc(size_t size);
 void propagate(struct redisCommand *cmd, int dbid, robj **argv, int argc, int flags);
 void alsoPropagate(struct redisCommand *cmd, int dbid, robj **argv, int argc, int target);
 void forceCommandPropagation(client *c, int flags);
@@ -1907,6 +2061,15 @@ unsigned int getLRUClock(void);
 unsigned int LRU_CLOCK(void);
 const char *evictPolicyToString(void);
 struct redisMemOverhead *getMemoryOverheadData(void);
+dbMemStats *memTrackCreate(void);
+void memTrackRelease(dbMemStats *ms);
+void memTrackKey(redisDb *db, sds key, robj *val);
+void memTrackKeyByName(redisDb *db, sds key);
+void memTrackCron(void);
+void memTrackDel(redisDb *db, sds key);
+void memTrackFlush(redisDb *db);
+void memTrackEnable(void);
+void memTrackDisable(void);
 void freeMemoryOverheadData(struct redisMemOverhead *mh);
 
 #define RESTART_SERVER_NONE 0
@@ -1939,6 +2102,23 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2);
 int hashTypeExists(robj *o, sds key);
 int hashTypeDelete(robj *o, sds key);
 unsigned long hashTypeLength(const robj *o);
+void hashFieldExpiresFree(hashFieldExpires *hfe);
+long long hashFieldGetExpire(redisDb *db, robj *key, sds field);
+void hashFieldSetExpire(redisDb *db, robj *key, sds field, long long when);
+int hashFieldRemoveExpire(redisDb *db, robj *key, sds field);
+void hashFieldExpiresDelKey(redisDb *db, sds key);
+hashFieldExpires *hashFieldExpiresUnlink(redisDb *db, robj *key);
+void hashFieldExpiresLink(redisDb *db, robj *key, hashFieldExpires *hfe);
+void hashFieldExpiresRestore(redisDb *db, robj *key, unsigned char *zl);
+void hashFieldExpiresInitIterator(hashFieldExpiresIterator *it, hashFieldExpires *hfe);
+int hashFieldExpiresNext(hashFieldExpiresIterator *it, sds *field, long long *when);
+unsigned long hashFieldExpiresLength(hashFieldExpires *hfe);
+long long hashFieldExpiresMin(hashFieldExpires *hfe);
+size_t hashFieldExpiresMemoryUsage(redisDb *db, robj *key, size_t samples);
+hashFieldExpires *hashFieldExpiresDue(redisDb *db, robj *key, long long *now);
+int hashFieldIsDue(hashFieldExpires *hfe, sds field, long long now);
+int hashExpireFields(redisDb *db, robj *key, long long now, long max);
+int hashExpireFieldsIfNeeded(redisDb *db, robj *key);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
@@ -2004,6 +2184,9 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
 #define EMPTYDB_NO_FLAGS 0      /* No flags. */
 #define EMPTYDB_ASYNC (1<<0)    /* Reclaim memory in another thread. */
 long long emptyDb(int dbnum, int flags, void(callback)(void*));
+redisDb *createTempDbs(void);
+void swapTempDbs(redisDb *dbs);
+void discardTempDbs(redisDb *dbs, int flags);
 
 int selectDb(client *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
@@ -2014,9 +2197,10 @@ unsigned int delKeysInSlot(unsigned int hashslot);
 int verifyClusterConfigWithData(void);
 void scanGenericCommand(client *c, robj *o, unsigned long cursor);
 int parseScanCursorOrReply(client *c, robj *o, unsigned long *cursor);
-void slotToKeyAdd(robj *key);
-void slotToKeyDel(robj *key);
+void slotToKeyAdd(sds key);
+void slotToKeyDel(sds key);
 void slotToKeyFlush(void);
+void slotToKeyReplaceKeyPtr(sds oldkey, sds newkey, uint64_t hash);
 int dbAsyncDelete(redisDb *db, robj *key);
 void emptyDbAsync(redisDb *db);
 void slotToKeyFlushAsync(void);
@@ -2032,6 +2216,11 @@ int *migrateGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkey
 int *georadiusGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *xreadGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 
+/* Sort */
+void sortAsyncInit(void);
+void sortHandleCompletedJobs(void);
+void unblockClientFromSort(client *c);
+
 /* Cluster */
 void clusterInit(void);
 unsigned short crc16(const char *buf, int len);
@@ -2076,6 +2265,14 @@ void blockForKeys(client *c, int btype, robj **keys, int numkeys, mstime_t timeo
 void activeExpireCycle(int type);
 void expireSlaveKeys(void);
 void rememberSlaveKeyWithExpire(redisDb *db, robj *key);
+void expireIndexAdd(redisDb *db, sds key, long long when);
+void expireIndexDel(redisDb *db, sds key);
+void expireIndexReplaceKeyPtr(redisDb *db, sds oldkey, sds newkey, uint64_t hash);
+void expireIndexRelease(rax *index);
+void expireIndexFlush(redisDb *db);
+void expireIndexEnable(void);
+void expireIndexDisable(void);
+long long expireIndexBacklog(void);
 void flushSlaveKeysWithExpireList(void);
 size_t getSlaveKeyWithExpireCount(void);
 
@@ -2085,6 +2282,11 @@ void evictionPoolAlloc(void);
 unsigned long LFUGetTimeInMinutes(void);
 uint8_t LFULogIncr(uint8_t value);
 unsigned long LFUDecrAndReturn(robj *o);
+void evictionPoolEmpty(void);
+void evictionPoolOfferKey(int dbid, sds key, robj *o);
+void evictionSketchRecord(sds key);
+unsigned long evictionSketchFrequency(sds key);
+void evictionSketchCron(void);
 
 /* Keys hashing / comparison functions for dict.c hash tables. */
 uint64_t dictSdsHash(const void *key);
@@ -2220,6 +2422,15 @@ void hmgetCommand(client *c);
 void hdelCommand(client *c);
 void hlenCommand(client *c);
 void hstrlenCommand(client *c);
+void hexpireCommand(client *c);
+void hpexpireCommand(client *c);
+void hexpireatCommand(client *c);
+void hpexpireatCommand(client *c);
+void httlCommand(client *c);
+void hpttlCommand(client *c);
+void hexpiretimeCommand(client *c);
+void hpexpiretimeCommand(client *c);
+void hpersistCommand(client *c);
 void zremrangebyrankCommand(client *c);
 void zunionstoreCommand(client *c);
 void zinterstoreCommand(client *c);
@@ -2265,6 +2476,8 @@ void georadiusbymemberCommand(client *c);
 void georadiusbymemberroCommand(client *c);
 void georadiusCommand(client *c);
 void georadiusroCommand(client *c);
+void geosearchCommand(client *c);
+void geosearchstoreCommand(client *c);
 void geoaddCommand(client *c);
 void geohashCommand(client *c);
 void geoposCommand(client *c);
@@ -2286,6 +2499,7 @@ void xgroupCommand(client *c);
 void xackCommand(client *c);
 void xpendingCommand(client *c);
 void xclaimCommand(client *c);
+void xautoclaimCommand(client *c);
 void xinfoCommand(client *c);
 void xdelCommand(client *c);
 void xtrimCommand(client *c);
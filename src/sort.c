@@ -30,6 +30,7 @@
 
 
 #include "server.h"
+#include "bio.h"
 #include "pqsort.h" /* Partial qsort for SORT+LIMIT */
 #include <math.h> /* isnan() */
 
@@ -42,35 +43,29 @@ redisSortOperation *createSortOperation(int type, robj *pattern) {
     return so;
 }
 
-/* Return the value associated to the key with a name obtained using
- * the following rules:
- *
- * 1) The first occurrence of '*' in 'pattern' is substituted with 'subst'.
- *
- * 2) If 'pattern' matches the "->" string, everything on the left of
- *    the arrow is treated as the name of a hash field, and the part on the
- *    left as the key name containing a hash. The value of the specified
- *    field is returned.
- *
- * 3) If 'pattern' equals "#", the function simply returns 'subst' itself so
- *    that the SORT command can be used like: SORT key GET # to retrieve
- *    the Set/List elements directly.
+/* Number of elements for which BY / GET patterns are resolved at once, see
+ * lookupKeysByPattern(). */
+#define SORT_LOOKUP_BATCH 16
+
+/* SORT ... LIMIT selects the requested range with a bounded heap instead of
+ * pqsort() when the range ends within the first 1/SORT_TOPK_RATIO of the
+ * vector, see sortVector(). */
+#define SORT_TOPK_RATIO 8
+
+/* Perform the '*' substitution of 'subst' into 'pattern', returning the
+ * name of the key to lookup. If the pattern uses the "->" notation the
+ * name of the hash field is returned by reference into '*fieldobj',
+ * otherwise '*fieldobj' is set to NULL.
  *
- * The returned object will always have its refcount increased by 1
- * when it is non-NULL. */
-robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
+ * If we can't find '*' in the pattern NULL is returned, as to GET a fixed
+ * key does not make sense. */
+static robj *sortPatternToKey(robj *pattern, robj *subst, robj **fieldobj) {
     char *p, *f, *k;
-    sds spat, ssub;
-    robj *keyobj, *fieldobj = NULL, *o;
+    sds spat = pattern->ptr, ssub;
+    robj *keyobj;
     int prefixlen, sublen, postfixlen, fieldlen;
 
-    /* If the pattern is "#" return the substitution object itself in order
-     * to implement the "SORT ... GET #" feature. */
-    spat = pattern->ptr;
-    if (spat[0] == '#' && spat[1] == '\0') {
-        incrRefCount(subst);
-        return subst;
-    }
+    *fieldobj = NULL;
 
     /* The substitution object may be specially encoded. If so we create
      * a decoded object on the fly. Otherwise getDecodedObject will just
@@ -89,7 +84,7 @@ robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
     /* Find out if we're dealing with a hash dereference. */
     if ((f = strstr(p + 1, "->")) != NULL && *(f + 2) != '\0') {
         fieldlen = sdslen(spat) - (f - spat) - 2;
-        fieldobj = createStringObject(f + 2, fieldlen);
+        *fieldobj = createStringObject(f + 2, fieldlen);
     } else {
         fieldlen = 0;
     }
@@ -104,6 +99,15 @@ robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
     memcpy(k + prefixlen, ssub, sublen);
     memcpy(k + prefixlen + sublen, p + 1, postfixlen);
     decrRefCount(subst); /* Incremented by decodeObject() */
+    return keyobj;
+}
+
+/* Lookup the key obtained with sortPatternToKey(), dereferencing the hash
+ * field if 'fieldobj' is not NULL. The references of 'keyobj' and
+ * 'fieldobj' are released. The returned object, if not NULL, has its
+ * refcount increased by 1. */
+static robj *sortLookupPatternKey(redisDb *db, robj *keyobj, robj *fieldobj) {
+    robj *o;
 
     /* Lookup substituted key */
     o = lookupKeyRead(db, keyobj);
@@ -128,18 +132,87 @@ robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
 
     noobj:
     decrRefCount(keyobj);
-    if (fieldlen) decrRefCount(fieldobj);
+    if (fieldobj) decrRefCount(fieldobj);
     return NULL;
 }
 
-/* sortCompare() is used by qsort in sortCommand(). Given that qsort_r with
- * the additional parameter is not standard but a BSD-specific we have to
- * pass sorting parameters via the global 'server' structure */
-int sortCompare(const void *s1, const void *s2) {
-    const redisSortObject *so1 = s1, *so2 = s2;
+/* Return the value associated to the key with a name obtained using
+ * the following rules:
+ *
+ * 1) The first occurrence of '*' in 'pattern' is substituted with 'subst'.
+ *
+ * 2) If 'pattern' matches the "->" string, everything on the left of
+ *    the arrow is treated as the name of a hash field, and the part on the
+ *    left as the key name containing a hash. The value of the specified
+ *    field is returned.
+ *
+ * 3) If 'pattern' equals "#", the function simply returns 'subst' itself so
+ *    that the SORT command can be used like: SORT key GET # to retrieve
+ *    the Set/List elements directly.
+ *
+ * The returned object will always have its refcount increased by 1
+ * when it is non-NULL. */
+robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
+    sds spat = pattern->ptr;
+    robj *keyobj, *fieldobj;
+
+    /* If the pattern is "#" return the substitution object itself in order
+     * to implement the "SORT ... GET #" feature. */
+    if (spat[0] == '#' && spat[1] == '\0') {
+        incrRefCount(subst);
+        return subst;
+    }
+
+    keyobj = sortPatternToKey(pattern, subst, &fieldobj);
+    if (keyobj == NULL) return NULL;
+    return sortLookupPatternKey(db, keyobj, fieldobj);
+}
+
+/* Batched version of lookupKeyByPattern(): resolve 'pattern' for the
+ * 'count' elements of 'vector' (at max SORT_LOOKUP_BATCH), storing the
+ * results into 'vals' with the same refcount rules.
+ *
+ * Resolving a pattern for every element of a big vector is dominated by
+ * the cache misses in the main dictionary, so we first build all the key
+ * names and prefetch their buckets, and only later perform the lookups,
+ * in order for the misses of the different keys to overlap. */
+void lookupKeysByPattern(redisDb *db, robj *pattern, redisSortObject *vector,
+                         int count, robj **vals) {
+    sds spat = pattern->ptr;
+    robj *keys[SORT_LOOKUP_BATCH], *fields[SORT_LOOKUP_BATCH];
+    uint64_t hashes[SORT_LOOKUP_BATCH];
+    int j;
+
+    serverAssert(count <= SORT_LOOKUP_BATCH);
+    if (spat[0] == '#' && spat[1] == '\0') {
+        for (j = 0; j < count; j++) {
+            incrRefCount(vector[j].obj);
+            vals[j] = vector[j].obj;
+        }
+        return;
+    }
+
+    for (j = 0; j < count; j++) {
+        keys[j] = sortPatternToKey(pattern, vector[j].obj, &fields[j]);
+        if (keys[j]) hashes[j] = dictPrefetchBucket(db->dict, keys[j]->ptr);
+    }
+    for (j = 0; j < count; j++)
+        if (keys[j]) dictPrefetchEntry(db->dict, hashes[j]);
+    for (j = 0; j < count; j++) {
+        vals[j] = keys[j] ? sortLookupPatternKey(db, keys[j], fields[j]) : NULL;
+    }
+}
+
+/* Compare two elements of the sorting vector accordingly to the specified
+ * sorting parameters. This is the implementation of both sortCompare(),
+ * used when sorting in the main thread, and sortJobCompare(), used by the
+ * BIO_SORT thread. */
+static int sortCompareGeneric(const redisSortObject *so1,
+                              const redisSortObject *so2,
+                              int desc, int alpha, int bypattern, int store) {
     int cmp;
 
-    if (!server.sort_alpha) {
+    if (!alpha) {
         /* Numeric sorting. Here it's trivial as we precomputed scores */
         if (so1->u.score > so2->u.score) {
             cmp = 1;
@@ -153,7 +226,7 @@ int sortCompare(const void *s1, const void *s2) {
         }
     } else {
         /* Alphanumeric sorting */
-        if (server.sort_bypattern) {
+        if (bypattern) {
             if (!so1->u.cmpobj || !so2->u.cmpobj) {
                 /* At least one compare object is NULL */
                 if (so1->u.cmpobj == so2->u.cmpobj)
@@ -164,7 +237,7 @@ int sortCompare(const void *s1, const void *s2) {
                     cmp = 1;
             } else {
                 /* We have both the objects, compare them. */
-                if (server.sort_store) {
+                if (store) {
                     cmp = compareStringObjects(so1->u.cmpobj, so2->u.cmpobj);
                 } else {
                     /* Here we can use strcoll() directly as we are sure that
@@ -174,14 +247,381 @@ int sortCompare(const void *s1, const void *s2) {
             }
         } else {
             /* Compare elements directly. */
-            if (server.sort_store) {
+            if (store) {
                 cmp = compareStringObjects(so1->obj, so2->obj);
             } else {
                 cmp = collateStringObjects(so1->obj, so2->obj);
             }
         }
     }
-    return server.sort_desc ? -cmp : cmp;
+    return desc ? -cmp : cmp;
+}
+
+/* sortCompare() is used by qsort in sortCommand(). Given that qsort_r with
+ * the additional parameter is not standard but a BSD-specific we have to
+ * pass sorting parameters via the global 'server' structure */
+int sortCompare(const void *s1, const void *s2) {
+    return sortCompareGeneric(s1, s2, server.sort_desc, server.sort_alpha,
+                              server.sort_bypattern, server.sort_store);
+}
+
+/* Move down the element at index 'j' of the max-heap of 'len' elements,
+ * see sortTopK(). */
+static void sortHeapDown(redisSortObject *heap, long len, long j,
+                         int (*cmp)(const void *, const void *)) {
+    redisSortObject so = heap[j];
+
+    while (1) {
+        long child = j*2+1;
+        if (child >= len) break;
+        if (child+1 < len && cmp(&heap[child+1],&heap[child]) > 0) child++;
+        if (cmp(&heap[child],&so) <= 0) break;
+        heap[j] = heap[child];
+        j = child;
+    }
+    heap[j] = so;
+}
+
+/* Move the 'k' smallest elements of the vector, sorted, at its head, using
+ * a max-heap of 'k' elements: every other element costs a single comparison
+ * with the root of the heap unless it belongs to the result, so this takes
+ * O(N log k) in the worst case and about N comparisons for small k. */
+static void sortTopK(redisSortObject *vector, long vectorlen, long k,
+                     int (*cmp)(const void *, const void *)) {
+    long j;
+
+    for (j = k/2-1; j >= 0; j--) sortHeapDown(vector,k,j,cmp);
+    for (j = k; j < vectorlen; j++) {
+        if (cmp(&vector[j],&vector[0]) >= 0) continue;
+        redisSortObject so = vector[0];
+        vector[0] = vector[j];
+        vector[j] = so;
+        sortHeapDown(vector,k,0,cmp);
+    }
+    qsort(vector, k, sizeof(redisSortObject), cmp);
+}
+
+/* Sort the vector, or just the start-end range of it if a partial sort
+ * is enough to produce the output: when the range is a small prefix of
+ * the vector, like in SORT ... LIMIT 0 10, a bounded heap selects it,
+ * otherwise pqsort() only sorts the partitions overlapping the range. */
+static void sortVector(redisSortObject *vector, int vectorlen, long start,
+                       long end, int (*cmp)(const void *, const void *)) {
+    if (end < start) return; /* Empty range, nothing to output. */
+    if (start == 0 && end == vectorlen - 1)
+        qsort(vector, vectorlen, sizeof(redisSortObject), cmp);
+    else if ((end+1)*SORT_TOPK_RATIO <= vectorlen)
+        sortTopK(vector, vectorlen, end+1, cmp);
+    else
+        pqsort(vector, vectorlen, sizeof(redisSortObject), cmp, start, end);
+}
+
+/* Release the objects referenced by the sorting vector. The vector itself
+ * is allocated in the command arena, unless the sort is performed by the
+ * BIO_SORT thread, see sortFreeJob(). */
+static void sortFreeVector(redisSortObject *vector, int vectorlen, int alpha) {
+    int j;
+
+    for (j = 0; j < vectorlen; j++) {
+        decrRefCount(vector[j].obj);
+        if (alpha && vector[j].u.cmpobj)
+            decrRefCount(vector[j].u.cmpobj);
+    }
+}
+
+/* A SORT ... STORE sorted in background can't be propagated verbatim, since
+ * its result was computed against the dataset as it was when the command
+ * was called, and replicas / the AOF would execute it against a different
+ * one. We propagate the resulting list instead: a DEL of the destination key
+ * followed by RPUSH commands of at max AOF_REWRITE_ITEMS_PER_CMD elements,
+ * wrapped into MULTI/EXEC. 'sobj' is NULL if the result was empty. */
+static void sortPropagateStore(int dbid, robj *storekey, robj *sobj) {
+    robj *argv[2 + AOF_REWRITE_ITEMS_PER_CMD];
+    int argc, j;
+
+    if (sobj) {
+        argv[0] = createStringObject("MULTI", 5);
+        propagate(server.multiCommand, dbid, argv, 1,
+                  PROPAGATE_AOF | PROPAGATE_REPL);
+        decrRefCount(argv[0]);
+    }
+
+    argv[0] = createStringObject("DEL", 3);
+    argv[1] = storekey;
+    propagate(server.delCommand, dbid, argv, 2, PROPAGATE_AOF | PROPAGATE_REPL);
+    decrRefCount(argv[0]);
+    if (sobj == NULL) return;
+
+    listTypeIterator *li = listTypeInitIterator(sobj, 0, LIST_TAIL);
+    listTypeEntry entry;
+    int more = listTypeNext(li, &entry);
+
+    argv[0] = createStringObject("RPUSH", 5);
+    while (more) {
+        argc = 2;
+        while (more && argc < (int) (sizeof(argv) / sizeof(argv[0]))) {
+            argv[argc++] = listTypeGet(&entry);
+            more = listTypeNext(li, &entry);
+        }
+        propagate(server.rpushCommand, dbid, argv, argc,
+                  PROPAGATE_AOF | PROPAGATE_REPL);
+        for (j = 2; j < argc; j++) decrRefCount(argv[j]);
+    }
+    decrRefCount(argv[0]);
+    listTypeReleaseIterator(li);
+
+    argv[0] = createStringObject("EXEC", 4);
+    propagate(server.execCommand, dbid, argv, 1, PROPAGATE_AOF | PROPAGATE_REPL);
+    decrRefCount(argv[0]);
+}
+
+/* Send the sorted vector to the client, or store it at 'storekey' if not
+ * NULL, performing the GET operations if any. When 'propagate_store' is
+ * true the STORE result is explicitly propagated, see sortPropagateStore(). */
+static void sortEmitResult(client *c, redisDb *db, redisSortObject *vector,
+                           long start, long end, list *operations, int getop,
+                           robj *storekey, int propagate_store) {
+    unsigned int outputlen = getop ? getop * (end - start + 1) : end - start + 1;
+    robj **vals = NULL, *sobj = NULL;
+    long j;
+    int k;
+
+    if (getop) vals = zmalloc(sizeof(robj *) * getop * SORT_LOOKUP_BATCH);
+    if (storekey == NULL) {
+        /* STORE option not specified, sent the sorting result to client */
+        addReplyMultiBulkLen(c, outputlen);
+    } else {
+        /* STORE option specified, set the sorting result as a List object */
+        sobj = createQuicklistObject();
+    }
+
+    for (j = start; j <= end; j += SORT_LOOKUP_BATCH) {
+        int batch = (end - j + 1 < SORT_LOOKUP_BATCH) ?
+                    end - j + 1 : SORT_LOOKUP_BATCH;
+        listNode *ln;
+        listIter li;
+        int op = 0;
+
+        /* Resolve the GET patterns for the whole batch at once. */
+        listRewind(operations, &li);
+        while ((ln = listNext(&li))) {
+            redisSortOperation *sop = ln->value;
+
+            /* Always fails */
+            serverAssert(sop->type == SORT_OP_GET);
+            lookupKeysByPattern(db, sop->pattern, vector + j, batch,
+                                vals + op * SORT_LOOKUP_BATCH);
+            op++;
+        }
+
+        for (k = 0; k < batch; k++) {
+            if (!getop) {
+                if (sobj)
+                    listTypePush(sobj, vector[j + k].obj, LIST_TAIL);
+                else
+                    addReplyBulk(c, vector[j + k].obj);
+                continue;
+            }
+            for (op = 0; op < getop; op++) {
+                robj *val = vals[op * SORT_LOOKUP_BATCH + k];
+
+                if (sobj) {
+                    if (!val) val = createStringObject("", 0);
+
+                    /* listTypePush does an incrRefCount, so we should take care
+                     * care of the incremented refcount caused by either
+                     * lookupKeyByPattern or createStringObject("",0) */
+                    listTypePush(sobj, val, LIST_TAIL);
+                    decrRefCount(val);
+                } else if (!val) {
+                    addReply(c, shared.nullbulk);
+                } else {
+                    addReplyBulk(c, val);
+                    decrRefCount(val);
+                }
+            }
+        }
+    }
+    zfree(vals);
+
+    if (sobj) {
+        if (outputlen) {
+            setKey(db, storekey, sobj);
+            notifyKeyspaceEvent(NOTIFY_LIST, "sortstore", storekey, db->id);
+            server.dirty += outputlen;
+        } else if (dbDelete(db, storekey)) {
+            signalModifiedKey(db, storekey);
+            notifyKeyspaceEvent(NOTIFY_GENERIC, "del", storekey, db->id);
+            server.dirty++;
+        }
+        if (propagate_store)
+            sortPropagateStore(db->id, storekey, outputlen ? sobj : NULL);
+        decrRefCount(sobj);
+        addReplyLongLong(c, outputlen);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Background SORT
+ *
+ * When the vector to sort has at least 'sort-async-min-elements' elements,
+ * the sorting step is performed by the BIO_SORT thread while the client is
+ * blocked, so that other clients are served in the meantime. The vector is
+ * loaded, and the BY patterns resolved, in the main thread: what the thread
+ * sorts is a snapshot composed of private copies of both the elements and
+ * the BY values, so it never accesses objects reachable from the keyspace.
+ * Once sorted the vector goes back to the main thread that performs the GET
+ * operations, and replies to the client or stores the result.
+ * -------------------------------------------------------------------------- */
+
+typedef struct sortJob {
+    client *client;         /* Client blocked on the job, or NULL if the
+                               client was freed or unblocked meanwhile. */
+    redisDb *db;            /* Database the SORT was called against. */
+    redisSortObject *vector;
+    int vectorlen;
+    long start, end;        /* Range of the vector to emit. */
+    int desc, alpha, bypattern, store; /* Sorting parameters. */
+    list *operations;       /* GET operations: patterns are retained. */
+    int getop;
+    robj *storekey;         /* STORE target (retained), or NULL. */
+} sortJob;
+
+/* Jobs sorted by the BIO_SORT thread, waiting to be served. */
+static list *sortCompletedJobs;
+static pthread_mutex_t sortCompletedJobsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Job currently sorted by the BIO_SORT thread, accessed only by such
+ * thread in order to pass the sorting parameters to sortJobCompare(). */
+static sortJob *sortCurrentJob;
+
+static int sortJobCompare(const void *s1, const void *s2) {
+    return sortCompareGeneric(s1, s2, sortCurrentJob->desc,
+                              sortCurrentJob->alpha, sortCurrentJob->bypattern,
+                              sortCurrentJob->store);
+}
+
+/* Readable handler for the awake pipe. Like for the modules blocked clients
+ * we do nothing here: jobs are served in beforeSleep() by calling
+ * sortHandleCompletedJobs(). */
+static void sortAsyncPipeReadable(aeEventLoop *el, int fd, void *privdata, int mask) {
+    UNUSED(el);
+    UNUSED(fd);
+    UNUSED(mask);
+    UNUSED(privdata);
+}
+
+/* Called by initServer() to setup the state used by background SORT. */
+void sortAsyncInit(void) {
+    sortCompletedJobs = listCreate();
+    if (pipe(server.sort_async_pipe) == -1) {
+        serverLog(LL_WARNING,
+                  "Can't create the pipe for background SORT: %s",
+                  strerror(errno));
+        exit(1);
+    }
+    anetNonBlock(NULL, server.sort_async_pipe[0]);
+    anetNonBlock(NULL, server.sort_async_pipe[1]);
+    if (aeCreateFileEvent(server.el, server.sort_async_pipe[0], AE_READABLE,
+                          sortAsyncPipeReadable, NULL) == AE_ERR) {
+        serverPanic("Error registering the readable event for background SORT.");
+    }
+}
+
+/* Return true if the SORT called by 'c' can be performed in background.
+ * This is not possible for fake clients (Lua, modules, AOF loading), for
+ * the master client and inside transactions, since all those contexts
+ * expect the command to be executed synchronously. */
+static int sortCanBlockClient(client *c, int vectorlen) {
+    if (server.sort_async_min_elements == 0 ||
+        vectorlen < server.sort_async_min_elements) return 0;
+    if (c->fd == -1 || c->flags & (CLIENT_MULTI | CLIENT_MASTER)) return 0;
+    return 1;
+}
+
+static void sortFreeJob(sortJob *job) {
+    listNode *ln;
+    listIter li;
+
+    sortFreeVector(job->vector, job->vectorlen, job->alpha);
+    zfree(job->vector);
+    listRewind(job->operations, &li);
+    while ((ln = listNext(&li))) {
+        redisSortOperation *sop = ln->value;
+        decrRefCount(sop->pattern);
+    }
+    listRelease(job->operations);
+    if (job->storekey) decrRefCount(job->storekey);
+    zfree(job);
+}
+
+/* Executed by the BIO_SORT thread. */
+void sortProcessJobFromBioThread(void *arg) {
+    sortJob *job = arg;
+
+    sortCurrentJob = job;
+    sortVector(job->vector, job->vectorlen, job->start, job->end,
+               sortJobCompare);
+    sortCurrentJob = NULL;
+
+    pthread_mutex_lock(&sortCompletedJobsMutex);
+    listAddNodeTail(sortCompletedJobs, job);
+    if (write(server.sort_async_pipe[1], "A", 1) != 1) {
+        /* Ignore the error, this is best-effort. */
+    }
+    pthread_mutex_unlock(&sortCompletedJobsMutex);
+}
+
+/* Called from blocked.c when a client blocked in a background SORT is
+ * unblocked, either because the job completed or because the client is
+ * being freed. In the latter case we just detach the client from the job,
+ * whose result will be discarded once the thread is done with it. */
+void unblockClientFromSort(client *c) {
+    sortJob *job = c->bpop.sort_job;
+
+    if (job) job->client = NULL;
+    c->bpop.sort_job = NULL;
+}
+
+/* Called in beforeSleep() in order to serve the clients whose background
+ * SORT completed. */
+void sortHandleCompletedJobs(void) {
+    listNode *ln;
+    sortJob *job;
+    char buf[1];
+
+    pthread_mutex_lock(&sortCompletedJobsMutex);
+    while (read(server.sort_async_pipe[0], buf, 1) == 1);
+    while (listLength(sortCompletedJobs)) {
+        ln = listFirst(sortCompletedJobs);
+        job = ln->value;
+        listDelNode(sortCompletedJobs, ln);
+        pthread_mutex_unlock(&sortCompletedJobsMutex);
+
+        /* Release the lock while serving the job, as long as we don't
+         * touch the shared list. */
+        client *c = job->client;
+        if (c) {
+            c->bpop.sort_job = NULL;
+            sortEmitResult(c, job->db, job->vector, job->start, job->end,
+                           job->operations, job->getop, job->storekey, 1);
+            unblockClient(c);
+        }
+        sortFreeJob(job);
+
+        pthread_mutex_lock(&sortCompletedJobsMutex);
+    }
+    pthread_mutex_unlock(&sortCompletedJobsMutex);
+}
+
+/* Return a private copy of the string object 'o', always sds encoded, in
+ * order to use it as BY value for a background sort. */
+static robj *sortPrivateStringObject(robj *o) {
+    robj *dec = getDecodedObject(o);
+    robj *copy = createStringObject(dec->ptr, sdslen(dec->ptr));
+
+    decrRefCount(dec);
+    return copy;
 }
 
 /*
@@ -192,12 +632,10 @@ int sortCompare(const void *s1, const void *s2) {
  */
 void sortCommand(client *c) {
     list *operations;
-    // 输出的长度
-    unsigned int outputlen = 0;
     // desc 降序
     int desc = 0, alpha = 0;
     long limit_start = 0, limit_count = -1, start, end;
-    int j, dontsort = 0, vectorlen;
+    int j, dontsort = 0, vectorlen, async;
     int getop = 0; /* GET operation counter */
     int int_convertion_error = 0;
     int syntax_error = 0;
@@ -366,9 +804,17 @@ void sortCommand(client *c) {
         vectorlen = end - start + 1;
     }
 
+    /* Decide if the sorting step is performed by the BIO_SORT thread: in
+     * that case the vector outlives the command and can't be allocated in
+     * the command arena. */
+    async = dontsort == 0 && sortCanBlockClient(c, vectorlen);
+
     /* Load the sorting vector with all the objects to sort */
     // 给要排序的对象分配内存
-    vector = zmalloc(sizeof(redisSortObject) * vectorlen);
+    if (async)
+        vector = zmalloc(sizeof(redisSortObject) * vectorlen);
+    else
+        vector = cmdArenaAlloc(sizeof(redisSortObject) * vectorlen);
     j = 0;
 
     // 如果排序类型是 list 且没有指定 dontsort
@@ -481,146 +927,120 @@ void sortCommand(client *c) {
     }
     serverAssertWithInfo(c, sortval, j == vectorlen);
 
-    /* Now it's time to load the right scores in the sorting vector */
+    /* Now it's time to load the right scores in the sorting vector.
+     * BY patterns are resolved in batches, see lookupKeysByPattern(). */
     if (dontsort == 0) {
-        for (j = 0; j < vectorlen; j++) {
-            robj *byval;
-            if (sortby) {
-                /* lookup value to sort by */
-                byval = lookupKeyByPattern(c->db, sortby, vector[j].obj);
-                if (!byval) continue;
-            } else {
-                /* use object itself to sort by */
-                byval = vector[j].obj;
-            }
+        for (j = 0; j < vectorlen; j += SORT_LOOKUP_BATCH) {
+            robj *byvals[SORT_LOOKUP_BATCH];
+            int k, batch = (vectorlen - j < SORT_LOOKUP_BATCH) ?
+                           vectorlen - j : SORT_LOOKUP_BATCH;
 
-            if (alpha) {
-                if (sortby) vector[j].u.cmpobj = getDecodedObject(byval);
-            } else {
-                if (sdsEncodedObject(byval)) {
-                    char *eptr;
+            /* lookup values to sort by */
+            if (sortby)
+                lookupKeysByPattern(c->db, sortby, vector + j, batch, byvals);
 
-                    vector[j].u.score = strtod(byval->ptr, &eptr);
-                    if (eptr[0] != '\0' || errno == ERANGE ||
-                        isnan(vector[j].u.score)) {
-                        int_convertion_error = 1;
-                    }
-                } else if (byval->encoding == OBJ_ENCODING_INT) {
-                    /* Don't need to decode the object if it's
-                     * integer-encoded (the only encoding supported) so
-                     * far. We can just cast it */
-                    vector[j].u.score = (long) byval->ptr;
+            for (k = 0; k < batch; k++) {
+                redisSortObject *so = vector + j + k;
+                robj *byval;
+
+                if (sortby) {
+                    byval = byvals[k];
+                    if (!byval) continue;
                 } else {
-                    serverAssertWithInfo(c, sortval, 1 != 1);
+                    /* use object itself to sort by */
+                    byval = so->obj;
                 }
-            }
-
-            /* when the object was retrieved using lookupKeyByPattern,
-             * its refcount needs to be decreased. */
-            if (sortby) {
-                decrRefCount(byval);
-            }
-        }
-    }
 
-    if (dontsort == 0) {
-        server.sort_desc = desc;
-        server.sort_alpha = alpha;
-        server.sort_bypattern = sortby ? 1 : 0;
-        server.sort_store = storekey ? 1 : 0;
-        if (sortby && (start != 0 || end != vectorlen - 1))
-            pqsort(vector, vectorlen, sizeof(redisSortObject), sortCompare, start, end);
-        else
-            qsort(vector, vectorlen, sizeof(redisSortObject), sortCompare);
-    }
+                if (alpha) {
+                    if (sortby) {
+                        so->u.cmpobj = async ? sortPrivateStringObject(byval) :
+                                               getDecodedObject(byval);
+                    }
+                } else {
+                    if (sdsEncodedObject(byval)) {
+                        char *eptr;
 
-    /* Send command output to the output buffer, performing the specified
-     * GET/DEL/INCR/DECR operations if any. */
-    outputlen = getop ? getop * (end - start + 1) : end - start + 1;
-    if (int_convertion_error) {
-        addReplyError(c, "One or more scores can't be converted into double");
-    } else if (storekey == NULL) {
-        /* STORE option not specified, sent the sorting result to client */
-        addReplyMultiBulkLen(c, outputlen);
-        for (j = start; j <= end; j++) {
-            listNode *ln;
-            listIter li;
-
-            if (!getop) addReplyBulk(c, vector[j].obj);
-            listRewind(operations, &li);
-            while ((ln = listNext(&li))) {
-                redisSortOperation *sop = ln->value;
-                robj *val = lookupKeyByPattern(c->db, sop->pattern,
-                                               vector[j].obj);
-
-                if (sop->type == SORT_OP_GET) {
-                    if (!val) {
-                        addReply(c, shared.nullbulk);
+                        so->u.score = strtod(byval->ptr, &eptr);
+                        if (eptr[0] != '\0' || errno == ERANGE ||
+                            isnan(so->u.score)) {
+                            int_convertion_error = 1;
+                        }
+                    } else if (byval->encoding == OBJ_ENCODING_INT) {
+                        /* Don't need to decode the object if it's
+                         * integer-encoded (the only encoding supported) so
+                         * far. We can just cast it */
+                        so->u.score = (long) byval->ptr;
                     } else {
-                        addReplyBulk(c, val);
-                        decrRefCount(val);
+                        serverAssertWithInfo(c, sortval, 1 != 1);
                     }
-                } else {
-                    /* Always fails */
-                    serverAssertWithInfo(c, sortval, sop->type == SORT_OP_GET);
+                }
+
+                /* when the object was retrieved using lookupKeyByPattern,
+                 * its refcount needs to be decreased. */
+                if (sortby) {
+                    decrRefCount(byval);
                 }
             }
         }
-    } else {
-        robj *sobj = createQuicklistObject();
+    }
 
-        /* STORE option specified, set the sorting result as a List object */
-        for (j = start; j <= end; j++) {
-            listNode *ln;
-            listIter li;
+    if (int_convertion_error) {
+        addReplyError(c, "One or more scores can't be converted into double");
+    } else if (async) {
+        /* Hand the vector to the BIO_SORT thread and block the client: the
+         * reply is emitted by sortHandleCompletedJobs(). Patterns and the
+         * STORE key are retained since the client argv is going to be
+         * released before the job completes. */
+        sortJob *job = zmalloc(sizeof(*job));
+        listNode *ln;
+        listIter li;
 
-            if (!getop) {
-                listTypePush(sobj, vector[j].obj, LIST_TAIL);
-            } else {
-                listRewind(operations, &li);
-                while ((ln = listNext(&li))) {
-                    redisSortOperation *sop = ln->value;
-                    robj *val = lookupKeyByPattern(c->db, sop->pattern,
-                                                   vector[j].obj);
-
-                    if (sop->type == SORT_OP_GET) {
-                        if (!val) val = createStringObject("", 0);
-
-                        /* listTypePush does an incrRefCount, so we should take care
-                         * care of the incremented refcount caused by either
-                         * lookupKeyByPattern or createStringObject("",0) */
-                        listTypePush(sobj, val, LIST_TAIL);
-                        decrRefCount(val);
-                    } else {
-                        /* Always fails */
-                        serverAssertWithInfo(c, sortval, sop->type == SORT_OP_GET);
-                    }
-                }
-            }
+        job->client = c;
+        job->db = c->db;
+        job->vector = vector;
+        job->vectorlen = vectorlen;
+        job->start = start;
+        job->end = end;
+        job->desc = desc;
+        job->alpha = alpha;
+        job->bypattern = sortby ? 1 : 0;
+        job->store = storekey ? 1 : 0;
+        job->operations = operations;
+        job->getop = getop;
+        job->storekey = storekey;
+        if (storekey) incrRefCount(storekey);
+        listRewind(operations, &li);
+        while ((ln = listNext(&li))) {
+            redisSortOperation *sop = ln->value;
+            incrRefCount(sop->pattern);
         }
-        if (outputlen) {
-            setKey(c->db, storekey, sobj);
-            notifyKeyspaceEvent(NOTIFY_LIST, "sortstore", storekey,
-                                c->db->id);
-            server.dirty += outputlen;
-        } else if (dbDelete(c->db, storekey)) {
-            signalModifiedKey(c->db, storekey);
-            notifyKeyspaceEvent(NOTIFY_GENERIC, "del", storekey, c->db->id);
-            server.dirty++;
+
+        c->bpop.sort_job = job;
+        c->bpop.timeout = 0;
+        blockClient(c, BLOCKED_SORT);
+        server.stat_sort_async++;
+        bioCreateBackgroundJob(BIO_SORT, job, NULL, NULL);
+        decrRefCount(sortval);
+        return;
+    } else {
+        if (dontsort == 0) {
+            server.sort_desc = desc;
+            server.sort_alpha = alpha;
+            server.sort_bypattern = sortby ? 1 : 0;
+            server.sort_store = storekey ? 1 : 0;
+            sortVector(vector, vectorlen, start, end, sortCompare);
         }
-        decrRefCount(sobj);
-        addReplyLongLong(c, outputlen);
+
+        /* Send command output to the output buffer, performing the specified
+         * GET/DEL/INCR/DECR operations if any. */
+        sortEmitResult(c, c->db, vector, start, end, operations, getop,
+                       storekey, 0);
     }
 
     /* Cleanup */
-    for (j = 0; j < vectorlen; j++)
-        decrRefCount(vector[j].obj);
-
     decrRefCount(sortval);
     listRelease(operations);
-    for (j = 0; j < vectorlen; j++) {
-        if (alpha && vector[j].u.cmpobj)
-            decrRefCount(vector[j].u.cmpobj);
-    }
-    zfree(vector);
+    sortFreeVector(vector, vectorlen, alpha);
+    /* Reached with an async vector only on conversion errors. */
+    if (async) zfree(vector);
 }
@@ -81,6 +81,12 @@ typedef struct streamCG {
                                as processed. The key of the radix tree is the
                                ID as a 64 bit big endian number, while the
                                associated value is a streamNACK structure.*/
+    rax *pel_by_time;       /* The same entries of the PEL indexed by delivery
+                               time: the key is the delivery time as a 64 bit
+                               big endian number followed by the entry ID,
+                               and the value the streamNACK shared with 'pel'.
+                               This allows to find the entries idle for more
+                               than a given time without scanning the PEL. */
     /**
      * 存储了我这个组有哪些消费者
      */
@@ -111,6 +117,10 @@ typedef struct streamConsumer {
                                    itself, so the value is shared. */
 } streamConsumer;
 
+/* Length of the keys of the consumer group delivery time index: the
+ * delivery time followed by the entry ID. */
+#define STREAM_NACK_TIME_KEY_LEN (sizeof(uint64_t)+sizeof(streamID))
+
 /* Pending (yet not acknowledged) message in a consumer group. */
 typedef struct streamNACK {
     mstime_t delivery_time;     /* Last time this message was delivered. */
@@ -140,6 +150,9 @@ streamCG *streamLookupCG(stream *s, sds groupname);
 streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int create);
 streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id);
 streamNACK *streamCreateNACK(streamConsumer *consumer);
+void streamIndexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamUnindexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack);
+void streamSetNACKDeliveryTime(streamCG *cg, unsigned char *rawid, streamNACK *nack, mstime_t time);
 void streamDecodeID(void *buf, streamID *id);
 
 #endif
@@ -507,6 +507,350 @@ void hashTypeConvert(robj *o, int enc) {
     }
 }
 
+/*-----------------------------------------------------------------------------
+ * Hash field expires
+ *
+ * The fields of a hash may have an expire time set with HEXPIRE and friends.
+ * Instead of paying a dictEntry in db->expires plus a key for every field,
+ * the expire times of all the fields of a given hash are stored in a single
+ * hashFieldExpires referenced by db->hexpires, that shares the key sds string
+ * of the main dictionary exactly like db->expires does. The times are stored
+ * in a sorted set of the fields scored by their expire time, that is a
+ * ziplist while there are few fields with a TTL and a skiplist plus a dict
+ * after the zset-max-ziplist-* limits: this way the fields to expire are
+ * the first ones, and finding them costs nothing when none is expired,
+ * whatever the number of fields with a TTL. Times are limited to
+ * HFE_MAX_TIME so that they are exact as doubles.
+ *
+ * Expired fields are deleted lazily when the hash is looked up, and actively
+ * by activeExpireCycle() sampling db->hexpires: in both cases an HDEL of the
+ * expired fields is propagated to AOF and slaves, that never expire fields
+ * by themselves. Like for expired keys, slaves still report the fields that
+ * expired as missing to their clients: see hashFieldExpiresDue().
+ *----------------------------------------------------------------------------*/
+
+static hashFieldExpires *hashFieldExpiresLookup(redisDb *db, robj *key);
+
+static hashFieldExpires *hashFieldExpiresCreate(void) {
+    hashFieldExpires *hfe = zmalloc(sizeof(*hfe));
+    hfe->times = createZsetZiplistObject();
+    return hfe;
+}
+
+void hashFieldExpiresFree(hashFieldExpires *hfe) {
+    if (hfe == NULL) return; /* Unlinked from db->hexpires. */
+    decrRefCount(hfe->times);
+    zfree(hfe);
+}
+
+unsigned long hashFieldExpiresLength(hashFieldExpires *hfe) {
+    return zsetLength(hfe->times);
+}
+
+/* Return the earliest expire time of the fields, LLONG_MAX if there are no
+ * fields. */
+long long hashFieldExpiresMin(hashFieldExpires *hfe) {
+    robj *zobj = hfe->times;
+
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        unsigned char *zl = zobj->ptr, *eptr;
+
+        if ((eptr = ziplistIndex(zl, 0)) == NULL) return LLONG_MAX;
+        return (long long) zzlGetScore(ziplistNext(zl, eptr));
+    } else {
+        zset *zs = zobj->ptr;
+        zskiplistNode *ln = zs->zsl->header->level[0].forward;
+
+        return ln ? (long long) ln->score : LLONG_MAX;
+    }
+}
+
+/* Return the number of fields expiring at or before 'now'. */
+static unsigned long hashFieldExpiresCountDue(hashFieldExpires *hfe, long long now) {
+    robj *zobj = hfe->times;
+
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        unsigned char *zl = zobj->ptr, *eptr, *sptr;
+        unsigned long count = 0;
+
+        eptr = ziplistIndex(zl, 0);
+        sptr = eptr ? ziplistNext(zl, eptr) : NULL;
+        while (eptr && zzlGetScore(sptr) <= now) {
+            count++;
+            zzlNext(zl, &eptr, &sptr);
+        }
+        return count;
+    } else {
+        zset *zs = zobj->ptr;
+        zrangespec range = { .min = 0, .max = now, .minex = 0, .maxex = 0 };
+        zskiplistNode *ln = zslLastInRange(zs->zsl, &range);
+
+        return ln ? zslGetRank(zs->zsl, ln->score, ln->ele) : 0;
+    }
+}
+
+/* Memory used by the fields expire times of the hash at 'key'. */
+size_t hashFieldExpiresMemoryUsage(redisDb *db, robj *key, size_t samples) {
+    hashFieldExpires *hfe = hashFieldExpiresLookup(db, key);
+
+    if (hfe == NULL) return 0;
+    return sizeof(dictEntry) + zmalloc_size(hfe) +
+           objectComputeSize(hfe->times, samples);
+}
+
+/* Return the expire time of 'field', or -1 if it has no expire set. */
+static long long hashFieldExpiresGet(hashFieldExpires *hfe, sds field) {
+    double score;
+
+    if (zsetScore(hfe->times, field, &score) == C_ERR) return -1;
+    return (long long) score;
+}
+
+static void hashFieldExpiresSet(hashFieldExpires *hfe, sds field, long long when) {
+    int flags = ZADD_NONE;
+    double newscore;
+
+    zsetAdd(hfe->times, (double) when, field, &flags, &newscore);
+}
+
+/* Return 1 if the field had an expire time that was removed. */
+static int hashFieldExpiresDel(hashFieldExpires *hfe, sds field) {
+    return zsetDel(hfe->times, field);
+}
+
+static hashFieldExpires *hashFieldExpiresLookup(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (dictSize(db->hexpires) == 0) return NULL;
+    de = dictFind(db->hexpires, key->ptr);
+    return de ? dictGetVal(de) : NULL;
+}
+
+/* Return the expire time of the field of the hash at 'key', or -1 if the
+ * field has no expire set. */
+long long hashFieldGetExpire(redisDb *db, robj *key, sds field) {
+    hashFieldExpires *hfe = hashFieldExpiresLookup(db, key);
+
+    return hfe ? hashFieldExpiresGet(hfe, field) : -1;
+}
+
+/* Set the expire time of the field of the hash at 'key', that must exist.
+ * The field existence is up to the caller. */
+void hashFieldSetExpire(redisDb *db, robj *key, sds field, long long when) {
+    dictEntry *kde, *de, *existing;
+    hashFieldExpires *hfe;
+
+    /* Reuse the sds from the main dict in the hexpires dict */
+    kde = dictFind(db->dict, key->ptr);
+    serverAssertWithInfo(NULL, key, kde != NULL);
+    de = dictAddRaw(db->hexpires, dictGetKey(kde), &existing);
+    if (de != NULL) {
+        hfe = hashFieldExpiresCreate();
+        dictSetVal(db->hexpires, de, hfe);
+    } else {
+        hfe = dictGetVal(existing);
+    }
+    hashFieldExpiresSet(hfe, field, when);
+}
+
+/* Remove the expire time of the field, returning 1 if it had one. */
+int hashFieldRemoveExpire(redisDb *db, robj *key, sds field) {
+    hashFieldExpires *hfe = hashFieldExpiresLookup(db, key);
+
+    if (hfe == NULL || !hashFieldExpiresDel(hfe, field)) return 0;
+    if (hashFieldExpiresLength(hfe) == 0) dictDelete(db->hexpires, key->ptr);
+    return 1;
+}
+
+/* Forget the fields expire times of a key that is going to be deleted or
+ * overwritten. */
+void hashFieldExpiresDelKey(redisDb *db, sds key) {
+    if (dictSize(db->hexpires)) dictDelete(db->hexpires, key);
+}
+
+/* Detach the fields expire times from the key, so that they can be moved
+ * to another key with hashFieldExpiresLink(), as RENAME and MOVE do. */
+hashFieldExpires *hashFieldExpiresUnlink(redisDb *db, robj *key) {
+    hashFieldExpires *hfe;
+    dictEntry *de;
+
+    if (dictSize(db->hexpires) == 0) return NULL;
+    de = dictUnlink(db->hexpires, key->ptr);
+    if (de == NULL) return NULL;
+    hfe = dictGetVal(de);
+    dictSetVal(db->hexpires, de, NULL);
+    dictFreeUnlinkedEntry(db->hexpires, de);
+    return hfe;
+}
+
+void hashFieldExpiresLink(redisDb *db, robj *key, hashFieldExpires *hfe) {
+    dictEntry *kde;
+
+    if (hfe == NULL) return;
+    kde = dictFind(db->dict, key->ptr);
+    serverAssertWithInfo(NULL, key, kde != NULL);
+    serverAssert(dictAdd(db->hexpires, dictGetKey(kde), hfe) == DICT_OK);
+}
+
+/* Set the expire times loaded from RDB or RESTORE, a ziplist of field, time
+ * pairs that is freed, to the fields of the hash at 'key' that exist. */
+void hashFieldExpiresRestore(redisDb *db, robj *key, unsigned char *zl) {
+    robj *o = dictFetchValue(db->dict, key->ptr);
+    unsigned char *fptr, *vstr;
+    unsigned int vlen;
+    long long vll;
+
+    fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+    while (o != NULL && o->type == OBJ_HASH && fptr != NULL) {
+        sds field;
+
+        ziplistGet(fptr, &vstr, &vlen, &vll);
+        field = vstr ? sdsnewlen(vstr, vlen) : sdsfromlonglong(vll);
+        fptr = ziplistNext(zl, fptr);
+        ziplistGet(fptr, &vstr, &vlen, &vll);
+        if (hashTypeExists(o, field)) hashFieldSetExpire(db, key, field, vll);
+        sdsfree(field);
+        fptr = ziplistNext(zl, fptr);
+    }
+    zfree(zl);
+}
+
+/* Iterate the fields by expire time, the ones expiring first first. */
+void hashFieldExpiresInitIterator(hashFieldExpiresIterator *it, hashFieldExpires *hfe) {
+    robj *zobj = hfe->times;
+
+    it->hfe = hfe;
+    it->eptr = it->sptr = NULL;
+    it->ln = NULL;
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        it->eptr = ziplistIndex(zobj->ptr, 0);
+        if (it->eptr) it->sptr = ziplistNext(zobj->ptr, it->eptr);
+    } else {
+        it->ln = ((zset*)zobj->ptr)->zsl->header->level[0].forward;
+    }
+}
+
+/* Move to the next field, returning it as a new sds string the caller should
+ * free, and its expire time. Returns C_ERR when the iteration is done. The
+ * fields expire times should not be modified while iterating. */
+int hashFieldExpiresNext(hashFieldExpiresIterator *it, sds *field, long long *when) {
+    robj *zobj = it->hfe->times;
+
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vll;
+
+        if (it->eptr == NULL) return C_ERR;
+        ziplistGet(it->eptr, &vstr, &vlen, &vll);
+        *field = vstr ? sdsnewlen(vstr, vlen) : sdsfromlonglong(vll);
+        *when = (long long) zzlGetScore(it->sptr);
+        zzlNext(zobj->ptr, &it->eptr, &it->sptr);
+    } else {
+        if (it->ln == NULL) return C_ERR;
+        *field = sdsdup(it->ln->ele);
+        *when = (long long) it->ln->score;
+        it->ln = it->ln->level[0].forward;
+    }
+    return C_OK;
+}
+
+/* Return the fields expire times of the hash at 'key' if some of its fields
+ * expired at the current time, that is stored at '*now', NULL otherwise.
+ *
+ * On masters such fields are deleted by hashExpireFieldsIfNeeded() when the
+ * key is looked up, but slaves wait for the HDEL of their master: like they
+ * do with expired keys, they should reply as if the fields did not exist.
+ * Read commands use this function together with hashFieldIsDue() to do so,
+ * the check is cheap when no field expired. */
+hashFieldExpires *hashFieldExpiresDue(redisDb *db, robj *key, long long *now) {
+    hashFieldExpires *hfe = hashFieldExpiresLookup(db, key);
+
+    if (hfe == NULL) return NULL;
+    *now = server.lua_caller ? server.lua_time_start : mstime();
+    return hashFieldExpiresMin(hfe) <= *now ? hfe : NULL;
+}
+
+/* Return 1 if 'field' expired at 'now' and should be considered missing. */
+int hashFieldIsDue(hashFieldExpires *hfe, sds field, long long now) {
+    long long when;
+
+    if (hfe == NULL) return 0;
+    when = hashFieldExpiresGet(hfe, field);
+    return when != -1 && when <= now;
+}
+
+/* Delete up to 'max' fields of the hash at 'key' that expired at 'now', the
+ * ones expiring first, propagating an HDEL of such fields to AOF and slaves,
+ * and deleting the key if the hash becomes empty. Returns the number of
+ * expired fields. Since the fields are sorted by expire time the cost is
+ * proportional to the number of fields expired. */
+int hashExpireFields(redisDb *db, robj *key, long long now, long max) {
+    hashFieldExpires *hfe = hashFieldExpiresLookup(db, key);
+    hashFieldExpiresIterator it;
+    unsigned long len;
+    long long when;
+    int j, argc = 2, expired;
+    robj **argv, *o;
+    sds field;
+
+    if (hfe == NULL || hashFieldExpiresMin(hfe) > now) return 0;
+
+    len = hashFieldExpiresLength(hfe);
+    if ((unsigned long) max > len) max = len;
+    argv = zmalloc(sizeof(robj*) * (max + 2));
+    hashFieldExpiresInitIterator(&it, hfe);
+    while (argc - 2 < max && hashFieldExpiresNext(&it, &field, &when) == C_OK) {
+        if (when > now) {
+            sdsfree(field);
+            break;
+        }
+        argv[argc++] = createObject(OBJ_STRING, field);
+    }
+    expired = argc - 2;
+
+    o = dictFetchValue(db->dict, key->ptr);
+    serverAssertWithInfo(NULL, key, o != NULL && o->type == OBJ_HASH);
+    for (j = 2; j < argc; j++) {
+        hashFieldExpiresDel(hfe, argv[j]->ptr);
+        hashTypeDelete(o, argv[j]->ptr);
+    }
+
+    /* Replicate/AOF the expired fields as an explicit HDEL. */
+    argv[0] = shared.hdel;
+    argv[1] = key;
+    incrRefCount(argv[0]);
+    incrRefCount(key);
+    if (server.aof_state != AOF_OFF)
+        feedAppendOnlyFile(server.hdelCommand, db->id, argv, argc);
+    replicationFeedSlaves(server.slaves, db->id, argv, argc);
+    server.stat_expired_fields += expired;
+
+    notifyKeyspaceEvent(NOTIFY_HASH, "hexpired", key, db->id);
+    if (hashTypeLength(o) == 0) {
+        dbDelete(db, key);
+        notifyKeyspaceEvent(NOTIFY_GENERIC, "del", key, db->id);
+    } else if (hashFieldExpiresLength(hfe) == 0) {
+        dictDelete(db->hexpires, key->ptr);
+    }
+    signalModifiedKey(db, key);
+
+    for (j = 0; j < argc; j++) decrRefCount(argv[j]);
+    zfree(argv);
+    return expired;
+}
+
+/* Called by the lookupKey*() family of functions: like expireIfNeeded()
+ * only the master expires fields, slaves wait for the HDEL. All the expired
+ * fields of the key are deleted, so that the commands don't have to care. */
+int hashExpireFieldsIfNeeded(redisDb *db, robj *key) {
+    mstime_t now;
+
+    if (server.loading || server.masterhost) return 0;
+    now = server.lua_caller ? server.lua_time_start : mstime();
+    return hashExpireFields(db, key, now, LONG_MAX);
+}
+
 /*-----------------------------------------------------------------------------
  * Hash type commands
  *----------------------------------------------------------------------------*/
@@ -539,8 +883,15 @@ void hsetCommand(client *c) {
     if ((o = hashTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
     hashTypeTryConversion(o,c->argv,2,c->argc-1);
 
-    for (i = 2; i < c->argc; i += 2)
-        created += !hashTypeSet(o,c->argv[i]->ptr,c->argv[i+1]->ptr,HASH_SET_COPY);
+    for (i = 2; i < c->argc; i += 2) {
+        if (hashTypeSet(o,c->argv[i]->ptr,c->argv[i+1]->ptr,HASH_SET_COPY)) {
+            /* Overwriting a field clears its expire, like SET does. */
+            if (dictSize(c->db->hexpires))
+                hashFieldRemoveExpire(c->db,c->argv[1],c->argv[i]->ptr);
+        } else {
+            created++;
+        }
+    }
 
     /* HMSET (deprecated) and HSET return value is different. */
     char *cmdname = c->argv[0]->ptr;
@@ -673,15 +1024,23 @@ static void addHashFieldToReply(client *c, robj *o, sds field) {
 }
 
 void hgetCommand(client *c) {
+    hashFieldExpires *hfe;
+    long long now;
     robj *o;
 
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk)) == NULL ||
         checkType(c,o,OBJ_HASH)) return;
 
-    addHashFieldToReply(c, o, c->argv[2]->ptr);
+    hfe = hashFieldExpiresDue(c->db, c->argv[1], &now);
+    if (hashFieldIsDue(hfe, c->argv[2]->ptr, now))
+        addReply(c, shared.nullbulk);
+    else
+        addHashFieldToReply(c, o, c->argv[2]->ptr);
 }
 
 void hmgetCommand(client *c) {
+    hashFieldExpires *hfe = NULL;
+    long long now;
     robj *o;
     int i;
 
@@ -693,9 +1052,13 @@ void hmgetCommand(client *c) {
         return;
     }
 
+    if (o) hfe = hashFieldExpiresDue(c->db, c->argv[1], &now);
     addReplyMultiBulkLen(c, c->argc-2);
     for (i = 2; i < c->argc; i++) {
-        addHashFieldToReply(c, o, c->argv[i]->ptr);
+        if (hashFieldIsDue(hfe, c->argv[i]->ptr, now))
+            addReply(c, shared.nullbulk);
+        else
+            addHashFieldToReply(c, o, c->argv[i]->ptr);
     }
 }
 
@@ -709,6 +1072,8 @@ void hdelCommand(client *c) {
     for (j = 2; j < c->argc; j++) {
         if (hashTypeDelete(o,c->argv[j]->ptr)) {
             deleted++;
+            if (dictSize(c->db->hexpires))
+                hashFieldRemoveExpire(c->db,c->argv[1],c->argv[j]->ptr);
             if (hashTypeLength(o) == 0) {
                 dbDelete(c->db,c->argv[1]);
                 keyremoved = 1;
@@ -728,20 +1093,32 @@ void hdelCommand(client *c) {
 }
 
 void hlenCommand(client *c) {
+    hashFieldExpires *hfe;
+    unsigned long len;
+    long long now;
     robj *o;
 
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,OBJ_HASH)) return;
 
-    addReplyLongLong(c,hashTypeLength(o));
+    len = hashTypeLength(o);
+    if ((hfe = hashFieldExpiresDue(c->db,c->argv[1],&now)) != NULL)
+        len -= hashFieldExpiresCountDue(hfe,now);
+    addReplyLongLong(c,len);
 }
 
 void hstrlenCommand(client *c) {
+    hashFieldExpires *hfe;
+    long long now;
     robj *o;
 
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,OBJ_HASH)) return;
-    addReplyLongLong(c,hashTypeGetValueLength(o,c->argv[2]->ptr));
+    hfe = hashFieldExpiresDue(c->db,c->argv[1],&now);
+    if (hashFieldIsDue(hfe,c->argv[2]->ptr,now))
+        addReply(c,shared.czero);
+    else
+        addReplyLongLong(c,hashTypeGetValueLength(o,c->argv[2]->ptr));
 }
 
 static void addHashIteratorCursorToReply(client *c, hashTypeIterator *hi, int what) {
@@ -766,6 +1143,8 @@ static void addHashIteratorCursorToReply(client *c, hashTypeIterator *hi, int wh
 void genericHgetallCommand(client *c, int flags) {
     robj *o;
     hashTypeIterator *hi;
+    hashFieldExpires *hfe;
+    long long now;
     int multiplier = 0;
     int length, count = 0;
 
@@ -775,11 +1154,22 @@ void genericHgetallCommand(client *c, int flags) {
     if (flags & OBJ_HASH_KEY) multiplier++;
     if (flags & OBJ_HASH_VALUE) multiplier++;
 
-    length = hashTypeLength(o) * multiplier;
+    /* On slaves, skip the fields that expired but were not deleted yet. */
+    length = hashTypeLength(o);
+    if ((hfe = hashFieldExpiresDue(c->db,c->argv[1],&now)) != NULL)
+        length -= hashFieldExpiresCountDue(hfe,now);
+    length *= multiplier;
     addReplyMultiBulkLen(c, length);
 
     hi = hashTypeInitIterator(o);
     while (hashTypeNext(hi) != C_ERR) {
+        if (hfe) {
+            sds field = hashTypeCurrentObjectNewSds(hi,OBJ_HASH_KEY);
+            int due = hashFieldIsDue(hfe,field,now);
+
+            sdsfree(field);
+            if (due) continue;
+        }
         if (flags & OBJ_HASH_KEY) {
             addHashIteratorCursorToReply(c, hi, OBJ_HASH_KEY);
             count++;
@@ -807,11 +1197,16 @@ void hgetallCommand(client *c) {
 }
 
 void hexistsCommand(client *c) {
+    hashFieldExpires *hfe;
+    long long now;
     robj *o;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,OBJ_HASH)) return;
 
-    addReply(c, hashTypeExists(o,c->argv[2]->ptr) ? shared.cone : shared.czero);
+    hfe = hashFieldExpiresDue(c->db,c->argv[1],&now);
+    addReply(c, hashTypeExists(o,c->argv[2]->ptr) &&
+                !hashFieldIsDue(hfe,c->argv[2]->ptr,now) ?
+                shared.cone : shared.czero);
 }
 
 void hscanCommand(client *c) {
@@ -823,3 +1218,266 @@ void hscanCommand(client *c) {
         checkType(c,o,OBJ_HASH)) return;
     scanGenericCommand(c,o,cursor);
 }
+
+/*-----------------------------------------------------------------------------
+ * Hash field expire commands
+ *----------------------------------------------------------------------------*/
+
+#define HFE_NX (1<<0)   /* Set only if the field has no expire. */
+#define HFE_XX (1<<1)   /* Set only if the field has an expire. */
+#define HFE_GT (1<<2)   /* Set only if greater than the current expire. */
+#define HFE_LT (1<<3)   /* Set only if less than the current expire. */
+
+/* The expire times are scores of a sorted set, so they must be exact as
+ * doubles: 2^48 milliseconds is about year 10889. */
+#define HFE_MAX_TIME ((1LL<<48)-1)
+
+/* Parse the "FIELDS numfields field [field ...]" arguments starting at
+ * 'pos', that must be the last arguments of the command. */
+static int getHashFieldsOrReply(client *c, int pos, long *numfields) {
+    if (pos + 1 >= c->argc || strcasecmp(c->argv[pos]->ptr,"fields")) {
+        addReplyError(c,"Mandatory argument FIELDS is missing or not at the right position");
+        return C_ERR;
+    }
+    if (getLongFromObjectOrReply(c,c->argv[pos+1],numfields,NULL) != C_OK)
+        return C_ERR;
+    if (*numfields <= 0 || *numfields != c->argc - pos - 2) {
+        addReplyError(c,"The `numfields` parameter must match the number of arguments");
+        return C_ERR;
+    }
+    return C_OK;
+}
+
+/* Implements HEXPIRE, HPEXPIRE, HEXPIREAT and HPEXPIREAT:
+ *
+ * HEXPIRE key seconds [NX|XX|GT|LT] FIELDS numfields field [field ...]
+ *
+ * Replies for every field with -2 if the field does not exist, 0 if the
+ * condition was not met, 1 if the expire was set, 2 if the field was deleted
+ * because the time is in the past. */
+void hexpireGenericCommand(client *c, long long basetime, int unit) {
+    robj *key = c->argv[1], *o, **newargv = NULL;
+    long long when, cur;
+    long numfields;
+    int j, pos = 3, flags = 0, set = 0, deleted = 0, keyremoved = 0, past;
+
+    if (getLongLongFromObjectOrReply(c,c->argv[2],&when,NULL) != C_OK)
+        return;
+    if (when < 0 || when > (LLONG_MAX - basetime) / (unit == UNIT_SECONDS ? 1000 : 1)) {
+        addReplyErrorFormat(c,"invalid expire time in '%s' command",c->cmd->name);
+        return;
+    }
+    if (unit == UNIT_SECONDS) when *= 1000;
+    when += basetime;
+    if (when > HFE_MAX_TIME) {
+        addReplyErrorFormat(c,"invalid expire time in '%s' command",c->cmd->name);
+        return;
+    }
+
+    if (c->argc > 3 && strcasecmp(c->argv[3]->ptr,"fields")) {
+        char *opt = c->argv[3]->ptr;
+
+        if (!strcasecmp(opt,"nx")) flags = HFE_NX;
+        else if (!strcasecmp(opt,"xx")) flags = HFE_XX;
+        else if (!strcasecmp(opt,"gt")) flags = HFE_GT;
+        else if (!strcasecmp(opt,"lt")) flags = HFE_LT;
+        else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        pos++;
+    }
+    if (getHashFieldsOrReply(c,pos,&numfields) != C_OK) return;
+
+    if ((o = lookupKeyWrite(c->db,key)) == NULL) {
+        addReplyMultiBulkLen(c,numfields);
+        for (j = 0; j < numfields; j++) addReplyLongLong(c,-2);
+        return;
+    }
+    if (checkType(c,o,OBJ_HASH)) return;
+
+    /* Like EXPIRE, a time in the past deletes the fields, but not when
+     * loading the AOF or in the context of a slave: see expireGenericCommand.
+     * The deleted fields are propagated as an HDEL. */
+    past = when <= mstime() && !server.loading && !server.masterhost;
+    if (past) {
+        newargv = zmalloc(sizeof(robj*) * (numfields + 2));
+        newargv[0] = shared.hdel;
+        newargv[1] = key;
+        incrRefCount(newargv[0]);
+        incrRefCount(key);
+    }
+
+    addReplyMultiBulkLen(c,numfields);
+    for (j = pos + 2; j < c->argc; j++) {
+        sds field = c->argv[j]->ptr;
+
+        if (keyremoved || !hashTypeExists(o,field)) {
+            addReplyLongLong(c,-2);
+            continue;
+        }
+        cur = hashFieldGetExpire(c->db,key,field);
+        if (((flags & HFE_NX) && cur != -1) ||
+            ((flags & HFE_XX) && cur == -1) ||
+            ((flags & HFE_GT) && (cur == -1 || when <= cur)) ||
+            ((flags & HFE_LT) && cur != -1 && when >= cur))
+        {
+            addReply(c,shared.czero);
+            continue;
+        }
+        if (past) {
+            hashFieldRemoveExpire(c->db,key,field);
+            hashTypeDelete(o,field);
+            incrRefCount(c->argv[j]);
+            newargv[2 + deleted++] = c->argv[j];
+            addReplyLongLong(c,2);
+            if (hashTypeLength(o) == 0) {
+                dbDelete(c->db,key);
+                keyremoved = 1;
+            }
+        } else {
+            hashFieldSetExpire(c->db,key,field,when);
+            set++;
+            addReply(c,shared.cone);
+        }
+    }
+
+    if (deleted) {
+        replaceClientCommandVector(c,deleted + 2,newargv);
+        signalModifiedKey(c->db,key);
+        notifyKeyspaceEvent(NOTIFY_HASH,"hdel",key,c->db->id);
+        if (keyremoved)
+            notifyKeyspaceEvent(NOTIFY_GENERIC,"del",key,c->db->id);
+        server.dirty += deleted;
+    } else {
+        if (newargv) {
+            decrRefCount(newargv[0]);
+            decrRefCount(newargv[1]);
+            zfree(newargv);
+        }
+        if (set) {
+            /* Propagate as HPEXPIREAT with the absolute time. */
+            if (basetime != 0 || unit == UNIT_SECONDS) {
+                robj *aux = createStringObjectFromLongLong(when);
+                rewriteClientCommandArgument(c,0,shared.hpexpireat);
+                rewriteClientCommandArgument(c,2,aux);
+                decrRefCount(aux);
+            }
+            signalModifiedKey(c->db,key);
+            notifyKeyspaceEvent(NOTIFY_HASH,"hexpire",key,c->db->id);
+            server.dirty += set;
+        }
+    }
+}
+
+void hexpireCommand(client *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_SECONDS);
+}
+
+void hpexpireCommand(client *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_MILLISECONDS);
+}
+
+void hexpireatCommand(client *c) {
+    hexpireGenericCommand(c,0,UNIT_SECONDS);
+}
+
+void hpexpireatCommand(client *c) {
+    hexpireGenericCommand(c,0,UNIT_MILLISECONDS);
+}
+
+/* Implements HTTL, HPTTL, HEXPIRETIME and HPEXPIRETIME: replies for every
+ * field with -2 if it does not exist, -1 if it has no expire, otherwise with
+ * the TTL or the unix time of the expire. */
+void httlGenericCommand(client *c, int output_ms, int output_abs) {
+    hashFieldExpires *hfe;
+    long long when, now;
+    long numfields;
+    robj *o;
+    int j;
+
+    if (getHashFieldsOrReply(c,2,&numfields) != C_OK) return;
+    if ((o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_NOTOUCH)) == NULL) {
+        addReplyMultiBulkLen(c,numfields);
+        for (j = 0; j < numfields; j++) addReplyLongLong(c,-2);
+        return;
+    }
+    if (checkType(c,o,OBJ_HASH)) return;
+
+    now = mstime();
+    hfe = hashFieldExpiresDue(c->db,c->argv[1],&now);
+    addReplyMultiBulkLen(c,numfields);
+    for (j = 4; j < c->argc; j++) {
+        if (!hashTypeExists(o,c->argv[j]->ptr) ||
+            hashFieldIsDue(hfe,c->argv[j]->ptr,now))
+        {
+            addReplyLongLong(c,-2);
+            continue;
+        }
+        when = hashFieldGetExpire(c->db,c->argv[1],c->argv[j]->ptr);
+        if (when == -1) {
+            addReplyLongLong(c,-1);
+        } else if (output_abs) {
+            addReplyLongLong(c,output_ms ? when : when / 1000);
+        } else {
+            long long ttl = when - now;
+            if (ttl < 0) ttl = 0;
+            addReplyLongLong(c,output_ms ? ttl : (ttl + 500) / 1000);
+        }
+    }
+}
+
+/* HTTL key FIELDS numfields field [field ...] */
+void httlCommand(client *c) {
+    httlGenericCommand(c,0,0);
+}
+
+/* HPTTL key FIELDS numfields field [field ...] */
+void hpttlCommand(client *c) {
+    httlGenericCommand(c,1,0);
+}
+
+/* HEXPIRETIME key FIELDS numfields field [field ...] */
+void hexpiretimeCommand(client *c) {
+    httlGenericCommand(c,0,1);
+}
+
+/* HPEXPIRETIME key FIELDS numfields field [field ...] */
+void hpexpiretimeCommand(client *c) {
+    httlGenericCommand(c,1,1);
+}
+
+/* HPERSIST key FIELDS numfields field [field ...]
+ *
+ * Replies for every field with -2 if it does not exist, -1 if it has no
+ * expire, 1 if the expire was removed. */
+void hpersistCommand(client *c) {
+    long numfields;
+    int j, removed = 0;
+    robj *o;
+
+    if (getHashFieldsOrReply(c,2,&numfields) != C_OK) return;
+    if ((o = lookupKeyWrite(c->db,c->argv[1])) == NULL) {
+        addReplyMultiBulkLen(c,numfields);
+        for (j = 0; j < numfields; j++) addReplyLongLong(c,-2);
+        return;
+    }
+    if (checkType(c,o,OBJ_HASH)) return;
+
+    addReplyMultiBulkLen(c,numfields);
+    for (j = 4; j < c->argc; j++) {
+        if (!hashTypeExists(o,c->argv[j]->ptr)) {
+            addReplyLongLong(c,-2);
+        } else if (hashFieldRemoveExpire(c->db,c->argv[1],c->argv[j]->ptr)) {
+            addReply(c,shared.cone);
+            removed++;
+        } else {
+            addReplyLongLong(c,-1);
+        }
+    }
+    if (removed) {
+        signalModifiedKey(c->db,c->argv[1]);
+        notifyKeyspaceEvent(NOTIFY_HASH,"hpersist",c->argv[1],c->db->id);
+        server.dirty += removed;
+    }
+}
@@ -828,7 +828,7 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
 
 void sinterGenericCommand(client *c, robj **setkeys,
                           unsigned long setnum, robj *dstkey) {
-    robj **sets = zmalloc(sizeof(robj*)*setnum);
+    robj **sets = cmdArenaAlloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
     robj *dstset = NULL;
     sds elesds;
@@ -842,7 +842,6 @@ void sinterGenericCommand(client *c, robj **setkeys,
             lookupKeyWrite(c->db,setkeys[j]) :
             lookupKeyRead(c->db,setkeys[j]);
         if (!setobj) {
-            zfree(sets);
             if (dstkey) {
                 if (dbDelete(c->db,dstkey)) {
                     signalModifiedKey(c->db,dstkey);
@@ -855,7 +854,6 @@ void sinterGenericCommand(client *c, robj **setkeys,
             return;
         }
         if (checkType(c,setobj,OBJ_SET)) {
-            zfree(sets);
             return;
         }
         sets[j] = setobj;
@@ -950,7 +948,6 @@ void sinterGenericCommand(client *c, robj **setkeys,
     } else {
         setDeferredMultiBulkLength(c,replylen,cardinality);
     }
-    zfree(sets);
 }
 
 void sinterCommand(client *c) {
@@ -967,7 +964,7 @@ void sinterstoreCommand(client *c) {
 
 void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
                               robj *dstkey, int op) {
-    robj **sets = zmalloc(sizeof(robj*)*setnum);
+    robj **sets = cmdArenaAlloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
     robj *dstset = NULL;
     sds ele;
@@ -983,7 +980,6 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
             continue;
         }
         if (checkType(c,setobj,OBJ_SET)) {
-            zfree(sets);
             return;
         }
         sets[j] = setobj;
@@ -1122,7 +1118,6 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
         signalModifiedKey(c->db,dstkey);
         server.dirty++;
     }
-    zfree(sets);
 }
 
 void sunionCommand(client *c) {
@@ -42,7 +42,8 @@
 
 void streamFreeCG(streamCG *cg);
 void streamFreeNACK(streamNACK *na);
-size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer);
+size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamCG *group, streamConsumer *consumer);
+robj *createObjectFromStreamID(streamID *id);
 
 /* -----------------------------------------------------------------------
  * Low level stream encoding: a radix tree of listpacks.
@@ -362,6 +363,156 @@ int streamAppendItem(stream *s, robj **argv, int64_t numfields, streamID *added_
     return C_OK;
 }
 
+/* Garbage collection of the stream macro nodes: entries removed by XDEL or
+ * by a partial trim are only flagged as deleted inside the listpack, so a
+ * node is rewritten without them once the deleted entries are the majority,
+ * and released as soon as no valid entry is left. The listpack size is
+ * bounded by stream-node-max-bytes / stream-node-max-entries, and a node is
+ * rewritten only after at least half of it was deleted, so the cost of the
+ * compaction is amortized over the deletions that triggered it. */
+#define STREAM_GC_MIN_ENTRIES 10
+
+/* Return the number of listpack elements composing the entry whose flags
+ * field is pointed by 'p', including the final lp-count field. */
+static int64_t streamEntryElements(unsigned char *lp, unsigned char *p, int64_t master_fields_count) {
+    int flags = lpGetInteger(p);
+    if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) return 3+master_fields_count+1;
+    p = lpNext(lp,p); /* Seek ID ms delta. */
+    p = lpNext(lp,p); /* Seek ID seq delta. */
+    p = lpNext(lp,p); /* Seek num-fields. */
+    return 3+1+lpGetInteger(p)*2+1;
+}
+
+/* Append to 'dst' 'count' elements of 'src' starting at 'p'. Returns the
+ * new 'dst' listpack, and sets '*next' to the element following the last
+ * one copied (NULL at the end of 'src'). */
+static unsigned char *streamCopyElements(unsigned char *dst, unsigned char *src, unsigned char *p, int64_t count, unsigned char **next) {
+    unsigned char buf[LP_INTBUF_SIZE];
+    while(count--) {
+        int64_t len;
+        unsigned char *e = lpGet(p,&len,buf);
+        dst = lpAppend(dst,e,len);
+        p = lpNext(src,p);
+    }
+    *next = p;
+    return dst;
+}
+
+/* Rewrite the listpack of a stream node without the entries flagged as
+ * deleted. The master entry is copied as it is (with a zero deleted counter),
+ * so the node key, the ID deltas and the SAMEFIELDS compression of the
+ * surviving entries are still valid. The old listpack is freed and the
+ * new one returned. */
+unsigned char *streamCompactListpack(unsigned char *lp) {
+    unsigned char *new = lpNew(), *p = lpFirst(lp);
+    new = lpAppendInteger(new,lpGetInteger(p)); /* Valid entries count. */
+    p = lpNext(lp,p);
+    new = lpAppendInteger(new,0);               /* No deleted entries. */
+    p = lpNext(lp,p);
+    int64_t master_fields_count = lpGetInteger(p);
+    /* Copy num-fields, the master fields and the zero terminator. */
+    new = streamCopyElements(new,lp,p,master_fields_count+2,&p);
+
+    while(p) {
+        int64_t elements = streamEntryElements(lp,p,master_fields_count);
+        if (lpGetInteger(p) & STREAM_ITEM_FLAG_DELETED) {
+            while(elements--) p = lpNext(lp,p);
+        } else {
+            new = streamCopyElements(new,lp,p,elements,&p);
+        }
+    }
+    lpFree(lp);
+    return new;
+}
+
+/* Called after some entry of the node 'lp', stored in the radix tree at
+ * 'key', was flagged as deleted. The node is removed if it has no longer
+ * valid entries, compacted if most of its entries are deleted, and in any
+ * case the listpack pointer stored in the radix tree is refreshed, since
+ * marking the entries may have reallocated it. */
+void streamNodeGC(stream *s, unsigned char *key, size_t key_len, unsigned char *lp) {
+    unsigned char *p = lpFirst(lp);
+    int64_t entries = lpGetInteger(p);
+    int64_t deleted = lpGetInteger(lpNext(lp,p));
+
+    if (entries == 0) {
+        lpFree(lp);
+        raxRemove(s->rax,key,key_len,NULL);
+        return;
+    }
+    if (entries+deleted > STREAM_GC_MIN_ENTRIES && deleted > entries)
+        lp = streamCompactListpack(lp);
+    raxInsert(s->rax,key,key_len,lp,NULL);
+}
+
+/* Mark as deleted the valid entries of the node 'lp' having master ID
+ * 'master_id', in ID order, until 'max' entries were deleted or, if
+ * 'minid' is not NULL, an entry with ID >= 'minid' is found. The valid and
+ * deleted counters of the master entry are updated accordingly. Returns the
+ * listpack (that may have been reallocated), the number of deleted entries
+ * is stored at '*deleted'. */
+static unsigned char *streamNodeDeleteHead(unsigned char *lp, streamID *master_id, int64_t max, streamID *minid, int64_t *deleted) {
+    unsigned char *p = lpFirst(lp);
+    p = lpNext(lp,p); /* Seek deleted field. */
+    p = lpNext(lp,p); /* Seek num-of-fields in the master entry. */
+    int64_t master_fields_count = lpGetInteger(p);
+    p = lpNext(lp,p); /* Seek the first field. */
+    for (int64_t j = 0; j < master_fields_count; j++)
+        p = lpNext(lp,p); /* Skip all master fields. */
+    p = lpNext(lp,p); /* Skip the zero master entry terminator. */
+
+    /* 'p' is now pointing to the first entry inside the listpack. We run
+     * entry after entry, marking entries as deleted if they are already not
+     * deleted. */
+    *deleted = 0;
+    while(p && *deleted < max) {
+        int flags = lpGetInteger(p);
+        int64_t elements = streamEntryElements(lp,p,master_fields_count);
+
+        if (minid) {
+            unsigned char *idp = lpNext(lp,p);
+            streamID id = *master_id;
+            id.ms += lpGetInteger(idp);
+            idp = lpNext(lp,idp);
+            id.seq += lpGetInteger(idp);
+            if (streamCompareID(&id,minid) >= 0) break;
+        }
+
+        /* Mark the entry as deleted. The flag is a small integer so its
+         * encoding length never changes and 'p' stays valid. */
+        if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
+            flags |= STREAM_ITEM_FLAG_DELETED;
+            lp = lpReplaceInteger(lp,&p,flags);
+            (*deleted)++;
+        }
+        while(elements--) p = lpNext(lp,p); /* Skip the whole entry. */
+    }
+
+    /* Update the entries/deleted counters of the master entry. */
+    if (*deleted) {
+        p = lpFirst(lp);
+        int64_t entries = lpGetInteger(p);
+        lp = lpReplaceInteger(lp,&p,entries-*deleted);
+        p = lpNext(lp,p);
+        int64_t marked_deleted = lpGetInteger(p);
+        lp = lpReplaceInteger(lp,&p,marked_deleted+*deleted);
+    }
+    return lp;
+}
+
+/* Return in 'id' the ID of the last entry, deleted or not, of the node
+ * 'lp' having master ID 'master_id'. */
+static void streamNodeLastID(unsigned char *lp, streamID *master_id, streamID *id) {
+    unsigned char *p = lpLast(lp);
+    int64_t lp_count = lpGetInteger(p);
+    while(lp_count--) p = lpPrev(lp,p); /* Seek the flags of the entry. */
+    p = lpNext(lp,p);
+    *id = *master_id;
+    id->ms += lpGetInteger(p);
+    p = lpNext(lp,p);
+    id->seq += lpGetInteger(p);
+}
+
 /* Trim the stream 's' to have no more than maxlen elements, and return the
  * number of elements removed from the stream. The 'approx' option, if non-zero,
  * specifies that the trimming must be performed in a approximated way in
@@ -404,71 +555,104 @@ int64_t streamTrimByLength(stream *s, size_t maxlen, int approx) {
         if (approx) break;
 
         /* Otherwise, we have to mark single entries inside the listpack
-         * as deleted. We start by updating the entries/deleted counters. */
-        int64_t to_delete = s->length - maxlen;
-        serverAssert(to_delete < entries);
-        lp = lpReplaceInteger(lp,&p,entries-to_delete);
-        p = lpNext(lp,p); /* Seek deleted field. */
-        int64_t marked_deleted = lpGetInteger(p);
-        lp = lpReplaceInteger(lp,&p,marked_deleted+to_delete);
-        p = lpNext(lp,p); /* Seek num-of-fields in the master entry. */
-
-        /* Skip all the master fields. */
-        int64_t master_fields_count = lpGetInteger(p);
-        p = lpNext(lp,p); /* Seek the first field. */
-        for (int64_t j = 0; j < master_fields_count; j++)
-            p = lpNext(lp,p); /* Skip all master fields. */
-        p = lpNext(lp,p); /* Skip the zero master entry terminator. */
-
-        /* 'p' is now pointing to the first entry inside the listpack.
-         * We have to run entry after entry, marking entries as deleted
-         * if they are already not deleted. */
-        while(p) {
-            int flags = lpGetInteger(p);
-            int to_skip;
-
-            /* Mark the entry as deleted. */
-            if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
-                flags |= STREAM_ITEM_FLAG_DELETED;
-                lp = lpReplaceInteger(lp,&p,flags);
-                deleted++;
-                s->length--;
-                if (s->length <= maxlen) break; /* Enough entries deleted. */
-            }
+         * as deleted, and collect the node garbage if needed. */
+        streamID master_id;
+        int64_t marked;
+        streamDecodeID(ri.key,&master_id);
+        lp = streamNodeDeleteHead(lp,&master_id,s->length-maxlen,NULL,&marked);
+        s->length -= marked;
+        deleted += marked;
+        streamNodeGC(s,ri.key,ri.key_len,lp);
 
-            p = lpNext(lp,p); /* Skip ID ms delta. */
-            p = lpNext(lp,p); /* Skip ID seq delta. */
-            p = lpNext(lp,p); /* Seek num-fields or values (if compressed). */
-            if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
-                to_skip = master_fields_count;
-            } else {
-                to_skip = lpGetInteger(p);
-                to_skip = 1+(to_skip*2);
-            }
+        break; /* If we are here, there was enough to delete in the current
+                  node, so no need to go to the next node. */
+    }
 
-            while(to_skip--) p = lpNext(lp,p); /* Skip the whole entry. */
-            p = lpNext(lp,p); /* Skip the final lp-count field. */
-        }
+    raxStop(&ri);
+    return deleted;
+}
 
-        /* Here we should perform garbage collection in case at this point
-         * there are too many entries deleted inside the listpack. */
-        entries -= to_delete;
-        marked_deleted += to_delete;
-        if (entries + marked_deleted > 10 && marked_deleted > entries/2) {
-            /* TODO: perform a garbage collection. */
-        }
+/* Trim the stream 's' removing all the entries with an ID smaller than
+ * 'minid', and return the number of elements removed from the stream.
+ * Nodes are visited from the head, and a node is dropped as a whole when
+ * its last entry is smaller than 'minid', so the cost is proportional to
+ * the number of removed nodes and not to the number of removed entries.
+ * Like in streamTrimByLength() the 'approx' option, if non-zero, only
+ * removes whole nodes, so entries older than 'minid' may be left in the
+ * first node of the stream. */
+int64_t streamTrimByID(stream *s, streamID *minid, int approx) {
+    raxIterator ri;
+    raxStart(&ri,s->rax);
+    raxSeek(&ri,"^",NULL,0);
 
-        /* Update the listpack with the new pointer. */
-        raxInsert(s->rax,ri.key,ri.key_len,lp,NULL);
+    int64_t deleted = 0;
+    while(raxNext(&ri)) {
+        unsigned char *lp = ri.data;
+        int64_t entries = lpGetInteger(lpFirst(lp));
+        streamID master_id, last_id;
+        streamDecodeID(ri.key,&master_id);
+
+        /* The node keys are sorted, so there is nothing to trim if the
+         * first entry of the node is already >= minid. */
+        if (streamCompareID(&master_id,minid) >= 0) break;
+
+        /* Remove the node as a whole if its last entry is older than the
+         * minimum ID. */
+        streamNodeLastID(lp,&master_id,&last_id);
+        if (streamCompareID(&last_id,minid) < 0) {
+            lpFree(lp);
+            raxRemove(s->rax,ri.key,ri.key_len,NULL);
+            raxSeek(&ri,">=",ri.key,ri.key_len);
+            s->length -= entries;
+            deleted += entries;
+            continue;
+        }
 
-        break; /* If we are here, there was enough to delete in the current
-                  node, so no need to go to the next node. */
+        /* This node contains 'minid': stop here if approx is true, or
+         * mark the older entries as deleted. */
+        if (!approx) {
+            int64_t marked;
+            lp = streamNodeDeleteHead(lp,&master_id,entries,minid,&marked);
+            s->length -= marked;
+            deleted += marked;
+            streamNodeGC(s,ri.key,ri.key_len,lp);
+        }
+        break;
     }
 
     raxStop(&ri);
     return deleted;
 }
 
+/* Rewrite the "MINID ~ <id>" arguments of the current command, where
+ * 'tilde_idx' is the index of the "~", into an exact "MINID <id>". The
+ * approximated trimming only removes whole nodes, so the replicas and the
+ * AOF could end with a different stream if they took the same decision on
+ * their own: the ID propagated is the one of the first entry that survived
+ * the trimming here, or the original 'minid' if the stream is now empty. */
+void streamRewriteApproxMinID(client *c, stream *s, int tilde_idx, streamID *minid) {
+    streamIterator si;
+    streamID first_id = *minid;
+    int64_t numfields;
+
+    streamIteratorStart(&si,s,NULL,NULL,0);
+    streamIteratorGetID(&si,&first_id,&numfields);
+    streamIteratorStop(&si);
+
+    robj **argv = zmalloc(sizeof(robj*)*(c->argc-1));
+    int j, argc = 0;
+    for (j = 0; j < c->argc; j++) {
+        if (j == tilde_idx) continue;
+        if (j == tilde_idx+1) {
+            argv[argc++] = createObjectFromStreamID(&first_id);
+        } else {
+            argv[argc] = c->argv[j];
+            incrRefCount(argv[argc++]);
+        }
+    }
+    replaceClientCommandVector(c,argc,argv);
+}
+
 /* Initialize the stream iterator, so that we can call iterating functions
  * to get the next items. This requires a corresponding streamIteratorStop()
  * at the end. The 'rev' parameter controls the direction. If it's zero the
@@ -719,6 +903,10 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
     /* Update the number of entries counter. */
     si->stream->length--;
 
+    /* Store back the listpack, releasing or compacting the node if most
+     * of its entries are now deleted. */
+    streamNodeGC(si->stream,si->ri.key,si->ri.key_len,lp);
+
     /* Re-seek the iterator to fix the now messed up state. */
     streamID start, end;
     if (si->rev) {
@@ -730,9 +918,6 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
     }
     streamIteratorStop(si);
     streamIteratorStart(si,si->stream,&start,&end,si->rev);
-
-    /* TODO: perform a garbage collection here if the ration between
-     * deleted and valid goes over a certain limit. */
 }
 
 /* Stop the stream iterator. The only cleanup we need is to free the rax
@@ -868,7 +1053,7 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
      * as delivered. */
     if (group && streamCompareID(start,&group->last_id) <= 0) {
         return streamReplyWithRangeFromConsumerPEL(c,s,start,end,count,
-                                                   consumer);
+                                                   group,consumer);
     }
 
     if (!(flags & STREAM_RWR_RAWENTRIES))
@@ -924,12 +1109,14 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
                 raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
                 /* Update the consumer and idle time. */
                 nack->consumer = consumer;
-                nack->delivery_time = mstime();
+                streamSetNACKDeliveryTime(group,buf,nack,mstime());
                 nack->delivery_count++;
                 /* Add the entry in the new consumer local PEL. */
                 raxInsert(consumer->pel,buf,sizeof(buf),nack,NULL);
             } else if (retval == 1) {
                 serverPanic("NACK half-created. Should not be possible.");
+            } else {
+                streamIndexNACK(group,buf,nack);
             }
 
             /* Propagate as XCLAIM. */
@@ -961,7 +1148,7 @@ size_t streamReplyWithRange(client *c, stream *s, streamID *start, streamID *end
  * seek into the radix tree of the messages in order to emit the full message
  * to the client. However clients only reach this code path when they are
  * fetching the history of already retrieved messages, which is rare. */
-size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer) {
+size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamCG *group, streamConsumer *consumer) {
     raxIterator ri;
     unsigned char startkey[sizeof(streamID)];
     unsigned char endkey[sizeof(streamID)];
@@ -989,8 +1176,10 @@ size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start
             addReplyStreamID(c,&id);
             addReply(c,shared.nullmultibulk);
         } else {
+            /* The consumer PEL is keyed by ID, so updating the delivery
+             * time index of the group does not invalidate the iterator. */
             streamNACK *nack = ri.data;
-            nack->delivery_time = mstime();
+            streamSetNACKDeliveryTime(group,ri.key,nack,mstime());
             nack->delivery_count++;
         }
         arraylen++;
@@ -1084,7 +1273,7 @@ invalid:
 }
 
 /*
- * XADD key [MAXLEN <count>] <ID or *> [field value] [field value] ...
+ * XADD key [MAXLEN [~] <count>|MINID [~] <id>] <ID or *> [field value] ...
  *
  * XADD mytopic * acctid 012 age 9
  *
@@ -1096,6 +1285,10 @@ void xaddCommand(client *c) {
     int approx_maxlen = 0;  /* If 1 only delete whole radix tree nodes, so
                                the maxium length is not applied verbatim. */
     int maxlen_arg_idx = 0; /* Index of the count in MAXLEN, for rewriting. */
+    streamID minid;
+    int minid_given = 0;    /* If 1 entries older than 'minid' are trimmed. */
+    int approx_minid = 0;   /* Like approx_maxlen, for MINID. */
+    int minid_tilde_idx = 0; /* Index of the "~" in MINID, for rewriting. */
 
     /* Parse options. */
     int i = 2; /* This is the first argument position where we could
@@ -1123,6 +1316,17 @@ void xaddCommand(client *c) {
             }
             i++;
             maxlen_arg_idx = i;
+        } else if (!strcasecmp(opt,"minid") && moreargs) {
+            char *next = c->argv[i+1]->ptr;
+            /* Check for the form MINID ~ <id>. */
+            if (moreargs >= 2 && next[0] == '~' && next[1] == '\0') {
+                approx_minid = 1;
+                minid_tilde_idx = i+1;
+                i++;
+            }
+            if (streamParseIDOrReply(c,c->argv[i+1],&minid,0) != C_OK) return;
+            minid_given = 1;
+            i++;
         } else {
             /* If we are here is a syntax error or a valid ID. */
             if (streamParseIDOrReply(c,c->argv[i],&id,0) != C_OK) return;
@@ -1132,6 +1336,12 @@ void xaddCommand(client *c) {
     }
     int field_pos = i+1;
 
+    if (maxlen >= 0 && minid_given) {
+        addReplyError(c,"MAXLEN and MINID options can't be used at the "
+                        "same time");
+        return;
+    }
+
     /* Check arity. */
     if ((c->argc - field_pos) < 2 || ((c->argc-field_pos) % 2) == 1) {
         addReplyError(c,"wrong number of arguments for XADD");
@@ -1173,12 +1383,22 @@ void xaddCommand(client *c) {
         }
     }
 
+    /* Remove the elements older than MINID if specified. */
+    if (minid_given && streamTrimByID(s,&minid,approx_minid))
+        notifyKeyspaceEvent(NOTIFY_STREAM,"xtrim",c->argv[1],c->db->id);
+
     /* Let's rewrite the ID argument with the one actually generated for
      * AOF/replication propagation. */
     robj *idarg = createObjectFromStreamID(&id);
     rewriteClientCommandArgument(c,i,idarg);
     decrRefCount(idarg);
 
+    /* An approximated MINID is propagated as an exact one, since exact
+     * trimming by ID gives the same result on the replicas. This must be
+     * the last rewrite since it removes the "~" argument, shifting the
+     * ones that follow. */
+    if (approx_minid) streamRewriteApproxMinID(c,s,minid_tilde_idx,&minid);
+
     /* We need to signal to blocked clients that there is new data on this
      * stream. */
     if (server.blocked_clients_by_type[BLOCKED_STREAM])
@@ -1492,6 +1712,41 @@ void streamFreeNACK(streamNACK *na) {
     zfree(na);
 }
 
+/* Populate 'buf' with the key of the NACK of the entry 'rawid' in the
+ * delivery time index of the group PEL, see streamCG->pel_by_time. */
+static void streamEncodeNACKTimeKey(unsigned char *buf, unsigned char *rawid,
+                                    mstime_t time) {
+    uint64_t t = htonu64((uint64_t)(time < 0 ? 0 : time));
+    memcpy(buf,&t,sizeof(t));
+    memcpy(buf+sizeof(t),rawid,sizeof(streamID));
+}
+
+/* Add the NACK of the entry 'rawid' (a big endian encoded ID), which was
+ * just added to the group PEL, to the group delivery time index. */
+void streamIndexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[STREAM_NACK_TIME_KEY_LEN];
+    streamEncodeNACKTimeKey(key,rawid,nack->delivery_time);
+    raxInsert(cg->pel_by_time,key,sizeof(key),nack,NULL);
+}
+
+/* Remove the NACK of the entry 'rawid' from the group delivery time index.
+ * Must be called before removing the NACK from the group PEL. */
+void streamUnindexNACK(streamCG *cg, unsigned char *rawid, streamNACK *nack) {
+    unsigned char key[STREAM_NACK_TIME_KEY_LEN];
+    streamEncodeNACKTimeKey(key,rawid,nack->delivery_time);
+    raxRemove(cg->pel_by_time,key,sizeof(key),NULL);
+}
+
+/* Change the delivery time of the NACK of the entry 'rawid', keeping the
+ * group delivery time index updated. */
+void streamSetNACKDeliveryTime(streamCG *cg, unsigned char *rawid,
+                               streamNACK *nack, mstime_t time) {
+    if (nack->delivery_time == time) return;
+    streamUnindexNACK(cg,rawid,nack);
+    nack->delivery_time = time;
+    streamIndexNACK(cg,rawid,nack);
+}
+
 /* Free a consumer and associated data structures. Note that this function
  * will not reassign the pending messages associated with this consumer
  * nor will delete them from the stream, so when this function is called
@@ -1515,6 +1770,7 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id) {
 
     streamCG *cg = zmalloc(sizeof(*cg));
     cg->pel = raxNew();
+    cg->pel_by_time = raxNew();
     cg->consumers = raxNew();
     cg->last_id = *id;
     raxInsert(s->cgroups,(unsigned char*)name,namelen,cg,NULL);
@@ -1524,6 +1780,7 @@ streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id) {
 /* Free a consumer group and all its associated data. */
 void streamFreeCG(streamCG *cg) {
     raxFreeWithCallback(cg->pel,(void(*)(void*))streamFreeNACK);
+    raxFree(cg->pel_by_time); /* The NACKs are shared with the PEL. */
     raxFreeWithCallback(cg->consumers,(void(*)(void*))streamFreeConsumer);
     zfree(cg);
 }
@@ -1572,6 +1829,7 @@ uint64_t streamDelConsumer(streamCG *cg, sds name) {
     raxSeek(&ri,"^",NULL,0);
     while(raxNext(&ri)) {
         streamNACK *nack = ri.data;
+        streamUnindexNACK(cg,ri.key,nack);
         raxRemove(cg->pel,ri.key,ri.key_len,NULL);
         streamFreeNACK(nack);
     }
@@ -1729,6 +1987,7 @@ void xackCommand(client *c) {
          * we are able to remove the entry from both PELs. */
         streamNACK *nack = raxFind(group->pel,buf,sizeof(buf));
         if (nack != raxNotFound) {
+            streamUnindexNACK(group,buf,nack);
             raxRemove(group->pel,buf,sizeof(buf),NULL);
             raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
             streamFreeNACK(nack);
@@ -2064,6 +2323,7 @@ void xclaimCommand(client *c) {
             /* Create the NACK. */
             nack = streamCreateNACK(NULL);
             raxInsert(group->pel,buf,sizeof(buf),nack,NULL);
+            streamIndexNACK(group,buf,nack);
         }
 
         if (nack != raxNotFound) {
@@ -2080,7 +2340,7 @@ void xclaimCommand(client *c) {
                 raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
             /* Update the consumer and idle time. */
             nack->consumer = consumer;
-            nack->delivery_time = deliverytime;
+            streamSetNACKDeliveryTime(group,buf,nack,deliverytime);
             /* Set the delivery attempts counter if given. */
             if (retrycount >= 0) nack->delivery_count = retrycount;
             /* Add the entry in the new consumer local PEL. */
@@ -2095,7 +2355,7 @@ void xclaimCommand(client *c) {
             arraylen++;
 
             /* Propagate this change. */
-            streamPropagateXCLAIM(c,c->argv[1],c->argv[3],c->argv[j],nack);
+            streamPropagateXCLAIM(c,c->argv[1],c->argv[2],c->argv[j],nack);
             server.dirty++;
         }
     }
@@ -2103,6 +2363,169 @@ void xclaimCommand(client *c) {
     preventCommandPropagation(c);
 }
 
+/* XAUTOCLAIM <key> <group> <consumer> <min-idle-time> <start>
+ *            [COUNT <count>] [JUSTID]
+ *
+ * Claim the pending messages of the group that were not delivered for at
+ * least <min-idle-time> milliseconds, transferring them to <consumer> like
+ * XCLAIM does. Instead of requiring the caller to find the IDs with XPENDING
+ * and to check the idle time of every entry of the PEL:
+ *
+ * - The delivery time index of the group tells in O(1) if any message is
+ *   idle enough, so that polling a PEL with nothing to claim is cheap.
+ * - Otherwise the PEL is walked in ID order starting at <start>, looking at
+ *   no more than COUNT*10 entries per call.
+ *
+ * Either way the cost is O(log(N) + COUNT) whatever the size of the PEL is.
+ * Only messages having an ID greater or equal than <start> are claimed.
+ * COUNT defaults to 100.
+ *
+ * Unless JUSTID is given the delivery counter of the claimed messages is
+ * incremented, since they are delivered again to the new consumer.
+ *
+ * The reply is a two elements array: the <start> to use in order to claim
+ * more messages, or 0-0 if the end of the PEL was reached or no message is
+ * idle enough, and the claimed
+ * messages in the same format of XCLAIM. Messages that are pending but no
+ * longer exist in the stream are reported with a null entry, like XREADGROUP
+ * does when serving the consumer history. */
+void xautoclaimCommand(client *c) {
+    streamCG *group = NULL;
+    robj *o = lookupKeyRead(c->db,c->argv[1]);
+    long long minidle; /* Minimum idle time argument. */
+    long long count = 100;
+    streamID startid, zeroid = {0,0};
+    int justid = 0;
+
+    if (o) {
+        if (checkType(c,o,OBJ_STREAM)) return; /* Type error. */
+        group = streamLookupCG(o->ptr,c->argv[2]->ptr);
+    }
+
+    /* No key or group? Send an error given that the group creation
+     * is mandatory. */
+    if (o == NULL || group == NULL) {
+        addReplyErrorFormat(c,"-NOGROUP No such key '%s' or "
+                              "consumer group '%s'", (char*)c->argv[1]->ptr,
+                              (char*)c->argv[2]->ptr);
+        return;
+    }
+
+    if (getLongLongFromObjectOrReply(c,c->argv[4],&minidle,
+        "Invalid min-idle-time argument for XAUTOCLAIM")
+        != C_OK) return;
+    if (minidle < 0) minidle = 0;
+    if (streamParseIDOrReply(c,c->argv[5],&startid,0) != C_OK) return;
+
+    for (int j = 6; j < c->argc; j++) {
+        int moreargs = (c->argc-1) - j; /* Number of additional arguments. */
+        char *opt = c->argv[j]->ptr;
+        if (!strcasecmp(opt,"COUNT") && moreargs) {
+            j++;
+            if (getLongLongFromObjectOrReply(c,c->argv[j],&count,
+                "Invalid COUNT option argument for XAUTOCLAIM")
+                != C_OK) return;
+            if (count <= 0) {
+                addReplyError(c,"COUNT must be > 0");
+                return;
+            }
+        } else if (!strcasecmp(opt,"JUSTID")) {
+            justid = 1;
+        } else {
+            addReplyErrorFormat(c,"Unrecognized XAUTOCLAIM option '%s'",opt);
+            return;
+        }
+    }
+
+    /* Collect the IDs to claim first, since claiming an entry moves it
+     * in the index we are iterating. */
+    mstime_t now = mstime();
+    unsigned char startkey[sizeof(streamID)];
+    streamID *ids = NULL;
+    long long numids = 0, idslen = 0;
+    raxIterator ri;
+
+    streamID nextid = zeroid;
+
+    /* The delivery time index tells if any entry is idle enough: when the
+     * oldest delivery is not, there is nothing to claim whatever <start>
+     * is, and the PEL is not scanned at all. */
+    int idle = 0;
+    raxStart(&ri,group->pel_by_time);
+    raxSeek(&ri,"^",NULL,0);
+    if (raxNext(&ri)) {
+        uint64_t t;
+        memcpy(&t,ri.key,sizeof(t));
+        idle = now - (mstime_t)ntohu64(t) >= minidle;
+    }
+    raxStop(&ri);
+
+    /* Otherwise walk in ID order from <start>, with a bounded number of
+     * entries looked at per call: the cursor is the first entry not looked
+     * at, so that paging with the returned cursor visits every entry once.
+     * Walking by delivery time instead would not work, since claimed
+     * entries move to the end of that index. */
+    if (idle) {
+        long long attempts = count > LLONG_MAX/10 ? LLONG_MAX : count*10;
+
+        streamEncodeID(startkey,&startid);
+        raxStart(&ri,group->pel);
+        raxSeek(&ri,">=",startkey,sizeof(startkey));
+        while (raxNext(&ri)) {
+            streamNACK *nack = ri.data;
+
+            if (numids == count || attempts-- == 0) {
+                streamDecodeID(ri.key,&nextid);
+                break;
+            }
+            if (now - nack->delivery_time < minidle) continue;
+            if (numids == idslen) {
+                idslen = idslen ? idslen*2 : 16;
+                ids = zrealloc(ids,sizeof(streamID)*idslen);
+            }
+            streamDecodeID(ri.key,&ids[numids++]);
+        }
+        raxStop(&ri);
+    }
+
+    /* Do the actual claiming. */
+    streamConsumer *consumer = streamLookupConsumer(group,c->argv[3]->ptr,1);
+    addReplyMultiBulkLen(c,2);
+    addReplyStreamID(c,&nextid);
+    addReplyMultiBulkLen(c,numids);
+    for (long long j = 0; j < numids; j++) {
+        streamID *id = ids+j;
+        unsigned char buf[sizeof(streamID)];
+        streamEncodeID(buf,id);
+
+        streamNACK *nack = raxFind(group->pel,buf,sizeof(buf));
+        serverAssert(nack != raxNotFound);
+        raxRemove(nack->consumer->pel,buf,sizeof(buf),NULL);
+        nack->consumer = consumer;
+        streamSetNACKDeliveryTime(group,buf,nack,now);
+        if (!justid) nack->delivery_count++;
+        raxInsert(consumer->pel,buf,sizeof(buf),nack,NULL);
+
+        if (justid) {
+            addReplyStreamID(c,id);
+        } else if (streamReplyWithRange(c,o->ptr,id,id,1,0,NULL,NULL,
+                                        STREAM_RWR_RAWENTRIES,NULL) == 0)
+        {
+            addReplyMultiBulkLen(c,2);
+            addReplyStreamID(c,id);
+            addReply(c,shared.nullmultibulk);
+        }
+
+        /* Propagate this change. */
+        robj *idarg = createObjectFromStreamID(id);
+        streamPropagateXCLAIM(c,c->argv[1],c->argv[2],idarg,nack);
+        decrRefCount(idarg);
+        server.dirty++;
+    }
+    zfree(ids);
+    preventCommandPropagation(c);
+}
+
 
 /* XDEL <key> [<ID1> <ID2> ... <IDN>]
  *
@@ -2144,10 +2567,14 @@ void xdelCommand(client *c) {
  *                             the specified length. Use ~ before the
  *                             count in order to demand approximated trimming
  *                             (like XADD MAXLEN option).
+ * MINID [~] <id>           -- Trim the entries with an ID smaller than the
+ *                             specified one. Use ~ in order to only remove
+ *                             whole radix tree nodes (like XADD MINID).
  */
 
 #define TRIM_STRATEGY_NONE 0
 #define TRIM_STRATEGY_MAXLEN 1
+#define TRIM_STRATEGY_MINID 2
 void xtrimCommand(client *c) {
     robj *o;
 
@@ -2162,6 +2589,9 @@ void xtrimCommand(client *c) {
     long long maxlen = 0;   /* 0 means no maximum length. */
     int approx_maxlen = 0;  /* If 1 only delete whole radix tree nodes, so
                                the maxium length is not applied verbatim. */
+    streamID minid;
+    int approx_minid = 0;   /* Like approx_maxlen, for MINID. */
+    int minid_tilde_idx = 0; /* Index of the "~" in MINID, for rewriting. */
 
     /* Parse options. */
     int i = 2; /* Start of options. */
@@ -2169,6 +2599,7 @@ void xtrimCommand(client *c) {
         int moreargs = (c->argc-1) - i; /* Number of additional arguments. */
         char *opt = c->argv[i]->ptr;
         if (!strcasecmp(opt,"maxlen") && moreargs) {
+            if (trim_strategy == TRIM_STRATEGY_MINID) goto both_strategies;
             trim_strategy = TRIM_STRATEGY_MAXLEN;
             char *next = c->argv[i+1]->ptr;
             /* Check for the form MAXLEN ~ <count>. */
@@ -2179,6 +2610,18 @@ void xtrimCommand(client *c) {
             if (getLongLongFromObjectOrReply(c,c->argv[i+1],&maxlen,NULL)
                 != C_OK) return;
             i++;
+        } else if (!strcasecmp(opt,"minid") && moreargs) {
+            if (trim_strategy == TRIM_STRATEGY_MAXLEN) goto both_strategies;
+            trim_strategy = TRIM_STRATEGY_MINID;
+            char *next = c->argv[i+1]->ptr;
+            /* Check for the form MINID ~ <id>. */
+            if (moreargs >= 2 && next[0] == '~' && next[1] == '\0') {
+                approx_minid = 1;
+                minid_tilde_idx = i+1;
+                i++;
+            }
+            if (streamParseIDOrReply(c,c->argv[i+1],&minid,0) != C_OK) return;
+            i++;
         } else {
             addReply(c,shared.syntaxerr);
             return;
@@ -2189,6 +2632,8 @@ void xtrimCommand(client *c) {
     int64_t deleted = 0;
     if (trim_strategy == TRIM_STRATEGY_MAXLEN) {
         deleted = streamTrimByLength(s,maxlen,approx_maxlen);
+    } else if (trim_strategy == TRIM_STRATEGY_MINID) {
+        deleted = streamTrimByID(s,&minid,approx_minid);
     } else {
         addReplyError(c,"XTRIM called without an option to trim the stream");
         return;
@@ -2199,8 +2644,16 @@ void xtrimCommand(client *c) {
         signalModifiedKey(c->db,c->argv[1]);
         notifyKeyspaceEvent(NOTIFY_STREAM,"xtrim",c->argv[1],c->db->id);
         server.dirty += deleted;
+        /* See the same rewrite in xaddCommand(). */
+        if (approx_minid) streamRewriteApproxMinID(c,s,minid_tilde_idx,&minid);
     }
     addReplyLongLong(c,deleted);
+    return;
+
+both_strategies:
+    /* Like XADD, only one trimming strategy can be given. */
+    addReplyError(c,"MAXLEN and MINID options can't be used at the "
+                    "same time");
 }
 
 /* XINFO CONSUMERS key group
@@ -1602,7 +1602,7 @@ void zaddGenericCommand(client *c, int flags) {
     /* Start parsing all the scores, we need to emit any syntax error
      * before executing additions to the sorted set, as the command should
      * either execute fully or nothing at all. */
-    scores = zmalloc(sizeof(double) * elements);
+    scores = cmdArenaAlloc(sizeof(double) * elements);
     for (j = 0; j < elements; j++) {
         if (getDoubleFromObjectOrReply(c, c->argv[scoreidx + j * 2], &scores[j], NULL)
             != C_OK)
@@ -1656,7 +1656,6 @@ void zaddGenericCommand(client *c, int flags) {
     }
 
     cleanup:
-    zfree(scores);
     if (added || updated) {
         signalModifiedKey(c->db, key);
         notifyKeyspaceEvent(NOTIFY_ZSET,
@@ -2223,12 +2222,11 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
     }
 
     /* read keys to be used for input */
-    src = zcalloc(sizeof(zsetopsrc) * setnum);
+    src = cmdArenaCalloc(sizeof(zsetopsrc) * setnum);
     for (i = 0, j = 3; i < setnum; i++, j++) {
         robj *obj = lookupKeyWrite(c->db, c->argv[j]);
         if (obj != NULL) {
             if (obj->type != OBJ_ZSET && obj->type != OBJ_SET) {
-                zfree(src);
                 addReply(c, shared.wrongtypeerr);
                 return;
             }
@@ -2256,7 +2254,6 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
                 for (i = 0; i < setnum; i++, j++, remaining--) {
                     if (getDoubleFromObjectOrReply(c, c->argv[j], &src[i].weight,
                                                    "weight value is not a float") != C_OK) {
-                        zfree(src);
                         return;
                     }
                 }
@@ -2271,14 +2268,12 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
                 } else if (!strcasecmp(c->argv[j]->ptr, "max")) {
                     aggregate = REDIS_AGGR_MAX;
                 } else {
-                    zfree(src);
                     addReply(c, shared.syntaxerr);
                     return;
                 }
                 j++;
                 remaining--;
             } else {
-                zfree(src);
                 addReply(c, shared.syntaxerr);
                 return;
             }
@@ -2417,7 +2412,6 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
             server.dirty++;
         }
     }
-    zfree(src);
 }
 
 void zunionstoreCommand(client *c) {
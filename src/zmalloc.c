@@ -28,6 +28,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "fmacros.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -42,6 +43,7 @@ void zlibc_free(void *ptr) {
 
 #include <string.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include "config.h"
 #include "zmalloc.h"
 #include "atomicvar.h"
@@ -220,6 +222,214 @@ void zmalloc_set_oom_handler(void (*oom_handler)(size_t)) {
     zmalloc_oom_handler = oom_handler;
 }
 
+/* Arena allocator. Allocations are carved sequentially from blocks obtained
+ * with zmalloc() and can't be freed one by one: the user takes a mark with
+ * zarenaGetMark() and later calls zarenaRelease() to free everything that
+ * was allocated after the mark. Marks can be nested, like stack frames.
+ * This turns many malloc()/free() pairs of allocations living for a short,
+ * well defined time into pointer increments.
+ *
+ * The first block is never released, so an arena that never needs more
+ * than 'block_size' bytes does no malloc() at all after zarenaInit().
+ * Allocations bigger than half a block get a block of their own. */
+#define ZARENA_ALIGN 16
+
+void zarenaInit(zarena *a, size_t block_size) {
+    a->block_size = block_size;
+    a->cur = zmalloc(sizeof(zarenaBlock)+block_size);
+    a->cur->prev = NULL;
+    a->cur->size = block_size;
+    a->cur->used = 0;
+}
+
+/* Return the padding needed to align the next allocation of block 'b'. */
+static size_t zarenaPadding(zarenaBlock *b) {
+    return (ZARENA_ALIGN - ((uintptr_t)(b->data + b->used) & (ZARENA_ALIGN-1))) &
+           (ZARENA_ALIGN-1);
+}
+
+void *zarenaAlloc(zarena *a, size_t size) {
+    zarenaBlock *b = a->cur;
+    size_t pad = zarenaPadding(b);
+    void *p;
+
+    if (b->used + pad + size > b->size) {
+        size_t bsize = size > a->block_size/2 ? size : a->block_size;
+
+        bsize += ZARENA_ALIGN; /* Room for the padding. */
+        b = zmalloc(sizeof(zarenaBlock)+bsize);
+        b->prev = a->cur;
+        b->size = bsize;
+        b->used = 0;
+        a->cur = b;
+        pad = zarenaPadding(b);
+    }
+    p = b->data + b->used + pad;
+    b->used += pad + size;
+    return p;
+}
+
+void *zarenaCalloc(zarena *a, size_t size) {
+    void *p = zarenaAlloc(a,size);
+
+    memset(p,0,size);
+    return p;
+}
+
+zarenaMark zarenaGetMark(zarena *a) {
+    zarenaMark mark = {a->cur, a->cur->used};
+    return mark;
+}
+
+/* Free all the allocations made after 'mark' was taken. */
+void zarenaRelease(zarena *a, zarenaMark mark) {
+    while (a->cur != mark.block) {
+        zarenaBlock *prev = a->cur->prev;
+
+        zfree(a->cur);
+        a->cur = prev;
+    }
+    a->cur->used = mark.used;
+}
+
+/* Huge page backed tables.
+ *
+ * The bucket arrays of big dictionaries, the keyspace above all, are accessed
+ * at random, so with 4k pages most lookups in a big database also miss the
+ * TLB. When enabled with zmalloc_set_huge_pages(), tables of ZMALLOC_HUGE_MIN
+ * bytes or more are mapped directly, aligned to the huge page size, trying
+ * first the hugetlbfs pages reserved by the administrator (MAP_HUGETLB) and
+ * then asking for transparent huge pages with madvise(), which works when THP
+ * is set to "madvise" or "always". Smaller tables, and all the tables when
+ * the feature is off, are allocated with zcalloc().
+ *
+ * The mappings are few, since each one is at least ZMALLOC_HUGE_MIN bytes, so
+ * they are kept in a list that zfree_huge() searches only for big sizes: this
+ * way the feature can be toggled at runtime without adding a header that
+ * would waste most of an huge page. The list is protected by a mutex since
+ * the tables may be freed by the lazyfree thread. */
+#define ZHUGE_THP 1             /* mmap() + madvise(MADV_HUGEPAGE). */
+#define ZHUGE_HUGETLB 2         /* mmap() with MAP_HUGETLB. */
+
+typedef struct zhugeMapping {
+    void *ptr;
+    size_t len;                 /* Length of the mapping. */
+    int type;                   /* ZHUGE_* */
+    struct zhugeMapping *next;
+} zhugeMapping;
+
+static int zmalloc_huge_pages = 0;
+static zhugeMapping *huge_mappings = NULL;
+static size_t huge_count = 0;
+static size_t huge_bytes = 0;
+static size_t huge_hugetlb_bytes = 0;
+static pthread_mutex_t huge_mappings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void zmalloc_set_huge_pages(int enabled) {
+    zmalloc_huge_pages = enabled;
+}
+
+/* Map 'len' bytes aligned to ZMALLOC_HUGE_MIN, setting '*type' to the kind
+ * of pages obtained and '*len' to the length of the mapping. Returns NULL if
+ * the memory can't be mapped. */
+static void *zhugeMap(size_t *len, int *type) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    size_t maplen = (*len + ZMALLOC_HUGE_MIN - 1) & ~((size_t)ZMALLOC_HUGE_MIN - 1);
+    char *p, *aligned;
+
+#ifdef MAP_HUGETLB
+    p = mmap(NULL,maplen,PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    if (p != MAP_FAILED) {
+        *len = maplen;
+        *type = ZHUGE_HUGETLB;
+        return p;
+    }
+#endif
+    /* Map an extra huge page and trim the mapping so that it starts at
+     * an huge page boundary, otherwise THP could not back its first and
+     * last part. */
+    p = mmap(NULL,maplen+ZMALLOC_HUGE_MIN,PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (p == MAP_FAILED) return NULL;
+    aligned = (char*)(((uintptr_t)p + ZMALLOC_HUGE_MIN - 1) &
+                      ~((uintptr_t)ZMALLOC_HUGE_MIN - 1));
+    if (aligned != p) munmap(p,aligned-p);
+    if (aligned+maplen != p+maplen+ZMALLOC_HUGE_MIN)
+        munmap(aligned+maplen,(p+maplen+ZMALLOC_HUGE_MIN)-(aligned+maplen));
+    madvise(aligned,maplen,MADV_HUGEPAGE);
+    *len = maplen;
+    *type = ZHUGE_THP;
+    return aligned;
+#else
+    ((void) len);
+    ((void) type);
+    return NULL;
+#endif
+}
+
+/* Like zcalloc(), but the memory must be released with zfree_huge(). */
+void *zcalloc_huge(size_t size) {
+    zhugeMapping *m;
+    size_t len = size;
+    int type;
+    void *ptr;
+
+    if (size < ZMALLOC_HUGE_MIN || !zmalloc_huge_pages ||
+        (ptr = zhugeMap(&len,&type)) == NULL) return zcalloc(size);
+
+    /* Anonymous mappings are already zeroed. */
+    m = zmalloc(sizeof(*m));
+    m->ptr = ptr;
+    m->len = len;
+    m->type = type;
+    update_zmalloc_stat_alloc(len);
+    pthread_mutex_lock(&huge_mappings_mutex);
+    m->next = huge_mappings;
+    huge_mappings = m;
+    huge_count++;
+    huge_bytes += len;
+    if (type == ZHUGE_HUGETLB) huge_hugetlb_bytes += len;
+    pthread_mutex_unlock(&huge_mappings_mutex);
+    return ptr;
+}
+
+void zfree_huge(void *ptr, size_t size) {
+    zhugeMapping **link, *m = NULL;
+
+    if (ptr == NULL) return;
+    if (size >= ZMALLOC_HUGE_MIN) {
+        pthread_mutex_lock(&huge_mappings_mutex);
+        for (link = &huge_mappings; *link; link = &(*link)->next) {
+            if ((*link)->ptr != ptr) continue;
+            m = *link;
+            *link = m->next;
+            huge_count--;
+            huge_bytes -= m->len;
+            if (m->type == ZHUGE_HUGETLB) huge_hugetlb_bytes -= m->len;
+            break;
+        }
+        pthread_mutex_unlock(&huge_mappings_mutex);
+    }
+    if (m == NULL) {
+        zfree(ptr);
+        return;
+    }
+    update_zmalloc_stat_free(m->len);
+    munmap(m->ptr,m->len);
+    zfree(m);
+}
+
+/* Report the number of tables mapped by zcalloc_huge() and their size, and
+ * how many of these bytes are hugetlbfs pages. */
+void zmalloc_get_huge_stats(size_t *count, size_t *bytes, size_t *hugetlb_bytes) {
+    pthread_mutex_lock(&huge_mappings_mutex);
+    *count = huge_count;
+    *bytes = huge_bytes;
+    *hugetlb_bytes = huge_hugetlb_bytes;
+    pthread_mutex_unlock(&huge_mappings_mutex);
+}
+
 /* Get the RSS information in an OS-specific way.
  *
  * WARNING: the function zmalloc_get_rss() is not designed to be fast
@@ -320,6 +530,46 @@ int zmalloc_get_allocator_info(size_t *allocated,
     je_mallctl("stats.allocated", allocated, &sz, NULL, 0);
     return 1;
 }
+
+/* Get the utilization of the jemalloc bins (the small size classes) merged
+ * across all the arenas: for the first 'maxbins' bins, the size of the
+ * regions, the regions in use and the regions of the slabs currently
+ * allocated, that are in use or free. Returns the number of bins reported,
+ * or 0 if the statistics are not available.
+ *
+ * This is safe to call from threads other than the main one, mallctl() is
+ * thread safe. The statistics are refreshed by this function. */
+int zmalloc_get_allocator_bins(size_t *size, size_t *curregs,
+                               size_t *totregs, int maxbins) {
+    uint64_t epoch = 1;
+    unsigned nbins, j;
+    uint32_t nregs;
+    size_t sz, curslabs;
+    char name[128];
+
+    sz = sizeof(epoch);
+    if (je_mallctl("epoch", &epoch, &sz, &epoch, sz)) return 0;
+    sz = sizeof(nbins);
+    if (je_mallctl("arenas.nbins", &nbins, &sz, NULL, 0)) return 0;
+    if (nbins > (unsigned)maxbins) nbins = maxbins;
+    for (j = 0; j < nbins; j++) {
+        sz = sizeof(size_t);
+        snprintf(name,sizeof(name),"arenas.bin.%u.size",j);
+        if (je_mallctl(name, &size[j], &sz, NULL, 0)) return 0;
+        sz = sizeof(nregs);
+        snprintf(name,sizeof(name),"arenas.bin.%u.nregs",j);
+        if (je_mallctl(name, &nregs, &sz, NULL, 0)) return 0;
+        sz = sizeof(size_t);
+        snprintf(name,sizeof(name),"stats.arenas.%u.bins.%u.curregs",
+            MALLCTL_ARENAS_ALL,j);
+        if (je_mallctl(name, &curregs[j], &sz, NULL, 0)) return 0;
+        snprintf(name,sizeof(name),"stats.arenas.%u.bins.%u.curslabs",
+            MALLCTL_ARENAS_ALL,j);
+        if (je_mallctl(name, &curslabs, &sz, NULL, 0)) return 0;
+        totregs[j] = curslabs*nregs;
+    }
+    return nbins;
+}
 #else
 int zmalloc_get_allocator_info(size_t *allocated,
                                size_t *active,
@@ -327,6 +577,15 @@ int zmalloc_get_allocator_info(size_t *allocated,
     *allocated = *resident = *active = 0;
     return 1;
 }
+
+int zmalloc_get_allocator_bins(size_t *size, size_t *curregs,
+                               size_t *totregs, int maxbins) {
+    ((void) size);
+    ((void) curregs);
+    ((void) totregs);
+    ((void) maxbins);
+    return 0;
+}
 #endif
 
 /* Get the sum of the specified field (converted form kb to bytes) in
@@ -375,6 +634,57 @@ size_t zmalloc_get_smap_bytes_by_field(char *field, long pid) {
 }
 #endif
 
+/* Fill bytes[0..maxnodes-1] with the resident memory of the process placed
+ * on each NUMA node, according to /proc/self/numa_maps. Returns the number
+ * of nodes found, or -1 if the information is not available.
+ *
+ * WARNING: the kernel walks the page tables of the whole process to produce
+ * numa_maps, so this is as slow as zmalloc_get_smap_bytes_by_field(). */
+#if defined(HAVE_PROC_NUMA_MAPS)
+int zmalloc_get_numa_bytes(size_t *bytes, int maxnodes) {
+    char line[4096];
+    int j, nodes = 0;
+    FILE *fp = fopen("/proc/self/numa_maps","r");
+
+    if (!fp) return -1;
+    for (j = 0; j < maxnodes; j++) bytes[j] = 0;
+    while(fgets(line,sizeof(line),fp) != NULL) {
+        size_t pages[64], pagesize = 4096;
+        int seen[64] = {0};
+        char *tok = line;
+
+        /* Tokens are separated by spaces: "N1=123" are the pages on node 1. */
+        while (tok && *tok) {
+            if (tok[0] == 'N' && tok[1] >= '0' && tok[1] <= '9') {
+                char *eq;
+                long node = strtol(tok+1,&eq,10);
+
+                if (*eq == '=' && node < maxnodes && node < 64) {
+                    pages[node] = strtoull(eq+1,NULL,10);
+                    seen[node] = 1;
+                }
+            } else if (!strncmp(tok,"kernelpagesize_kB=",18)) {
+                pagesize = strtoull(tok+18,NULL,10)*1024;
+            }
+            if ((tok = strchr(tok,' ')) != NULL) tok++;
+        }
+        for (j = 0; j < maxnodes && j < 64; j++) {
+            if (!seen[j]) continue;
+            bytes[j] += pages[j]*pagesize;
+            if (j >= nodes) nodes = j+1;
+        }
+    }
+    fclose(fp);
+    return nodes;
+}
+#else
+int zmalloc_get_numa_bytes(size_t *bytes, int maxnodes) {
+    ((void) bytes);
+    ((void) maxnodes);
+    return -1;
+}
+#endif
+
 size_t zmalloc_get_private_dirty(long pid) {
     return zmalloc_get_smap_bytes_by_field("Private_Dirty:",pid);
 }
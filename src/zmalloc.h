@@ -86,11 +86,46 @@ size_t zmalloc_used_memory(void);
 void zmalloc_set_oom_handler(void (*oom_handler)(size_t));
 size_t zmalloc_get_rss(void);
 int zmalloc_get_allocator_info(size_t *allocated, size_t *active, size_t *resident);
+int zmalloc_get_allocator_bins(size_t *size, size_t *curregs, size_t *totregs, int maxbins);
 size_t zmalloc_get_private_dirty(long pid);
 size_t zmalloc_get_smap_bytes_by_field(char *field, long pid);
 size_t zmalloc_get_memory_size(void);
 void zlibc_free(void *ptr);
 
+/* A bump allocator for short lived allocations, released all together up to
+ * a mark previously taken with zarenaGetMark(). See zmalloc.c. */
+typedef struct zarenaBlock {
+    struct zarenaBlock *prev;   /* Previous block, NULL for the first one. */
+    size_t size;                /* Usable bytes in data[]. */
+    size_t used;                /* Bytes of data[] already allocated. */
+    char data[];
+} zarenaBlock;
+
+typedef struct zarena {
+    zarenaBlock *cur;           /* Block serving the allocations. */
+    size_t block_size;          /* Size of the blocks, but for big allocations. */
+} zarena;
+
+typedef struct zarenaMark {
+    zarenaBlock *block;
+    size_t used;
+} zarenaMark;
+
+void zarenaInit(zarena *a, size_t block_size);
+void *zarenaAlloc(zarena *a, size_t size);
+void *zarenaCalloc(zarena *a, size_t size);
+zarenaMark zarenaGetMark(zarena *a);
+void zarenaRelease(zarena *a, zarenaMark mark);
+
+/* Allocations of big tables that may be backed by huge pages, see zmalloc.c.
+ * The size must be passed again to zfree_huge(). */
+#define ZMALLOC_HUGE_MIN (2*1024*1024)
+void zmalloc_set_huge_pages(int enabled);
+void *zcalloc_huge(size_t size);
+void zfree_huge(void *ptr, size_t size);
+void zmalloc_get_huge_stats(size_t *count, size_t *bytes, size_t *hugetlb_bytes);
+int zmalloc_get_numa_bytes(size_t *bytes, int maxnodes);
+
 #ifdef HAVE_DEFRAG
 void zfree_no_tcache(void *ptr);
 void *zmalloc_no_tcache(size_t size);
@@ -0,0 +1,100 @@
+# Test CLUSTER MIGRATESLOT, moving a slot to another master in background
+# while clients keep writing to it.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 2 nodes cluster" {
+    create_cluster 2 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+# Find a hash tag served by instance #0.
+set tag {}
+for {set j 0} {$j < 1000} {incr j} {
+    set slot [R 0 cluster keyslot "{t$j}"]
+    if {[R 0 cluster countkeysinslot $slot] == 0 &&
+        [catch {R 0 get "{t$j}"}] == 0} {
+        set tag "{t$j}"
+        break
+    }
+}
+set src_id [dict get [get_myself 0] id]
+set dst_id [dict get [get_myself 1] id]
+
+test "Populate the slot to migrate" {
+    assert {$tag ne {}}
+    for {set j 0} {$j < 5000} {incr j} {
+        R 0 set $tag:string:$j $j
+    }
+    for {set j 0} {$j < 100} {incr j} {
+        R 0 rpush $tag:list:$j a b c
+        R 0 hset $tag:hash:$j field $j
+    }
+    R 0 set $tag:volatile foo px 100000
+    for {set j 0} {$j < 20000} {incr j} {
+        R 0 sadd $tag:bigset $j
+    }
+    assert {[R 0 cluster countkeysinslot $slot] == 5202}
+}
+
+test "MIGRATESLOT requires the slot to be migrating" {
+    catch {R 0 cluster migrateslot $slot} err
+    assert_match {*not in migrating state*} $err
+    catch {R 1 cluster migrateslot $slot} err
+    assert_match {*not the owner*} $err
+}
+
+test "MIGRATESLOT moves the slot while it is being written" {
+    R 1 cluster setslot $slot importing $src_id
+    R 0 cluster setslot $slot migrating $dst_id
+    R 0 cluster migrateslot $slot
+
+    # Keep modifying keys while the migration is running: the writes must
+    # reach the target, either because the key was still local and was
+    # sent again, or following the ASK redirection.
+    set written 0
+    while {[dict get [lindex [R 0 cluster migrateslot status] 0] state]
+           eq {streaming}} {
+        set k $tag:string:[expr {$written % 5000}]
+        if {[catch {R 0 incr $k} err]} {
+            assert_match {ASK*} $err
+            R 1 asking
+            R 1 incr $k
+        }
+        incr written
+    }
+
+    wait_for_condition 1000 50 {
+        [dict get [lindex [R 0 cluster migrateslot status] 0] state] eq {done}
+    } else {
+        fail "Slot migration didn't complete"
+    }
+    set status [lindex [R 0 cluster migrateslot status] 0]
+    assert {[dict get $status keys-migrated] >= 5202}
+    assert {[dict get $status error] eq {}}
+    assert {[R 0 cluster countkeysinslot $slot] == 0}
+    assert {[R 1 cluster countkeysinslot $slot] == 5202}
+    catch {R 0 get $tag:string:0} err
+    assert_match "MOVED $slot *:[get_instance_attrib redis 1 port]" $err
+    set incremented $written
+}
+
+test "Migrated keys are served by the target with their values" {
+    set sum 0
+    for {set j 0} {$j < 5000} {incr j} {
+        incr sum [expr {[R 1 get $tag:string:$j] - $j}]
+    }
+    assert {$sum == $incremented}
+    assert {[R 1 lrange $tag:list:42 0 -1] eq {a b c}}
+    assert {[R 1 hget $tag:hash:42 field] == 42}
+    assert {[R 1 scard $tag:bigset] == 20000}
+    assert {[R 1 pttl $tag:volatile] > 0}
+}
+
+test "MIGRATESLOT CANCEL forgets the migration" {
+    R 0 cluster migrateslot cancel $slot
+    assert {[R 0 cluster migrateslot status] eq {}}
+}
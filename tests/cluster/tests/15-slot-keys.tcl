@@ -0,0 +1,54 @@
+# Check the keys -> slot index used by COUNTKEYSINSLOT / GETKEYSINSLOT.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 1 node cluster" {
+    create_cluster 1 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+set slot [R 0 cluster keyslot "{s}"]
+
+test "Keys are indexed by slot" {
+    for {set j 0} {$j < 1000} {incr j} {
+        R 0 set "{s}:$j" $j
+        R 0 set "other:$j" $j
+    }
+    assert {[R 0 cluster countkeysinslot $slot] == 1000}
+    set keys [R 0 cluster getkeysinslot $slot 2000]
+    assert {[llength $keys] == 1000}
+    foreach k $keys {assert_match "{s}:*" $k}
+    assert {[llength [R 0 cluster getkeysinslot $slot 10]] == 10}
+}
+
+test "Deleted and expired keys leave the index" {
+    for {set j 0} {$j < 500} {incr j} {
+        R 0 del "{s}:$j"
+    }
+    R 0 pexpire "{s}:500" 1
+    after 10
+    R 0 get "{s}:500"
+    assert {[R 0 cluster countkeysinslot $slot] == 499}
+    for {set j 501} {$j < 1000} {incr j} {
+        R 0 unlink "{s}:$j"
+    }
+    assert {[R 0 cluster countkeysinslot $slot] == 0}
+    assert {[R 0 cluster getkeysinslot $slot 10] eq {}}
+}
+
+test "The index survives a reload and is emptied by FLUSHALL" {
+    for {set j 0} {$j < 100} {incr j} {
+        R 0 set "{s}:$j" $j
+    }
+    R 0 debug reload
+    assert {[R 0 cluster countkeysinslot $slot] == 100}
+    R 0 flushall async
+    assert {[R 0 cluster countkeysinslot $slot] == 0}
+    R 0 set "{s}:0" 0
+    R 0 flushall
+    assert {[R 0 cluster countkeysinslot $slot] == 0}
+    assert {[R 0 dbsize] == 0}
+}
@@ -0,0 +1,62 @@
+# Check the compact PING / PONG messages of the cluster bus.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 3 nodes cluster" {
+    create_cluster 3 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+test "Nodes exchange compact PING / PONG" {
+    wait_for_condition 1000 50 {
+        [CI 0 cluster_stats_compact_sent] > 0 &&
+        [CI 0 cluster_stats_compact_received] > 0
+    } else {
+        fail "No compact message exchanged"
+    }
+    assert {[CI 0 cluster_stats_bytes_sent] > 0}
+    assert {[CI 0 cluster_stats_bytes_received] > 0}
+    assert {[CI 0 cluster_stats_bytes_ping_sent] > 0}
+}
+
+# Return the port of the instance 'id' thinks is serving 'key'.
+proc key_owner_port {id key} {
+    if {[catch {R $id get $key} e]} {
+        return [lindex [split [lindex $e 2] :] 1]
+    }
+    return [get_instance_attrib redis $id port]
+}
+
+test "Slots changes still propagate" {
+    set key "{compact}"
+    set owner [get_instance_id_by_port redis [key_owner_port 0 $key]]
+    set target [expr {($owner + 1) % 3}]
+    set target_id [dict get [get_myself $target] id]
+    R $target cluster bumpepoch
+    R $target cluster setslot [R 0 cluster keyslot $key] node $target_id
+    set port [get_instance_attrib redis $target port]
+    for {set id 0} {$id < 3} {incr id} {
+        wait_for_condition 1000 50 {
+            [key_owner_port $id $key] == $port
+        } else {
+            fail "Instance $id did not learn the new slot owner"
+        }
+    }
+    assert_cluster_state ok
+}
+
+test "Compact messages can be disabled" {
+    for {set id 0} {$id < 3} {incr id} {
+        R $id config set cluster-compact-bus no
+    }
+    set sent [CI 0 cluster_stats_compact_sent]
+    after 2000
+    assert {[CI 0 cluster_stats_compact_sent] == $sent}
+    assert_cluster_state ok
+    for {set id 0} {$id < 3} {incr id} {
+        R $id config set cluster-compact-bus yes
+    }
+}
@@ -251,6 +251,32 @@ tags {"aof"} {
         }
     }
 
+    ## Test that commands rewriting their argv are loaded correctly
+    create_aof {
+        append_to_aof [formatCommand sadd set a b c]
+        append_to_aof [formatCommand spop set 3]
+        append_to_aof [formatCommand sadd set d]
+        append_to_aof [formatCommand incrbyfloat float 1.5]
+        append_to_aof [formatCommand incrbyfloat float 1.5]
+    }
+
+    start_server_aof [list dir $server_path aof-load-truncated no] {
+        test "AOF+SPOP+INCRBYFLOAT: Server should have been started" {
+            assert_equal 1 [is_alive $srv]
+        }
+
+        test "AOF+SPOP+INCRBYFLOAT: Data should match" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            wait_for_condition 50 100 {
+                [catch {$client ping} e] == 0
+            } else {
+                fail "Loading DB is taking too much time."
+            }
+            assert_equal {d} [$client smembers set]
+            assert_equal 3 [$client get float]
+        }
+    }
+
     start_server {overrides {appendonly {yes} appendfilename {appendonly.aof}}} {
         test {Redis should not try to convert DEL into EXPIREAT for EXPIRE -1} {
             r set x 10
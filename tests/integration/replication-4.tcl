@@ -153,3 +153,200 @@ start_server {tags {"repl"}} {
         }
     }
 }
+
+start_server {tags {"repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        $master config set repl-backlog-size 1mb
+        $slave slaveof $master_host $master_port
+        wait_for_condition 50 100 {
+            [s 0 master_link_status] eq {up}
+        } else {
+            fail "Replication not started."
+        }
+
+        test {Slaves and backlog share the replication buffer} {
+            set payload [string repeat x 1000]
+            for {set j 0} {$j < 500} {incr j} {
+                $master set key:$j $payload
+            }
+            wait_for_condition 50 100 {
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Slave not in sync with the master"
+            }
+            # The stream is stored once, not once more for the slave.
+            set histlen [s -1 repl_backlog_histlen]
+            set backlog [dict get [$master memory stats] replication.backlog]
+            assert {$histlen > 500000}
+            assert {$backlog >= $histlen && $backlog < $histlen*2}
+        }
+
+        test {Resizing the backlog does not discard its history} {
+            set histlen [s -1 repl_backlog_histlen]
+            $master config set repl-backlog-size 2mb
+            assert_equal $histlen [s -1 repl_backlog_histlen]
+
+            $master config set repl-backlog-size 16kb
+            set histlen [s -1 repl_backlog_histlen]
+            assert {$histlen >= 16384 && $histlen < 100000}
+            assert_equal [expr {[s -1 master_repl_offset]-$histlen+1}] \
+                         [s -1 repl_backlog_first_byte_offset]
+
+            $master set foo bar
+            wait_for_condition 50 100 {
+                [$slave get foo] eq {bar}
+            } else {
+                fail "Slave not receiving writes after backlog resize"
+            }
+        }
+    }
+}
+
+start_server {tags {"repl"}} {
+    start_server {overrides {slave-io-thread yes}} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        $slave slaveof $master_host $master_port
+        wait_for_condition 50 100 {
+            [s 0 master_link_status] eq {up}
+        } else {
+            fail "Replication not started."
+        }
+
+        test {Slave IO thread reads the master stream} {
+            assert_equal 1 [s 0 slave_io_thread]
+            set load_handle [start_bg_complex_data $master_host $master_port 9 100000]
+            after 2000
+            $master multi
+            $master incr counter
+            $master incr counter
+            $master exec
+            $master eval {redis.call('incr','counter')} 0
+            stop_bg_complex_data $load_handle
+            wait_for_condition 50 100 {
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Slave not in sync with the master"
+            }
+            assert_equal 3 [$slave get counter]
+            wait_for_condition 50 100 {
+                [s 0 slave_apply_lag_bytes] == 0
+            } else {
+                fail "Slave apply lag not back to zero"
+            }
+            assert_equal [s -1 master_repl_offset] [s 0 slave_repl_offset]
+            assert_equal [s 0 slave_read_repl_offset] [s 0 slave_repl_offset]
+        }
+
+        test {Slave IO thread survives a partial resync} {
+            set sync_partial [s -1 sync_partial_ok]
+            $slave client kill type master
+            $master set after-psync foo
+            wait_for_condition 50 100 {
+                [$slave get after-psync] eq {foo}
+            } else {
+                fail "Slave not receiving writes after the link was killed"
+            }
+            assert_equal [expr {$sync_partial+1}] [s -1 sync_partial_ok]
+            assert_equal 1 [s 0 slave_io_thread]
+        }
+
+        start_server {} {
+            set subslave [srv 0 client]
+
+            test {Slave IO thread proxies the applied stream when the link drops} {
+                $subslave slaveof [srv -1 host] [srv -1 port]
+                wait_for_condition 50 100 {
+                    [s 0 master_link_status] eq {up}
+                } else {
+                    fail "Sub-slave replication not started."
+                }
+                set load_handle [start_bg_complex_data $master_host $master_port 9 100000]
+                for {set j 0} {$j < 5} {incr j} {
+                    after 300
+                    $slave client kill type master
+                }
+                stop_bg_complex_data $load_handle
+                wait_for_condition 50 100 {
+                    [$master debug digest] eq [$slave debug digest] &&
+                    [$slave debug digest] eq [$subslave debug digest]
+                } else {
+                    fail "Sub-slave not in sync with its master"
+                }
+                wait_for_condition 50 100 {
+                    [s -1 master_repl_offset] == [s 0 master_repl_offset]
+                } else {
+                    fail "Sub-slave offset differs from its master"
+                }
+            }
+        }
+    }
+}
+
+start_server {tags {"repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        test {First server should have role slave after SLAVEOF} {
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+        }
+
+        foreach {type entries} {ziplist 512 hashtable 1} {
+            test "Slave reports the expired fields of a $type hash as missing" {
+                $master debug set-active-expire 0
+                $master config set hash-max-ziplist-entries $entries
+                $master config set zset-max-ziplist-entries $entries
+                $slave config set zset-max-ziplist-entries $entries
+                $master del myhash
+                $master hset myhash a 1 b 2 c 3
+                $master hpexpire myhash 1000 FIELDS 2 a b
+                wait_for_condition 50 100 {
+                    [$slave hlen myhash] == 3
+                } else {
+                    fail "Hash not replicated"
+                }
+                after 1100
+                # The master did not delete the fields yet.
+                assert_equal {} [$slave hget myhash a]
+                assert_equal {{} {} 3} [$slave hmget myhash a b c]
+                assert_equal 0 [$slave hexists myhash b]
+                assert_equal 0 [$slave hstrlen myhash b]
+                assert_equal 1 [$slave hlen myhash]
+                assert_equal {c 3} [$slave hgetall myhash]
+                assert_equal {c} [$slave hkeys myhash]
+                assert_equal {3} [$slave hvals myhash]
+                assert_equal {c 3} [lindex [$slave hscan myhash 0] 1]
+                assert_equal {-2 -2 -1} [$slave httl myhash FIELDS 3 a b c]
+
+                # Once the master expires them the HDEL reaches the slave.
+                $master hget myhash a
+                wait_for_condition 50 100 {
+                    [$master debug digest] eq [$slave debug digest]
+                } else {
+                    fail "Expired fields not deleted on the slave"
+                }
+                assert_equal {c 3} [$slave hgetall myhash]
+                $master debug set-active-expire 1
+                $master config set hash-max-ziplist-entries 512
+                $master config set zset-max-ziplist-entries 128
+                $slave config set zset-max-ziplist-entries 128
+            }
+        }
+    }
+}
@@ -266,3 +266,71 @@ foreach dl {no yes} {
         }
     }
 }
+
+foreach mdl {no yes} {
+    foreach sdl {disabled on-empty-db swapdb} {
+        start_server {tags {"repl"}} {
+            set master [srv 0 client]
+            $master config set repl-diskless-sync $mdl
+            $master config set repl-diskless-sync-delay 0
+            set master_host [srv 0 host]
+            set master_port [srv 0 port]
+            $master debug populate 20000
+            $master select 9
+            createComplexDataset $master 1000
+            start_server {} {
+                set slave [srv 0 client]
+                test "Slave loads the master dataset, diskless=$mdl load=$sdl" {
+                    $slave config set repl-diskless-load $sdl
+                    $slave set stale:key 1
+                    $slave slaveof $master_host $master_port
+                    wait_for_condition 500 100 {
+                        [lindex [$slave role] 3] eq {connected}
+                    } else {
+                        fail "Slave still not connected after some time"
+                    }
+                    assert_equal [$master debug digest] [$slave debug digest]
+                    $slave select 9
+                    assert_equal 0 [$slave exists stale:key]
+                    assert_equal 0 [s 0 async_loading]
+                }
+            }
+        }
+    }
+}
+
+start_server {tags {"repl"}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+    $master config set repl-diskless-sync yes
+    $master config set repl-diskless-sync-delay 1
+    $master config set repl-diskless-sync-max-stall 1
+    $master debug populate 300000 key 100
+    start_server {} {
+        set slave [srv 0 client]
+        test {Diskless sync drops the slave that delays the others} {
+            # A fake slave that requests the RDB but never reads it.
+            set fd [socket $master_host $master_port]
+            fconfigure $fd -translation binary
+            puts -nonewline $fd "REPLCONF capa eof\r\n"
+            flush $fd
+            gets $fd
+            puts -nonewline $fd "PSYNC ? -1\r\n"
+            flush $fd
+            $slave slaveof $master_host $master_port
+            wait_for_condition 500 100 {
+                [lindex [$slave role] 3] eq {connected}
+            } else {
+                fail "Slave still not connected after some time"
+            }
+            assert_equal [$master debug digest] [$slave debug digest]
+            wait_for_condition 50 100 {
+                [s -1 connected_slaves] == 1
+            } else {
+                fail "The stalled slave was not dropped"
+            }
+            close $fd
+        }
+    }
+}
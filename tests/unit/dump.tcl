@@ -86,6 +86,24 @@ start_server {tags {"dump"}} {
         r dump nonexisting_key
     } {}
 
+    test {DUMP payloads carry RDB version 9} {
+        r del foo
+        r hset foo a 1 b 2
+        set encoded [r dump foo]
+        binary scan [string range $encoded end-9 end-8] s ver
+        set ver
+    } {9}
+
+    test {DUMP of a hash with field TTLs starts with the field expires opcode} {
+        r hexpireat foo 2000000000 FIELDS 1 a
+        set encoded [r dump foo]
+        binary scan [string index $encoded 0] cu opcode
+        binary scan [string range $encoded end-9 end-8] s ver
+        r del foo
+        r restore foo 0 $encoded
+        list $opcode $ver [r hexpiretime foo FIELDS 2 a b]
+    } {200 9 {2000000000 -1}}
+
     test {MIGRATE is caching connections} {
         # Note, we run this as first test so that the connection cache
         # is empty.
@@ -219,4 +219,59 @@ start_server {tags {"expire"}} {
         set ttl [r ttl foo]
         assert {$ttl <= 98 && $ttl > 90}
     }
+
+    test {Expire index reclaims expired keys among many persistent ones} {
+        r config set appendonly no
+        r flushall
+        r config set active-expire-index yes
+        for {set j 0} {$j < 1000} {incr j} {
+            r set persistent:$j x
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            r psetex volatile:$j [expr {100+$j}] x
+        }
+        # Random sampling would find ~2 expired keys every cycle here.
+        wait_for_condition 20 50 {
+            [r dbsize] == 1000
+        } else {
+            fail "Expired keys not reclaimed by the expire index"
+        }
+        assert {[s expire_index_backlog_ms] == 0}
+        assert {[s expired_lag_max_ms] >= 0}
+    }
+
+    test {Expire index follows EXPIRE updates, PERSIST and FLUSHALL ASYNC} {
+        r flushall async
+        r psetex a 100 x
+        r pexpire a 100000
+        r psetex b 100 x
+        r persist b
+        r psetex c 100000 x
+        r pexpire c 100
+        r set d x px 100
+        r set d x
+        wait_for_condition 20 50 {
+            [r dbsize] == 3
+        } else {
+            fail "Key with updated TTL not reclaimed"
+        }
+        list [expr {[r ttl a] > 90}] [r ttl b] [r exists c] [r ttl d]
+    } {1 -1 0 -1}
+
+    test {Expire index is built by CONFIG SET and loaded keys are indexed} {
+        r flushall
+        r config set active-expire-index no
+        r psetex x 200 v
+        r set y v
+        r config set active-expire-index yes
+        r psetex z 400 v
+        r debug reload
+        wait_for_condition 20 50 {
+            [r dbsize] == 1
+        } else {
+            fail "Expired keys not reclaimed after DEBUG RELOAD"
+        }
+        r config set active-expire-index no
+        r get y
+    } {v}
 }
@@ -223,6 +223,70 @@ start_server {tags {"geo"}} {
         assert {[lindex $res 0] eq "Catania"}
     }
 
+    test {GEOSEARCH FROMLONLAT and FROMMEMBER BYRADIUS} {
+        r del nyc
+        r geoadd nyc -73.9454966 40.747533 "lic market"
+        r geoadd nyc -73.9733487 40.7648057 "central park n/q/r" -73.9903085 40.7362513 "union square" -74.0131604 40.7126674 "wtc one" -73.7858139 40.6428986 "jfk" -73.9375699 40.7498929 "q4" -73.9564142 40.7480973 4545
+        assert_equal [r geosearch nyc fromlonlat -73.9798091 40.7598464 byradius 3 km asc] \
+                     [r georadius nyc -73.9798091 40.7598464 3 km asc]
+        r geosearch nyc frommember "wtc one" byradius 7 km withdist asc
+    } {{{wtc one} 0.0000} {{union square} 3.2544} {4545 6.1975} {{central park n/q/r} 6.7000} {{lic market} 6.8969}}
+
+    test {GEOSEARCH BYBOX} {
+        r geosearch nyc fromlonlat -73.9798091 40.7598464 bybox 6 6 km asc
+    } {{central park n/q/r} 4545 {union square} {lic market}}
+
+    test {GEOSEARCH BYBOX is wider than the circle inscribed} {
+        set box [r geosearch nyc frommember "wtc one" bybox 14 14 km asc]
+        set circle [r geosearch nyc frommember "wtc one" byradius 7 km asc]
+        list [llength $box] [llength $circle]
+    } {6 5}
+
+    test {GEOSEARCH with COUNT returns the nearest and farthest points} {
+        list [r geosearch nyc fromlonlat -73.9798091 40.7598464 byradius 10 km count 3] \
+             [r geosearch nyc fromlonlat -73.9798091 40.7598464 byradius 10 km count 2 desc]
+    } {{{central park n/q/r} 4545 {union square}} {{wtc one} q4}}
+
+    test {GEOSEARCH with COUNT ANY} {
+        r geosearch nyc fromlonlat -73.9798091 40.7598464 byradius 20 km count 2 any withdist
+        llength [r geosearch nyc fromlonlat -73.9798091 40.7598464 byradius 20 km count 2 any]
+    } {2}
+
+    test {GEOSEARCH argument errors} {
+        catch {r geosearch nyc byradius 10 km asc withdist} e
+        assert_match {ERR*FROMMEMBER or FROMLONLAT*} $e
+        catch {r geosearch nyc fromlonlat -73.9798091 40.7598464 asc withdist} e
+        assert_match {ERR*BYRADIUS and BYBOX*} $e
+        catch {r geosearch nyc frommember jfk byradius 10 km bybox 1 1 km} e
+        assert_match {ERR*syntax*} $e
+        catch {r geosearch nyc frommember jfk bybox 1 -1 km} e
+        assert_match {ERR*negative*} $e
+        catch {r geosearch nyc frommember jfk byradius 10 km any} e
+        assert_match {ERR*ANY*requires COUNT*} $e
+        catch {r geosearch nyc frommember jfk byradius 10 km store dst} e
+        set e
+    } {ERR*syntax*}
+
+    test {GEOSEARCH with non existing key} {
+        r geosearch nosuchkey frommember jfk byradius 10 km
+    } {}
+
+    test {GEOSEARCHSTORE and STOREDIST} {
+        r del points points2
+        r geoadd points 13.361389 38.115556 "Palermo" \
+                        15.087269 37.502669 "Catania"
+        assert_equal 2 [r geosearchstore points2 points fromlonlat 13.361389 38.115556 byradius 500 km]
+        assert_equal [r zrange points 0 -1 withscores] [r zrange points2 0 -1 withscores]
+        assert_equal 1 [r geosearchstore points2 points frommember Palermo bybox 400 400 km desc count 1 storedist]
+        set res [r zrange points2 0 -1 withscores]
+        assert {[lindex $res 0] eq "Catania"}
+        assert {[lindex $res 1] > 166 && [lindex $res 1] < 167}
+        catch {r geosearchstore points2 points frommember Palermo byradius 10 km withdist} e
+        assert_match {ERR*not compatible*} $e
+        r geosearchstore points2 nosuchkey frommember Palermo byradius 10 km
+        r exists points2
+    } {0}
+
     test {GEOADD + GEORANGE randomized test} {
         set attempt 30
         while {[incr attempt -1]} {
@@ -308,4 +372,67 @@ start_server {tags {"geo"}} {
         }
         set test_result
     } {OK}
+
+    test {GEOADD + GEOSEARCH randomized test, boxes and poles} {
+        set attempt 20
+        while {[incr attempt -1]} {
+            unset -nocomplain debuginfo
+            set srand_seed [clock milliseconds]
+            lappend debuginfo "srand_seed is $srand_seed"
+            expr {srand($srand_seed)} ; # If you need a reproducible run
+            r del mypoints
+
+            if {[randomInt 5] == 0} {
+                set width_km [expr {[randomInt 20000]+10}]
+            } else {
+                set width_km [expr {[randomInt 1000]+10}]
+            }
+            set height_km [expr {[randomInt 1000]+10}]
+            set box [expr {$attempt % 2}]
+            # Search everywhere, including near the poles and across the
+            # antimeridian, which are the hardest cases for the covering.
+            set search_lon [expr {-180 + rand()*360}]
+            set search_lat [expr {-85 + rand()*170}]
+            lappend debuginfo "Search area: $search_lon,$search_lat box:$box $width_km x $height_km km"
+            set tcl_result {}
+            set border {}
+            set argv {}
+            for {set j 0} {$j < 5000} {incr j} {
+                set lon [expr {-180 + rand()*360}]
+                set lat [expr {-85 + rand()*170}]
+                lappend argv $lon $lat "place:$j"
+                if {$box} {
+                    set latdist [expr {6372797.560856 * \
+                        abs([geo_degrad $lat] - [geo_degrad $search_lat])}]
+                    set londist [geo_distance $lon $lat $search_lon $lat]
+                    set ratio [expr {max($latdist/($height_km*500.0), \
+                                         $londist/($width_km*500.0))}]
+                } else {
+                    set distance [geo_distance $lon $lat $search_lon $search_lat]
+                    set ratio [expr {$distance/($width_km*1000.0)}]
+                }
+                if {$ratio < 1} {lappend tcl_result "place:$j"}
+                if {abs($ratio-1) < 0.001} {lappend border "place:$j"}
+            }
+            r geoadd mypoints {*}$argv
+            if {$box} {
+                set res [r geosearch mypoints fromlonlat $search_lon $search_lat bybox $width_km $height_km km]
+            } else {
+                set res [r geosearch mypoints fromlonlat $search_lon $search_lat byradius $width_km km]
+            }
+            set res [lsort $res]
+            set res2 [lsort $tcl_result]
+            set diff {}
+            foreach place [compare_lists $res $res2] {
+                if {[lsearch -exact $border $place] == -1} {lappend diff $place}
+            }
+            if {$diff ne {}} {
+                puts "*** Possible problem in GEO search query ***"
+                puts "Diff : $diff"
+                puts [join $debuginfo "\n"]
+                break
+            }
+        }
+        set diff
+    } {}
 }
@@ -24,7 +24,8 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        allkeys-random allkeys-lru allkeys-lfu volatile-lru volatile-lfu volatile-random volatile-ttl
+        allkeys-random allkeys-lru allkeys-lfu allkeys-tinylfu volatile-lru
+        volatile-lfu volatile-tinylfu volatile-random volatile-ttl
     } {
         test "maxmemory - is the memory limit honoured? (policy $policy)" {
             # make sure to start with a blank instance
@@ -98,7 +99,7 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        volatile-lru volatile-lfu volatile-random volatile-ttl
+        volatile-lru volatile-lfu volatile-tinylfu volatile-random volatile-ttl
     } {
         test "maxmemory - policy $policy should only remove volatile keys." {
             # make sure to start with a blank instance
@@ -141,4 +142,71 @@ start_server {tags {"maxmemory"}} {
             }
         }
     }
+
+    test "maxmemory - allkeys-tinylfu keeps frequently used keys during a scan" {
+        r flushall
+        r config set maxmemory-policy allkeys-tinylfu
+        set used [s used_memory]
+        set limit [expr {$used+200*1024}]
+        r config set maxmemory $limit
+        # Fill about half of the memory with keys, accessed a few times.
+        set numkeys 0
+        while {[s used_memory] < $used+100*1024} {
+            r set "hot:$numkeys" x
+            incr numkeys
+        }
+        for {set i 0} {$i < 5} {incr i} {
+            for {set j 0} {$j < $numkeys} {incr j} {
+                r get "hot:$j"
+            }
+        }
+        assert {[r object freq hot:0] > 1}
+        # Now scan many more keys than fit in memory, each requested once
+        # and then created, as a cache filled on misses would do.
+        for {set j 0} {$j < $numkeys*4} {incr j} {
+            r get "scan:$j"
+            r set "scan:$j" x
+        }
+        assert {[s used_memory] < ($limit+4096)}
+        assert {[s evicted_keys] > 0}
+        set kept 0
+        for {set j 0} {$j < $numkeys} {incr j} {
+            incr kept [r exists "hot:$j"]
+        }
+        assert {$kept > $numkeys*0.9}
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+    }
+
+    test "maxmemory - proactive eviction evicts keys in background" {
+        r flushall
+        r config resetstat
+        r config set maxmemory-policy allkeys-lru
+        set used [s used_memory]
+        set limit [expr {$used+400*1024}]
+        r config set maxmemory $limit
+        # Fill up to ~90% of maxmemory, without reaching it.
+        set numkeys 0
+        while {[s used_memory] < $used+330*1024} {
+            r set "key:$numkeys" [string repeat x 100]
+            incr numkeys
+        }
+        assert {[s evicted_keys] == 0}
+        # Set the watermark at about the middle of the keys added.
+        set perc [expr {($used+200*1024)*100/$limit}]
+        r config set maxmemory-eviction-watermark $perc
+        # How close to the watermark memory gets depends on the cron timing,
+        # only check that keys are evicted in background under maxmemory.
+        wait_for_condition 200 100 {
+            [s evicted_keys_proactive] > 0 &&
+            [s used_memory] < $limit
+        } else {
+            fail "Proactive eviction didn't evict keys"
+        }
+        assert {[s evicted_keys] == [s evicted_keys_proactive]}
+        assert {[s eviction_foreground_usec] == 0}
+        r config set maxmemory-eviction-watermark 0
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+    }
 }
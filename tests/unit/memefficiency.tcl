@@ -36,6 +36,93 @@ start_server {tags {"memefficiency"}} {
     }
 }
 
+proc memory_prefix {prefix} {
+    foreach item [r memory prefixes count 1000] {
+        lassign $item p keys bytes
+        if {$p eq $prefix} {return [list $keys $bytes]}
+    }
+    return {0 0}
+}
+
+start_server {tags {"memefficiency"} overrides {memory-tracking yes}} {
+    test "MEMORY PREFIXES accounts keys by prefix" {
+        r flushall
+        for {set j 0} {$j < 100} {incr j} {
+            r set user:$j [string repeat x 100]
+            r rpush queue:$j a b c
+        }
+        r set noprefix foo
+        lassign [memory_prefix user:] keys bytes
+        assert_equal 100 $keys
+        assert {$bytes >= 100*100}
+        assert_equal 100 [lindex [memory_prefix queue:] 0]
+        assert_equal 1 [lindex [memory_prefix {}] 0]
+        # The prefix of the biggest values comes first.
+        assert_equal user: [lindex [r memory prefixes count 1] 0 0]
+    }
+
+    test "MEMORY PREFIXES is updated on writes, overwrites and deletes" {
+        lassign [memory_prefix user:] keys bytes
+        r append user:0 [string repeat y 10000]
+        # The key may have been estimated in this second already, in that
+        # case the estimate is refreshed by the cron.
+        wait_for_condition 50 100 {
+            [lindex [memory_prefix user:] 1] >= $bytes+10000
+        } else {
+            fail "The estimate of user:0 was not refreshed"
+        }
+        r set user:0 small
+        r del user:1 user:2
+        lassign [memory_prefix user:] keys newbytes
+        assert_equal 98 $keys
+        assert {$newbytes < $bytes}
+        r unlink queue:0
+        assert_equal 99 [lindex [memory_prefix queue:] 0]
+    }
+
+    test "MEMORY PREFIXES sums all the DBs and is reset by FLUSHDB" {
+        r select 10
+        r set user:other bar
+        assert_equal 99 [lindex [memory_prefix user:] 0]
+        r flushdb
+        assert_equal 98 [lindex [memory_prefix user:] 0]
+        r select 9
+        r flushall
+        assert_equal {} [r memory prefixes]
+    }
+
+    test "MEMORY PREFIXES with custom delimiters" {
+        r set a.b.c 1
+        r set a:b 1
+        r config set memory-tracking-delimiters ".:"
+        assert_equal 1 [lindex [memory_prefix a.] 0]
+        assert_equal 1 [lindex [memory_prefix a:] 0]
+        r config set memory-tracking-delimiters ":"
+        assert_equal 1 [lindex [memory_prefix {}] 0]
+        assert_equal 1 [lindex [memory_prefix a:] 0]
+    }
+
+    test "MEMORY PREFIXES refreshes the keys written many times per second" {
+        r flushall
+        r rpush hot:list a
+        for {set j 0} {$j < 1000} {incr j} {
+            r rpush hot:list [string repeat x 100]
+        }
+        wait_for_condition 50 100 {
+            [lindex [memory_prefix hot:] 1] >= 100*1000
+        } else {
+            fail "The estimate of hot:list was not refreshed"
+        }
+    }
+
+    test "MEMORY PREFIXES requires memory-tracking" {
+        r config set memory-tracking no
+        catch {r memory prefixes} e
+        r config set memory-tracking yes
+        set e
+    } {*memory-tracking*}
+}
+
 start_server {tags {"defrag"}} {
     if {[string match {*jemalloc*} [s mem_allocator]]} {
         test "Active defrag" {
@@ -197,5 +284,116 @@ start_server {tags {"defrag"}} {
                 set _ ""
             }
         } {}
+
+        test "Active defrag big list" {
+            r flushdb
+            r config resetstat
+            r config set save "" ;# prevent bgsave from interfering with save below
+            r config set activedefrag no
+            r config set active-defrag-max-scan-fields 1000
+            r config set active-defrag-threshold-lower 5
+            r config set active-defrag-cycle-min 65
+            r config set active-defrag-cycle-max 75
+            r config set active-defrag-ignore-bytes 2mb
+            r config set maxmemory 0
+            r config set list-max-ziplist-size 5 ;# list of 500k items will have 100k quicklist nodes
+
+            # add a mass of list nodes to two lists (allocations are interlaced)
+            set rd [redis_deferring_client]
+            set val [string repeat A 100] ;# 5 items of 100 bytes fill a 640 bytes bin
+            set elements 500000
+            for {set j 0} {$j < $elements} {incr j} {
+                $rd lpush biglist1 $val
+                $rd lpush biglist2 $val
+            }
+            for {set j 0} {$j < $elements} {incr j} {
+                $rd read ; # Discard replies
+                $rd read ; # Discard replies
+            }
+
+            # create some fragmentation
+            r del biglist2
+
+            # start defrag
+            after 120 ;# serverCron only updates the info once in 100ms
+            set frag [s allocator_frag_ratio]
+            if {$::verbose} {
+                puts "frag $frag"
+            }
+            assert {$frag >= 1.7}
+            r config set latency-monitor-threshold 5
+            r latency reset
+
+            set digest [r debug digest]
+            catch {r config set activedefrag yes} e
+            if {![string match {DISABLED*} $e]} {
+                # wait for the active defrag to start working (decision once a second)
+                wait_for_condition 50 100 {
+                    [s active_defrag_running] ne 0
+                } else {
+                    fail "defrag not started."
+                }
+
+                # wait for the active defrag to stop working
+                wait_for_condition 500 100 {
+                    [s active_defrag_running] eq 0
+                } else {
+                    puts [r info memory]
+                    puts [r memory malloc-stats]
+                    fail "defrag didn't stop."
+                }
+
+                # test the the fragmentation is lower, and that every node
+                # was visited about once: walking the list from the head at
+                # every step would not finish in time.
+                after 120 ;# serverCron only updates the info once in 100ms
+                set misses [s active_defrag_misses]
+                set frag [s allocator_frag_ratio]
+                set max_latency 0
+                foreach event [r latency latest] {
+                    lassign $event eventname time latency max
+                    if {$eventname == "active-defrag-cycle"} {
+                        set max_latency $max
+                    }
+                }
+                if {$::verbose} {
+                    puts "frag $frag"
+                    puts "misses: $misses"
+                    puts "max latency $max_latency"
+                    puts [r latency latest]
+                    puts [r latency history active-defrag-cycle]
+                }
+                assert {$frag < 1.1}
+                assert {$max_latency <= 80}
+                assert {$misses < $elements}
+            }
+            # verify the data isn't corrupted or changed
+            assert_equal $digest [r debug digest]
+            r save ;# saving an rdb iterates over all the data / pointers
+            r del biglist1 ;# coverage for quicklistBookmarksClear
+        } {1}
+    }
+}
+
+start_server {tags {"memefficiency"}} {
+    if {$::tcl_platform(os) eq "Linux"} {
+        test "Big dict tables are placed on huge pages with hugepages-tables" {
+            r flushall
+            r config set hugepages-tables yes
+            r debug populate 300000
+            assert_equal 1 [s hugepage_tables]
+            assert {[s hugepage_tables_bytes] >= 2097152}
+            r flushall
+            assert_equal 0 [s hugepage_tables]
+            r config set hugepages-tables no
+            r debug populate 300000
+            assert_equal 0 [s hugepage_tables]
+            r flushall
+        }
+    }
+
+    test "INFO NUMA is only returned when requested" {
+        assert_match {*numa_node:-1*} [r info numa]
+        assert {![string match {*numa_node*} [r info all]]}
     }
 }
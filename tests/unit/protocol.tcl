@@ -60,6 +60,29 @@ start_server {tags {"protocol"}} {
         assert_error "*wrong*arguments*ping*" {r ping x y z}
     }
 
+    test "Reused argument objects don't alter stored values" {
+        set rd [redis_deferring_client]
+        # Lengths around the EMBSTR limit, getting shorter and longer, so
+        # that pooled argument objects are both reused and skipped.
+        set lengths {1 44 45 3 128 129 44 2 200 45 0 10}
+        for {set j 0} {$j < 100} {incr j} {
+            set len [lindex $lengths [expr {$j % [llength $lengths]}]]
+            $rd set key:$j [string repeat [expr {$j % 10}] $len]
+            $rd lpush list:[expr {$j % 3}] [string repeat x $len]
+        }
+        for {set j 0} {$j < 200} {incr j} {$rd read}
+        for {set j 0} {$j < 100} {incr j} {
+            set len [lindex $lengths [expr {$j % [llength $lengths]}]]
+            assert_equal [string repeat [expr {$j % 10}] $len] [r get key:$j]
+        }
+        $rd close
+        r multi
+        r set foo bar
+        r set foo2 [string repeat y 100]
+        r exec
+        list [r get foo] [string length [r get foo2]]
+    } {bar 100}
+
     test "Unbalanced number of quotes" {
         reconnect
         r write "set \"\"\"test-key\"\"\" test-value\r\n"
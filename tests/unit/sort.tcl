@@ -263,6 +263,101 @@ start_server {
         r lrange testb 0 -1
     } {5 3 4}
 
+    test "SORT LIMIT returns the same range of a full sort" {
+        r del tosort
+        for {set i 0} {$i < 1000} {incr i} {
+            r rpush tosort [randomInt 500]
+        }
+        foreach opts {{} {alpha} {desc} {alpha desc}} {
+            set full [r sort tosort {*}$opts]
+            foreach {start count} {0 1 0 10 5 10 100 100 0 500 990 100 2000 10} {
+                assert_equal [lrange $full $start [expr {$start+$count-1}]] \
+                    [r sort tosort {*}$opts limit $start $count]
+            }
+        }
+    }
+
+    test "Background SORT BY key and GET" {
+        set result [create_random_dataset 1000 lpush]
+        r config set sort-async-min-elements 100
+        set before [s sort_async_jobs]
+        set l1 [r sort tosort BY weight_* GET # GET wobj_*->weight]
+        set l2 [r sort tosort BY weight_* DESC LIMIT 10 20]
+        r config set sort-async-min-elements 0
+        assert {[s sort_async_jobs] == $before+2}
+        set ids {}
+        foreach {id w} $l1 {
+            lappend ids $id
+            assert_equal $w [r get weight_$id]
+        }
+        assert_equal $result $ids
+        assert_equal [lrange [lreverse $result] 10 29] $l2
+    }
+
+    test "Background SORT ALPHA BY hash field STORE" {
+        create_random_dataset 1000 sadd
+        r config set sort-async-min-elements 100
+        set l1 [r sort tosort BY wobj_*->weight ALPHA]
+        assert_equal 1000 [r sort tosort BY wobj_*->weight ALPHA STORE sort-res]
+        r config set sort-async-min-elements 0
+        assert_equal $l1 [r lrange sort-res 0 -1]
+        assert_equal $l1 [r sort tosort BY wobj_*->weight ALPHA]
+    }
+
+    test "Background SORT STORE is propagated as the resulting list" {
+        r del tosort sort-res
+        for {set i 0} {$i < 100} {incr i} {
+            r rpush tosort [expr {100-$i}]
+        }
+        r config set sort-async-min-elements 10
+        set repl [attach_to_replication_stream]
+        assert_equal 100 [r sort tosort STORE sort-res]
+        r config set sort-async-min-elements 0
+        assert_replication_stream $repl {
+            {select *}
+            {multi}
+            {del sort-res}
+            {rpush sort-res 1 2 3 *}
+            {rpush sort-res 65 66 *}
+            {exec}
+        }
+        close_replication_stream $repl
+        assert_equal [r lrange sort-res 0 2] {1 2 3}
+    }
+
+    test "Background SORT is synchronous inside MULTI" {
+        r config set sort-async-min-elements 10
+        set before [s sort_async_jobs]
+        r multi
+        r sort tosort LIMIT 0 3
+        set res [r exec]
+        r config set sort-async-min-elements 0
+        assert_equal [s sort_async_jobs] $before
+        assert_equal {{1 2 3}} $res
+    }
+
+    test "Background SORT of non numeric values returns an error" {
+        r del tosort
+        for {set i 0} {$i < 100} {incr i} {
+            r rpush tosort $i
+        }
+        r rpush tosort foo
+        r config set sort-async-min-elements 10
+        catch {r sort tosort} e
+        r config set sort-async-min-elements 0
+        set e
+    } {*scores can't be converted*}
+
+    test "Background SORT: client disconnection while sorting" {
+        create_random_dataset 10000 lpush
+        r config set sort-async-min-elements 100
+        set rd [redis_deferring_client]
+        $rd sort tosort BY wobj_*->weight
+        $rd close
+        r config set sort-async-min-elements 0
+        r ping
+    } {PONG}
+
     tags {"slow"} {
         set num 100
         set res [create_random_dataset $num lpush]
@@ -533,4 +533,139 @@ start_server {tags {"hash"}} {
             assert {[r hincrbyfloat myhash float -0.1] eq {1.9}}
         }
     }
+
+    test {HEXPIRE/HTTL/HPERSIST basics} {
+        r config set hash-max-ziplist-entries 512
+        r del myhash
+        r hset myhash a 1 b 2 c 3
+        assert_equal {1 1 -2} [r hexpire myhash 100 FIELDS 3 a b nosuchfield]
+        set ttl [lindex [r httl myhash FIELDS 1 a] 0]
+        assert {$ttl >= 90 && $ttl <= 100}
+        set ttl [lindex [r hpttl myhash FIELDS 1 a] 0]
+        assert {$ttl >= 90000 && $ttl <= 100000}
+        assert_equal {-1} [r httl myhash FIELDS 1 c]
+        assert_equal {0 1} [r hexpire myhash 200 NX FIELDS 2 a c]
+        assert_equal {1 1} [r hexpire myhash 300 GT FIELDS 2 a c]
+        assert_equal {1} [r hexpire myhash 250 LT FIELDS 1 a]
+        assert_equal {0 1} [r hexpire myhash 280 LT FIELDS 2 a c]
+        assert_equal {1 -1} [r hpersist myhash FIELDS 2 a a]
+        assert_equal {0} [r hexpire myhash 50 XX FIELDS 1 a]
+        assert_equal {-2 -2} [r httl nosuchkey FIELDS 2 a b]
+        assert_error {*numfields*} {r httl myhash FIELDS 3 a b}
+        assert_error {*FIELDS*} {r hexpire myhash 10 NX a b c}
+    }
+
+    test {HEXPIREAT/HPEXPIRETIME report the absolute time} {
+        r del myhash
+        r hset myhash a 1
+        set at [expr {[clock seconds]+100}]
+        r hexpireat myhash $at FIELDS 1 a
+        assert_equal $at [lindex [r hexpiretime myhash FIELDS 1 a] 0]
+        assert_equal [expr {$at*1000}] [lindex [r hpexpiretime myhash FIELDS 1 a] 0]
+    }
+
+    test {HEXPIRE with a time in the past deletes the fields} {
+        r del myhash
+        r hset myhash a 1 b 2
+        assert_equal {2} [r hexpire myhash 0 FIELDS 1 a]
+        assert_equal {b 2} [r hgetall myhash]
+        assert_equal {2} [r hpexpireat myhash 1 FIELDS 1 b]
+        r exists myhash
+    } {0}
+
+    test {Hash fields expire lazily and actively} {
+        r config resetstat
+        r del myhash myhash2
+        r hset myhash a 1 b 2 c 3
+        r hset myhash2 a 1
+        r hpexpire myhash 50 FIELDS 2 a b
+        r hpexpire myhash2 50 FIELDS 1 a
+        after 100
+        assert_equal {c 3} [r hgetall myhash]
+        wait_for_condition 50 100 {
+            [r exists myhash2] == 0
+        } else {
+            fail "Hash with all fields expired not deleted"
+        }
+        assert_match {*expired_fields:3*} [r info stats]
+    }
+
+    test {HEXPIRE rejects times not exact as doubles} {
+        r del myhash
+        r hset myhash a 1
+        assert_error {*invalid expire time*} {r hpexpireat myhash 281474976710656 FIELDS 1 a}
+        assert_equal {-1} [r httl myhash FIELDS 1 a]
+    }
+
+    test {Active expire deletes more fields than the per key bound} {
+        r config resetstat
+        r del myhash
+        r debug set-active-expire 0
+        for {set j 0} {$j < 3000} {incr j} {
+            r hset myhash f$j $j
+        }
+        r hset myhash persistent 1
+        for {set j 0} {$j < 3000} {incr j 100} {
+            set fields {}
+            for {set k $j} {$k < $j+100} {incr k} {lappend fields f$k}
+            r hpexpire myhash 50 FIELDS 100 {*}$fields
+        }
+        after 100
+        r debug set-active-expire 1
+        wait_for_condition 50 100 {
+            [string match {*expired_fields:3000*} [r info stats]]
+        } else {
+            fail "Expired fields not deleted by the active expire cycle"
+        }
+        r hgetall myhash
+    } {persistent 1}
+
+    foreach {type entries} {ziplist 512 hashtable 4} {
+        test "Field expires of $type encoded metadata survive DEBUG RELOAD, RENAME and RESTORE" {
+            r config set hash-max-ziplist-entries $entries
+            r del myhash myhash2
+            for {set j 0} {$j < 10} {incr j} {
+                r hset myhash f$j $j
+                r hexpireat myhash [expr {2000000000+$j}] FIELDS 1 f$j
+            }
+            r hset myhash persistent 1
+            r debug reload
+            assert_equal {2000000009 -1} [r hexpiretime myhash FIELDS 2 f9 persistent]
+            r rename myhash myhash2
+            assert_equal {-1} [r httl myhash2 FIELDS 1 persistent]
+            assert_equal {2000000005} [r hexpiretime myhash2 FIELDS 1 f5]
+            set dump [r dump myhash2]
+            r del myhash2
+            assert_equal {-2} [r httl myhash2 FIELDS 1 f5]
+            r restore myhash2 0 $dump
+            assert_equal {2000000005} [r hexpiretime myhash2 FIELDS 1 f5]
+            r config set hash-max-ziplist-entries 512
+        }
+    }
+
+    test {HSET overwriting a field clears its expire, HINCRBY does not} {
+        r del myhash
+        r hset myhash a 1 b 2
+        r hexpire myhash 100 FIELDS 2 a b
+        r hset myhash a 10
+        r hincrby myhash b 1
+        assert_equal {-1} [r httl myhash FIELDS 1 a]
+        set ttl [lindex [r httl myhash FIELDS 1 b] 0]
+        assert {$ttl >= 90 && $ttl <= 100}
+        r set myhash foo
+        r del myhash
+        r hset myhash b 1
+        assert_equal {-1} [r httl myhash FIELDS 1 b]
+    }
+
+    test {Hash field expires are rewritten in the AOF} {
+        r del myhash
+        r hset myhash a 1 b 2
+        r hexpireat myhash 2000000000 FIELDS 1 a
+        r config set appendonly yes
+        waitForBgrewriteaof r
+        r debug loadaof
+        r config set appendonly no
+        list [r hexpiretime myhash FIELDS 2 a b] [r hgetall myhash]
+    } {{2000000000 -1} {a 1 b 2}}
 }
@@ -81,4 +81,105 @@ start_server {
         # just ID2.
         assert {[r XACK mystream mygroup $id1 $id2] eq 1}
     }
+
+    test {XAUTOCLAIM claims only the entries idle enough} {
+        r del mystream
+        for {set j 1} {$j <= 5} {incr j} {
+            r XADD mystream $j-0 item $j
+        }
+        r XGROUP CREATE mystream mygroup 0
+        r XREADGROUP GROUP mygroup consumer1 COUNT 2 STREAMS mystream >
+        after 100
+        r XREADGROUP GROUP mygroup consumer1 COUNT 3 STREAMS mystream >
+        # Redeliver 1-0 so that now 2-0 is the oldest delivery.
+        r XREADGROUP GROUP mygroup consumer1 COUNT 1 STREAMS mystream 0
+        set reply [r XAUTOCLAIM mystream mygroup consumer2 50 0-0]
+        assert_equal {0-0 {{2-0 {item 2}}}} $reply
+        set pending [r XPENDING mystream mygroup - + 10 consumer2]
+        assert_equal {2-0 consumer2} [lrange [lindex $pending 0] 0 1]
+        # The delivery counter is incremented.
+        assert_equal 2 [lindex $pending 0 3]
+        # Nothing else is idle for 50 milliseconds.
+        r XAUTOCLAIM mystream mygroup consumer2 50 0-0
+    } {0-0 {}}
+
+    test {XAUTOCLAIM with COUNT, start ID and JUSTID} {
+        after 100
+        set reply [r XAUTOCLAIM mystream mygroup consumer2 50 3-0 COUNT 2 JUSTID]
+        assert_equal {5-0 {3-0 4-0}} $reply
+        set reply [r XAUTOCLAIM mystream mygroup consumer2 50 3-0 COUNT 2 JUSTID]
+        assert_equal {0-0 5-0} $reply
+        # JUSTID does not increment the delivery counter.
+        lindex [r XPENDING mystream mygroup 5-0 5-0 1] 0 3
+    } {1}
+
+    test {XAUTOCLAIM reports entries deleted from the stream} {
+        after 100
+        r XDEL mystream 1-0
+        r XAUTOCLAIM mystream mygroup consumer3 50 0-0 COUNT 1
+    } {2-0 {{1-0 {}}}}
+
+    test {XAUTOCLAIM argument errors} {
+        catch {r XAUTOCLAIM mystream nosuchgroup consumer 10 0-0} e
+        assert_match {NOGROUP*} $e
+        catch {r XAUTOCLAIM mystream mygroup consumer 10 0-0 COUNT 0} e
+        assert_match {ERR*COUNT*} $e
+        catch {r XAUTOCLAIM mystream mygroup consumer 10 0-0 FOO} e
+        set e
+    } {ERR*Unrecognized*}
+
+    test {XAUTOCLAIM index survives XACK, DELCONSUMER and DEBUG RELOAD} {
+        r XACK mystream mygroup 2-0
+        r XGROUP DELCONSUMER mystream mygroup consumer3
+        r DEBUG RELOAD
+        after 100
+        r XAUTOCLAIM mystream mygroup consumer4 50 0-0 JUSTID
+    } {0-0 {3-0 4-0 5-0}}
+
+    test {XAUTOCLAIM is propagated as XCLAIM} {
+        set repl [attach_to_replication_stream]
+        after 100
+        r XAUTOCLAIM mystream mygroup consumer5 50 0-0 COUNT 1 JUSTID
+        assert_replication_stream $repl {
+            {select *}
+            {xclaim mystream mygroup consumer5 0 3-0 TIME * RETRYCOUNT 1 FORCE JUSTID}
+        }
+        close_replication_stream $repl
+    }
+
+    test {XAUTOCLAIM with a start ID looks at COUNT*10 entries at most} {
+        r del autoclaim
+        for {set j 1} {$j <= 30} {incr j} {
+            r XADD autoclaim $j-0 item $j
+        }
+        r XGROUP CREATE autoclaim mygroup 0
+        r XREADGROUP GROUP mygroup consumer1 COUNT 1 STREAMS autoclaim >
+        after 100
+        r XREADGROUP GROUP mygroup consumer1 COUNT 29 STREAMS autoclaim >
+        # No entry from 2-0 on is idle: the call stops after 10 of them.
+        r XAUTOCLAIM autoclaim mygroup consumer2 50 2-0 COUNT 1 JUSTID
+    } {12-0 {}}
+
+    foreach minidle {0 50} {
+        test "XAUTOCLAIM paging claims every entry once (min-idle-time $minidle)" {
+            r del autoclaim
+            for {set j 1} {$j <= 25} {incr j} {
+                r XADD autoclaim $j-0 item $j
+            }
+            r XGROUP CREATE autoclaim mygroup 0
+            r XREADGROUP GROUP mygroup consumer1 STREAMS autoclaim >
+            after 100
+            set cursor 0-0
+            set claimed {}
+            while 1 {
+                set reply [r XAUTOCLAIM autoclaim mygroup consumer2 $minidle $cursor COUNT 4 JUSTID]
+                set cursor [lindex $reply 0]
+                lappend claimed {*}[lindex $reply 1]
+                if {$cursor eq {0-0}} break
+            }
+            assert_equal 25 [llength $claimed]
+            assert_equal 25 [llength [lsort -unique $claimed]]
+            llength [r XPENDING autoclaim mygroup - + 100 consumer2]
+        } {25}
+    }
 }
@@ -96,6 +96,109 @@ start_server {
         }
     }
 
+    test {XADD with MINID option} {
+        r DEL mystream
+        for {set j 1} {$j < 1001} {incr j} {
+            set minid 1000
+            if {$j >= 5} {
+                set minid [expr {$j-5}]
+            }
+            r XADD mystream MINID $minid $j xitem $j
+        }
+        set res [r xrange mystream - +]
+        set expected 995
+        foreach r $res {
+            assert {[lindex $r 1 1] == $expected}
+            incr expected
+        }
+        assert_error {*MAXLEN and MINID*} {r XADD mystream MAXLEN 5 MINID 1 * a b}
+    }
+
+    test {XTRIM with MINID option} {
+        r DEL mystream
+        r config set stream-node-max-entries 10
+        for {set j 1} {$j <= 100} {incr j} {
+            r XADD mystream $j-0 item $j
+        }
+        # Approximated trimming only removes whole nodes.
+        assert_equal 0 [r XTRIM mystream MINID ~ 5]
+        set deleted [r XTRIM mystream MINID ~ 25]
+        assert {$deleted > 0 && $deleted < 25}
+        assert_equal [expr {100-$deleted}] [r XLEN mystream]
+        set first [expr {$deleted+1}]
+        assert_equal "$first-0 {item $first}" [lindex [r XRANGE mystream - + COUNT 1] 0]
+        # Exact trimming also removes the entries of the first node.
+        assert_equal [expr {24-$deleted}] [r XTRIM mystream MINID 25]
+        assert_equal {25-0 {item 25}} [lindex [r XRANGE mystream - + COUNT 1] 0]
+        assert_equal 0 [r XTRIM mystream MINID 25-0]
+        assert_equal 76 [r XLEN mystream]
+        assert_equal 76 [r XTRIM mystream MINID 1000]
+        assert_equal {} [r XRANGE mystream - +]
+        r config set stream-node-max-entries 100
+    }
+
+    test {XTRIM can't use MAXLEN and MINID at the same time} {
+        r DEL mystream
+        for {set j 1} {$j <= 10} {incr j} {
+            r XADD mystream $j-0 item $j
+        }
+        assert_error {*MAXLEN and MINID*} {r XTRIM mystream MAXLEN 5 MINID 1}
+        assert_error {*MAXLEN and MINID*} {r XTRIM mystream MINID ~ 8 MAXLEN ~ 5}
+        r XLEN mystream
+    } {10}
+
+    test {Approximated MINID trimming is propagated as exact MINID} {
+        r DEL mystream
+        r config set stream-node-max-entries 10
+        for {set j 1} {$j <= 30} {incr j} {
+            r XADD mystream $j-0 item $j
+        }
+        set repl [attach_to_replication_stream]
+        r XTRIM mystream MINID ~ 15
+        set first1 [lindex [r XRANGE mystream - + COUNT 1] 0 0]
+        r XADD mystream MINID ~ 25 31-0 item 31
+        set first2 [lindex [r XRANGE mystream - + COUNT 1] 0 0]
+        # Only whole nodes were removed, so older entries were left.
+        assert {$first1 ne {15-0} && $first2 ne {25-0}}
+        assert_replication_stream $repl [list \
+            {select *} \
+            "xtrim mystream MINID $first1" \
+            "xadd mystream MINID $first2 31-0 item 31" \
+        ]
+        close_replication_stream $repl
+        r config set stream-node-max-entries 100
+    }
+
+    test {XDEL compacts nodes with many deleted entries} {
+        r DEL mystream
+        r config set stream-node-max-entries 100
+        for {set j 1} {$j <= 1000} {incr j} {
+            r XADD mystream $j-0 item $j otherfield [expr {$j%3 == 0 ? "foo" : ""}]
+        }
+        set before [r MEMORY USAGE mystream]
+        for {set j 1} {$j <= 1000} {incr j} {
+            if {$j % 10 != 0} {r XDEL mystream $j-0}
+        }
+        assert {[r MEMORY USAGE mystream] < $before/2}
+        assert_equal 100 [r XLEN mystream]
+        set expected 10
+        foreach e [r XRANGE mystream - +] {
+            assert_equal $expected-0 [lindex $e 0]
+            assert_equal $expected [lindex $e 1 1]
+            incr expected 10
+        }
+        set expected 1000
+        foreach e [r XREVRANGE mystream + -] {
+            assert_equal $expected-0 [lindex $e 0]
+            incr expected -10
+        }
+        # Nodes left without valid entries are released.
+        for {set j 10} {$j <= 1000} {incr j 10} {r XDEL mystream $j-0}
+        assert_equal 0 [r XLEN mystream]
+        r XADD mystream 1001-0 item 1001
+        assert_equal {{1001-0 {item 1001}}} [r XRANGE mystream - +]
+    }
+
     test {XADD mass insertion and XLEN} {
         r DEL mystream
         r multi
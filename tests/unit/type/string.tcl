@@ -420,3 +420,88 @@ start_server {tags {"string"}} {
         r getrange foo 0 4294967297
     } {bar}
 }
+
+start_server {tags {"string"} overrides {intern-values-max-entries 3}} {
+    test {Small repeated values are interned} {
+        r flushall
+        for {set j 0} {$j < 100} {incr j} {
+            r set flag:$j pending
+            r set num:$j 123456
+        }
+        assert_equal 2 [s interned_values]
+        assert_equal pending [r get flag:99]
+        assert_equal 123456 [r get num:99]
+        assert_equal [r object refcount flag:98] [r object refcount flag:99]
+        assert {[r object refcount flag:99] > 90}
+        assert {[r object refcount num:99] > 90}
+    }
+
+    test {Values are interned only after being set a few times} {
+        # The first keys were set before the values were interned.
+        assert_equal 1 [r object refcount flag:0]
+        r set a once
+        r set b twice
+        r set b twice
+        list [s interned_values] [r object refcount a] [r object refcount b]
+    } {2 1 1}
+
+    test {Modifying an interned value doesn't affect other keys} {
+        r append flag:50 -done
+        r setrange flag:51 0 P
+        r incr num:50
+        list [r get flag:50] [r get flag:51] [r get flag:52] [r get num:50] [r get num:51]
+    } {pending-done Pending pending 123457 123456}
+
+    test {Interned values table is bounded} {
+        for {set j 0} {$j < 10} {incr j} {
+            r set done:$j done
+            r set failed:$j failed
+        }
+        assert_equal 3 [s interned_values]
+        assert {[r object refcount done:9] > 1}
+        assert_equal 1 [r object refcount failed:9]
+        r get failed:9
+    } {failed}
+
+    test {Interned values under an LRU policy share just the string} {
+        r config set maxmemory 1gb
+        r config set maxmemory-policy allkeys-lru
+        r set lru:1 pending
+        r set lru:2 pending
+        # Every key has its own object, hence its own LRU clock.
+        assert_equal 1 [r object refcount lru:1]
+        assert_equal interned [r object encoding lru:1]
+        # A SET that doesn't store its value must not corrupt the interned
+        # string when the argument object is reused.
+        r set lru:1 pending nx
+        r set lru:3 abcdefg
+        r append lru:2 -x
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+        list [r get lru:1] [r get lru:2] [r get lru:3] [r get flag:5]
+    } {pending pending-x abcdefg pending}
+
+    test {Interned values under an LRU policy are not reused by scripts} {
+        r config set maxmemory 1gb
+        r config set maxmemory-policy allkeys-lru
+        set res [r eval {
+            redis.call('set','lua:a','pending')
+            redis.call('set','lua:a','pending','nx')
+            redis.call('set','lua:b','XXXXXXX')
+            return redis.call('get','lua:a')
+        } 0]
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+        list $res [r get flag:5]
+    } {pending pending}
+
+    test {Interned values survive DEBUG RELOAD} {
+        r debug reload
+        list [r get flag:97] [r get num:97] [s interned_values]
+    } {pending 123456 3}
+
+    test {intern-values-max-entries can't be negative} {
+        catch {r config set intern-values-max-entries -1} e
+        set e
+    } {*ERR*}
+}
@@ -0,0 +1,179 @@
+# Compare the hit ratio of the maxmemory policies replaying the same trace
+# against a running Redis server used as a cache: every request is a GET
+# followed, on a miss, by a SET of the key, like an application filling the
+# cache on misses would do.
+#
+# By default a synthetic trace is generated: a Zipf distributed workload over
+# a set of popular keys, interrupted from time to time by scans of keys that
+# are requested just once, which is the case where LRU and, to a lesser
+# extent, LFU evict the popular keys. A trace file with one key name per line
+# can be replayed instead with --trace.
+#
+# The server maxmemory is set so that about --cache-ratio of the keys of the
+# trace fit in memory. Note that this script flushes the server.
+#
+# Usage:
+#
+#   tclsh hit-ratio.tcl [--port 6379] [--trace file] [--requests 200000]
+#                       [--keys 20000] [--zipf 0.9] [--scan-every 20000]
+#                       [--scan-len 5000] [--value-size 100]
+#                       [--cache-ratio 0.2] [--policies "allkeys-lru ..."]
+
+source [file join [file dirname [info script]] ../../tests/support/redis.tcl]
+
+set ::host 127.0.0.1
+set ::port 6379
+set ::trace_file {}
+set ::requests 200000
+set ::keys 20000
+set ::zipf 0.9
+set ::scan_every 20000
+set ::scan_len 5000
+set ::value_size 100
+set ::cache_ratio 0.2
+set ::policies {allkeys-lru allkeys-lfu allkeys-tinylfu}
+set ::batch 100
+
+foreach {opt val} $argv {
+    switch -- $opt {
+        --host {set ::host $val}
+        --port {set ::port $val}
+        --trace {set ::trace_file $val}
+        --requests {set ::requests $val}
+        --keys {set ::keys $val}
+        --zipf {set ::zipf $val}
+        --scan-every {set ::scan_every $val}
+        --scan-len {set ::scan_len $val}
+        --value-size {set ::value_size $val}
+        --cache-ratio {set ::cache_ratio $val}
+        --policies {set ::policies $val}
+        default {
+            puts "Unknown option $opt"
+            exit 1
+        }
+    }
+}
+
+# Return a list of 'requests' key names: Zipf distributed accesses to 'keys'
+# popular keys, plus a scan of 'scan_len' never seen keys every 'scan_every'
+# requests.
+proc generate_trace {} {
+    expr {srand(1234)}
+    set cdf {}
+    set sum 0.0
+    for {set j 1} {$j <= $::keys} {incr j} {
+        set sum [expr {$sum + 1.0/pow($j,$::zipf)}]
+        lappend cdf $sum
+    }
+
+    set trace {}
+    set scan_id 0
+    while {[llength $trace] < $::requests} {
+        if {$::scan_every && [llength $trace] &&
+            [llength $trace] % $::scan_every == 0} {
+            for {set j 0} {$j < $::scan_len} {incr j} {
+                lappend trace scan:[incr scan_id]
+            }
+        }
+        # Binary search of the key rank in the cumulative distribution.
+        set r [expr {rand()*$sum}]
+        set lo 0
+        set hi [expr {$::keys-1}]
+        while {$lo < $hi} {
+            set mid [expr {($lo+$hi)/2}]
+            if {[lindex $cdf $mid] < $r} {
+                set lo [expr {$mid+1}]
+            } else {
+                set hi $mid
+            }
+        }
+        lappend trace key:$lo
+    }
+    lrange $trace 0 [expr {$::requests-1}]
+}
+
+proc load_trace {filename} {
+    set fd [open $filename]
+    set trace {}
+    while {[gets $fd line] >= 0} {
+        if {$line ne {}} {lappend trace $line}
+    }
+    close $fd
+    return $trace
+}
+
+proc info_field {r field} {
+    if {[regexp "\r\n$field:(.*?)\r\n" [$r info] -> value]} {
+        return $value
+    }
+    return {}
+}
+
+# Set maxmemory so that 'cache_ratio' of the distinct keys of the trace fit,
+# measuring the memory used by a key filling the server once without limits.
+proc setup_maxmemory {r distinct} {
+    $r config set maxmemory 0
+    $r flushall
+    set base [info_field $r used_memory]
+    set value [string repeat x $::value_size]
+    for {set j 0} {$j < 10000} {incr j} {
+        $r set sizing:$j $value
+    }
+    set perkey [expr {([info_field $r used_memory]-$base)/10000.0}]
+    $r flushall
+    set base [info_field $r used_memory]
+    set maxmemory [expr {int($base + $perkey*$distinct*$::cache_ratio)}]
+    return $maxmemory
+}
+
+# Replay the trace with the given policy, returning {hits misses evicted}.
+proc replay {r policy trace maxmemory} {
+    $r config set maxmemory 0
+    $r flushall
+    $r config set maxmemory-policy $policy
+    $r config set maxmemory $maxmemory
+    $r config resetstat
+
+    set value [string repeat x $::value_size]
+    set hits 0
+    set misses 0
+    $r deferred 1
+    for {set i 0} {$i < [llength $trace]} {incr i $::batch} {
+        set keys [lrange $trace $i [expr {$i+$::batch-1}]]
+        foreach key $keys {$r get $key}
+        set missed {}
+        foreach key $keys {
+            if {[$r read] eq {}} {
+                lappend missed $key
+                incr misses
+            } else {
+                incr hits
+            }
+        }
+        # With volatile policies and no keys to evict SET may fail with OOM.
+        foreach key $missed {$r set $key $value}
+        foreach key $missed {catch {$r read}}
+    }
+    $r deferred 0
+    list $hits $misses [info_field $r evicted_keys]
+}
+
+set r [redis $::host $::port]
+if {$::trace_file ne {}} {
+    set trace [load_trace $::trace_file]
+} else {
+    set trace [generate_trace]
+}
+set distinct [llength [lsort -unique $trace]]
+set maxmemory [setup_maxmemory $r $distinct]
+
+puts "Requests: [llength $trace], distinct keys: $distinct,\
+      maxmemory: $maxmemory bytes ([expr {int($::cache_ratio*100)}]% of the keys)"
+puts [format "%-20s %10s %10s %10s" policy hit-ratio hits evicted]
+foreach policy $::policies {
+    lassign [replay $r $policy $trace $maxmemory] hits misses evicted
+    puts [format "%-20s %9.2f%% %10d %10s" $policy \
+        [expr {100.0*$hits/($hits+$misses)}] $hits $evicted]
+}
+$r config set maxmemory 0
+$r flushall
@@ -0,0 +1,36 @@
+/* Count the malloc() and calloc() calls of a process, loaded with LD_PRELOAD.
+ * The count is written at exit to the file named by the MALLOC_COUNT_FILE
+ * environment variable, or to stderr if it is not set.
+ *
+ * Build with:
+ *
+ *     cc -shared -fPIC -O2 -o malloc-count.so malloc-count.c
+ *
+ * Redis must be built with MALLOC=libc, otherwise its allocations don't go
+ * through the libc malloc(). See malloc-count.sh. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+
+static unsigned long long allocs;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&allocs,1,__ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    __atomic_add_fetch(&allocs,1,__ATOMIC_RELAXED);
+    return __libc_calloc(nmemb,size);
+}
+
+__attribute__((destructor)) static void reportAllocs(void) {
+    char *path = getenv("MALLOC_COUNT_FILE");
+    FILE *fp = path ? fopen(path,"w") : NULL;
+
+    fprintf(fp ? fp : stderr,"%llu\n",allocs);
+    if (fp) fclose(fp);
+}
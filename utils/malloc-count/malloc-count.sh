@@ -0,0 +1,46 @@
+#!/bin/sh
+# Print the malloc()/calloc() calls per request of a few commands, as the
+# difference between a server that served N requests of the command and one
+# that served none, divided by N. Run from the root of a Redis source tree
+# built with MALLOC=libc:
+#
+#     ./utils/malloc-count/malloc-count.sh [requests]
+
+N=${1:-100000}
+PORT=21111
+DIR=$(dirname "$0")
+LIB=/tmp/malloc-count.so
+OUT=/tmp/malloc-count.out
+
+cc -shared -fPIC -O2 -o $LIB "$DIR/malloc-count.c" || exit 1
+
+# Start a server, prepare the keys, run the command $2 times, shut it down
+# and print the count.
+run() {
+    MALLOC_COUNT_FILE=$OUT LD_PRELOAD=$LIB ./src/redis-server \
+        --port $PORT --save "" --appendonly no --daemonize no > /dev/null &
+    while ! ./src/redis-cli -p $PORT ping > /dev/null 2>&1; do sleep 0.1; done
+    ./src/redis-cli -p $PORT rpush l 3 1 2 > /dev/null
+    ./src/redis-cli -p $PORT sadd s1 a b c > /dev/null
+    ./src/redis-cli -p $PORT sadd s2 c d e > /dev/null
+    ./src/redis-cli -p $PORT set k1 foo > /dev/null
+    ./src/redis-cli -p $PORT set k2 bar > /dev/null
+    ./src/redis-cli -p $PORT zadd za 1 a 2 b > /dev/null
+    ./src/redis-cli -p $PORT zadd zb 1 b 2 c > /dev/null
+    if [ "$2" -gt 0 ]; then
+        ./src/redis-benchmark -p $PORT -c 1 -n "$2" -q $1 > /dev/null
+    fi
+    ./src/redis-cli -p $PORT shutdown nosave > /dev/null 2>&1
+    wait
+    cat $OUT
+}
+
+for cmd in "zadd z 1 a 2 b 3 c 4 d 5 e" "sunion s1 s2" "bitop and dst k1 k2" \
+           "zunionstore zd 2 za zb" "sort l"
+do
+    # The benchmark client connection costs some allocations as well.
+    base=$(run "$cmd" 1)
+    total=$(run "$cmd" $((N+1)))
+    awk -v c="$cmd" -v t=$total -v b=$base -v n=$N \
+        'BEGIN { printf "%s: %.1f\n", c, (t-b)/n }'
+done